@@ -0,0 +1,217 @@
+#include "AsyncLog.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+
+namespace SystemDrag
+{
+	static std::atomic<uint64_t> g_nextLoggerId(1);
+
+	// The ring of the logger this thread used last; the id never repeats, so a destroyed
+	// logger's entry can not match a new one at the same address
+	struct LocalRing
+	{
+		uint64_t logger;
+		void* ring;
+		size_t sinceWake;   // records pushed since this thread last woke the background thread
+	};
+
+	static thread_local LocalRing t_localRing = { 0, nullptr, 0 };
+
+	AsyncLogger::AsyncLogger(std::ostream& out, std::chrono::milliseconds interval)
+		: m_id(g_nextLoggerId.fetch_add(1, std::memory_order_relaxed)), m_out(out), m_interval(interval),
+		m_flushRequested(0), m_flushDone(0), m_stop(false), m_reportedDrops(0), m_urgent(false), m_written(0)
+	{
+		m_worker = std::thread(&AsyncLogger::Run, this);
+	}
+
+	AsyncLogger::~AsyncLogger()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_one();
+		m_worker.join();
+	}
+
+	// First record from a thread registers its ring, under the lock; after that it is a
+	// thread_local compare
+	AsyncLogger::Ring& AsyncLogger::Local()
+	{
+		if (t_localRing.logger == m_id)
+		{
+			return *static_cast<Ring*>(t_localRing.ring);
+		}
+
+		std::lock_guard<std::mutex> lock(m_ringsMutex);
+		std::thread::id self = std::this_thread::get_id();
+		Ring* ring = nullptr;
+		for (auto& entry : m_rings)
+		{
+			if (entry.first == self)
+			{
+				ring = entry.second.get();
+			}
+		}
+		if (ring == nullptr)
+		{
+			m_rings.emplace_back(self, std::unique_ptr<Ring>(new Ring()));
+			ring = m_rings.back().second.get();
+		}
+		t_localRing.logger = m_id;
+		t_localRing.ring = ring;
+		t_localRing.sinceWake = 0;
+		return *ring;
+	}
+
+	// The wakeup skips the mutex, so the background thread can miss one that lands while it
+	// is between its check and its wait; it then runs at the end of the interval as before
+	bool AsyncLogger::Push(const LogRecord& record)
+	{
+		bool pushed = Local().TryPush(record);
+		if (++t_localRing.sinceWake >= HighWater)
+		{
+			t_localRing.sinceWake = 0;
+			m_urgent.store(true, std::memory_order_release);
+			m_wake.notify_one();
+		}
+		return pushed;
+	}
+
+	uint64_t AsyncLogger::Dropped() const
+	{
+		std::lock_guard<std::mutex> lock(m_ringsMutex);
+		uint64_t dropped = 0;
+		for (const auto& entry : m_rings)
+		{
+			dropped += entry.second->Dropped();
+		}
+		return dropped;
+	}
+
+	void AsyncLogger::Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		uint64_t target = ++m_flushRequested;
+		m_wake.notify_one();
+		m_flushed.wait(lock, [this, target] { return m_flushDone >= target; });
+	}
+
+	void AsyncLogger::Format(const LogRecord& record, std::string& out)
+	{
+		char number[32];
+		size_t next = 0;
+		for (const char* p = record.format; *p != '\0'; p++)
+		{
+			if (p[0] != '{' || p[1] != '}' || next >= record.count)
+			{
+				out += *p;
+				continue;
+			}
+
+			const LogValue& value = record.args[next];
+			switch (record.types[next])
+			{
+			case LogArgType::Signed:
+				std::snprintf(number, sizeof(number), "%" PRId64, value.i);
+				break;
+			case LogArgType::Unsigned:
+				std::snprintf(number, sizeof(number), "%" PRIu64, value.u);
+				break;
+			case LogArgType::Double:
+				std::snprintf(number, sizeof(number), "%g", value.d);
+				break;
+			case LogArgType::Bool:
+				std::snprintf(number, sizeof(number), "%s", value.u != 0 ? "true" : "false");
+				break;
+			case LogArgType::Char:
+				number[0] = (char)value.i;
+				number[1] = '\0';
+				break;
+			case LogArgType::Pointer:
+				std::snprintf(number, sizeof(number), "0x%" PRIx64, value.u);
+				break;
+			}
+			out += number;
+			next++;
+			p++;
+		}
+		out += '\n';
+	}
+
+	// At most one ring's worth per thread and pass, so a busy producer can not stall the rest
+	void AsyncLogger::Drain(std::string& batch)
+	{
+		std::vector<Ring*> rings;
+		{
+			std::lock_guard<std::mutex> lock(m_ringsMutex);
+			for (auto& entry : m_rings)
+			{
+				rings.push_back(entry.second.get());
+			}
+		}
+
+		uint64_t count = 0;
+		LogRecord record;
+		for (Ring* ring : rings)
+		{
+			for (size_t i = 0; i < RingSize && ring->TryPop(record); i++)
+			{
+				Format(record, batch);
+				count++;
+			}
+		}
+		m_written.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	void AsyncLogger::Run()
+	{
+		std::string batch;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			uint64_t flushTarget = m_flushRequested;
+			bool stopping = m_stop;
+			m_urgent.store(false, std::memory_order_relaxed);
+			lock.unlock();
+
+			// One pass takes everything that was in the rings when it started
+			batch.clear();
+			Drain(batch);
+			uint64_t dropped = Dropped();
+			if (dropped != m_reportedDrops)
+			{
+				batch += "[log] " + std::to_string(dropped - m_reportedDrops) + " records dropped\n";
+				m_reportedDrops = dropped;
+			}
+			if (!batch.empty())
+			{
+				m_out.write(batch.data(), (std::streamsize)batch.size());
+				m_out.flush();
+			}
+
+			lock.lock();
+			if (flushTarget != m_flushDone)
+			{
+				m_flushDone = flushTarget;
+				m_flushed.notify_all();
+			}
+			if (stopping)
+			{
+				return;
+			}
+			m_wake.wait_for(lock, m_interval, [this]
+				{
+					return m_stop || m_flushRequested != m_flushDone || m_urgent.load(std::memory_order_acquire);
+				});
+		}
+	}
+
+	AsyncLogger& SharedLog()
+	{
+		static AsyncLogger log(std::cout);
+		return log;
+	}
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "SpscRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Asynchronous logger for the hook path.
+// A call site copies a 64-byte record (the address of its format string literal and up to
+// six scalar arguments) into a ring owned by the calling thread; no lock, no allocation,
+// no formatting. A background thread drains every thread's ring, replaces each {} in the
+// format with the next argument and writes the batch to the output with one flush. It runs
+// every interval, and early when a thread has written a quarter of a ring since it last
+// asked, so a burst is drained before it overflows. A full ring drops the record and counts
+// it; the drop count is reported in the output.
+// Records from one thread keep their order, records from different threads do not.
+namespace SystemDrag
+{
+	enum class LogArgType : uint8_t
+	{
+		Signed,
+		Unsigned,
+		Double,
+		Bool,
+		Char,
+		Pointer
+	};
+
+	union LogValue
+	{
+		int64_t i;
+		uint64_t u;
+		double d;
+	};
+
+	struct LogRecord
+	{
+		static constexpr size_t MaxArgs = 6;
+
+		const char* format;     // string literal, doubles as the message id
+		uint8_t count;
+		LogArgType types[MaxArgs];
+		uint8_t reserved;
+		LogValue args[MaxArgs];
+	};
+
+	static_assert(sizeof(LogRecord) == 64, "one record per cache line");
+
+	class AsyncLogger
+	{
+	public:
+		static constexpr size_t RingSize = 1024;
+		// Records a thread writes between early wakeups of the background thread
+		static constexpr size_t HighWater = RingSize / 4;
+
+		// out is only touched by the background thread
+		explicit AsyncLogger(std::ostream& out, std::chrono::milliseconds interval = std::chrono::milliseconds(5));
+		~AsyncLogger();
+
+		AsyncLogger(const AsyncLogger&) = delete;
+		AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+		// Hot path; false when the calling thread's ring is full and the record was dropped.
+		// Arguments are integers, enums, bool, char, floating point or pointers.
+		template <size_t N, typename... Args>
+		bool Write(const char (&format)[N], const Args&... args)
+		{
+			static_assert(sizeof...(Args) <= LogRecord::MaxArgs, "too many log arguments");
+			LogRecord record;
+			record.format = format;
+			record.count = (uint8_t)sizeof...(Args);
+			size_t index = 0;
+			(Encode(record, index++, args), ...);
+			return Push(record);
+		}
+
+		// Returns once every record written before the call is out
+		void Flush();
+
+		uint64_t Written() const { return m_written.load(std::memory_order_relaxed); }
+		uint64_t Dropped() const;
+
+		// The formatting the background thread does, exposed for checks
+		static void Format(const LogRecord& record, std::string& out);
+
+	private:
+		typedef SpscRing<LogRecord, RingSize> Ring;
+
+		template <typename T>
+		static void Encode(LogRecord& record, size_t index, const T& value)
+		{
+			if constexpr (std::is_same<T, bool>::value)
+			{
+				record.types[index] = LogArgType::Bool;
+				record.args[index].u = value ? 1 : 0;
+			}
+			else if constexpr (std::is_same<T, char>::value)
+			{
+				record.types[index] = LogArgType::Char;
+				record.args[index].i = value;
+			}
+			else if constexpr (std::is_enum<T>::value)
+			{
+				Encode(record, index, (typename std::underlying_type<T>::type)value);
+			}
+			else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+			{
+				record.types[index] = LogArgType::Signed;
+				record.args[index].i = (int64_t)value;
+			}
+			else if constexpr (std::is_integral<T>::value)
+			{
+				record.types[index] = LogArgType::Unsigned;
+				record.args[index].u = (uint64_t)value;
+			}
+			else if constexpr (std::is_floating_point<T>::value)
+			{
+				record.types[index] = LogArgType::Double;
+				record.args[index].d = (double)value;
+			}
+			else
+			{
+				// Strings would have to be copied; only their address fits a slot
+				static_assert(std::is_pointer<T>::value && !std::is_same<T, const char*>::value && !std::is_same<T, char*>::value,
+					"unsupported log argument");
+				record.types[index] = LogArgType::Pointer;
+				record.args[index].u = (uint64_t)(uintptr_t)value;
+			}
+		}
+
+		Ring& Local();
+		bool Push(const LogRecord& record);
+		void Run();
+		void Drain(std::string& batch);
+
+		const uint64_t m_id;
+		std::ostream& m_out;
+		std::chrono::milliseconds m_interval;
+
+		mutable std::mutex m_ringsMutex;
+		std::vector<std::pair<std::thread::id, std::unique_ptr<Ring>>> m_rings;
+
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_flushed;
+		uint64_t m_flushRequested;
+		uint64_t m_flushDone;
+		bool m_stop;
+		uint64_t m_reportedDrops;
+		std::atomic<bool> m_urgent;     // a producer passed its high-water mark
+
+		std::atomic<uint64_t> m_written;
+		std::thread m_worker;
+	};
+
+	// Writes to std::cout
+	AsyncLogger& SharedLog();
+}
@@ -0,0 +1,156 @@
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// Call-site cost of the hook's log lines: the std::cout << ... << std::endl (here into
+// the null device, so every line still pays the flush, but not the console) against the
+// async logger, on one thread and on several at once. Every record must come out either
+// written or counted as dropped, and at a paced burst rate at most 1% may be dropped.
+namespace SystemDrag
+{
+#ifdef _WIN32
+	static const char* const NullDevice = "NUL";
+#else
+	static const char* const NullDevice = "/dev/null";
+#endif
+
+	static bool CheckFormat()
+	{
+		enum class Side { Left = 3 };
+		int value = 0;
+		std::ostringstream pointer;
+		pointer << "0x" << std::hex << (uintptr_t)&value;
+
+		std::ostringstream out;
+		AsyncLogger logger(out);
+		logger.Write("move at ({}, {}) button {} speed {} {} {}", -12, 40000u, Side::Left, 1.5, true, 'x');
+		logger.Write("hr {} at {} {{}}", (long)-2147467259, &value);
+		logger.Write("{} {}", 7);
+		logger.Flush();
+		std::string expected = "move at (-12, 40000) button 3 speed 1.5 true x\nhr -2147467259 at "
+			+ pointer.str() + " {{}}\n7 {}\n";
+		return out.str() == expected && logger.Written() == 3;
+	}
+
+	// Command line entry: AsyncLogBenchMain [lines] [threads]
+	int AsyncLogBenchMain(int argc, char* argv[])
+	{
+		size_t lines = argc > 1 ? (size_t)std::atoll(argv[1]) : 1000000;
+		int threads = argc > 2 ? std::atoi(argv[2]) : 4;
+		bool correct = CheckFormat();
+		std::cout << "format " << (correct ? "ok" : "WRONG") << std::endl;
+
+		std::ofstream streamSink(NullDevice);
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < lines; i++)
+		{
+			streamSink << "Mouse Button move at (" << (long)i << ", " << (long)(i >> 3) << ")" << std::endl;
+		}
+		double streamNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / lines;
+
+		std::ofstream logSink(NullDevice);
+		uint64_t written = 0;
+		uint64_t dropped = 0;
+		double logNs = 0;
+		{
+			// Bursts that fit the ring, like a drag's worth of moves, so the time is the
+			// record copy and not the drop path
+			AsyncLogger logger(logSink);
+			const size_t burst = AsyncLogger::RingSize / 2;
+			for (size_t done = 0; done < lines; done += burst)
+			{
+				size_t end = std::min(lines, done + burst);
+				auto t1 = std::chrono::steady_clock::now();
+				for (size_t i = done; i < end; i++)
+				{
+					logger.Write("Mouse Button move at ({}, {})", (long)i, (long)(i >> 3));
+				}
+				logNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t1).count();
+				logger.Flush();
+			}
+			logNs /= lines;
+			written = logger.Written();
+			dropped = logger.Dropped();
+		}
+		std::cout << "iostream with endl: " << streamNs << " ns/line, async logger: " << logNs << " ns/line ("
+			<< written << " written, " << dropped << " dropped)" << std::endl;
+		correct = correct && written + dropped == lines;
+
+		// Several producers flat out, each on its own ring: far more than the formatter keeps
+		// up with, so this is mostly the drop path and its accounting
+		std::ofstream sharedSink(NullDevice);
+		double sharedNs = 0;
+		{
+			AsyncLogger logger(sharedSink);
+			std::vector<std::thread> producers;
+			auto t2 = std::chrono::steady_clock::now();
+			for (int t = 0; t < threads; t++)
+			{
+				producers.emplace_back([&logger, lines, t]()
+				{
+					for (size_t i = 0; i < lines; i++)
+					{
+						logger.Write("thread {} line {}", t, i);
+					}
+				});
+			}
+			for (std::thread& producer : producers)
+			{
+				producer.join();
+			}
+			sharedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t2).count() / lines;
+			logger.Flush();
+			written = logger.Written();
+			dropped = logger.Dropped();
+		}
+		std::cout << threads << " producers: " << sharedNs << " ns/line per thread (" << written << " written, "
+			<< dropped << " dropped)" << std::endl;
+		correct = correct && written + dropped == lines * threads;
+
+		// The load the logger is sized for: every producer writes bursts of more than a ring per
+		// interval, a millisecond apart, far above a hook logging every event of an 8 kHz
+		// mouse. The early wakeups have to keep the drop rate down.
+		std::ofstream pacedSink(NullDevice);
+		const size_t bursts = 50;
+		const size_t burstSize = AsyncLogger::RingSize * 3 / 8;
+		{
+			AsyncLogger logger(pacedSink);
+			std::vector<std::thread> producers;
+			for (int t = 0; t < threads; t++)
+			{
+				producers.emplace_back([&logger, bursts, burstSize, t]()
+				{
+					for (size_t b = 0; b < bursts; b++)
+					{
+						for (size_t i = 0; i < burstSize; i++)
+						{
+							logger.Write("thread {} burst {} line {}", t, b, i);
+						}
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+				});
+			}
+			for (std::thread& producer : producers)
+			{
+				producer.join();
+			}
+			logger.Flush();
+			written = logger.Written();
+			dropped = logger.Dropped();
+		}
+		double dropRate = (double)dropped / (double)(written + dropped);
+		std::cout << threads << " producers, bursts of " << burstSize << " every 1 ms: " << written << " written, "
+			<< dropped << " dropped (" << dropRate * 100 << "%)" << std::endl;
+		correct = correct && written + dropped == bursts * burstSize * threads && dropRate <= 0.01;
+
+		std::cout << (correct ? "async log ok" : "async log WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
@@ -0,0 +1,648 @@
+#include "DragVerdict.h"
+#include "DropFiles.h"
+#include "ExtensionPolicy.h"
+#include "GestureEngine.h"
+#include "ShellAncestry.h"
+#include "SpscRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Benchmark suite over the monitor's hot paths, with JSON results to track across commits.
+// Micro benchmarks time one operation in a fixed-size loop (fixed seeds and inputs, one
+// warm-up run, then the best and median of several runs): extension matching, gesture
+// transitions, DROPFILES parsing, the selection walk of ReadSelection / HasValidSelection
+// on a fake view, shell ancestry over a fake window tree and the hook-to-detection ring.
+// Macro benchmarks are the XxxBenchMain scenarios, run with their output captured; they
+// already use fake windows, views and clocks where Windows would be needed, and their exit
+// code says whether the results were also correct.
+// Built into MouseHook.vcxproj like the other benches; CMakeLists.txt at the top of the
+// tree defines SYSTEMDRAG_BENCH_RUNNER and builds it as the MouseHookBench executable,
+// on Linux as well.
+namespace SystemDrag
+{
+	int AsyncLogBenchMain(int argc, char* argv[]);
+	int ContentSnifferBenchMain(int argc, char* argv[]);
+	int DetectionExecutorBenchMain(int argc, char* argv[]);
+	int DragTraceBenchMain(int argc, char* argv[]);
+	int VerdictBenchMain(int argc, char* argv[]);
+	int DropFilesBenchMain(int argc, char* argv[]);
+	int ExtensionBenchMain(int argc, char* argv[]);
+	int ExtensionPolicyBenchMain(int argc, char* argv[]);
+	int MetadataBenchMain(int argc, char* argv[]);
+	int FormatNegotiationBenchMain(int argc, char* argv[]);
+	int ReplayMain(int argc, char* argv[]);
+	int HookWatchdogBenchMain(int argc, char* argv[]);
+	int LatencyBenchMain(int argc, char* argv[]);
+	int MetadataCacheBenchMain(int argc, char* argv[]);
+	int MoveCoalescingBenchMain(int argc, char* argv[]);
+	int PathKernelBenchMain(int argc, char* argv[]);
+	int PointerTableBenchMain(int argc, char* argv[]);
+	int RingBenchMain(int argc, char* argv[]);
+	int SelectionBenchMain(int argc, char* argv[]);
+	int ShellAncestryBenchMain(int argc, char* argv[]);
+	int ShellIdListBenchMain(int argc, char* argv[]);
+	int ShellSessionBenchMain(int argc, char* argv[]);
+	int ShellViewBenchMain(int argc, char* argv[]);
+	int SpeculationBenchMain(int argc, char* argv[]);
+
+	struct MacroBench
+	{
+		const char* name;
+		int (*entry)(int argc, char* argv[]);
+		std::vector<std::string> quickArgs;   // full runs use the bench's own defaults
+	};
+
+	static const std::vector<MacroBench>& MacroBenches()
+	{
+		static const std::vector<MacroBench> benches = {
+			{ "AsyncLogBench", AsyncLogBenchMain, { "100000", "2" } },
+			{ "ContentSnifferBench", ContentSnifferBenchMain, {} },
+			{ "DetectionExecutorBench", DetectionExecutorBenchMain, { "1000", "2" } },
+			{ "DragTraceBench", DragTraceBenchMain, {} },
+			{ "VerdictBench", VerdictBenchMain, { "50", "10" } },
+			{ "DropFilesBench", DropFilesBenchMain, { "10000", "20000" } },
+			{ "ExtensionBench", ExtensionBenchMain, { "100000" } },
+			{ "ExtensionPolicyBench", ExtensionPolicyBenchMain, { "5", "2" } },
+			{ "MetadataBench", MetadataBenchMain, { "500", "4" } },
+			{ "FormatNegotiationBench", FormatNegotiationBenchMain, { "1000", "100" } },
+			{ "GestureReplay", ReplayMain, { "-", "2" } },
+			{ "HookWatchdogBench", HookWatchdogBenchMain, { "1000000" } },
+			{ "LatencyBench", LatencyBenchMain, { "2000000", "2" } },
+			{ "MetadataCacheBench", MetadataCacheBenchMain, { "500", "20000" } },
+			{ "MoveCoalescingBench", MoveCoalescingBenchMain, { "10" } },
+			{ "PathKernelBench", PathKernelBenchMain, { "10000", "5" } },
+			{ "PointerTableBench", PointerTableBenchMain, { "50", "256" } },
+			{ "RingBench", RingBenchMain, { "2000000" } },
+			{ "SelectionBench", SelectionBenchMain, { "8", "20000" } },
+			{ "ShellAncestryBench", ShellAncestryBenchMain, { "200", "8", "20000" } },
+			{ "ShellIdListBench", ShellIdListBenchMain, { "10000", "10000" } },
+			{ "ShellSessionBench", ShellSessionBenchMain, { "500", "20" } },
+			{ "ShellViewBench", ShellViewBenchMain, { "32", "200" } },
+			{ "SpeculationBench", SpeculationBenchMain, { "2000" } },
+		};
+		return benches;
+	}
+
+	struct MicroResult
+	{
+		std::string name;
+		std::string unit;       // what one operation is
+		size_t operations;      // per run
+		int runs;
+		double bestNs;
+		double medianNs;
+		double worstNs;
+		bool correct;
+	};
+
+	struct MacroResult
+	{
+		std::string name;
+		std::vector<std::string> args;
+		int status;
+		double seconds;
+		std::vector<std::string> output;
+	};
+
+	static volatile uint64_t g_benchSink;
+
+	// run() does `operations` operations and returns a checksum, so nothing is optimized away
+	static MicroResult Measure(const char* name, const char* unit, size_t operations, int runs,
+		const std::function<uint64_t()>& run)
+	{
+		g_benchSink = g_benchSink + run();
+		std::vector<double> samples;
+		for (int r = 0; r < runs; r++)
+		{
+			auto t0 = std::chrono::steady_clock::now();
+			uint64_t checksum = run();
+			auto t1 = std::chrono::steady_clock::now();
+			g_benchSink = g_benchSink + checksum;
+			samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() / operations);
+		}
+		std::sort(samples.begin(), samples.end());
+		return MicroResult{ name, unit, operations, runs, samples.front(), samples[samples.size() / 2], samples.back(), true };
+	}
+
+	static uint64_t NextRandom(uint64_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	// Paths shaped like Explorer selections: a few directories, a name, one of a mix of
+	// supported, unsupported, upper case and missing extensions
+	static std::vector<std::u16string> MakePaths(size_t count, uint64_t seed)
+	{
+		static const char* const extensions[] = { ".txt", ".docx", ".PDF", ".exe", ".png", ".tar.gz", ".md", "", ".Xlsx", ".dll" };
+		std::vector<std::u16string> paths;
+		uint64_t state = seed;
+		for (size_t i = 0; i < count; i++)
+		{
+			std::string path = "C:\\Users\\bench\\Documents";
+			for (uint64_t d = NextRandom(state) % 4; d > 0; d--)
+			{
+				path += "\\folder" + std::to_string(NextRandom(state) % 100);
+			}
+			path += "\\file" + std::to_string(i) + extensions[NextRandom(state) % std::size(extensions)];
+			paths.push_back(std::u16string(path.begin(), path.end()));
+		}
+		return paths;
+	}
+
+	static MicroResult BenchExtensionMatch(const char* name, int runs)
+	{
+		std::vector<std::u16string> paths = MakePaths(4096, 7);
+		const ExtensionPolicy& policy = SharedExtensionPolicy();
+		return Measure(name, "path", paths.size(), runs, [&]()
+		{
+			uint64_t matched = 0;
+			for (const std::u16string& path : paths)
+			{
+				matched += policy.MatchPath(std::u16string_view(path));
+			}
+			return matched;
+		});
+	}
+
+	// Press, twenty moves that cross the threshold, release: every transition of a drag
+	static MicroResult BenchGestureFeed(const char* name, int runs)
+	{
+		std::vector<PointerEvent> events;
+		uint32_t time = 1000;
+		for (int g = 0; g < 256; g++)
+		{
+			events.push_back(PointerEvent{ time++, 100, 100, PointerAction::ButtonDown });
+			for (int m = 1; m <= 20; m++)
+			{
+				events.push_back(PointerEvent{ time++, 100 + m, 100 + m / 2, PointerAction::Move });
+			}
+			events.push_back(PointerEvent{ time++, 120, 110, PointerAction::ButtonUp });
+		}
+
+		uint64_t dragStarts = 0;
+		MicroResult result = Measure(name, "event", events.size(), runs, [&]()
+		{
+			GestureEngine engine;
+			uint64_t starts = 0;
+			for (const PointerEvent& ev : events)
+			{
+				starts += (engine.Feed(ev) & GestureDragStart) != 0;
+			}
+			dragStarts = starts;
+			return starts;
+		});
+		result.correct = dragStarts == 256;
+		return result;
+	}
+
+	// DROPFILES with the wide layout, as Explorer puts it on the clipboard
+	static std::vector<uint8_t> MakeDropFiles(const std::vector<std::u16string>& paths)
+	{
+		std::vector<uint8_t> block(DropFilesView::HeaderSize, 0);
+		uint32_t offset = (uint32_t)DropFilesView::HeaderSize;
+		uint32_t wide = 1;
+		std::memcpy(block.data(), &offset, sizeof(offset));
+		std::memcpy(block.data() + 16, &wide, sizeof(wide));
+		for (const std::u16string& path : paths)
+		{
+			const uint8_t* bytes = (const uint8_t*)path.c_str();
+			block.insert(block.end(), bytes, bytes + (path.size() + 1) * sizeof(char16_t));
+		}
+		block.push_back(0);
+		block.push_back(0);
+		return block;
+	}
+
+	static MicroResult BenchDropFiles(const char* name, size_t count, int runs)
+	{
+		std::vector<std::u16string> paths = MakePaths(count, 11);
+		std::vector<uint8_t> block = MakeDropFiles(paths);
+		size_t blocks = std::max<size_t>(1, 65536 / count);
+
+		size_t walked = 0;
+		MicroResult result = Measure(name, "block", blocks, runs, [&]()
+		{
+			uint64_t length = 0;
+			size_t files = 0;
+			for (size_t b = 0; b < blocks; b++)
+			{
+				DropFilesView view;
+				if (DropFilesView::Parse(block.data(), block.size(), view) != DropFilesView::Status::Ok)
+				{
+					return (uint64_t)0;
+				}
+				files = 0;
+				for (std::u16string_view path : view.WidePaths())
+				{
+					length += path.size();
+					files++;
+				}
+			}
+			walked = files;
+			return length;
+		});
+		result.correct = walked == count;
+		return result;
+	}
+
+	// What ReadSelection does per selected item once the COM calls have returned: a cancel
+	// check, skip folders, match the extension, stop at the first supported file
+	struct FakeFolderItem
+	{
+		bool folder;
+		std::u16string path;
+	};
+
+	static Verdict WalkSelection(const std::vector<FakeFolderItem>& items, const CancelToken& token)
+	{
+		for (const FakeFolderItem& item : items)
+		{
+			if (token.Cancelled())
+			{
+				return Verdict::Cancelled;
+			}
+			if (item.folder)
+			{
+				continue;
+			}
+			if (SharedExtensionPolicy().MatchPath(std::u16string_view(item.path)))
+			{
+				return Verdict::Supported;
+			}
+		}
+		return Verdict::Unsupported;
+	}
+
+	// Worst case: nothing supported, so every item is looked at
+	static MicroResult BenchSelectionWalk(const char* name, int runs)
+	{
+		std::vector<FakeFolderItem> items;
+		std::vector<std::u16string> paths = MakePaths(64, 13);
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			items.push_back(FakeFolderItem{ i % 8 == 0, paths[i].substr(0, paths[i].rfind(u'.')) + u".exe" });
+		}
+		DragSessionGate gate;
+		gate.Begin(42);
+		CancelToken token(gate, 42);
+		const size_t walks = 1024;
+
+		bool unsupported = true;
+		MicroResult result = Measure(name, "walk", walks, runs, [&]()
+		{
+			uint64_t supported = 0;
+			for (size_t w = 0; w < walks; w++)
+			{
+				Verdict verdict = WalkSelection(items, token);
+				supported += verdict == Verdict::Supported;
+				unsupported = unsupported && verdict == Verdict::Unsupported;
+			}
+			return supported;
+		});
+		result.correct = unsupported;
+		return result;
+	}
+
+	// Top-level windows, each with a chain of child windows; every fourth is Explorer
+	class FakeWindowTree : public IWindowTree
+	{
+	public:
+		FakeWindowTree(size_t topLevel, int depth)
+		{
+			m_parent.push_back(0);
+			m_kind.push_back(ShellKind::None);
+			for (size_t t = 0; t < topLevel; t++)
+			{
+				WindowKey parent = m_parent.size();
+				m_parent.push_back(0);
+				m_kind.push_back(t == 0 ? ShellKind::Desktop : (t % 4 == 0 ? ShellKind::Explorer : ShellKind::None));
+				for (int d = 0; d < depth; d++)
+				{
+					m_parent.push_back(parent);
+					m_kind.push_back(ShellKind::None);
+					parent = m_parent.size() - 1;
+				}
+				m_leaves.push_back(parent);
+			}
+		}
+
+		WindowKey Parent(WindowKey window) override { return window < m_parent.size() ? m_parent[window] : 0; }
+		ShellKind Classify(WindowKey window) override { return window < m_kind.size() ? m_kind[window] : ShellKind::None; }
+
+		const std::vector<WindowKey>& Leaves() const { return m_leaves; }
+
+	private:
+		std::vector<WindowKey> m_parent;
+		std::vector<ShellKind> m_kind;
+		std::vector<WindowKey> m_leaves;
+	};
+
+	static std::vector<WindowKey> PressTargets(const FakeWindowTree& tree, size_t count)
+	{
+		std::vector<WindowKey> targets;
+		uint64_t state = 17;
+		for (size_t i = 0; i < count; i++)
+		{
+			targets.push_back(tree.Leaves()[NextRandom(state) % tree.Leaves().size()]);
+		}
+		return targets;
+	}
+
+	static MicroResult BenchAncestry(const char* name, bool cached, int runs)
+	{
+		FakeWindowTree tree(256, 8);
+		std::vector<WindowKey> targets = PressTargets(tree, 4096);
+		ShellAncestryCache cache(tree);
+		return Measure(name, "press", targets.size(), runs, [&]()
+		{
+			uint64_t shells = 0;
+			for (WindowKey target : targets)
+			{
+				ShellRoot root = cached ? cache.Resolve(target) : WalkShellAncestry(tree, target);
+				shells += root.kind != ShellKind::None;
+			}
+			return shells;
+		});
+	}
+
+	// The hook callback's push plus the detection thread's pop, on one thread
+	static MicroResult BenchRing(const char* name, int runs)
+	{
+		static SpscRing<DragEventRecord, 256> ring;
+		const size_t records = 1 << 16;
+		return Measure(name, "record", records, runs, [&]()
+		{
+			uint64_t sum = 0;
+			DragEventRecord record = { 0, 0, 0, 0, DragEventKind::CheckRequested, 0 };
+			DragEventRecord out = record;
+			for (size_t i = 0; i < records; i++)
+			{
+				record.sessionId = (uint32_t)i;
+				ring.TryPush(record);
+				ring.TryPop(out);
+				sum += out.sessionId;
+			}
+			return sum;
+		});
+	}
+
+	struct MicroBench
+	{
+		const char* name;
+		std::function<MicroResult(const char* name, int runs)> run;
+	};
+
+	static std::vector<MicroResult> RunMicro(const std::string& filter, int runs)
+	{
+		const MicroBench benches[] = {
+			{ "extension.match_path", BenchExtensionMatch },
+			{ "gesture.feed", BenchGestureFeed },
+			{ "dropfiles.parse_walk_1", [](const char* name, int n) { return BenchDropFiles(name, 1, n); } },
+			{ "dropfiles.parse_walk_256", [](const char* name, int n) { return BenchDropFiles(name, 256, n); } },
+			{ "selection.walk_64_items", BenchSelectionWalk },
+			{ "ancestry.walk_uncached", [](const char* name, int n) { return BenchAncestry(name, false, n); } },
+			{ "ancestry.resolve_cached", [](const char* name, int n) { return BenchAncestry(name, true, n); } },
+			{ "ring.push_pop", BenchRing },
+		};
+
+		std::vector<MicroResult> results;
+		for (const MicroBench& bench : benches)
+		{
+			if (std::string(bench.name).find(filter) == std::string::npos)
+			{
+				continue;
+			}
+			MicroResult result = bench.run(bench.name, runs);
+			std::cerr << "  " << result.name << ": " << result.bestNs << " ns/" << result.unit << " best, "
+				<< result.medianNs << " median" << (result.correct ? "" : " WRONG") << std::endl;
+			results.push_back(result);
+		}
+		return results;
+	}
+
+	static MacroResult RunMacro(const MacroBench& bench, bool quick)
+	{
+		MacroResult result;
+		result.name = bench.name;
+		if (quick)
+		{
+			result.args = bench.quickArgs;
+		}
+
+		std::vector<char*> argv;
+		std::string program = bench.name;
+		argv.push_back(&program[0]);
+		for (std::string& arg : result.args)
+		{
+			argv.push_back(&arg[0]);
+		}
+		argv.push_back(nullptr);
+
+		// The scenarios report on std::cout; keep it for the JSON instead of the console
+		std::ostringstream captured;
+		std::streambuf* console = std::cout.rdbuf(captured.rdbuf());
+		auto t0 = std::chrono::steady_clock::now();
+		result.status = bench.entry((int)argv.size() - 1, argv.data());
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		std::cout.rdbuf(console);
+
+		std::istringstream lines(captured.str());
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			result.output.push_back(line);
+		}
+		std::cerr << "  " << result.name << ": " << (result.status == 0 ? "ok" : "FAILED") << " in "
+			<< result.seconds << " s" << std::endl;
+		return result;
+	}
+
+	static void WriteJsonString(std::ostream& out, std::string_view text)
+	{
+		out << '"';
+		for (char c : text)
+		{
+			switch (c)
+			{
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if ((unsigned char)c < 0x20)
+				{
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)(unsigned char)c);
+					out << escaped;
+				}
+				else
+				{
+					out << c;
+				}
+			}
+		}
+		out << '"';
+	}
+
+	static const char* Compiler()
+	{
+#if defined(_MSC_VER)
+		static const std::string name = "msvc " + std::to_string(_MSC_VER);
+		return name.c_str();
+#elif defined(__VERSION__)
+		return __VERSION__;
+#else
+		return "unknown";
+#endif
+	}
+
+	static void WriteJson(std::ostream& out, const std::string& label, bool quick,
+		const std::vector<MicroResult>& micro, const std::vector<MacroResult>& macro)
+	{
+		out.precision(6);
+		out << "{\n  \"suite\": \"systemdrag\",\n  \"label\": ";
+		WriteJsonString(out, label);
+		out << ",\n  \"mode\": \"" << (quick ? "quick" : "full") << "\",\n  \"compiler\": ";
+		WriteJsonString(out, Compiler());
+#ifdef _WIN32
+		out << ",\n  \"platform\": \"windows\"";
+#else
+		out << ",\n  \"platform\": \"posix\"";
+#endif
+#ifdef NDEBUG
+		out << ",\n  \"optimized\": true";
+#else
+		out << ",\n  \"optimized\": false";
+#endif
+		out << ",\n  \"threads\": " << std::thread::hardware_concurrency() << ",\n  \"micro\": [";
+		for (size_t i = 0; i < micro.size(); i++)
+		{
+			const MicroResult& r = micro[i];
+			out << (i == 0 ? "\n" : ",\n") << "    { \"name\": ";
+			WriteJsonString(out, r.name);
+			out << ", \"unit\": ";
+			WriteJsonString(out, r.unit);
+			out << ", \"operations\": " << r.operations << ", \"runs\": " << r.runs << ", \"best_ns\": " << r.bestNs
+				<< ", \"median_ns\": " << r.medianNs << ", \"worst_ns\": " << r.worstNs << ", \"correct\": "
+				<< (r.correct ? "true" : "false") << " }";
+		}
+		out << "\n  ],\n  \"macro\": [";
+		for (size_t i = 0; i < macro.size(); i++)
+		{
+			const MacroResult& r = macro[i];
+			out << (i == 0 ? "\n" : ",\n") << "    {\n      \"name\": ";
+			WriteJsonString(out, r.name);
+			out << ",\n      \"args\": [";
+			for (size_t a = 0; a < r.args.size(); a++)
+			{
+				out << (a == 0 ? "" : ", ");
+				WriteJsonString(out, r.args[a]);
+			}
+			out << "],\n      \"status\": " << r.status << ",\n      \"seconds\": " << r.seconds << ",\n      \"output\": [";
+			for (size_t l = 0; l < r.output.size(); l++)
+			{
+				out << (l == 0 ? "\n        " : ",\n        ");
+				WriteJsonString(out, r.output[l]);
+			}
+			out << (r.output.empty() ? "]" : "\n      ]") << "\n    }";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	// Command line entry: BenchSuiteMain [--quick] [--filter text] [--runs n] [--label text]
+	//                                    [--json file, - for stdout] [--micro-only]
+	int BenchSuiteMain(int argc, char* argv[])
+	{
+		bool quick = false;
+		bool microOnly = false;
+		int runs = 7;
+		std::string filter;
+		std::string label;
+		std::string jsonPath = "systemdrag-bench.json";
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "--quick") quick = true;
+			else if (arg == "--micro-only") microOnly = true;
+			else if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+			else if (arg == "--runs" && i + 1 < argc) runs = std::max(1, std::atoi(argv[++i]));
+			else if (arg == "--label" && i + 1 < argc) label = argv[++i];
+			else if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+			else
+			{
+				std::cerr << "unknown argument: " << arg << std::endl;
+				return 2;
+			}
+		}
+		if (quick)
+		{
+			runs = std::min(runs, 3);
+		}
+
+		std::cerr << "micro benchmarks:" << std::endl;
+		std::vector<MicroResult> micro = RunMicro(filter, runs);
+		std::vector<MacroResult> macro;
+		if (!microOnly)
+		{
+			std::cerr << "scenarios" << (quick ? " (quick):" : ":") << std::endl;
+			for (const MacroBench& bench : MacroBenches())
+			{
+				if (std::string(bench.name).find(filter) != std::string::npos)
+				{
+					macro.push_back(RunMacro(bench, quick));
+				}
+			}
+		}
+
+		if (jsonPath == "-")
+		{
+			WriteJson(std::cout, label, quick, micro, macro);
+		}
+		else
+		{
+			std::ofstream json(jsonPath, std::ios::binary | std::ios::trunc);
+			WriteJson(json, label, quick, micro, macro);
+			if (!json)
+			{
+				std::cerr << "failed to write " << jsonPath << std::endl;
+				return 2;
+			}
+			std::cerr << "results in " << jsonPath << std::endl;
+		}
+
+		bool correct = true;
+		for (const MicroResult& r : micro)
+		{
+			correct = correct && r.correct;
+		}
+		for (const MacroResult& r : macro)
+		{
+			correct = correct && r.status == 0;
+		}
+		return correct ? 0 : 1;
+	}
+}
+
+#ifdef SYSTEMDRAG_BENCH_RUNNER
+int main(int argc, char* argv[])
+{
+	return SystemDrag::BenchSuiteMain(argc, argv);
+}
+#endif
@@ -0,0 +1,114 @@
+#include "ComShellSession.h"
+
+#include "AsyncLog.h"
+#include "LatencyHistogram.h"
+
+#pragma comment(lib, "Ole32.lib")
+#pragma comment(lib, "OleAut32.lib")
+
+namespace SystemDrag
+{
+	ShellStatus ShellStatusFromResult(HRESULT hr)
+	{
+		if (SUCCEEDED(hr))
+		{
+			return ShellStatus::Ok;
+		}
+		if (hr == RPC_E_DISCONNECTED || hr == RPC_E_SERVER_DIED || hr == RPC_E_SERVER_DIED_DNE ||
+			hr == HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE) || hr == HRESULT_FROM_WIN32(RPC_S_CALL_FAILED))
+		{
+			return ShellStatus::Disconnected;
+		}
+		return ShellStatus::Failed;
+	}
+
+	class ComShellSessionFactory : public IShellSessionFactory<CComPtr<IShellWindows>, CComPtr<IDispatch>>
+	{
+	public:
+		ShellStatus CreateShellWindows(CComPtr<IShellWindows>& windows) override
+		{
+			StageTimer stage(DetectionStage::CreateShellWindows);
+			HRESULT hr = windows.CoCreateInstance(CLSID_ShellWindows);
+			stage.Stop();
+			if (FAILED(hr))
+			{
+				SharedLog().Write("Failed to create IShellWindows instance:{}", hr);
+			}
+			return ShellStatusFromResult(hr);
+		}
+
+		ShellStatus FindDesktop(const CComPtr<IShellWindows>& windows, CComPtr<IDispatch>& desktop, WindowKey& window) override
+		{
+			// Same as C#: shellWindows.FindWindowSW(..., SWC_DESKTOP, ..., SWFO_NEEDDISPATCH)
+			CComVariant missing;
+			missing.vt = VT_ERROR;
+			missing.scode = DISP_E_PARAMNOTFOUND;
+			long hwnd = 0;
+
+			StageTimer stage(DetectionStage::ShellWindowsScan);
+			HRESULT hr = windows->FindWindowSW(&missing, &missing, SWC_DESKTOP, &hwnd, SWFO_NEEDDISPATCH, &desktop);
+			stage.Stop();
+			if (hr == S_FALSE || (SUCCEEDED(hr) && !desktop))
+			{
+				// No desktop registered (yet)
+				return ShellStatus::Failed;
+			}
+
+			// The window identifies this Explorer instance; fall back to the shell's desktop
+			// window when FindWindowSW leaves it out
+			window = hwnd != 0 ? (WindowKey)(ULONG_PTR)(ULONG)hwnd : (WindowKey)GetShellWindow();
+			return ShellStatusFromResult(hr);
+		}
+
+		bool WindowExists(WindowKey window) override
+		{
+			return IsWindow((HWND)window) != FALSE;
+		}
+	};
+
+	struct ShellSessionState
+	{
+		ShellSessionState() : session(factory)
+		{
+		}
+
+		ComShellSessionFactory factory;
+		ComShellSession session;
+	};
+
+	// One per STA thread: the proxies belong to the apartment that created them
+	static thread_local ShellSessionState* t_shellSession = nullptr;
+
+	ComShellSession& CurrentShellSession()
+	{
+		if (t_shellSession == nullptr)
+		{
+			t_shellSession = new ShellSessionState();
+		}
+		return t_shellSession->session;
+	}
+
+	void ReleaseShellSession()
+	{
+		delete t_shellSession;
+		t_shellSession = nullptr;
+	}
+
+	ShellApartmentScope::ShellApartmentScope()
+		: m_initialized(SUCCEEDED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED)))
+	{
+		if (!m_initialized)
+		{
+			SharedLog().Write("[WARN] thread is not in a COM STA, shell calls will fail");
+		}
+	}
+
+	ShellApartmentScope::~ShellApartmentScope()
+	{
+		ReleaseShellSession();
+		if (m_initialized)
+		{
+			CoUninitialize();
+		}
+	}
+}
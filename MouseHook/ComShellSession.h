@@ -0,0 +1,39 @@
+#pragma once
+
+#include <windows.h>
+#include <exdisp.h>
+#include <atlbase.h>
+
+#include "ShellSession.h"
+
+namespace SystemDrag
+{
+	typedef ShellSession<CComPtr<IShellWindows>, CComPtr<IDispatch>> ComShellSession;
+
+	// RPC_E_DISCONNECTED, RPC_E_SERVER_DIED(_DNE) and an unavailable RPC server mean Explorer
+	// is gone; any other failure is Failed
+	ShellStatus ShellStatusFromResult(HRESULT hr);
+
+	// Session owned by the calling STA thread, created on first use.
+	// Call ReleaseShellSession() after ReleaseShellViews() and before CoUninitialize.
+	ComShellSession& CurrentShellSession();
+	void ReleaseShellSession();
+
+	// Enters an STA for a thread that has none of its own, such as the polling demo, and
+	// leaves it again after releasing the thread's session. Detection workers get their
+	// apartment from StaApartment instead.
+	class ShellApartmentScope
+	{
+	public:
+		ShellApartmentScope();
+		~ShellApartmentScope();
+
+		ShellApartmentScope(const ShellApartmentScope&) = delete;
+		ShellApartmentScope& operator=(const ShellApartmentScope&) = delete;
+
+		bool Entered() const { return m_initialized; }
+
+	private:
+		bool m_initialized;
+	};
+}
@@ -0,0 +1,323 @@
+#include "ContentSniffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace SystemDrag
+{
+	namespace
+	{
+		struct Signature
+		{
+			ContentType type;
+			uint8_t length;
+			uint8_t bytes[8];
+		};
+
+		// Offset 0 magic; Zip and Bmp get a second look in SniffContent
+		const Signature Signatures[] =
+		{
+			{ ContentType::Png, 8, { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A } },
+			{ ContentType::Jpeg, 3, { 0xFF, 0xD8, 0xFF } },
+			{ ContentType::Bmp, 2, { 'B', 'M' } },
+			{ ContentType::Pdf, 5, { '%', 'P', 'D', 'F', '-' } },
+			{ ContentType::Zip, 4, { 'P', 'K', 0x03, 0x04 } },
+			{ ContentType::Utf8Text, 3, { 0xEF, 0xBB, 0xBF } },
+			{ ContentType::Utf16Text, 2, { 0xFF, 0xFE } },
+			{ ContentType::Utf16Text, 2, { 0xFE, 0xFF } }
+		};
+
+		// Signatures grouped by first byte, so a head is compared against at most a couple
+		class SignatureIndex
+		{
+		public:
+			SignatureIndex()
+			{
+				for (const Signature& signature : Signatures)
+				{
+					m_sorted.push_back(&signature);
+				}
+				std::stable_sort(m_sorted.begin(), m_sorted.end(), [](const Signature* a, const Signature* b)
+				{
+					return a->bytes[0] != b->bytes[0] ? a->bytes[0] < b->bytes[0] : a->length > b->length;
+				});
+
+				std::fill(std::begin(m_begin), std::end(m_begin), (uint8_t)0);
+				std::fill(std::begin(m_count), std::end(m_count), (uint8_t)0);
+				for (size_t i = m_sorted.size(); i > 0; i--)
+				{
+					uint8_t first = m_sorted[i - 1]->bytes[0];
+					m_begin[first] = (uint8_t)(i - 1);
+					m_count[first]++;
+				}
+			}
+
+			const Signature* Match(const uint8_t* head, size_t size) const
+			{
+				if (size == 0)
+				{
+					return nullptr;
+				}
+				for (size_t i = m_begin[head[0]], end = i + m_count[head[0]]; i < end; i++)
+				{
+					const Signature* signature = m_sorted[i];
+					if (size >= signature->length && std::memcmp(head, signature->bytes, signature->length) == 0)
+					{
+						return signature;
+					}
+				}
+				return nullptr;
+			}
+
+		private:
+			std::vector<const Signature*> m_sorted;
+			uint8_t m_begin[256];
+			uint8_t m_count[256];
+		};
+
+		const SignatureIndex& Index()
+		{
+			static const SignatureIndex index;
+			return index;
+		}
+
+		uint32_t ReadLe32(const uint8_t* p)
+		{
+			return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+		}
+
+		// Office writes [Content_Types].xml or one of the part folders as the first entry
+		bool IsOfficeOpenXml(const uint8_t* head, size_t size)
+		{
+			if (size < 30)
+			{
+				return false;
+			}
+			size_t nameLength = (size_t)head[26] | ((size_t)head[27] << 8);
+			std::string_view name((const char*)head + 30, (std::min)(nameLength, size - 30));
+			static const char* const prefixes[] = { "[Content_Types].xml", "_rels/", "docProps/", "word/", "xl/", "ppt/" };
+			for (const char* prefix : prefixes)
+			{
+				if (name.compare(0, std::strlen(prefix), prefix) == 0)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// "BM", then the file size and two reserved zero words
+		bool IsBitmap(const uint8_t* head, size_t size)
+		{
+			return size >= 14 && ReadLe32(head + 6) == 0 && ReadLe32(head + 10) >= 14;
+		}
+
+		// Valid UTF-8 with no control bytes besides whitespace and escape; a sequence cut off
+		// by the end of the head is fine, the file goes on
+		bool IsPlainText(const uint8_t* head, size_t size)
+		{
+			if (size == 0)
+			{
+				return false;
+			}
+			size_t i = 0;
+			while (i < size)
+			{
+				uint8_t c = head[i];
+				if (c < 0x80)
+				{
+					if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != 0x1B)
+					{
+						return false;
+					}
+					i++;
+					continue;
+				}
+
+				size_t length = c >= 0xF0 && c <= 0xF4 ? 4 : c >= 0xE0 ? 3 : c >= 0xC2 && c <= 0xDF ? 2 : 0;
+				if (length == 0 || (length == 3 && c > 0xEF))
+				{
+					return false;
+				}
+				for (size_t k = 1; k < length; k++)
+				{
+					if (i + k >= size)
+					{
+						return true;
+					}
+					if ((head[i + k] & 0xC0) != 0x80)
+					{
+						return false;
+					}
+				}
+				i += length;
+			}
+			return true;
+		}
+	}
+
+	const char* ContentTypeName(ContentType type)
+	{
+		switch (type)
+		{
+		case ContentType::Png: return "png";
+		case ContentType::Jpeg: return "jpeg";
+		case ContentType::Bmp: return "bmp";
+		case ContentType::Pdf: return "pdf";
+		case ContentType::Zip: return "zip";
+		case ContentType::OfficeOpenXml: return "ooxml";
+		case ContentType::Utf8Text: return "utf8-bom";
+		case ContentType::Utf16Text: return "utf16-bom";
+		case ContentType::PlainText: return "text";
+		default: return "unknown";
+		}
+	}
+
+	ContentType SniffContent(const uint8_t* head, size_t size)
+	{
+		const Signature* signature = Index().Match(head, size);
+		if (signature == nullptr)
+		{
+			return IsPlainText(head, size) ? ContentType::PlainText : ContentType::Unknown;
+		}
+
+		switch (signature->type)
+		{
+		case ContentType::Zip:
+			return IsOfficeOpenXml(head, size) ? ContentType::OfficeOpenXml : ContentType::Zip;
+		case ContentType::Bmp:
+			// "BM" also starts ordinary text
+			if (IsBitmap(head, size))
+			{
+				return ContentType::Bmp;
+			}
+			return IsPlainText(head, size) ? ContentType::PlainText : ContentType::Unknown;
+		default:
+			return signature->type;
+		}
+	}
+
+#ifdef _WIN32
+	int64_t NativeContentReader::ReadHead(const std::filesystem::path& path, uint8_t* buffer, size_t capacity)
+	{
+		// Opening a placeholder can already start the download, so look before opening
+		DWORD attributes = GetFileAttributesW(path.c_str());
+		if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & (FILE_ATTRIBUTE_OFFLINE | FILE_ATTRIBUTE_RECALL_ON_OPEN
+			| FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS)) != 0)
+		{
+			return -1;
+		}
+
+		// Directories fail to open without FILE_FLAG_BACKUP_SEMANTICS, which is what we want
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return -1;
+		}
+
+		DWORD read = 0;
+		BOOL ok = ReadFile(file, buffer, (DWORD)capacity, &read, NULL);
+		CloseHandle(file);
+		return ok ? (int64_t)read : -1;
+	}
+#else
+	int64_t NativeContentReader::ReadHead(const std::filesystem::path& path, uint8_t* buffer, size_t capacity)
+	{
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			return -1;
+		}
+
+		size_t total = 0;
+		while (total < capacity)
+		{
+			ssize_t read = ::read(fd, buffer + total, capacity - total);
+			if (read < 0)
+			{
+				close(fd);
+				return -1;
+			}
+			if (read == 0)
+			{
+				break;
+			}
+			total += (size_t)read;
+		}
+		close(fd);
+		return (int64_t)total;
+	}
+#endif
+
+	ContentSniffer::ContentSniffer(IContentReader& reader, const SniffBudget& budget, uint32_t accepted)
+		: m_reader(reader), m_budget(budget), m_accepted(accepted), m_enabled(false)
+	{
+	}
+
+	SniffResult ContentSniffer::FindAccepted(const std::vector<std::filesystem::path>& paths, const StopWhen& stop,
+		const Fallback& fallback)
+	{
+		SniffResult result = { (size_t)-1, ContentType::Unknown, false, 0, 0, false, false };
+		auto deadline = std::chrono::steady_clock::now() + m_budget.maxTime;
+		std::vector<uint8_t> buffer(m_budget.headBytes);
+
+		for (; result.examined < paths.size(); result.examined++)
+		{
+			if (stop && stop())
+			{
+				result.cancelled = true;
+				break;
+			}
+			if (result.examined >= m_budget.maxFiles || result.bytesRead >= m_budget.maxBytes
+				|| std::chrono::steady_clock::now() >= deadline)
+			{
+				result.exhausted = true;
+				break;
+			}
+
+			size_t capacity = (std::min)(buffer.size(), (size_t)(m_budget.maxBytes - result.bytesRead));
+			int64_t read = m_reader.ReadHead(paths[result.examined], buffer.data(), capacity);
+			if (read <= 0)
+			{
+				// Nothing to sniff: an empty file, one that cannot be opened or a placeholder
+				if (fallback && fallback(paths[result.examined]))
+				{
+					result.found = result.examined;
+					result.byFallback = true;
+					result.examined++;
+					break;
+				}
+				continue;
+			}
+			result.bytesRead += (uint64_t)read;
+
+			ContentType type = SniffContent(buffer.data(), (size_t)read);
+			if ((m_accepted & ContentBit(type)) != 0)
+			{
+				result.found = result.examined;
+				result.type = type;
+				result.examined++;
+				break;
+			}
+		}
+		return result;
+	}
+
+	ContentSniffer& SharedContentSniffer()
+	{
+		// 512 bytes covers every signature and the first zip entry name; 256 files or
+		// 128 KiB or 30 ms, whichever comes first, then the extension decides
+		static NativeContentReader reader;
+		static ContentSniffer sniffer(reader, { 512, 256, 128 * 1024, std::chrono::milliseconds(30) });
+		return sniffer;
+	}
+}
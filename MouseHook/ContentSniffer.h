@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+// Content sniffing by magic bytes.
+// The extension says what a file claims to be; the first few hundred bytes say what it is.
+// The sniffer reads a bounded head of each candidate and matches it against a signature
+// table compiled once into a first-byte index. A drag is decided by the first file whose
+// content is accepted, and the whole batch runs under a file, byte and time budget so a
+// 10k-file drag costs a bounded amount of I/O; paths the budget did not reach are left to
+// the caller's extension check, and so are files whose head cannot be read at all.
+namespace SystemDrag
+{
+	enum class ContentType : uint8_t
+	{
+		Unknown,
+		Png,
+		Jpeg,
+		Bmp,
+		Pdf,
+		Zip,            // a zip that is not an Office Open XML package
+		OfficeOpenXml,  // docx / xlsx / pptx
+		Utf8Text,       // UTF-8 BOM
+		Utf16Text,      // UTF-16 BOM, either byte order
+		PlainText,      // no BOM, but the head is valid UTF-8 without binary control bytes
+		Count
+	};
+
+	const char* ContentTypeName(ContentType type);
+
+	constexpr uint32_t ContentBit(ContentType type) { return 1u << (unsigned)type; }
+
+	// Everything the detectors treat as a document
+	constexpr uint32_t DocumentContent = ContentBit(ContentType::Png) | ContentBit(ContentType::Jpeg)
+		| ContentBit(ContentType::Bmp) | ContentBit(ContentType::Pdf) | ContentBit(ContentType::OfficeOpenXml)
+		| ContentBit(ContentType::Utf8Text) | ContentBit(ContentType::Utf16Text) | ContentBit(ContentType::PlainText);
+
+	// Classifies a file head; size may be shorter than the file
+	ContentType SniffContent(const uint8_t* head, size_t size);
+
+	class IContentReader
+	{
+	public:
+		virtual ~IContentReader() {}
+
+		// Reads at most capacity bytes from the start of the file, -1 if it cannot be opened
+		// or should not be read
+		virtual int64_t ReadHead(const std::filesystem::path& path, uint8_t* buffer, size_t capacity) = 0;
+	};
+
+	// CreateFileW + one ReadFile on Windows, open + read elsewhere. Offline files and cloud
+	// placeholders are not opened: reading them would download the file first.
+	class NativeContentReader : public IContentReader
+	{
+	public:
+		int64_t ReadHead(const std::filesystem::path& path, uint8_t* buffer, size_t capacity) override;
+	};
+
+	struct SniffBudget
+	{
+		size_t headBytes;                   // bytes read per file
+		size_t maxFiles;                    // files read per batch
+		size_t maxBytes;                    // bytes read per batch
+		std::chrono::microseconds maxTime;  // wall time per batch, checked between files
+	};
+
+	struct SniffResult
+	{
+		size_t found;        // index of the first accepted file, or npos
+		ContentType type;    // its content type, Unknown when the fallback accepted it
+		bool byFallback;     // accepted by the fallback, its head could not be read
+		size_t examined;     // paths looked at, readable or not
+		uint64_t bytesRead;
+		bool exhausted;      // stopped by the budget; paths from examined on are unchecked
+		bool cancelled;
+	};
+
+	class ContentSniffer
+	{
+	public:
+		typedef std::function<bool()> StopWhen;
+		// Decides a path whose head is empty or cannot be read, usually by its extension
+		typedef std::function<bool(const std::filesystem::path&)> Fallback;
+
+		ContentSniffer(IContentReader& reader, const SniffBudget& budget, uint32_t accepted = DocumentContent);
+
+		// Reads paths in order until one is accepted, the budget runs out or stop() says so.
+		// Safe to call from several threads at once; each call reads into its own buffer.
+		SniffResult FindAccepted(const std::vector<std::filesystem::path>& paths, const StopWhen& stop = StopWhen(),
+			const Fallback& fallback = Fallback());
+
+		// Off by default; the detectors check this before collecting paths for it
+		bool Enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+		void SetEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+		const SniffBudget& Budget() const { return m_budget; }
+
+	private:
+		IContentReader& m_reader;
+		SniffBudget m_budget;
+		uint32_t m_accepted;
+		std::atomic<bool> m_enabled;
+	};
+
+	// Sniffer shared by the detectors' worker threads over the native reader
+	ContentSniffer& SharedContentSniffer();
+}
@@ -0,0 +1,167 @@
+#include "ContentSniffer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Content sniffer against a fixture directory: one file per signature plus the cases the
+// extension check gets wrong (an executable named like a document, an extensionless log),
+// then a 10k-file drag of unsupported files to show the budget caps reads and latency, the
+// extension fallback for files with nothing to sniff, and
+// one sniffer shared by several threads the way the detection workers share it.
+namespace SystemDrag
+{
+	struct SnifferFixture
+	{
+		const char* name;
+		std::string content;
+		ContentType expected;
+	};
+
+	static std::string Bytes(std::initializer_list<int> bytes)
+	{
+		std::string s;
+		for (int b : bytes)
+		{
+			s.push_back((char)b);
+		}
+		return s;
+	}
+
+	static std::vector<SnifferFixture> Fixtures()
+	{
+		std::string zipHeader = Bytes({ 'P', 'K', 3, 4, 20, 0, 6, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 });
+		std::string bmpHeader = Bytes({ 'B', 'M', 0x46, 0, 0, 0, 0, 0, 0, 0, 0x36, 0, 0, 0, 0x28, 0, 0, 0 });
+		return
+		{
+			{ "image.png", Bytes({ 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A, 0, 0, 0, 13, 'I', 'H', 'D', 'R' }), ContentType::Png },
+			{ "photo.jpg", Bytes({ 0xFF, 0xD8, 0xFF, 0xE0, 0, 0x10, 'J', 'F', 'I', 'F', 0 }), ContentType::Jpeg },
+			{ "picture.bmp", bmpHeader + std::string(32, '\0'), ContentType::Bmp },
+			{ "paper.pdf", "%PDF-1.7\n%\xE2\xE3\xCF\xD3\n1 0 obj\n", ContentType::Pdf },
+			{ "report.docx", zipHeader + Bytes({ 19, 0, 0, 0 }) + "[Content_Types].xml" + std::string(16, '\0'), ContentType::OfficeOpenXml },
+			{ "sheet.xlsx", zipHeader + Bytes({ 11, 0, 0, 0 }) + "_rels/.rels" + std::string(16, '\0'), ContentType::OfficeOpenXml },
+			{ "archive.zip", zipHeader + Bytes({ 9, 0, 0, 0 }) + "notes.txt" + std::string(16, '\0'), ContentType::Zip },
+			{ "bom8.txt", "\xEF\xBB\xBFhello", ContentType::Utf8Text },
+			{ "bom16.txt", Bytes({ 0xFF, 0xFE, 'h', 0, 'i', 0 }), ContentType::Utf16Text },
+			{ "bom16be.txt", Bytes({ 0xFE, 0xFF, 0, 'h', 0, 'i' }), ContentType::Utf16Text },
+			{ "server-log", "2024-01-01 12:00:00 started\n\xE5\xBC\x80\xE5\xA7\x8B\n", ContentType::PlainText },
+			{ "BMW notes", "BM notes: not a bitmap at all\n", ContentType::PlainText },
+			{ "report.TXT.exe", Bytes({ 'M', 'Z', 0x90, 0, 3, 0, 0, 0, 4, 0, 0, 0, 0xFF, 0xFF, 0, 0 }), ContentType::Unknown },
+			{ "fake.pdf", std::string("\x7F" "ELF\x02\x01\x01", 7) + std::string(16, '\0'), ContentType::Unknown },
+			{ "empty.txt", "", ContentType::Unknown }
+		};
+	}
+
+	// Command line entry: ContentSnifferBenchMain [fixture directory] [files]
+	int ContentSnifferBenchMain(int argc, char* argv[])
+	{
+		std::filesystem::path root = argc > 1 ? std::filesystem::path(argv[1])
+			: std::filesystem::temp_directory_path() / "content-sniffer-bench";
+		size_t files = argc > 2 ? (size_t)std::atoi(argv[2]) : 10000;
+
+		std::error_code ec;
+		std::filesystem::create_directories(root, ec);
+
+		size_t wrong = 0;
+		for (const SnifferFixture& fixture : Fixtures())
+		{
+			std::filesystem::path path = root / fixture.name;
+			std::ofstream(path, std::ios::binary | std::ios::trunc) << fixture.content;
+
+			uint8_t head[512];
+			NativeContentReader reader;
+			int64_t read = reader.ReadHead(path, head, sizeof(head));
+			ContentType type = read >= 0 ? SniffContent(head, (size_t)read) : ContentType::Unknown;
+			if (type != fixture.expected)
+			{
+				wrong++;
+			}
+			std::cout << (type == fixture.expected ? "  ok  " : "  BAD ") << fixture.name << ": " << ContentTypeName(type)
+				<< " (expected " << ContentTypeName(fixture.expected) << ")" << std::endl;
+		}
+
+		// A large drag of executables with one document at the very end: the budget stops
+		// long before it, and the caller falls back to extensions for the rest
+		std::filesystem::path dragDir = root / "drag";
+		std::filesystem::create_directories(dragDir, ec);
+		std::vector<std::filesystem::path> drag;
+		std::string executable = Bytes({ 'M', 'Z', 0x90, 0 }) + std::string(1020, '\0');
+		for (size_t i = 0; i < files; i++)
+		{
+			std::filesystem::path path = dragDir / ("tool" + std::to_string(i) + ".exe");
+			if (!std::filesystem::exists(path))
+			{
+				std::ofstream(path, std::ios::binary) << executable;
+			}
+			drag.push_back(path);
+		}
+		drag.push_back(root / "paper.pdf");
+
+		NativeContentReader reader;
+		SniffBudget budget = { 512, 256, 128 * 1024, std::chrono::milliseconds(30) };
+		ContentSniffer sniffer(reader, budget);
+		auto t0 = std::chrono::steady_clock::now();
+		SniffResult capped = sniffer.FindAccepted(drag);
+		double cappedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+		std::cout << files + 1 << " files, budget " << budget.maxFiles << " files / " << budget.maxBytes << " bytes / "
+			<< budget.maxTime.count() << " us: examined " << capped.examined << ", read " << capped.bytesRead
+			<< " bytes, exhausted " << capped.exhausted << ", " << cappedMs << " ms" << std::endl;
+
+		SniffBudget unlimited = { 512, (size_t)-1, (size_t)-1, std::chrono::hours(1) };
+		ContentSniffer full(reader, unlimited);
+		t0 = std::chrono::steady_clock::now();
+		SniffResult uncapped = full.FindAccepted(drag);
+		double uncappedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+		std::cout << "without budget: examined " << uncapped.examined << ", read " << uncapped.bytesRead << " bytes, found "
+			<< (uncapped.found == drag.size() - 1 ? "the document" : "nothing") << ", " << uncappedMs << " ms" << std::endl;
+
+		// Short-circuit: the document first, nothing else is read
+		std::swap(drag.front(), drag.back());
+		SniffResult first = sniffer.FindAccepted(drag);
+		std::cout << "document first: examined " << first.examined << ", type " << ContentTypeName(first.type) << std::endl;
+
+		// Nothing to sniff: an empty file and a missing one are left to the fallback, a file
+		// that was read and rejected is not
+		std::vector<std::filesystem::path> unreadable = { root / "report.TXT.exe", root / "empty.txt", root / "missing.pdf" };
+		auto byExtension = [](const std::filesystem::path& path) { return path.extension() == ".pdf"; };
+		SniffResult missing = sniffer.FindAccepted(unreadable, ContentSniffer::StopWhen(), byExtension);
+		auto anyName = [](const std::filesystem::path&) { return true; };
+		SniffResult empty = sniffer.FindAccepted(unreadable, ContentSniffer::StopWhen(), anyName);
+		bool fallbackOk = missing.found == 2 && missing.byFallback && empty.found == 1 && empty.byFallback;
+		std::cout << "unreadable heads: fallback " << (fallbackOk ? "ok" : "WRONG") << std::endl;
+
+		// Shared sniffer: each thread sniffs one document fixture over and over and must always
+		// get that fixture's type back, whatever the other threads are reading at the time
+		std::vector<SnifferFixture> fixtures = Fixtures();
+		std::vector<std::thread> threads;
+		std::vector<size_t> crossed(4, 0);
+		for (size_t t = 0; t < crossed.size(); t++)
+		{
+			threads.emplace_back([&, t]()
+				{
+					const SnifferFixture& fixture = fixtures[t];
+					std::vector<std::filesystem::path> one = { root / fixture.name };
+					for (int i = 0; i < 2000; i++)
+					{
+						crossed[t] += sniffer.FindAccepted(one).type != fixture.expected;
+					}
+				});
+		}
+		size_t crossedTotal = 0;
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+			crossedTotal += crossed[t];
+		}
+		std::cout << threads.size() << " threads on one sniffer: " << crossedTotal << " wrong types" << std::endl;
+
+		bool budgetOk = capped.exhausted && capped.examined <= budget.maxFiles && capped.bytesRead <= budget.maxBytes
+			&& uncapped.found == drag.size() - 1 && first.found == 0 && first.examined == 1;
+		std::cout << "misclassified: " << wrong << ", budget " << (budgetOk ? "ok" : "VIOLATED") << std::endl;
+		return wrong == 0 && budgetOk && fallbackOk && crossedTotal == 0 ? 0 : 1;
+	}
+}
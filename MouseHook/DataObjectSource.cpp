@@ -0,0 +1,84 @@
+#include "DataObjectSource.h"
+
+#pragma comment(lib, "Ole32.lib")
+
+namespace SystemDrag
+{
+	DataObjectSource::DataObjectSource(IDataObject* dataObject)
+		: m_dataObject(dataObject), m_medium(), m_held(false)
+	{
+	}
+
+	DataObjectSource::~DataObjectSource()
+	{
+		Release();
+	}
+
+	void DataObjectSource::EnumerateFormats(std::vector<uint32_t>& formats, std::vector<bool>& fetchable)
+	{
+		formats.clear();
+		fetchable.clear();
+
+		CComPtr<IEnumFORMATETC> enumerator;
+		if (!m_dataObject || FAILED(m_dataObject->EnumFormatEtc(DATADIR_GET, &enumerator)) || !enumerator)
+		{
+			return;
+		}
+
+		// Batches of 16 keep the cross-process round trips down for out-of-process sources
+		FORMATETC batch[16];
+		ULONG fetched = 0;
+		while (SUCCEEDED(enumerator->Next(16, batch, &fetched)) && fetched > 0)
+		{
+			for (ULONG i = 0; i < fetched; i++)
+			{
+				formats.push_back(batch[i].cfFormat);
+				fetchable.push_back(batch[i].dwAspect == DVASPECT_CONTENT && (batch[i].tymed & TYMED_HGLOBAL) != 0);
+				if (batch[i].ptd)
+				{
+					CoTaskMemFree(batch[i].ptd);
+				}
+			}
+			if (fetched < 16)
+			{
+				break;
+			}
+		}
+	}
+
+	bool DataObjectSource::Fetch(uint32_t format, FormatPayload& payload)
+	{
+		Release();
+
+		FORMATETC formatEtc = { (CLIPFORMAT)format, NULL, DVASPECT_CONTENT, -1, TYMED_HGLOBAL };
+		if (!m_dataObject || FAILED(m_dataObject->GetData(&formatEtc, &m_medium)))
+		{
+			return false;
+		}
+		if (m_medium.tymed != TYMED_HGLOBAL)
+		{
+			ReleaseStgMedium(&m_medium);
+			return false;
+		}
+
+		payload.data = GlobalLock(m_medium.hGlobal);
+		payload.size = GlobalSize(m_medium.hGlobal);
+		if (payload.data == nullptr)
+		{
+			ReleaseStgMedium(&m_medium);
+			return false;
+		}
+		m_held = true;
+		return true;
+	}
+
+	void DataObjectSource::Release()
+	{
+		if (m_held)
+		{
+			GlobalUnlock(m_medium.hGlobal);
+			ReleaseStgMedium(&m_medium);
+			m_held = false;
+		}
+	}
+}
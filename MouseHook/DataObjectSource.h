@@ -0,0 +1,31 @@
+#pragma once
+
+#include <windows.h>
+#include <objidl.h>
+#include <atlbase.h>
+
+#include "FormatNegotiation.h"
+
+namespace SystemDrag
+{
+	// IFormatSource over an IDataObject from OleGetClipboard or a drop.
+	// Fetch asks for TYMED_HGLOBAL and keeps the medium locked until Release.
+	class DataObjectSource : public IFormatSource
+	{
+	public:
+		explicit DataObjectSource(IDataObject* dataObject);
+		~DataObjectSource();
+
+		DataObjectSource(const DataObjectSource&) = delete;
+		DataObjectSource& operator=(const DataObjectSource&) = delete;
+
+		void EnumerateFormats(std::vector<uint32_t>& formats, std::vector<bool>& fetchable) override;
+		bool Fetch(uint32_t format, FormatPayload& payload) override;
+		void Release() override;
+
+	private:
+		CComPtr<IDataObject> m_dataObject;
+		STGMEDIUM m_medium;
+		bool m_held;
+	};
+}
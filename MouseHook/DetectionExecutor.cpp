@@ -0,0 +1,137 @@
+#include "DetectionExecutor.h"
+
+#include <chrono>
+
+namespace SystemDrag
+{
+	void CondVarApartment::Wait(uint32_t timeoutMs)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return m_signaled; });
+		m_signaled = false;
+	}
+
+	void CondVarApartment::Notify()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_signaled = true;
+		}
+		m_cond.notify_one();
+	}
+
+	DetectionExecutor::DetectionExecutor(size_t workers, ApartmentFactory factory, IDetectionHandler& handler,
+		DetectionLatency& latency)
+		: m_factory(std::move(factory)), m_handler(handler), m_latency(latency)
+		, m_stopping(false), m_posted(0), m_entered(0), m_failed(0)
+	{
+		for (size_t i = 0; i < (workers == 0 ? 1 : workers); i++)
+		{
+			m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+		}
+	}
+
+	DetectionExecutor::~DetectionExecutor()
+	{
+		Stop();
+	}
+
+	int64_t DetectionExecutor::NowNs()
+	{
+		return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	bool DetectionExecutor::Start()
+	{
+		m_stopping.store(false, std::memory_order_relaxed);
+		m_entered = 0;
+		m_failed = 0;
+		for (size_t i = 0; i < m_workers.size(); i++)
+		{
+			Worker& worker = *m_workers[i];
+			worker.apartment = m_factory(i);
+			worker.queue.GetWakeup().apartment = worker.apartment.get();
+			worker.thread = std::thread(&DetectionExecutor::Loop, this, i);
+		}
+
+		bool entered;
+		{
+			std::unique_lock<std::mutex> lock(m_startMutex);
+			m_startCond.wait(lock, [this] { return m_entered + m_failed == m_workers.size(); });
+			entered = m_failed == 0;
+		}
+		if (!entered)
+		{
+			Stop();
+		}
+		return entered;
+	}
+
+	void DetectionExecutor::Stop()
+	{
+		m_stopping.store(true, std::memory_order_release);
+		for (std::unique_ptr<Worker>& worker : m_workers)
+		{
+			if (worker->thread.joinable())
+			{
+				worker->apartment->Notify();
+				worker->thread.join();
+			}
+		}
+	}
+
+	bool DetectionExecutor::Post(const DragEventRecord& record)
+	{
+		m_posted.store(m_posted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		Worker& worker = *m_workers[record.pointer % m_workers.size()];
+		return worker.queue.TryPush(Job{ record, NowNs() });
+	}
+
+	void DetectionExecutor::Loop(size_t index)
+	{
+		Worker& worker = *m_workers[index];
+		bool entered = worker.apartment->Enter();
+		{
+			std::lock_guard<std::mutex> lock(m_startMutex);
+			(entered ? m_entered : m_failed)++;
+		}
+		m_startCond.notify_all();
+		if (!entered)
+		{
+			return;
+		}
+
+		Job job;
+		while (!m_stopping.load(std::memory_order_acquire))
+		{
+			while (!m_stopping.load(std::memory_order_acquire) && worker.queue.TryPop(job))
+			{
+				m_latency.Record(DetectionStage::WorkerHandoff, (uint64_t)(NowNs() - job.postedNs));
+				m_handler.Run(index, job.record);
+				worker.completed.fetch_add(1, std::memory_order_relaxed);
+			}
+			m_handler.Idle(index);
+
+			// The ring notifies only when it finds the worker drained, which it now is
+			worker.apartment->Wait(IdleWaitMs);
+			worker.wakeups.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		m_handler.Exit(index);
+		worker.apartment->Leave();
+	}
+
+	ExecutorStats DetectionExecutor::Stats() const
+	{
+		ExecutorStats stats = {};
+		stats.posted = m_posted.load(std::memory_order_relaxed);
+		for (const std::unique_ptr<Worker>& worker : m_workers)
+		{
+			stats.dropped += worker->queue.Dropped();
+			stats.completed += worker->completed.load(std::memory_order_relaxed);
+			stats.wakeups += worker->wakeups.load(std::memory_order_relaxed);
+		}
+		return stats;
+	}
+}
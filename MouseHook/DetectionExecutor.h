@@ -0,0 +1,149 @@
+#pragma once
+
+#include "GestureEngine.h"
+#include "LatencyHistogram.h"
+#include "SpscRing.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Detection off the hook thread.
+// The hook thread only pumps WH_MOUSE_LL and posts drag events here. Every worker thread
+// owns an apartment (a COM STA on Windows) and an SPSC ring fed by the hook; it drains the
+// ring through the handler and otherwise waits inside its apartment, which keeps pumping
+// the messages COM calls and the shell event sinks depend on. Events are routed by pointer
+// slot, so the prefetch, check and drag end of one pointer run in order on one worker, next
+// to the apartment-bound caches they use.
+namespace SystemDrag
+{
+	class IApartment
+	{
+	public:
+		virtual ~IApartment() {}
+
+		// Worker thread, before the first event; false stops the worker
+		virtual bool Enter() = 0;
+		// Worker thread: returns on Notify(), after dispatching pending messages or on timeout
+		virtual void Wait(uint32_t timeoutMs) = 0;
+		// Any thread
+		virtual void Notify() = 0;
+		// Worker thread, after the last event
+		virtual void Leave() = 0;
+	};
+
+	// Stand-in apartment without COM or a message queue, for the benches and non-Windows builds
+	class CondVarApartment : public IApartment
+	{
+	public:
+		CondVarApartment() : m_signaled(false) {}
+
+		bool Enter() override { return true; }
+		void Wait(uint32_t timeoutMs) override;
+		void Notify() override;
+		void Leave() override {}
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		bool m_signaled;
+	};
+
+	// Creates the apartment of one worker; called on the thread that starts the executor
+	typedef std::function<std::unique_ptr<IApartment>(size_t worker)> ApartmentFactory;
+
+	class IDetectionHandler
+	{
+	public:
+		virtual ~IDetectionHandler() {}
+
+		// Worker thread, inside its apartment
+		virtual void Run(size_t worker, const DragEventRecord& record) = 0;
+		// Worker thread after every wait, between events
+		virtual void Idle(size_t worker) { (void)worker; }
+		// Worker thread before its apartment is left: release apartment-bound objects here
+		virtual void Exit(size_t worker) { (void)worker; }
+	};
+
+	struct ExecutorStats
+	{
+		uint64_t posted;
+		uint64_t dropped;       // the worker's ring was full
+		uint64_t completed;
+		uint64_t wakeups;
+	};
+
+	class DetectionExecutor
+	{
+	public:
+		static constexpr size_t QueueSize = 256;
+		// Upper bound on a worker's wait, so Idle() runs even without messages
+		static constexpr uint32_t IdleWaitMs = 250;
+
+		DetectionExecutor(size_t workers, ApartmentFactory factory, IDetectionHandler& handler,
+			DetectionLatency& latency = SharedDetectionLatency());
+		~DetectionExecutor();
+
+		DetectionExecutor(const DetectionExecutor&) = delete;
+		DetectionExecutor& operator=(const DetectionExecutor&) = delete;
+
+		// Starts the workers and returns once every apartment was entered; when one fails the
+		// others are stopped again and false is returned
+		bool Start();
+		// Events still queued are discarded; joins the workers
+		void Stop();
+
+		// Hook thread only: each worker ring has exactly one producer. False when the ring is full.
+		bool Post(const DragEventRecord& record);
+
+		size_t Workers() const { return m_workers.size(); }
+		ExecutorStats Stats() const;
+
+	private:
+		struct Job
+		{
+			DragEventRecord record;
+			int64_t postedNs;   // steady clock
+		};
+
+		// SpscRing wakeup policy: the producer notifies the apartment, the worker waits in it
+		struct ApartmentWakeup
+		{
+			IApartment* apartment = nullptr;
+
+			void Notify() { apartment->Notify(); }
+			void Wait() {}
+		};
+
+		struct Worker
+		{
+			std::unique_ptr<IApartment> apartment;
+			SpscRing<Job, QueueSize, ApartmentWakeup> queue;
+			std::thread thread;
+			std::atomic<uint64_t> completed{ 0 };
+			std::atomic<uint64_t> wakeups{ 0 };
+		};
+
+		void Loop(size_t index);
+		static int64_t NowNs();
+
+		ApartmentFactory m_factory;
+		IDetectionHandler& m_handler;
+		DetectionLatency& m_latency;
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		std::atomic<bool> m_stopping;
+		std::atomic<uint64_t> m_posted;     // written by the hook thread only
+
+		// Start() handshake
+		std::mutex m_startMutex;
+		std::condition_variable m_startCond;
+		size_t m_entered;
+		size_t m_failed;
+	};
+}
@@ -0,0 +1,195 @@
+#include "DetectionExecutor.h"
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Detection workers without COM. CondVarApartment stands in for the STA; the handler plays
+// a detector that is usually quick and now and then stuck behind a slow Explorer. The
+// producer plays the hook thread: it times each Post() and compares that with running the
+// same detector inline, as the hook thread did before. Checked: every pointer's events run
+// in order on the worker it maps to, nothing is lost except what a full ring reports as
+// dropped, a worker that cannot enter its apartment fails Start() and the others leave
+// theirs again. Handoff latency comes from the executor's own histogram.
+namespace SystemDrag
+{
+	struct CountingApartment : public CondVarApartment
+	{
+		CountingApartment(bool fail, std::atomic<int>& entered, std::atomic<int>& left)
+			: fail(fail), entered(entered), left(left)
+		{
+		}
+
+		bool Enter() override
+		{
+			if (fail)
+			{
+				return false;
+			}
+			entered++;
+			return true;
+		}
+
+		void Leave() override { left++; }
+
+		bool fail;
+		std::atomic<int>& entered;
+		std::atomic<int>& left;
+	};
+
+	class SimulatedDetector : public IDetectionHandler
+	{
+	public:
+		SimulatedDetector(size_t workers, size_t pointers, int slowEvery, int slowUs)
+			: m_lastSession(pointers, 0), m_misrouted(0), m_reordered(0), m_workers(workers)
+			, m_slowEvery(slowEvery), m_slowUs(slowUs), m_exits(0)
+		{
+		}
+
+		void Run(size_t worker, const DragEventRecord& record) override
+		{
+			// A slot is only touched by its own worker, no lock needed
+			m_misrouted += worker != record.pointer % m_workers;
+			m_reordered += record.sessionId <= m_lastSession[record.pointer];
+			m_lastSession[record.pointer] = record.sessionId;
+			Detect(record);
+		}
+
+		void Exit(size_t) override { m_exits++; }
+
+		// A detection mostly waits for Explorer to answer a cross-process call, so it sleeps
+		void Detect(const DragEventRecord& record)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(record.sessionId % m_slowEvery == 0 ? m_slowUs : 20));
+		}
+
+		std::vector<uint32_t> m_lastSession;
+		std::atomic<uint64_t> m_misrouted;
+		std::atomic<uint64_t> m_reordered;
+		size_t m_workers;
+		int m_slowEvery;
+		int m_slowUs;
+		std::atomic<int> m_exits;
+	};
+
+	static bool CheckFailedStart()
+	{
+		std::atomic<int> entered(0);
+		std::atomic<int> left(0);
+		SimulatedDetector detector(3, 3, 1000, 0);
+		DetectionExecutor executor(3, [&](size_t worker)
+		{
+			return std::unique_ptr<IApartment>(new CountingApartment(worker == 1, entered, left));
+		}, detector);
+
+		bool started = executor.Start();
+		bool correct = !started && entered == 2 && left == 2 && detector.m_exits == 2;
+		std::cout << "failed apartment: " << (correct ? "ok" : "WRONG") << " (entered " << entered << ", left " << left
+			<< ")" << std::endl;
+		return correct;
+	}
+
+	// Events are paced like drags from several pointers, four per millisecond
+	static bool RunExecutor(size_t workers, size_t pointers, size_t events, int slowEvery, int slowUs)
+	{
+		std::atomic<int> entered(0);
+		std::atomic<int> left(0);
+		DetectionLatency latency;
+		SimulatedDetector detector(workers, pointers, slowEvery, slowUs);
+		DetectionExecutor executor(workers, [&](size_t)
+		{
+			return std::unique_ptr<IApartment>(new CountingApartment(false, entered, left));
+		}, detector, latency);
+		if (!executor.Start())
+		{
+			std::cout << "executor did not start" << std::endl;
+			return false;
+		}
+
+		LatencyHistogram postNs;
+		std::vector<uint32_t> sessions(pointers, 0);
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < events; i++)
+		{
+			uint16_t slot = (uint16_t)(i % pointers);
+			sessions[slot] += (uint32_t)pointers;
+			DragEventRecord record = { sessions[slot] + slot, (uint32_t)i, 0, 0, DragEventKind::CheckRequested, slot };
+			auto before = std::chrono::steady_clock::now();
+			executor.Post(record);
+			postNs.Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - before).count());
+
+			std::this_thread::sleep_until(t0 + std::chrono::microseconds((i + 1) * 250));
+		}
+
+		// Let the workers drain before stopping, Stop() discards what is left
+		ExecutorStats stats = executor.Stats();
+		for (int wait = 0; wait < 5000 && stats.completed + stats.dropped < stats.posted; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			stats = executor.Stats();
+		}
+		executor.Stop();
+
+		LatencySnapshot post;
+		postNs.Snapshot(post);
+		LatencySnapshot handoff;
+		latency.Snapshot(DetectionStage::WorkerHandoff, handoff);
+
+		// The same detector on the hook thread: every slow detection stalls the hook
+		LatencyHistogram inlineNs;
+		for (size_t i = 0; i < std::min<size_t>(events, 2000); i++)
+		{
+			DragEventRecord record = { (uint32_t)i + 1, (uint32_t)i, 0, 0, DragEventKind::CheckRequested, 0 };
+			auto before = std::chrono::steady_clock::now();
+			detector.Detect(record);
+			inlineNs.Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - before).count());
+		}
+		LatencySnapshot inlined;
+		inlineNs.Snapshot(inlined);
+
+		std::cout << workers << " workers, " << pointers << " pointers, " << stats.posted << " events: completed "
+			<< stats.completed << ", dropped " << stats.dropped << ", wakeups " << stats.wakeups << std::endl;
+		std::cout << "  hook side: post p50 " << post.QuantileNs(0.5) << " ns, p99 " << post.QuantileNs(0.99)
+			<< " ns, max " << post.maxNs << " ns; inline detection p99 " << inlined.QuantileNs(0.99) / 1000
+			<< " us, max " << inlined.maxNs / 1000 << " us" << std::endl;
+		std::cout << "  handoff p50 " << handoff.QuantileNs(0.5) / 1000 << " us, p99 " << handoff.QuantileNs(0.99) / 1000
+			<< " us over " << handoff.count << " events" << std::endl;
+
+		bool correct = stats.completed + stats.dropped == stats.posted && stats.posted == events
+			&& handoff.count == stats.completed && detector.m_misrouted == 0 && detector.m_reordered == 0
+			&& entered == (int)workers && left == (int)workers && detector.m_exits == (int)workers;
+		if (!correct)
+		{
+			std::cout << "  misrouted " << detector.m_misrouted << ", reordered " << detector.m_reordered << std::endl;
+		}
+		return correct;
+	}
+
+	// Command line entry: DetectionExecutorBenchMain [events] [max workers]
+	int DetectionExecutorBenchMain(int argc, char* argv[])
+	{
+		size_t events = argc > 1 ? (size_t)std::atoi(argv[1]) : 8000;
+		size_t maxWorkers = argc > 2 ? (size_t)std::atoi(argv[2]) : 4;
+		if (events == 0)
+		{
+			events = 1;
+		}
+
+		bool correct = CheckFailedStart();
+		for (size_t workers = 1; workers <= std::max<size_t>(maxWorkers, 1); workers *= 2)
+		{
+			// One detection in 50 takes 5 ms
+			correct = RunExecutor(workers, 8, events, 50, 5000) && correct;
+		}
+
+		std::cout << (correct ? "executor ok" : "executor WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
@@ -0,0 +1,394 @@
+#include "DirectoryWatcher.h"
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace SystemDrag
+{
+#ifdef _WIN32
+	// One overlapped ReadDirectoryChangesW per directory, all completing on one port.
+	// The directory handle stays open from Watch until Unwatch, or until the directory goes
+	// away; it shares read, write and delete so it never keeps the user from renaming,
+	// moving or deleting the folder. MetadataCache bounds how many are open at once.
+	class Win32DirectoryWatcher : public IDirectoryWatcher
+	{
+	public:
+		Win32DirectoryWatcher() : m_port(NULL), m_listener(nullptr), m_live(0), m_stopping(false) {}
+
+		~Win32DirectoryWatcher()
+		{
+			if (m_port == NULL)
+			{
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (auto& watch : m_watches)
+				{
+					Close(watch.second);
+				}
+				m_watches.clear();
+			}
+			PostQueuedCompletionStatus(m_port, 0, 0, NULL);
+			m_thread.join();
+			CloseHandle(m_port);
+		}
+
+		bool Start(IChangeListener& listener) override
+		{
+			m_listener = &listener;
+			m_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+			if (m_port == NULL)
+			{
+				return false;
+			}
+			m_thread = std::thread(&Win32DirectoryWatcher::Loop, this);
+			return true;
+		}
+
+		bool Watch(const std::filesystem::path& directory) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_port == NULL)
+			{
+				return false;
+			}
+			if (m_watches.count(directory.native()) != 0)
+			{
+				return true;
+			}
+
+			HANDLE handle = CreateFileW(directory.c_str(), FILE_LIST_DIRECTORY,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+				FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+			if (handle == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+
+			WatchState* watch = new WatchState();
+			watch->handle = handle;
+			watch->directory = directory;
+			watch->closing = false;
+			if (CreateIoCompletionPort(handle, m_port, (ULONG_PTR)watch, 0) == NULL || !Arm(watch))
+			{
+				CloseHandle(handle);
+				delete watch;
+				return false;
+			}
+
+			m_live++;
+			m_watches[directory.native()] = watch;
+			return true;
+		}
+
+		void Unwatch(const std::filesystem::path& directory) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_watches.find(directory.native());
+			if (it != m_watches.end())
+			{
+				Close(it->second);
+				m_watches.erase(it);
+			}
+		}
+
+	private:
+		struct WatchState
+		{
+			HANDLE handle;
+			OVERLAPPED overlapped;
+			std::filesystem::path directory;
+			bool closing;
+			DWORD buffer[4096];
+		};
+
+		static bool Arm(WatchState* watch)
+		{
+			ZeroMemory(&watch->overlapped, sizeof(watch->overlapped));
+			return ReadDirectoryChangesW(watch->handle, watch->buffer, sizeof(watch->buffer), FALSE,
+				FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_ATTRIBUTES |
+				FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+				NULL, &watch->overlapped, NULL) != FALSE;
+		}
+
+		// Closing the handle aborts the pending read; the loop frees the state when that
+		// completion, or the one it is processing right now, comes back
+		static void Close(WatchState* watch)
+		{
+			watch->closing = true;
+			CloseHandle(watch->handle);
+			watch->handle = INVALID_HANDLE_VALUE;
+		}
+
+		void Free(WatchState* watch)
+		{
+			delete watch;
+			m_live--;
+		}
+
+		void Loop()
+		{
+			for (;;)
+			{
+				DWORD bytes = 0;
+				ULONG_PTR key = 0;
+				OVERLAPPED* overlapped = nullptr;
+				BOOL ok = GetQueuedCompletionStatus(m_port, &bytes, &key, &overlapped, INFINITE);
+
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (key == 0)
+				{
+					m_stopping = true;
+				}
+				else
+				{
+					WatchState* watch = (WatchState*)key;
+					if (watch->closing)
+					{
+						Free(watch);
+					}
+					else
+					{
+						std::filesystem::path directory = watch->directory;
+						lock.unlock();
+						Dispatch(watch, directory, ok != FALSE, bytes);
+						lock.lock();
+						Rearm(watch, directory, lock);
+					}
+				}
+
+				if (m_stopping && m_live == 0)
+				{
+					return;
+				}
+			}
+		}
+
+		void Dispatch(WatchState* watch, const std::filesystem::path& directory, bool ok, DWORD bytes)
+		{
+			if (!ok || bytes == 0)
+			{
+				// The buffer overflowed: something changed, but not what
+				m_listener->OnDirectoryChanged(directory);
+				return;
+			}
+
+			const BYTE* cursor = (const BYTE*)watch->buffer;
+			for (;;)
+			{
+				const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)cursor;
+				m_listener->OnPathChanged(directory / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+				if (info->NextEntryOffset == 0)
+				{
+					break;
+				}
+				cursor += info->NextEntryOffset;
+			}
+		}
+
+		void Rearm(WatchState* watch, const std::filesystem::path& directory, std::unique_lock<std::mutex>& lock)
+		{
+			if (watch->closing)
+			{
+				// Unwatched while we were dispatching, no read is pending any more
+				Free(watch);
+				return;
+			}
+			if (Arm(watch))
+			{
+				return;
+			}
+
+			// The directory is gone or unreachable: stop watching and tell the listener
+			m_watches.erase(directory.native());
+			CloseHandle(watch->handle);
+			Free(watch);
+			lock.unlock();
+			m_listener->OnDirectoryChanged(directory);
+			lock.lock();
+		}
+
+		HANDLE m_port;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::unordered_map<std::wstring, WatchState*> m_watches;
+		IChangeListener* m_listener;
+		size_t m_live;
+		bool m_stopping;
+	};
+
+	std::unique_ptr<IDirectoryWatcher> CreateNativeDirectoryWatcher()
+	{
+		return std::unique_ptr<IDirectoryWatcher>(new Win32DirectoryWatcher());
+	}
+
+#elif defined(__linux__)
+	class InotifyDirectoryWatcher : public IDirectoryWatcher
+	{
+	public:
+		InotifyDirectoryWatcher() : m_fd(-1), m_stop(-1), m_listener(nullptr) {}
+
+		~InotifyDirectoryWatcher()
+		{
+			if (m_thread.joinable())
+			{
+				uint64_t one = 1;
+				ssize_t written = write(m_stop, &one, sizeof(one));
+				(void)written;
+				m_thread.join();
+			}
+			if (m_fd >= 0)
+			{
+				close(m_fd);
+			}
+			if (m_stop >= 0)
+			{
+				close(m_stop);
+			}
+		}
+
+		bool Start(IChangeListener& listener) override
+		{
+			m_listener = &listener;
+			m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			m_stop = eventfd(0, EFD_CLOEXEC);
+			if (m_fd < 0 || m_stop < 0)
+			{
+				return false;
+			}
+			m_thread = std::thread(&InotifyDirectoryWatcher::Loop, this);
+			return true;
+		}
+
+		bool Watch(const std::filesystem::path& directory) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_fd < 0)
+			{
+				return false;
+			}
+			if (m_byPath.count(directory.native()) != 0)
+			{
+				return true;
+			}
+
+			int wd = inotify_add_watch(m_fd, directory.c_str(),
+				IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+				IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+			if (wd < 0)
+			{
+				return false;
+			}
+			m_byPath[directory.native()] = wd;
+			m_byWatch[wd] = directory;
+			return true;
+		}
+
+		void Unwatch(const std::filesystem::path& directory) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_byPath.find(directory.native());
+			if (it != m_byPath.end())
+			{
+				inotify_rm_watch(m_fd, it->second);
+				m_byWatch.erase(it->second);
+				m_byPath.erase(it);
+			}
+		}
+
+	private:
+		void Loop()
+		{
+			alignas(inotify_event) char buffer[16384];
+			pollfd fds[2] = { { m_fd, POLLIN, 0 }, { m_stop, POLLIN, 0 } };
+			for (;;)
+			{
+				if (poll(fds, 2, -1) < 0)
+				{
+					continue;
+				}
+				if (fds[1].revents & POLLIN)
+				{
+					return;
+				}
+
+				ssize_t length = read(m_fd, buffer, sizeof(buffer));
+				for (ssize_t offset = 0; length > 0 && offset < length; )
+				{
+					const inotify_event* event = (const inotify_event*)(buffer + offset);
+					offset += sizeof(inotify_event) + event->len;
+					Dispatch(*event);
+				}
+			}
+		}
+
+		void Dispatch(const inotify_event& event)
+		{
+			if (event.mask & IN_Q_OVERFLOW)
+			{
+				m_listener->OnOverflow();
+				return;
+			}
+
+			std::filesystem::path directory;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto it = m_byWatch.find(event.wd);
+				if (it == m_byWatch.end())
+				{
+					// Unwatched meanwhile
+					return;
+				}
+				directory = it->second;
+				if (event.mask & IN_IGNORED)
+				{
+					// The kernel dropped the watch (directory deleted or unmounted)
+					m_byPath.erase(directory.native());
+					m_byWatch.erase(it);
+				}
+			}
+
+			if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED | IN_UNMOUNT))
+			{
+				m_listener->OnDirectoryChanged(directory);
+			}
+			else if (event.len > 0)
+			{
+				m_listener->OnPathChanged(directory / event.name);
+			}
+		}
+
+		int m_fd;
+		int m_stop;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::unordered_map<std::string, int> m_byPath;
+		std::unordered_map<int, std::filesystem::path> m_byWatch;
+		IChangeListener* m_listener;
+	};
+
+	std::unique_ptr<IDirectoryWatcher> CreateNativeDirectoryWatcher()
+	{
+		return std::unique_ptr<IDirectoryWatcher>(new InotifyDirectoryWatcher());
+	}
+
+#else
+	std::unique_ptr<IDirectoryWatcher> CreateNativeDirectoryWatcher()
+	{
+		return nullptr;
+	}
+#endif
+}
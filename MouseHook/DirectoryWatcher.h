@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+
+// Directory change notifications for the metadata cache.
+// A watcher reports changes of the entries directly inside a watched directory; it does not
+// recurse. Callbacks come from the watcher's own thread and never while it holds a lock
+// that Watch/Unwatch take, so the listener may call back into the watcher.
+namespace SystemDrag
+{
+	class IChangeListener
+	{
+	public:
+		virtual ~IChangeListener() {}
+
+		// An entry of a watched directory was created, deleted, renamed or modified
+		virtual void OnPathChanged(const std::filesystem::path& path) = 0;
+		// The directory itself went away or its changes could not be tracked individually
+		virtual void OnDirectoryChanged(const std::filesystem::path& directory) = 0;
+		// Notifications were lost, nothing learned so far can be trusted
+		virtual void OnOverflow() = 0;
+	};
+
+	class IDirectoryWatcher
+	{
+	public:
+		virtual ~IDirectoryWatcher() {}
+
+		// Called once, before any Watch
+		virtual bool Start(IChangeListener& listener) = 0;
+
+		// False when the directory cannot be watched; watching it twice is harmless. The watch
+		// holds on to the directory until Unwatch, or until the directory is deleted or moved
+		virtual bool Watch(const std::filesystem::path& directory) = 0;
+		virtual void Unwatch(const std::filesystem::path& directory) = 0;
+	};
+
+	// ReadDirectoryChangesW on Windows, inotify on Linux, nullptr elsewhere
+	std::unique_ptr<IDirectoryWatcher> CreateNativeDirectoryWatcher();
+}
@@ -0,0 +1,636 @@
+#include "DragTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace SystemDrag
+{
+	// Start of the file; records follow in a ring of capacity bytes. Positions are
+	// monotonic byte counts, the slot is position % capacity.
+	struct TraceFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t capacity;
+		uint64_t head;          // next write position
+		uint64_t tail;          // oldest record still in the ring
+		uint64_t records;
+		uint64_t overwritten;
+		uint64_t reserved[2];
+	};
+
+	static_assert(sizeof(TraceFileHeader) == 64, "records start on a cache line");
+	static_assert(sizeof(TraceRecordHeader) == 24, "record header layout is part of the file format");
+
+	static const uint32_t TraceMagic = 0x43525444;   // "DTRC"
+	static const uint32_t TraceVersion = 1;
+	static const size_t TraceAlign = 8;
+
+	static uint64_t NowUs()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static uint64_t RoundCapacity(size_t capacity)
+	{
+		uint64_t rounded = (std::max)((uint64_t)capacity, (uint64_t)(4 * TraceRing::MaxRecord));
+		return (rounded + TraceAlign - 1) & ~(uint64_t)(TraceAlign - 1);
+	}
+
+	static bool ValidHeader(const TraceFileHeader& header, uint64_t capacity)
+	{
+		return header.magic == TraceMagic && header.version == TraceVersion && header.capacity == capacity
+			&& header.tail <= header.head && header.head - header.tail <= capacity
+			&& header.tail % TraceAlign == 0 && header.head % TraceAlign == 0;
+	}
+
+	// Copies [tail, head) out of the ring and splits it into records. Records never wrap;
+	// the gap at the end of a lap is a Pad record, or nothing when no header fits there.
+	// A damaged record ends the walk, a crash can leave a torn last write.
+	static void CopyRecords(const uint8_t* data, uint64_t capacity, uint64_t tail, uint64_t head,
+		std::vector<uint8_t>& bytes, std::vector<TraceRecord>& records)
+	{
+		records.clear();
+		bytes.resize((size_t)(head - tail));
+		uint64_t first = (std::min)(head - tail, capacity - tail % capacity);
+		if (!bytes.empty())
+		{
+			std::memcpy(bytes.data(), data + tail % capacity, (size_t)first);
+			std::memcpy(bytes.data() + first, data, (size_t)(head - tail - first));
+		}
+
+		for (uint64_t position = tail; position < head;)
+		{
+			uint64_t offset = position % capacity;
+			if (capacity - offset < sizeof(TraceRecordHeader))
+			{
+				position += capacity - offset;
+				continue;
+			}
+
+			TraceRecordHeader header;
+			std::memcpy(&header, bytes.data() + (position - tail), sizeof(header));
+			if (header.size < sizeof(header) || header.size % TraceAlign != 0
+				|| header.size > head - position || header.size > capacity - offset)
+			{
+				break;
+			}
+			if (header.type != TraceRecordType::Pad)
+			{
+				const uint8_t* payload = bytes.data() + (position - tail) + sizeof(header);
+				records.push_back({ header, payload, header.size - sizeof(header) });
+			}
+			position += header.size;
+		}
+	}
+
+	TraceRing::TraceRing()
+		: m_header(nullptr), m_data(nullptr), m_capacity(0), m_file(-1), m_mapping(nullptr), m_mappedSize(0)
+	{
+	}
+
+	TraceRing::~TraceRing()
+	{
+		Close();
+	}
+
+	void TraceRing::Attach(uint8_t* view, uint64_t capacity)
+	{
+		m_header = (TraceFileHeader*)view;
+		m_data = view + sizeof(TraceFileHeader);
+		m_capacity = capacity;
+		if (!ValidHeader(*m_header, capacity))
+		{
+			Reset();
+		}
+	}
+
+	void TraceRing::Reset()
+	{
+		std::memset(m_header, 0, sizeof(TraceFileHeader));
+		m_header->magic = TraceMagic;
+		m_header->version = TraceVersion;
+		m_header->capacity = m_capacity;
+	}
+
+#ifdef _WIN32
+	bool TraceRing::OpenFile(const std::filesystem::path& path, size_t capacity)
+	{
+		Close();
+		uint64_t rounded = RoundCapacity(capacity);
+		uint64_t total = sizeof(TraceFileHeader) + rounded;
+
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		// The mapping grows the file to its full size up front
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, (DWORD)(total >> 32), (DWORD)total, nullptr);
+		void* view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)total) : nullptr;
+		if (view == nullptr)
+		{
+			if (mapping != nullptr)
+			{
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_file = (intptr_t)file;
+		m_mapping = mapping;
+		m_mappedSize = (size_t)total;
+		Attach((uint8_t*)view, rounded);
+		return true;
+	}
+
+	void TraceRing::Close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_mapping != nullptr)
+		{
+			FlushViewOfFile(m_header, m_mappedSize);
+			UnmapViewOfFile(m_header);
+			CloseHandle((HANDLE)m_mapping);
+			CloseHandle((HANDLE)m_file);
+		}
+		m_file = -1;
+		m_mapping = nullptr;
+		m_mappedSize = 0;
+		m_memory.clear();
+		m_header = nullptr;
+		m_data = nullptr;
+	}
+#else
+	bool TraceRing::OpenFile(const std::filesystem::path& path, size_t capacity)
+	{
+		Close();
+		uint64_t rounded = RoundCapacity(capacity);
+		uint64_t total = sizeof(TraceFileHeader) + rounded;
+
+		int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		struct stat info;
+		if ((fstat(fd, &info) != 0 || (uint64_t)info.st_size != total) && ftruncate(fd, (off_t)total) != 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		void* view = mmap(nullptr, (size_t)total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (view == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_file = fd;
+		m_mapping = view;
+		m_mappedSize = (size_t)total;
+		Attach((uint8_t*)view, rounded);
+		return true;
+	}
+
+	void TraceRing::Close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_mapping != nullptr)
+		{
+			msync(m_mapping, m_mappedSize, MS_ASYNC);
+			munmap(m_mapping, m_mappedSize);
+			close((int)m_file);
+		}
+		m_file = -1;
+		m_mapping = nullptr;
+		m_mappedSize = 0;
+		m_memory.clear();
+		m_header = nullptr;
+		m_data = nullptr;
+	}
+#endif
+
+	void TraceRing::OpenMemory(size_t capacity)
+	{
+		Close();
+		uint64_t rounded = RoundCapacity(capacity);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_memory.assign(sizeof(TraceFileHeader) + (size_t)rounded, 0);
+		Attach(m_memory.data(), rounded);
+	}
+
+	uint64_t TraceRing::Span(uint64_t position, bool& pad) const
+	{
+		uint64_t offset = position % m_capacity;
+		pad = true;
+		if (m_capacity - offset < sizeof(TraceRecordHeader))
+		{
+			return m_capacity - offset;
+		}
+
+		TraceRecordHeader header;
+		std::memcpy(&header, m_data + offset, sizeof(header));
+		if (header.size < sizeof(header) || header.size > m_capacity - offset)
+		{
+			// Not a record boundary (torn write before a crash): drop the rest of the lap
+			return m_capacity - offset;
+		}
+		pad = header.type == TraceRecordType::Pad;
+		return header.size;
+	}
+
+	bool TraceRing::Append(TraceRecordType type, uint32_t session, const void* payload, size_t size)
+	{
+		return Append(type, session, payload, size, nullptr, 0);
+	}
+
+	bool TraceRing::Append(TraceRecordType type, uint32_t session, const void* payload, size_t size,
+		const void* tail, size_t tailSize)
+	{
+		size_t used = sizeof(TraceRecordHeader) + size + tailSize;
+		size_t total = (used + TraceAlign - 1) & ~(TraceAlign - 1);
+		if (total > MaxRecord)
+		{
+			return false;
+		}
+		TraceRecordHeader header = { (uint32_t)total, type, {}, session, 0, NowUs() };
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_header == nullptr)
+		{
+			return false;
+		}
+
+		// A record that would cross the end of the ring starts the next lap instead
+		uint64_t head = m_header->head;
+		uint64_t offset = head % m_capacity;
+		uint64_t skip = m_capacity - offset < total ? m_capacity - offset : 0;
+		uint64_t end = head + skip + total;
+
+		while (end - m_header->tail > m_capacity)
+		{
+			bool pad = false;
+			m_header->tail += Span(m_header->tail, pad);
+			m_header->overwritten += pad ? 0 : 1;
+		}
+
+		if (skip >= sizeof(TraceRecordHeader))
+		{
+			TraceRecordHeader padding = { (uint32_t)skip, TraceRecordType::Pad, {}, 0, 0, 0 };
+			std::memcpy(Slot(head), &padding, sizeof(padding));
+		}
+
+		uint8_t* slot = Slot(head + skip);
+		std::memcpy(slot, &header, sizeof(header));
+		if (size != 0)
+		{
+			std::memcpy(slot + sizeof(header), payload, size);
+		}
+		if (tailSize != 0)
+		{
+			std::memcpy(slot + sizeof(header) + size, tail, tailSize);
+		}
+		std::memset(slot + used, 0, total - used);
+
+		// Publish last: a crash before this leaves the previous head, never a torn record
+		m_header->head = end;
+		m_header->records++;
+		return true;
+	}
+
+	void TraceRing::Snapshot(std::vector<uint8_t>& bytes, std::vector<TraceRecord>& records)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_header == nullptr)
+		{
+			bytes.clear();
+			records.clear();
+			return;
+		}
+		CopyRecords(m_data, m_capacity, m_header->tail, m_header->head, bytes, records);
+	}
+
+	uint64_t TraceRing::Written() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_header != nullptr ? m_header->records : 0;
+	}
+
+	uint64_t TraceRing::Overwritten() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_header != nullptr ? m_header->overwritten : 0;
+	}
+
+	bool LoadTraceFile(const std::filesystem::path& path, std::vector<uint8_t>& bytes, std::vector<TraceRecord>& records)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in)
+		{
+			return false;
+		}
+		std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		if (file.size() < sizeof(TraceFileHeader))
+		{
+			return false;
+		}
+
+		TraceFileHeader header;
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (header.capacity == 0 || file.size() - sizeof(header) < header.capacity || !ValidHeader(header, header.capacity))
+		{
+			return false;
+		}
+		CopyRecords(file.data() + sizeof(header), header.capacity, header.tail, header.head, bytes, records);
+		return true;
+	}
+
+	bool DragTraceRecorder::Open(const std::filesystem::path& path, size_t capacity, int minDragX, int minDragY)
+	{
+		if (!m_ring.OpenFile(path, capacity))
+		{
+			return false;
+		}
+		m_config = { minDragX, minDragY };
+		m_enabled.store(true, std::memory_order_relaxed);
+		return true;
+	}
+
+	void DragTraceRecorder::Close()
+	{
+		m_enabled.store(false, std::memory_order_relaxed);
+		m_ring.Close();
+	}
+
+	void DragTraceRecorder::Pointer(uint32_t session, const PointerEvent& ev, uint8_t pressKind,
+		uint32_t device, PointerButton button)
+	{
+		if (!Enabled())
+		{
+			return;
+		}
+		// Every press repeats the thresholds, so a ring that wrapped still replays with them
+		if (ev.action == PointerAction::ButtonDown)
+		{
+			m_ring.Append(TraceRecordType::Config, session, &m_config, sizeof(m_config));
+		}
+		TracePointer pointer = { ev.time, ev.x, ev.y, ev.action, pressKind, (uint8_t)button, (uint16_t)device };
+		m_ring.Append(TraceRecordType::Pointer, session, &pointer, sizeof(pointer));
+	}
+
+	void DragTraceRecorder::ShellLookup(uint32_t session, uint64_t target, uint64_t shellWindow, uint8_t kind, bool tracked)
+	{
+		if (!Enabled())
+		{
+			return;
+		}
+		TraceShellLookup lookup = { target, shellWindow, kind, (uint8_t)tracked, {} };
+		m_ring.Append(TraceRecordType::ShellLookup, session, &lookup, sizeof(lookup));
+	}
+
+	void DragTraceRecorder::Selection(uint32_t session, const std::u16string& packed, uint32_t count, uint16_t stored, bool sniffed)
+	{
+		if (!Enabled())
+		{
+			return;
+		}
+		TraceSelection selection = { count, stored, (uint8_t)sniffed, 0 };
+		m_ring.Append(TraceRecordType::Selection, session, &selection, sizeof(selection),
+			packed.data(), packed.size() * sizeof(char16_t));
+	}
+
+	void DragTraceRecorder::VerdictReached(uint32_t session, Verdict verdict, VerdictSource source, uint32_t latencyMs)
+	{
+		if (!Enabled())
+		{
+			return;
+		}
+		TraceVerdict record = { verdict, source, {}, latencyMs };
+		m_ring.Append(TraceRecordType::Verdict, session, &record, sizeof(record));
+	}
+
+	DragTraceRecorder& SharedDragTrace()
+	{
+		static DragTraceRecorder recorder;
+		return recorder;
+	}
+
+	TracedSelection::TracedSelection(DragTraceRecorder& recorder, uint32_t session, bool sniffed)
+		: m_recorder(recorder), m_enabled(recorder.Enabled()), m_sniffed(sniffed), m_session(session), m_count(0), m_stored(0)
+	{
+	}
+
+	TracedSelection::~TracedSelection()
+	{
+		if (m_enabled)
+		{
+			m_recorder.Selection(m_session, m_packed, m_count, m_stored, m_sniffed);
+		}
+	}
+
+	void TracedSelection::Add(std::u16string_view path)
+	{
+		if (!m_enabled)
+		{
+			return;
+		}
+		m_count++;
+
+		// Paths are kept while the record stays under MaxRecord; later ones are only counted
+		const size_t room = (TraceRing::MaxRecord - sizeof(TraceRecordHeader) - sizeof(TraceSelection)) / sizeof(char16_t);
+		if (m_stored == m_count - 1 && m_packed.size() + path.size() + 1 <= room)
+		{
+			m_packed.append(path);
+			m_packed.push_back(u'\0');
+			m_stored++;
+		}
+	}
+
+	template <typename T>
+	static bool ReadPayload(const TraceRecord& record, T& value)
+	{
+		if (record.payloadSize < sizeof(T))
+		{
+			return false;
+		}
+		std::memcpy(&value, record.payload, sizeof(T));
+		return true;
+	}
+
+	TraceReplayStats ReplayDragTrace(const std::vector<TraceRecord>& records, const ReplayDetector& detect)
+	{
+		// What the replayed detection concluded for a session; Unknown when the trace alone
+		// cannot tell (tracker answer, content sniffing, paths cut off)
+		enum class Expected : uint8_t
+		{
+			Unsupported,
+			Supported,
+			Unknown
+		};
+
+		TraceReplayStats stats = {};
+		PointerTable table(256);
+		std::vector<uint32_t> recordedSessions(table.Capacity(), 0);   // per slot, as the hook numbered it
+		PointerSignal raised[PointerTable::ButtonCount];
+		std::unordered_set<uint32_t> pressed;   // sessions whose button down is in the trace
+		std::unordered_set<uint32_t> checked;   // sessions the replayed engine asked to check
+		std::unordered_map<uint32_t, Expected> expected;
+		std::vector<std::u16string_view> paths;
+
+		auto begin = std::chrono::steady_clock::now();
+		for (const TraceRecord& record : records)
+		{
+			stats.records++;
+			uint32_t session = record.header.session;
+			switch (record.header.type)
+			{
+			case TraceRecordType::Config:
+			{
+				TraceConfig config;
+				if (ReadPayload(record, config))
+				{
+					table.SetThreshold(config.minDragX, config.minDragY);
+				}
+				break;
+			}
+			case TraceRecordType::Pointer:
+			{
+				TracePointer pointer;
+				if (!ReadPayload(record, pointer))
+				{
+					break;
+				}
+				stats.pointerEvents++;
+
+				// Same order as the hook: press, then drop a press outside the shell
+				PointerEvent ev = { pointer.time, pointer.x, pointer.y, pointer.action };
+				PointerButton button = (PointerButton)pointer.button;
+				if (ev.action == PointerAction::ButtonDown)
+				{
+					pressed.insert(session);
+					uint32_t slot = table.Press(pointer.device, button, ev);
+					if (slot != PointerTable::NoSlot)
+					{
+						recordedSessions[slot] = session;
+						if (pointer.pressKind == 0)
+						{
+							table.Drop(slot);
+						}
+					}
+				}
+				else if (ev.action == PointerAction::Move)
+				{
+					size_t count = table.Move(pointer.device, ev, raised);
+					for (size_t i = 0; i < count; i++)
+					{
+						stats.checksReplayed++;
+						checked.insert(recordedSessions[raised[i].slot]);
+					}
+				}
+				else
+				{
+					table.Release(pointer.device, button);
+				}
+				break;
+			}
+			case TraceRecordType::ShellLookup:
+			{
+				TraceShellLookup lookup;
+				if (ReadPayload(record, lookup))
+				{
+					expected[session] = lookup.tracked ? Expected::Unknown : Expected::Unsupported;
+				}
+				break;
+			}
+			case TraceRecordType::Selection:
+			{
+				TraceSelection selection;
+				if (!ReadPayload(record, selection))
+				{
+					break;
+				}
+				if (selection.sniffed || selection.stored < selection.count)
+				{
+					expected[session] = Expected::Unknown;
+					break;
+				}
+
+				paths.clear();
+				const char16_t* text = (const char16_t*)(record.payload + sizeof(selection));
+				size_t units = (record.payloadSize - sizeof(selection)) / sizeof(char16_t);
+				size_t start = 0;
+				for (size_t i = 0; i < units && paths.size() < selection.stored; i++)
+				{
+					if (text[i] == u'\0')
+					{
+						paths.emplace_back(text + start, i - start);
+						start = i + 1;
+					}
+				}
+				expected[session] = paths.size() != selection.stored ? Expected::Unknown
+					: detect(paths) == Verdict::Supported ? Expected::Supported : Expected::Unsupported;
+				break;
+			}
+			case TraceRecordType::Verdict:
+			{
+				TraceVerdict verdict;
+				if (!ReadPayload(record, verdict) || pressed.count(session) == 0)
+				{
+					// Press already overwritten in the ring
+					break;
+				}
+				stats.checksRecorded++;
+				if (checked.count(session) == 0)
+				{
+					stats.gestureMismatches++;
+				}
+				if (verdict.verdict == Verdict::Cancelled)
+				{
+					break;
+				}
+
+				// A detection that gave up before reading any selection reported Unsupported
+				auto found = expected.find(session);
+				Expected replayed = found != expected.end() ? found->second : Expected::Unsupported;
+				if (replayed == Expected::Unknown)
+				{
+					break;
+				}
+				stats.verdictsCompared++;
+				if ((replayed == Expected::Supported) != (verdict.verdict == Verdict::Supported))
+				{
+					stats.verdictMismatches++;
+				}
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		stats.elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - begin).count();
+		return stats;
+	}
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "DragVerdict.h"
+#include "GestureEngine.h"
+#include "PointerTable.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary drag-session trace.
+// Raw hook events, shell window lookups, the selection each detection read and the verdicts
+// go into a fixed-size ring inside a memory-mapped file, so the last few minutes survive a
+// crash and the file never grows. Every record carries the gesture session id, which is
+// enough to re-drive the pointer table and the selection matching offline and compare the
+// replayed verdicts with the recorded ones.
+namespace SystemDrag
+{
+	enum class TraceRecordType : uint8_t
+	{
+		Pad,            // filler up to the end of the ring
+		Config,         // TraceConfig, written when the trace is opened
+		Pointer,        // TracePointer, every event the hook fed to the gesture state
+		ShellLookup,    // TraceShellLookup, one per detection
+		Selection,      // TraceSelection + UTF-16 paths, NUL separated
+		Verdict         // TraceVerdict
+	};
+
+	struct TraceRecordHeader
+	{
+		uint32_t size;          // whole record including this header, multiple of 8
+		TraceRecordType type;
+		uint8_t reserved[3];
+		uint32_t session;
+		uint32_t reserved2;
+		uint64_t timeUs;        // steady clock of the recording process
+	};
+
+	struct TraceConfig
+	{
+		int32_t minDragX;
+		int32_t minDragY;
+	};
+
+	struct TracePointer
+	{
+		uint32_t time;          // MSLLHOOKSTRUCT::time
+		int32_t x;
+		int32_t y;
+		PointerAction action;
+		uint8_t pressKind;      // ShellKind under a button down, 0 otherwise
+		uint8_t button;         // PointerButton; traces before multi-pointer tracking hold 0 (left)
+		uint16_t device;        // MouseDevice, PenDevice() or TouchDevice()
+	};
+
+	struct TraceShellLookup
+	{
+		uint64_t target;        // window under the cursor
+		uint64_t shellWindow;   // its shell ancestor, 0 if none
+		uint8_t kind;           // ShellKind
+		uint8_t tracked;        // answered from the selection tracker
+		uint8_t reserved[6];
+	};
+
+	struct TraceSelection
+	{
+		uint32_t count;         // paths read by the detection
+		uint16_t stored;        // paths that fit into the record
+		uint8_t sniffed;        // decided by file content, not replayable from the paths
+		uint8_t reserved;
+	};
+
+	enum class VerdictSource : uint8_t
+	{
+		Detected,       // on demand at the check
+		Speculative     // prefetched at the press and committed at the check
+	};
+
+	struct TraceVerdict
+	{
+		Verdict verdict;
+		VerdictSource source;
+		uint8_t reserved[2];
+		uint32_t latencyMs;     // from the triggering hook event
+	};
+
+	// One record as read back; payload points into the reader's copy
+	struct TraceRecord
+	{
+		TraceRecordHeader header;
+		const uint8_t* payload;
+		size_t payloadSize;
+	};
+
+	struct TraceFileHeader;
+
+	class TraceRing
+	{
+	public:
+		// Records larger than this are truncated by the writers (selection paths)
+		static constexpr size_t MaxRecord = 4096;
+
+		TraceRing();
+		~TraceRing();
+
+		TraceRing(const TraceRing&) = delete;
+		TraceRing& operator=(const TraceRing&) = delete;
+
+		// Maps path with room for capacity bytes of records; an existing trace of the same
+		// capacity is continued, anything else is reset
+		bool OpenFile(const std::filesystem::path& path, size_t capacity);
+		// Same ring in anonymous memory
+		void OpenMemory(size_t capacity);
+		void Close();
+		bool IsOpen() const { return m_header != nullptr; }
+
+		// Thread safe; false if the ring is closed or the record does not fit
+		bool Append(TraceRecordType type, uint32_t session, const void* payload, size_t size);
+		bool Append(TraceRecordType type, uint32_t session, const void* payload, size_t size,
+			const void* tail, size_t tailSize);
+
+		// Oldest to newest, copied out under the lock; payloads point into bytes
+		void Snapshot(std::vector<uint8_t>& bytes, std::vector<TraceRecord>& records);
+
+		uint64_t Written() const;
+		uint64_t Overwritten() const;
+
+	private:
+		uint8_t* Slot(uint64_t position) const { return m_data + position % m_capacity; }
+		void Reset();
+		void Attach(uint8_t* view, uint64_t capacity);
+		uint64_t Span(uint64_t position, bool& pad) const;
+
+		TraceFileHeader* m_header;
+		uint8_t* m_data;
+		uint64_t m_capacity;
+		std::vector<uint8_t> m_memory;
+		intptr_t m_file;     // HANDLE or file descriptor, -1 when not mapped
+		void* m_mapping;
+		size_t m_mappedSize;
+		mutable std::mutex m_mutex;
+	};
+
+	// Reads a trace file without mapping it for writing
+	bool LoadTraceFile(const std::filesystem::path& path, std::vector<uint8_t>& bytes, std::vector<TraceRecord>& records);
+
+	// Recorder used by the hook and the detectors; does nothing until opened
+	class DragTraceRecorder
+	{
+	public:
+		DragTraceRecorder() : m_enabled(false), m_config{ 0, 0 } {}
+
+		bool Open(const std::filesystem::path& path, size_t capacity, int minDragX, int minDragY);
+		void Close();
+		bool Enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+		// session is the pointer's session for presses and releases, 0 for moves
+		void Pointer(uint32_t session, const PointerEvent& ev, uint8_t pressKind,
+			uint32_t device = MouseDevice, PointerButton button = PointerButton::Left);
+		void ShellLookup(uint32_t session, uint64_t target, uint64_t shellWindow, uint8_t kind, bool tracked);
+		// packed: stored paths, each followed by a NUL
+		void Selection(uint32_t session, const std::u16string& packed, uint32_t count, uint16_t stored, bool sniffed);
+		void VerdictReached(uint32_t session, Verdict verdict, VerdictSource source, uint32_t latencyMs);
+
+		TraceRing& Ring() { return m_ring; }
+
+	private:
+		std::atomic<bool> m_enabled;
+		TraceConfig m_config;
+		TraceRing m_ring;
+	};
+
+	DragTraceRecorder& SharedDragTrace();
+
+	// Collects the paths one detection reads and records them when it goes out of scope,
+	// whichever way the detection returns
+	class TracedSelection
+	{
+	public:
+		TracedSelection(DragTraceRecorder& recorder, uint32_t session, bool sniffed);
+		~TracedSelection();
+
+		void Add(std::u16string_view path);
+
+	private:
+		DragTraceRecorder& m_recorder;
+		bool m_enabled;
+		bool m_sniffed;
+		uint32_t m_session;
+		uint32_t m_count;
+		uint16_t m_stored;
+		std::u16string m_packed;
+	};
+
+	struct TraceReplayStats
+	{
+		uint64_t records;
+		uint64_t pointerEvents;
+		uint64_t checksReplayed;    // CheckRequested raised by the replayed PointerTable
+		uint64_t checksRecorded;    // sessions with a recorded verdict
+		uint64_t gestureMismatches; // recorded verdicts for sessions the replay never checked
+		uint64_t verdictsCompared;
+		uint64_t verdictMismatches;
+		double elapsedNs;
+	};
+
+	// Detection as replayed: decides from the paths the recorded detection read
+	typedef std::function<Verdict(const std::vector<std::u16string_view>& paths)> ReplayDetector;
+
+	// Re-drives a PointerTable from the pointer records and the detector from the selection
+	// records; verdicts answered by the tracker or cancelled are not compared
+	TraceReplayStats ReplayDragTrace(const std::vector<TraceRecord>& records, const ReplayDetector& detect);
+}
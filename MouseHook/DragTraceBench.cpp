@@ -0,0 +1,165 @@
+#include "DragTrace.h"
+#include "ExtensionPolicy.h"
+#include "GestureReplay.h"
+#include "ShellAncestry.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Drag trace recording and replay without a desktop. A fake hook drives GestureEngine
+// over synthetic gestures and writes what Hook.cpp writes: the pointer events, a shell
+// lookup and the selection read for every check, and the verdict, decided by the
+// extension policy over fake selections. Part of the presses land outside the shell and
+// part of the checks are answered by the tracker. The ring is small enough to wrap many
+// times. The file is then reloaded and replayed, once with the same policy (no mismatch
+// allowed) and once with a detector that rejects everything (mismatches must show up).
+namespace SystemDrag
+{
+	static void PrintReplay(const char* name, const TraceReplayStats& stats)
+	{
+		std::cout << name << ": " << stats.records << " records, " << stats.pointerEvents << " pointer events, checks "
+			<< stats.checksReplayed << " replayed / " << stats.checksRecorded << " recorded, gesture mismatches "
+			<< stats.gestureMismatches << ", verdicts compared " << stats.verdictsCompared << ", mismatches "
+			<< stats.verdictMismatches << ", " << stats.elapsedNs / (stats.records ? stats.records : 1)
+			<< " ns/record" << std::endl;
+	}
+
+	static Verdict PolicyDetector(const std::vector<std::u16string_view>& paths)
+	{
+		for (std::u16string_view path : paths)
+		{
+			if (SharedExtensionPolicy().MatchPath(path))
+			{
+				return Verdict::Supported;
+			}
+		}
+		return Verdict::Unsupported;
+	}
+
+	// Records a synthetic session log; returns the number of records written
+	static uint64_t RecordSynthetic(DragTraceRecorder& recorder, size_t gestures, uint32_t seed)
+	{
+		static const char16_t* const names[] = { u"report.docx", u"notes.txt", u"photo.png", u"archive.zip",
+			u"slides.PPTX", u"readme", u"data.csv", u"movie.mkv", u"sheet.xlsx", u"scan.pdf" };
+		std::mt19937 rng(seed);
+		std::vector<PointerEvent> events = MakeSyntheticGestures(gestures, 16, 30, seed);
+		GestureEngine engine(4, 4);
+
+		for (const PointerEvent& ev : events)
+		{
+			unsigned signals = engine.Feed(ev);
+			uint8_t pressKind = 0;
+			if (ev.action == PointerAction::ButtonDown)
+			{
+				pressKind = rng() % 5 == 0 ? (uint8_t)ShellKind::None : (uint8_t)ShellKind::Explorer;
+				if (pressKind == (uint8_t)ShellKind::None)
+				{
+					engine.Reset();
+				}
+			}
+			recorder.Pointer(engine.SessionId(), ev, pressKind);
+
+			if (signals & GestureCheckRequested)
+			{
+				uint32_t session = engine.SessionId();
+				bool tracked = rng() % 10 == 0;
+				recorder.ShellLookup(session, 0x10000 + session, 0x20000, (uint8_t)ShellKind::Explorer, tracked);
+
+				Verdict verdict = Verdict::Unsupported;
+				if (tracked)
+				{
+					verdict = rng() % 2 ? Verdict::Supported : Verdict::Unsupported;
+				}
+				else
+				{
+					// Reads up to the first match, like ShellSelectionSource
+					TracedSelection traced(recorder, session, false);
+					size_t selected = 1 + rng() % 6;
+					for (size_t i = 0; i < selected; i++)
+					{
+						std::u16string path = u"C:\\Users\\someone\\Documents\\" + std::u16string(names[rng() % 10]);
+						traced.Add(path);
+						if (SharedExtensionPolicy().MatchPath(std::u16string_view(path)))
+						{
+							verdict = Verdict::Supported;
+							break;
+						}
+					}
+				}
+				recorder.VerdictReached(session, verdict, VerdictSource::Detected, rng() % 40);
+			}
+		}
+		return recorder.Ring().Written();
+	}
+
+	// Command line entry: DragTraceBenchMain [trace file to replay] [gestures] [ring bytes]
+	int DragTraceBenchMain(int argc, char* argv[])
+	{
+		std::vector<uint8_t> bytes;
+		std::vector<TraceRecord> records;
+		if (argc > 1 && std::string(argv[1]) != "-")
+		{
+			if (!LoadTraceFile(argv[1], bytes, records))
+			{
+				std::cerr << "Failed to load trace: " << argv[1] << std::endl;
+				return 1;
+			}
+			TraceReplayStats stats = ReplayDragTrace(records, PolicyDetector);
+			PrintReplay(argv[1], stats);
+			return stats.gestureMismatches == 0 && stats.verdictMismatches == 0 ? 0 : 1;
+		}
+
+		size_t gestures = argc > 2 ? (size_t)std::atoi(argv[2]) : 200000;
+		size_t ringBytes = argc > 3 ? (size_t)std::atoi(argv[3]) : 4 << 20;
+		std::filesystem::path path = std::filesystem::temp_directory_path() / "dragtrace-bench.bin";
+		std::filesystem::remove(path);
+
+		DragTraceRecorder recorder;
+		if (!recorder.Open(path, ringBytes, 4, 4))
+		{
+			std::cerr << "Failed to map trace: " << path.string() << std::endl;
+			return 1;
+		}
+		auto t0 = std::chrono::steady_clock::now();
+		uint64_t written = RecordSynthetic(recorder, gestures, 17);
+		double recordNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+		uint64_t overwritten = recorder.Ring().Overwritten();
+		recorder.Close();
+		std::cout << "recorded " << written << " records (" << overwritten << " overwritten by the ring), "
+			<< recordNs / written << " ns/record including the fake hook" << std::endl;
+
+		bool correct = LoadTraceFile(path, bytes, records) && !records.empty();
+		TraceReplayStats same = ReplayDragTrace(records, PolicyDetector);
+		PrintReplay("same policy", same);
+		TraceReplayStats changed = ReplayDragTrace(records,
+			[](const std::vector<std::u16string_view>&) { return Verdict::Unsupported; });
+		PrintReplay("reject all", changed);
+
+		correct = correct && same.gestureMismatches == 0 && same.verdictMismatches == 0 && same.verdictsCompared > 0
+			&& changed.verdictMismatches > 0 && written - overwritten == same.records;
+
+		// Continuing an existing file keeps what is there
+		DragTraceRecorder reopened;
+		if (!reopened.Open(path, ringBytes, 4, 4))
+		{
+			correct = false;
+		}
+		else
+		{
+			std::vector<uint8_t> again;
+			std::vector<TraceRecord> continued;
+			reopened.Ring().Snapshot(again, continued);
+			correct = correct && continued.size() == records.size();
+			reopened.Close();
+		}
+		std::filesystem::remove(path);
+
+		std::cout << (correct ? "replay ok" : "replay WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Drag verdicts as cancellable jobs.
+// The hook publishes which drag session is live; a detection job carries the session id
+// it was started for and polls its CancelToken between COM steps. Releasing the button or
+// starting a new press retires the session, so the job stops at the next step and a
+// result that still arrives late is recognised as stale and dropped.
+namespace SystemDrag
+{
+	enum class Verdict : uint8_t
+	{
+		Unsupported,
+		Supported,
+		Cancelled
+	};
+
+	class DragSessionGate
+	{
+	public:
+		DragSessionGate() : m_active(0) {}
+
+		// Hook side: the session crossed the drag threshold
+		void Begin(uint32_t session) { m_active.store(session, std::memory_order_release); }
+		// Hook side: button released or a new press started
+		void End() { m_active.store(0, std::memory_order_release); }
+
+		bool IsLive(uint32_t session) const
+		{
+			return session != 0 && m_active.load(std::memory_order_acquire) == session;
+		}
+
+	private:
+		std::atomic<uint32_t> m_active;
+	};
+
+	class CancelToken
+	{
+	public:
+		CancelToken() : m_gate(nullptr), m_session(0) {}
+		CancelToken(const DragSessionGate& gate, uint32_t session) : m_gate(&gate), m_session(session) {}
+
+		// A default token (no gate) is never cancelled, for callers outside the hook flow
+		bool Cancelled() const { return m_gate != nullptr && !m_gate->IsLive(m_session); }
+		uint32_t Session() const { return m_session; }
+
+	private:
+		const DragSessionGate* m_gate;
+		uint32_t m_session;
+	};
+
+	// Consumer side bookkeeping
+	struct VerdictStats
+	{
+		uint64_t started;
+		uint64_t completed;
+		uint64_t cancelled;      // stopped between steps
+		uint64_t skipped;        // session already over before the job started
+		uint64_t staleDropped;   // finished, but the session ended meanwhile
+	};
+}
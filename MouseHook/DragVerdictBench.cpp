@@ -0,0 +1,289 @@
+#include "DetectionExecutor.h"
+#include "DragVerdict.h"
+#include "PointerTable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Cancellation latency of a drag verdict: a fake detector made of slow steps (standing in
+// for the cross-process COM calls) polls its CancelToken between steps while the "hook"
+// ends the session after a random delay. Reports how long the job keeps running after
+// the release, which is bounded by one step instead of the whole detection. Checked: a
+// cancelled job stops within one step of the release, and a job whose session was released
+// before it reported never reports Supported. The same checks run a second time through the
+// hook's own path: presses and releases go through a PointerTable, the check request is
+// posted to a DetectionExecutor and the job polls the table's drag gate, with steps of
+// uneven length.
+namespace SystemDrag
+{
+	static void Spin(std::chrono::microseconds cost)
+	{
+		auto until = std::chrono::steady_clock::now() + cost;
+		while (std::chrono::steady_clock::now() < until)
+		{
+		}
+	}
+
+	static Verdict FakeDetect(const CancelToken& token, int steps, std::chrono::microseconds stepCost,
+		std::atomic<int>& progress)
+	{
+		for (int i = 0; i < steps; i++)
+		{
+			Spin(stepCost);
+			progress.store(i + 1, std::memory_order_release);
+			if (token.Cancelled())
+			{
+				return Verdict::Cancelled;
+			}
+		}
+		return Verdict::Supported;
+	}
+
+	// What HookDetectionHandler does with a check request, over a detector whose COM calls
+	// mostly answer at once and now and then wait on a busy Explorer: a tenth of the step
+	// cost, the step cost or four times it, drawn per session
+	class UnevenDetectionHandler : public IDetectionHandler
+	{
+	public:
+		UnevenDetectionHandler(const PointerTable& pointers, int steps, std::chrono::microseconds stepCost)
+			: m_pointers(pointers), m_steps(steps), m_stepCost(stepCost), m_stats(), m_progress(0), m_released(0),
+			m_finished(0), m_supportedAfterRelease(0)
+		{
+		}
+
+		void Run(size_t, const DragEventRecord& record) override
+		{
+			if (record.kind == DragEventKind::CheckRequested)
+			{
+				Check(record.sessionId, CancelToken(m_pointers.DragGate(record.pointer), record.sessionId));
+			}
+			m_finished.store(record.sessionId, std::memory_order_release);
+		}
+
+		// Hook side
+		void Released(uint32_t session) { m_released.store(session, std::memory_order_release); }
+		uint32_t Finished() const { return m_finished.load(std::memory_order_acquire); }
+		// Steps the job of session has finished so far
+		int Progress(uint32_t session) const
+		{
+			uint64_t progress = m_progress.load(std::memory_order_acquire);
+			return (uint32_t)(progress >> 32) == session ? (int)(uint32_t)progress : 0;
+		}
+
+		// Read once the executor has stopped
+		const VerdictStats& Stats() const { return m_stats; }
+		int SupportedAfterRelease() const { return m_supportedAfterRelease; }
+
+	private:
+		void Check(uint32_t session, const CancelToken& token)
+		{
+			if (token.Cancelled())
+			{
+				m_stats.skipped++;
+				return;
+			}
+
+			m_stats.started++;
+			std::mt19937 rng(session);
+			std::discrete_distribution<int> pick({ 6, 3, 1 });
+			const int tenths[] = { 1, 10, 40 };
+			for (int i = 0; i < m_steps; i++)
+			{
+				Spin(m_stepCost * tenths[pick(rng)] / 10);
+				m_progress.store((uint64_t)session << 32 | (uint32_t)(i + 1), std::memory_order_release);
+				if (token.Cancelled())
+				{
+					m_stats.cancelled++;
+					return;
+				}
+			}
+
+			bool releasedBefore = m_released.load(std::memory_order_acquire) == session;
+			if (token.Cancelled())
+			{
+				m_stats.staleDropped++;
+				return;
+			}
+			m_stats.completed++;
+			m_supportedAfterRelease += releasedBefore;
+		}
+
+		const PointerTable& m_pointers;
+		int m_steps;
+		std::chrono::microseconds m_stepCost;
+		VerdictStats m_stats;
+		std::atomic<uint64_t> m_progress;   // session << 32 | steps done
+		std::atomic<uint32_t> m_released;
+		std::atomic<uint32_t> m_finished;
+		int m_supportedAfterRelease;
+	};
+
+	static bool CheckExecutorCancellation(int jobs, int steps, std::chrono::microseconds stepCost)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		PointerTable pointers(4);
+		UnevenDetectionHandler handler(pointers, steps, stepCost);
+		DetectionLatency latency;
+		DetectionExecutor executor(1, [](size_t) { return std::unique_ptr<IApartment>(new CondVarApartment()); },
+			handler, latency);
+		if (!executor.Start())
+		{
+			std::cout << "executor: Start failed" << std::endl;
+			return false;
+		}
+
+		std::mt19937 rng(13);
+		std::uniform_int_distribution<int> releaseAfter(0, (int)(steps * stepCost.count() * 2));
+		int maxStepsAfterRelease = 0;
+		int lateCancels = 0;
+		int lost = 0;
+		for (int job = 0; job < jobs; job++)
+		{
+			// Press, cross the threshold, post the check like the hook does
+			uint32_t time = (uint32_t)job * 1000;
+			PointerEvent down = { time, 100, 100, PointerAction::ButtonDown };
+			PointerEvent move = { time + 10, 120, 100, PointerAction::Move };
+			uint32_t slot = pointers.Press(MouseDevice, PointerButton::Left, down);
+			PointerSignal signals[PointerTable::ButtonCount];
+			if (slot == PointerTable::NoSlot || pointers.Move(MouseDevice, move, signals) != 1
+				|| (signals[0].signals & GestureCheckRequested) == 0)
+			{
+				lost++;
+				continue;
+			}
+			uint32_t session = signals[0].sessionId;
+			DragEventRecord record = { session, move.time, move.x, move.y, DragEventKind::CheckRequested, (uint16_t)slot };
+			if (!executor.Post(record))
+			{
+				lost++;
+				continue;
+			}
+
+			auto releaseAt = Clock::now() + std::chrono::microseconds(releaseAfter(rng));
+			while (Clock::now() < releaseAt && handler.Finished() != session)
+			{
+				std::this_thread::yield();
+			}
+			pointers.Release(MouseDevice, PointerButton::Left);
+			handler.Released(session);
+			int stepsAtRelease = handler.Progress(session);
+
+			while (handler.Finished() != session)
+			{
+				std::this_thread::yield();
+			}
+			int after = handler.Progress(session) - stepsAtRelease;
+			maxStepsAfterRelease = std::max(maxStepsAfterRelease, after);
+			lateCancels += after > 1;
+		}
+		executor.Stop();
+
+		const VerdictStats& stats = handler.Stats();
+		bool correct = lost == 0 && lateCancels == 0 && handler.SupportedAfterRelease() == 0
+			&& stats.skipped + stats.started == (uint64_t)jobs;
+		std::cout << "executor, uneven steps: jobs " << jobs << ": completed " << stats.completed << ", cancelled "
+			<< stats.cancelled << ", skipped " << stats.skipped << ", stale " << stats.staleDropped << ", lost " << lost
+			<< std::endl;
+		std::cout << "executor steps after release: max " << maxStepsAfterRelease << ", over one step " << lateCancels
+			<< ", Supported after release " << handler.SupportedAfterRelease() << std::endl;
+		return correct;
+	}
+
+	// Command line entry: VerdictBenchMain [jobs] [steps] [step-us]
+	int VerdictBenchMain(int argc, char* argv[])
+	{
+		int jobs = argc > 1 ? std::atoi(argv[1]) : 200;
+		int steps = argc > 2 ? std::atoi(argv[2]) : 20;
+		std::chrono::microseconds stepCost(argc > 3 ? std::atoi(argv[3]) : 500);
+		typedef std::chrono::steady_clock Clock;
+
+		DragSessionGate gate;
+		VerdictStats stats = {};
+		std::vector<double> latencyUs;
+		std::mt19937 rng(11);
+		std::uniform_int_distribution<int> releaseAfter(0, (int)(steps * stepCost.count() * 2));
+		int maxStepsAfterRelease = 0;
+		int lateCancels = 0;
+		int supportedAfterRelease = 0;
+
+		for (int job = 1; job <= jobs; job++)
+		{
+			uint32_t session = (uint32_t)job;
+			gate.Begin(session);
+
+			std::atomic<bool> done(false);
+			std::atomic<bool> released(false);
+			std::atomic<int> progress(0);
+			Verdict verdict = Verdict::Unsupported;
+			bool reportedAfterRelease = false;
+			Clock::time_point finished;
+			std::thread worker([&]()
+			{
+				CancelToken token(gate, session);
+				verdict = FakeDetect(token, steps, stepCost, progress);
+				finished = Clock::now();
+
+				// The consumer's last check before reporting; once the release is visible
+				// the token has to say so
+				bool releasedBefore = released.load(std::memory_order_acquire);
+				reportedAfterRelease = releasedBefore && verdict == Verdict::Supported && !token.Cancelled();
+				done.store(true, std::memory_order_release);
+			});
+
+			// The hook side: the button goes up after a random delay, possibly after the job is done
+			auto releaseAt = Clock::now() + std::chrono::microseconds(releaseAfter(rng));
+			while (Clock::now() < releaseAt && !done.load(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+			}
+			Clock::time_point releaseTime = Clock::now();
+			gate.End();
+			released.store(true, std::memory_order_release);
+			int stepsAtRelease = progress.load(std::memory_order_acquire);
+			worker.join();
+
+			stats.started++;
+			supportedAfterRelease += reportedAfterRelease;
+			if (verdict == Verdict::Cancelled)
+			{
+				stats.cancelled++;
+				latencyUs.push_back(std::chrono::duration<double, std::micro>(finished - releaseTime).count());
+
+				int after = progress.load(std::memory_order_relaxed) - stepsAtRelease;
+				maxStepsAfterRelease = std::max(maxStepsAfterRelease, after);
+				lateCancels += after > 1;
+			}
+			else if (finished > releaseTime)
+			{
+				stats.staleDropped++;
+			}
+			else
+			{
+				stats.completed++;
+			}
+		}
+
+		std::cout << "jobs " << stats.started << ": completed " << stats.completed << ", cancelled "
+			<< stats.cancelled << ", stale " << stats.staleDropped << std::endl;
+		std::cout << "uncancelled detection would take " << steps * stepCost.count() << " us" << std::endl;
+		if (!latencyUs.empty())
+		{
+			std::sort(latencyUs.begin(), latencyUs.end());
+			std::cout << "release -> cancelled: p50 " << latencyUs[latencyUs.size() / 2] << " us, p99 "
+				<< latencyUs[latencyUs.size() * 99 / 100] << " us, max " << latencyUs.back() << " us" << std::endl;
+		}
+
+		std::cout << "steps after release: max " << maxStepsAfterRelease << ", over one step " << lateCancels
+			<< ", Supported after release " << supportedAfterRelease << std::endl;
+		bool correct = CheckExecutorCancellation(jobs, steps, stepCost) && lateCancels == 0 && supportedAfterRelease == 0;
+		std::cout << (correct ? "verdict ok" : "verdict WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
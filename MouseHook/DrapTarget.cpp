@@ -4,6 +4,9 @@
 #include <string>
 #include <iostream>
 
+#include "DropFiles.h"
+#include "ShellIdList.h"
+
 class DropTarget : public IDropTarget {
 private:
 	ULONG m_refCount;
@@ -40,6 +43,7 @@ public:
 
 		// ݸʽ
 		FORMATETC fmtetc = { CF_HDROP, nullptr, DVASPECT_CONTENT, -1, TYMED_HGLOBAL };
+		FORMATETC shellIdListFormat = { (CLIPFORMAT)RegisterClipboardFormat(CFSTR_SHELLIDLIST), nullptr, DVASPECT_CONTENT, -1, TYMED_HGLOBAL };
 		if (SUCCEEDED(pDataObj->QueryGetData(&fmtetc))) {
 			std::cout << "File drag detected" << std::endl;
 			*pdwEffect = DROPEFFECT_COPY;
@@ -47,6 +51,12 @@ public:
 			// ȡļϢ
 			ExtractFileInfoFromDataObject(pDataObj);
 		}
+		else if (SUCCEEDED(pDataObj->QueryGetData(&shellIdListFormat))) {
+			// ⡢ѹļСֻֻ shell item ID
+			std::cout << "Shell item drag detected" << std::endl;
+			*pdwEffect = DROPEFFECT_COPY;
+			ExtractShellItemsFromDataObject(pDataObj, shellIdListFormat);
+		}
 		else {
 			std::cout << "No file data available" << std::endl;
 			*pdwEffect = DROPEFFECT_NONE;
@@ -78,19 +88,49 @@ private:
 
 		HRESULT hr = pDataObj->GetData(&fmtetc, &stgmed);
 		if (SUCCEEDED(hr)) {
-			HDROP hDrop = static_cast<HDROP>(GlobalLock(stgmed.hGlobal));
-			if (hDrop) {
-				UINT fileCount = DragQueryFile(hDrop, 0xFFFFFFFF, nullptr, 0);
-				std::cout << "Files being dragged: " << fileCount << std::endl;
-
-				for (UINT i = 0; i < fileCount; i++) {
-					UINT pathLength = DragQueryFile(hDrop, i, nullptr, 0);
-					if (pathLength > 0) {
-						std::vector<TCHAR> buffer(pathLength + 1);
-						DragQueryFile(hDrop, i, buffer.data(), pathLength + 1);
-						std::wstring filePath(buffer.data());
-						std::wcout << L"File " << (i + 1) << L": " << filePath << std::endl;
+			void* dropData = GlobalLock(stgmed.hGlobal);
+			if (dropData) {
+				// ֱӶ DROPFILES ڴ棬·
+				SystemDrag::DropFilesView dropFiles;
+				SystemDrag::DropFilesView::Parse(dropData, GlobalSize(stgmed.hGlobal), dropFiles);
+				std::cout << "Files being dragged: " << dropFiles.size() << std::endl;
+
+				size_t i = 0;
+				for (std::u16string_view filePath : dropFiles.WidePaths()) {
+					std::wcout << L"File " << ++i << L": " << SystemDrag::AsWide(filePath) << std::endl;
+				}
+				for (std::string_view filePath : dropFiles.AnsiPaths()) {
+					std::cout << "File " << ++i << ": " << filePath << std::endl;
+				}
+				GlobalUnlock(stgmed.hGlobal);
+			}
+			ReleaseStgMedium(&stgmed);
+		}
+	}
+
+	//  item ID ֱӶ֣ shell 󶨣ļϵͳ item ֻ
+	void ExtractShellItemsFromDataObject(IDataObject* pDataObj, FORMATETC& fmtetc) {
+		STGMEDIUM stgmed;
+
+		HRESULT hr = pDataObj->GetData(&fmtetc, &stgmed);
+		if (SUCCEEDED(hr)) {
+			void* idListData = GlobalLock(stgmed.hGlobal);
+			if (idListData) {
+				SystemDrag::ShellIdListView items;
+				SystemDrag::ShellIdListView::Parse(idListData, GlobalSize(stgmed.hGlobal), items);
+				std::cout << "Shell items being dragged: " << items.size() << std::endl;
+
+				size_t others = 0;
+				for (size_t i = 0; i < items.size(); i++) {
+					SystemDrag::ShellItem item = items.Item(i);
+					if (item.kind == SystemDrag::ShellItemKind::Other) {
+						others++;
+						continue;
 					}
+					std::wcout << L"Item " << (i + 1) << L": " << SystemDrag::AsWide(item.name) << std::endl;
+				}
+				if (others > 0) {
+					std::cout << others << " items need the shell to be named" << std::endl;
 				}
 				GlobalUnlock(stgmed.hGlobal);
 			}
@@ -0,0 +1,76 @@
+#include "DropFiles.h"
+
+#include <cstring>
+
+namespace SystemDrag
+{
+	// Counts the paths up to the empty one, -1 if any of them runs past end
+	template <typename CharT>
+	static int64_t CountPaths(const CharT* current, const CharT* end)
+	{
+		int64_t count = 0;
+		for (;;)
+		{
+			const CharT* start = current;
+			while (current < end && *current != 0)
+			{
+				current++;
+			}
+			if (current == end)
+			{
+				return -1;
+			}
+			if (current == start)
+			{
+				return count;
+			}
+			count++;
+			current++;
+		}
+	}
+
+	DropFilesView::Status DropFilesView::Parse(const void* data, size_t size, DropFilesView& view)
+	{
+		view = DropFilesView();
+		if (data == nullptr || size < HeaderSize)
+		{
+			return Status::TooSmall;
+		}
+
+		// The block comes from GlobalLock, but read the header without assuming alignment
+		const uint8_t* bytes = (const uint8_t*)data;
+		uint32_t offset = 0;
+		uint32_t wide = 0;
+		std::memcpy(&offset, bytes, sizeof(offset));
+		std::memcpy(&wide, bytes + 16, sizeof(wide));
+		if (offset < HeaderSize || offset >= size)
+		{
+			return Status::BadOffset;
+		}
+
+		int64_t count = 0;
+		if (wide != 0)
+		{
+			if (((uintptr_t)(bytes + offset) & 1) != 0)
+			{
+				return Status::BadOffset;
+			}
+			const char16_t* first = (const char16_t*)(bytes + offset);
+			count = CountPaths(first, first + (size - offset) / sizeof(char16_t));
+		}
+		else
+		{
+			const char* first = (const char*)(bytes + offset);
+			count = CountPaths(first, first + (size - offset));
+		}
+		if (count < 0)
+		{
+			return Status::Unterminated;
+		}
+
+		view.m_wide = wide != 0;
+		view.m_count = (size_t)count;
+		view.m_files = bytes + offset;
+		return Status::Ok;
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+// Zero-copy reader for the DROPFILES block behind CF_HDROP.
+// DragQueryFile walks the list from the start on every call, and the usual length-then-copy
+// pair makes a drop of n files cost O(n^2) plus two allocations per file. The block is just
+// a 20-byte header followed by NUL-separated paths ending in an empty one, so this walks it
+// once, checks every path ends inside the block, and hands out views into the locked memory.
+// No Windows headers needed, so blobs can be built and fuzzed anywhere.
+namespace SystemDrag
+{
+	// Paths of one layout; iterating yields views that stay valid while the block is locked
+	template <typename CharT>
+	class DropPathRange
+	{
+	public:
+		class iterator
+		{
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef std::basic_string_view<CharT> value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const value_type* pointer;
+			typedef value_type reference;
+
+			iterator() : m_current(nullptr) {}
+			explicit iterator(const CharT* current) : m_current(current) { Load(); }
+
+			value_type operator*() const { return m_path; }
+			iterator& operator++()
+			{
+				m_current += m_path.size() + 1;
+				Load();
+				return *this;
+			}
+			iterator operator++(int)
+			{
+				iterator previous = *this;
+				++*this;
+				return previous;
+			}
+			bool operator==(const iterator& other) const { return m_current == other.m_current; }
+			bool operator!=(const iterator& other) const { return m_current != other.m_current; }
+
+		private:
+			// The empty path that ends the list becomes the end iterator
+			void Load()
+			{
+				m_path = m_current != nullptr ? value_type(m_current) : value_type();
+				if (m_path.empty())
+				{
+					m_current = nullptr;
+				}
+			}
+
+			const CharT* m_current;
+			value_type m_path;
+		};
+
+		DropPathRange() : m_first(nullptr) {}
+		explicit DropPathRange(const CharT* first) : m_first(first) {}
+
+		iterator begin() const { return iterator(m_first); }
+		iterator end() const { return iterator(); }
+
+	private:
+		const CharT* m_first;
+	};
+
+	class DropFilesView
+	{
+	public:
+		enum class Status
+		{
+			Ok,
+			TooSmall,       // shorter than the DROPFILES header
+			BadOffset,      // pFiles outside the block, or odd for the wide layout
+			Unterminated    // the list runs off the end of the block
+		};
+
+		// Byte layout of DROPFILES: DWORD pFiles, POINT pt, BOOL fNC, BOOL fWide
+		static constexpr size_t HeaderSize = 20;
+
+		DropFilesView() : m_wide(false), m_count(0), m_files(nullptr) {}
+
+		// size is what GlobalSize reports; nothing outside [data, data + size) is read
+		static Status Parse(const void* data, size_t size, DropFilesView& view);
+
+		bool Wide() const { return m_wide; }
+		size_t size() const { return m_count; }
+
+		// Only the one matching Wide() is meaningful; the other one is empty
+		DropPathRange<char16_t> WidePaths() const
+		{
+			return m_wide ? DropPathRange<char16_t>((const char16_t*)m_files) : DropPathRange<char16_t>();
+		}
+		DropPathRange<char> AnsiPaths() const
+		{
+			return m_wide ? DropPathRange<char>() : DropPathRange<char>((const char*)m_files);
+		}
+
+	private:
+		bool m_wide;
+		size_t m_count;
+		const void* m_files;
+	};
+
+#ifdef _WIN32
+	// wchar_t is UTF-16 on Windows, so wide paths can be handed to Win32 as they are
+	inline std::wstring_view AsWide(std::u16string_view path)
+	{
+		return std::wstring_view(reinterpret_cast<const wchar_t*>(path.data()), path.size());
+	}
+#endif
+}
@@ -0,0 +1,209 @@
+#include "DropFiles.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// DROPFILES parser on synthetic blobs: round trip of both layouts, the DragQueryFile pattern
+// it replaces (walk to path i, once for the length and once for the copy, then a vector and
+// a wstring per file), and a fuzz pass over truncated and mutated blobs. Run the fuzz pass
+// under AddressSanitizer to catch reads outside the block.
+namespace SystemDrag
+{
+	template <typename CharT>
+	static std::vector<uint8_t> BuildDropFiles(const std::vector<std::basic_string<CharT>>& paths)
+	{
+		std::vector<uint8_t> blob(DropFilesView::HeaderSize, 0);
+		uint32_t offset = (uint32_t)DropFilesView::HeaderSize;
+		uint32_t wide = sizeof(CharT) == 2 ? 1 : 0;
+		std::memcpy(blob.data(), &offset, sizeof(offset));
+		std::memcpy(blob.data() + 16, &wide, sizeof(wide));
+		for (const std::basic_string<CharT>& path : paths)
+		{
+			const uint8_t* bytes = (const uint8_t*)path.c_str();
+			blob.insert(blob.end(), bytes, bytes + (path.size() + 1) * sizeof(CharT));
+		}
+		blob.insert(blob.end(), sizeof(CharT), 0);
+		return blob;
+	}
+
+	// What DragQueryFile(hDrop, i, ...) does: start over from the first path every time
+	static size_t LegacyQuery(const uint8_t* blob, size_t index, char16_t* buffer, size_t capacity)
+	{
+		uint32_t offset = 0;
+		std::memcpy(&offset, blob, sizeof(offset));
+		const char16_t* current = (const char16_t*)(blob + offset);
+		for (size_t i = 0; i < index; i++)
+		{
+			current += std::char_traits<char16_t>::length(current) + 1;
+		}
+		size_t length = std::char_traits<char16_t>::length(current);
+		if (buffer != nullptr && capacity > 0)
+		{
+			size_t copied = length < capacity - 1 ? length : capacity - 1;
+			std::memcpy(buffer, current, copied * sizeof(char16_t));
+			buffer[copied] = 0;
+		}
+		return length;
+	}
+
+	static size_t LegacyDropList(const uint8_t* blob, size_t count)
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t length = LegacyQuery(blob, i, nullptr, 0);
+			std::vector<char16_t> buffer(length + 1);
+			LegacyQuery(blob, i, buffer.data(), length + 1);
+			std::u16string path(buffer.data());
+			total += path.size();
+		}
+		return total;
+	}
+
+	// Command line entry: DropFilesBenchMain [paths] [fuzz iterations]
+	int DropFilesBenchMain(int argc, char* argv[])
+	{
+		size_t count = argc > 1 ? (size_t)std::atoi(argv[1]) : 100000;
+		size_t fuzzIterations = argc > 2 ? (size_t)std::atoi(argv[2]) : 200000;
+
+		std::mt19937 rng(14);
+		std::uniform_int_distribution<int> pick(0, 9999);
+		std::vector<std::u16string> widePaths;
+		std::vector<std::string> ansiPaths;
+		size_t units = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			std::string path = "C:\\Users\\someone\\Documents\\project" + std::to_string(pick(rng) % 50)
+				+ "\\file" + std::to_string(i) + ".docx";
+			ansiPaths.push_back(path);
+			widePaths.push_back(std::u16string(path.begin(), path.end()));
+			units += path.size();
+		}
+		std::vector<uint8_t> wideBlob = BuildDropFiles(widePaths);
+		std::vector<uint8_t> ansiBlob = BuildDropFiles(ansiPaths);
+
+		// Round trip
+		size_t mismatches = 0;
+		DropFilesView view;
+		if (DropFilesView::Parse(wideBlob.data(), wideBlob.size(), view) != DropFilesView::Status::Ok
+			|| !view.Wide() || view.size() != count)
+		{
+			mismatches++;
+		}
+		size_t index = 0;
+		for (std::u16string_view path : view.WidePaths())
+		{
+			if (index >= count || path != widePaths[index])
+			{
+				mismatches++;
+			}
+			index++;
+		}
+		if (DropFilesView::Parse(ansiBlob.data(), ansiBlob.size(), view) != DropFilesView::Status::Ok
+			|| view.Wide() || view.size() != count)
+		{
+			mismatches++;
+		}
+		index = 0;
+		for (std::string_view path : view.AnsiPaths())
+		{
+			if (index >= count || path != ansiPaths[index])
+			{
+				mismatches++;
+			}
+			index++;
+		}
+		std::cout << count << " paths, " << units << " units, round trip mismatches " << mismatches << std::endl;
+
+		// Parse and walk every path
+		const int rounds = 20;
+		size_t sink = 0;
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < rounds; r++)
+		{
+			DropFilesView::Parse(wideBlob.data(), wideBlob.size(), view);
+			for (std::u16string_view path : view.WidePaths())
+			{
+				sink += path.size();
+			}
+		}
+		double viewNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds / count;
+
+		// The legacy pattern is quadratic; time a prefix and report both per-path and the projection
+		size_t legacyCount = count < 5000 ? count : 5000;
+		std::vector<uint8_t> legacyBlob = BuildDropFiles(std::vector<std::u16string>(widePaths.begin(), widePaths.begin() + legacyCount));
+		t0 = std::chrono::steady_clock::now();
+		sink += LegacyDropList(legacyBlob.data(), legacyCount);
+		double legacyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+		double projectedMs = legacyMs * ((double)count / legacyCount) * ((double)count / legacyCount);
+
+		std::cout << "view: " << viewNs << " ns/path, " << viewNs * count / 1e6 << " ms for all" << std::endl;
+		std::cout << "DragQueryFile pattern: " << legacyMs * 1e6 / legacyCount << " ns/path at " << legacyCount
+			<< " paths, about " << projectedMs << " ms projected for " << count << " (sink " << sink % 10 << ")" << std::endl;
+
+		// Fuzz: truncations, random header fields and random bytes; the parser must either
+		// reject the blob or produce views that all lie inside it
+		size_t accepted = 0;
+		size_t escaped = 0;
+		std::vector<uint8_t> small = BuildDropFiles(std::vector<std::u16string>(widePaths.begin(), widePaths.begin() + 8));
+		std::vector<uint8_t> smallAnsi = BuildDropFiles(std::vector<std::string>(ansiPaths.begin(), ansiPaths.begin() + 8));
+		for (size_t i = 0; i < fuzzIterations; i++)
+		{
+			std::vector<uint8_t> blob = (i & 1) ? small : smallAnsi;
+			switch (rng() % 4)
+			{
+			case 0:
+				blob.resize(rng() % (blob.size() + 1));
+				break;
+			case 1:
+			{
+				uint32_t offset = rng() % 64;
+				std::memcpy(blob.data(), &offset, sizeof(offset));
+				break;
+			}
+			case 2:
+				blob[16] = (uint8_t)(rng() % 2);
+				break;
+			default:
+				for (int k = 0; k < 8; k++)
+				{
+					blob[rng() % blob.size()] = (uint8_t)rng();
+				}
+				break;
+			}
+
+			// Exact-size heap copy, so a sanitizer sees any overrun
+			uint8_t* copy = new uint8_t[blob.size()];
+			std::memcpy(copy, blob.data(), blob.size());
+			const uint8_t* end = copy + blob.size();
+			if (DropFilesView::Parse(blob.empty() ? nullptr : copy, blob.size(), view) == DropFilesView::Status::Ok)
+			{
+				accepted++;
+				for (std::u16string_view path : view.WidePaths())
+				{
+					if ((const uint8_t*)(path.data() + path.size()) >= end)
+					{
+						escaped++;
+					}
+				}
+				for (std::string_view path : view.AnsiPaths())
+				{
+					if ((const uint8_t*)(path.data() + path.size()) >= end)
+					{
+						escaped++;
+					}
+				}
+			}
+			delete[] copy;
+		}
+		std::cout << "fuzz: " << fuzzIterations << " blobs, " << accepted << " accepted, " << escaped
+			<< " views outside the block" << std::endl;
+
+		return mismatches == 0 && escaped == 0 ? 0 : 1;
+	}
+}
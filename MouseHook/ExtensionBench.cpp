@@ -0,0 +1,82 @@
+#include "ExtensionMatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cwctype>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Compares the compile-time extension matcher with the std::set<std::wstring> lookup
+// the detectors used before (copy the suffix, towlower it, set::count).
+namespace SystemDrag
+{
+	static constexpr ExtensionMatcher<std::size(ExtensionLists::Document)> DocumentExtensions(ExtensionLists::Document);
+
+	static bool LegacyIsTargetExtension(const std::wstring& path)
+	{
+		static const std::set<std::wstring> targetExtensions(
+			std::begin(ExtensionLists::Document), std::end(ExtensionLists::Document));
+
+		std::wstring_view ext = ExtensionKeys::FindExtension(std::wstring_view(path));
+		std::wstring extStr(ext);
+		std::transform(extStr.begin(), extStr.end(), extStr.begin(), ::towlower);
+		return targetExtensions.count(extStr) > 0;
+	}
+
+	static std::vector<std::wstring> MakeSyntheticPaths(size_t count, uint32_t seed)
+	{
+		static const wchar_t* const extensions[] = {
+			L".txt", L".TXT", L".Docx", L".pdf", L".cpp", L".exe", L".dll", L".zip",
+			L".jpeg", L".mp4", L".tar.gz", L"", L".verylongextension", L".Md"
+		};
+
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<size_t> pick(0, std::size(extensions) - 1);
+		std::uniform_int_distribution<int> nameLength(4, 24);
+
+		std::vector<std::wstring> paths;
+		paths.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			std::wstring path = L"C:\\Users\\trader\\Documents\\project.v2\\";
+			path.append(nameLength(rng), L'a' + (wchar_t)(i % 26));
+			path += extensions[pick(rng)];
+			paths.push_back(std::move(path));
+		}
+		return paths;
+	}
+
+	// Command line entry: ExtensionBenchMain [paths]
+	int ExtensionBenchMain(int argc, char* argv[])
+	{
+		size_t count = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+		std::vector<std::wstring> paths = MakeSyntheticPaths(count, 7);
+
+		auto t0 = std::chrono::steady_clock::now();
+		size_t legacyHits = 0;
+		for (const std::wstring& path : paths)
+		{
+			legacyHits += LegacyIsTargetExtension(path);
+		}
+
+		auto t1 = std::chrono::steady_clock::now();
+		size_t matcherHits = 0;
+		for (const std::wstring& path : paths)
+		{
+			matcherHits += DocumentExtensions.MatchPath(std::wstring_view(path));
+		}
+		auto t2 = std::chrono::steady_clock::now();
+
+		double legacyNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+		double matcherNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+
+		std::cout << "set<wstring>: " << legacyNs / count << " ns/path, hits: " << legacyHits << std::endl;
+		std::cout << "perfect hash: " << matcherNs / count << " ns/path, hits: " << matcherHits << std::endl;
+		std::cout << "speedup: " << legacyNs / matcherNs << "x" << std::endl;
+		return legacyHits == matcherHits ? 0 : 1;
+	}
+}
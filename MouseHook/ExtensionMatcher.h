@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+// Compile-time perfect hash over a fixed extension list.
+// An extension such as L".Txt" is ASCII-folded and packed into a 64-bit key (8 bits per
+// character, at most 8 characters after the dot); a multiplicative hash with a multiplier
+// searched at compile time maps every listed key to its own slot, so a lookup is one
+// multiply, one shift and one compare. No allocation, no locale, case-insensitive.
+namespace SystemDrag
+{
+	namespace ExtensionKeys
+	{
+		constexpr size_t MaxChars = 8;
+
+		// Packs ".ext" into a key, 0 if it is not a matchable extension
+		// (missing dot, empty, too long, non-ASCII or embedded separator)
+		template <typename CharT>
+		constexpr uint64_t Fold(std::basic_string_view<CharT> ext)
+		{
+			if (ext.size() < 2 || ext.size() > MaxChars + 1 || ext[0] != CharT('.'))
+			{
+				return 0;
+			}
+
+			uint64_t key = 0;
+			for (size_t i = 1; i < ext.size(); i++)
+			{
+				uint32_t c = (uint32_t)ext[i];
+				if (c == 0 || c >= 0x80 || c == '\\' || c == '/' || c == '.')
+				{
+					return 0;
+				}
+				if (c >= 'A' && c <= 'Z')
+				{
+					c += 'a' - 'A';
+				}
+				key = (key << 8) | c;
+			}
+			return key;
+		}
+
+		// Suffix starting at the last '.' of the final path component, empty if none
+		template <typename CharT>
+		constexpr std::basic_string_view<CharT> FindExtension(std::basic_string_view<CharT> path)
+		{
+			for (size_t i = path.size(); i > 0; i--)
+			{
+				CharT c = path[i - 1];
+				if (c == CharT('.'))
+				{
+					return path.substr(i - 1);
+				}
+				if (c == CharT('\\') || c == CharT('/') || c == CharT(':'))
+				{
+					break;
+				}
+			}
+			return std::basic_string_view<CharT>();
+		}
+
+		constexpr size_t TableSizeFor(size_t n)
+		{
+			size_t size = 16;
+			while (size < n * 4)
+			{
+				size <<= 1;
+			}
+			return size;
+		}
+
+		constexpr unsigned Log2(size_t n)
+		{
+			unsigned bits = 0;
+			while (((size_t)1 << bits) < n)
+			{
+				bits++;
+			}
+			return bits;
+		}
+	}
+
+	template <size_t N>
+	class ExtensionMatcher
+	{
+	public:
+		static constexpr size_t TableSize = ExtensionKeys::TableSizeFor(N);
+		static constexpr unsigned Shift = 64 - ExtensionKeys::Log2(TableSize);
+
+		constexpr explicit ExtensionMatcher(const wchar_t* const (&extensions)[N])
+			: m_multiplier(0), m_keys{}
+		{
+			uint64_t sourceKeys[N] = {};
+			for (size_t i = 0; i < N; i++)
+			{
+				sourceKeys[i] = ExtensionKeys::Fold(std::wstring_view(extensions[i]));
+			}
+
+			// Walk odd multipliers from a fixed LCG until one is collision free
+			uint64_t candidate = 0x9E3779B97F4A7C15ull;
+			for (int attempt = 0; attempt < 100000; attempt++)
+			{
+				candidate = candidate * 6364136223846793005ull + 1442695040888963407ull;
+				uint64_t multiplier = candidate | 1;
+				if (TryBuild(sourceKeys, multiplier))
+				{
+					m_multiplier = multiplier;
+					return;
+				}
+			}
+			// Reached only if the list contains duplicates; fails constant evaluation
+			throw "ExtensionMatcher: no perfect hash found";
+		}
+
+		// ext is a suffix such as returned by PathFindExtensionW (".txt")
+		template <typename CharT>
+		constexpr bool Match(std::basic_string_view<CharT> ext) const
+		{
+			uint64_t key = ExtensionKeys::Fold(ext);
+			return key != 0 && m_keys[Slot(key, m_multiplier)] == key;
+		}
+
+		constexpr bool Match(const wchar_t* ext) const
+		{
+			return ext != nullptr && Match(std::wstring_view(ext));
+		}
+
+		template <typename CharT>
+		constexpr bool MatchPath(std::basic_string_view<CharT> path) const
+		{
+			return Match(ExtensionKeys::FindExtension(path));
+		}
+
+		static constexpr size_t size() { return N; }
+
+	private:
+		static constexpr size_t Slot(uint64_t key, uint64_t multiplier)
+		{
+			return (size_t)((key * multiplier) >> Shift);
+		}
+
+		constexpr bool TryBuild(const uint64_t (&sourceKeys)[N], uint64_t multiplier)
+		{
+			for (size_t i = 0; i < TableSize; i++)
+			{
+				m_keys[i] = 0;
+			}
+			for (size_t i = 0; i < N; i++)
+			{
+				size_t slot = Slot(sourceKeys[i], multiplier);
+				if (sourceKeys[i] == 0 || m_keys[slot] != 0)
+				{
+					return false;
+				}
+				m_keys[slot] = sourceKeys[i];
+			}
+			return true;
+		}
+
+		uint64_t m_multiplier;
+		uint64_t m_keys[TableSize];
+	};
+
+	namespace ExtensionLists
+	{
+		// Built-in policy, used until an extensions.conf is loaded
+		constexpr const wchar_t* Document[] = {
+			L".txt", L".csv", L".log", L".xml", L".json", L".cs",
+			L".html", L".md", L".xaml", L".py", L".java", L".c", L".cpp", L".png", L".doc", L".docx", L".pdf", L".jpg", L".jpeg", L".bmp"
+		};
+	}
+}
@@ -0,0 +1,218 @@
+#include "ExtensionPolicy.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+
+namespace SystemDrag
+{
+	std::unique_ptr<ExtensionTable> ExtensionTable::Compile(std::vector<uint64_t> keys)
+	{
+		keys.erase(std::remove(keys.begin(), keys.end(), 0ull), keys.end());
+		std::sort(keys.begin(), keys.end());
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+		std::unique_ptr<ExtensionTable> table(new ExtensionTable());
+		table->m_count = keys.size();
+
+		// Same search as the compile-time matcher; grow the table if the load is too high to
+		// find a collision free multiplier quickly
+		size_t size = ExtensionKeys::TableSizeFor(keys.size());
+		uint64_t candidate = 0x9E3779B97F4A7C15ull;
+		for (;;)
+		{
+			unsigned shift = 64 - ExtensionKeys::Log2(size);
+			table->m_keys.assign(size, 0);
+
+			for (int attempt = 0; attempt < 1000; attempt++)
+			{
+				candidate = candidate * 6364136223846793005ull + 1442695040888963407ull;
+				uint64_t multiplier = candidate | 1;
+
+				std::fill(table->m_keys.begin(), table->m_keys.end(), 0ull);
+				bool collision = false;
+				for (uint64_t key : keys)
+				{
+					uint64_t& slot = table->m_keys[(size_t)((key * multiplier) >> shift)];
+					if (slot != 0)
+					{
+						collision = true;
+						break;
+					}
+					slot = key;
+				}
+
+				if (!collision)
+				{
+					table->m_multiplier = multiplier;
+					table->m_shift = shift;
+					return table;
+				}
+			}
+			size <<= 1;
+		}
+	}
+
+	std::unique_ptr<ExtensionTable> ExtensionTable::FromList(const wchar_t* const* extensions, size_t count)
+	{
+		std::vector<uint64_t> keys;
+		keys.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			keys.push_back(ExtensionKeys::Fold(std::wstring_view(extensions[i])));
+		}
+		return Compile(std::move(keys));
+	}
+
+	bool ParseExtensionPolicy(const std::string& text, std::vector<uint64_t>& keys, std::string& error)
+	{
+		std::istringstream lines(text);
+		std::string line;
+		int lineNumber = 0;
+
+		while (std::getline(lines, line))
+		{
+			lineNumber++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+			{
+				line.erase(comment);
+			}
+			std::replace_if(line.begin(), line.end(), [](char c) { return c == ',' || c == ';'; }, ' ');
+
+			std::istringstream tokens(line);
+			std::string token;
+			while (tokens >> token)
+			{
+				if (token[0] != '.')
+				{
+					token.insert(token.begin(), '.');
+				}
+
+				uint64_t key = ExtensionKeys::Fold(std::string_view(token));
+				if (key == 0)
+				{
+					error = "line " + std::to_string(lineNumber) + ": invalid extension '" + token + "'";
+					return false;
+				}
+				keys.push_back(key);
+			}
+		}
+		return true;
+	}
+
+	ExtensionPolicy::ExtensionPolicy()
+		: m_current(nullptr), m_epoch(0), m_readers{ {0}, {0} }, m_generation(0), m_stopWatching(false)
+	{
+		Publish(ExtensionTable::FromList(ExtensionLists::Document, std::size(ExtensionLists::Document)));
+	}
+
+	ExtensionPolicy::~ExtensionPolicy()
+	{
+		StopWatching();
+		delete m_current.load();
+	}
+
+	bool ExtensionPolicy::LoadFile(const std::filesystem::path& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in)
+		{
+			std::cerr << "Cannot open extension policy: " << path.string() << std::endl;
+			return false;
+		}
+
+		std::ostringstream content;
+		content << in.rdbuf();
+
+		std::vector<uint64_t> keys;
+		std::string error;
+		if (!ParseExtensionPolicy(content.str(), keys, error))
+		{
+			std::cerr << "Extension policy " << path.string() << " rejected, " << error << std::endl;
+			return false;
+		}
+
+		Publish(ExtensionTable::Compile(std::move(keys)));
+		return true;
+	}
+
+	void ExtensionPolicy::Publish(std::unique_ptr<ExtensionTable> table)
+	{
+		std::lock_guard<std::mutex> lock(m_publishMutex);
+
+		const ExtensionTable* old = m_current.exchange(table.release(), std::memory_order_seq_cst);
+		unsigned epoch = m_epoch.load(std::memory_order_relaxed);
+		m_epoch.store(epoch + 1, std::memory_order_seq_cst);
+
+		// Grace period: readers of the retired epoch may still hold the old table
+		while (m_readers[epoch & 1].load(std::memory_order_acquire) != 0)
+		{
+			std::this_thread::yield();
+		}
+		delete old;
+
+		m_generation.fetch_add(1, std::memory_order_release);
+	}
+
+	void ExtensionPolicy::StartWatching(const std::filesystem::path& path, std::chrono::milliseconds interval)
+	{
+		StopWatching();
+		{
+			std::lock_guard<std::mutex> lock(m_watchMutex);
+			m_stopWatching = false;
+		}
+		m_watcher = std::thread(&ExtensionPolicy::WatchLoop, this, path, interval);
+	}
+
+	void ExtensionPolicy::StopWatching()
+	{
+		if (!m_watcher.joinable())
+		{
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_watchMutex);
+			m_stopWatching = true;
+		}
+		m_watchCond.notify_all();
+		m_watcher.join();
+	}
+
+	void ExtensionPolicy::WatchLoop(std::filesystem::path path, std::chrono::milliseconds interval)
+	{
+		std::filesystem::file_time_type lastWrite{};
+		uintmax_t lastSize = (uintmax_t)-1;
+		bool seen = false;
+
+		std::unique_lock<std::mutex> lock(m_watchMutex);
+		while (!m_stopWatching)
+		{
+			std::error_code ec;
+			auto writeTime = std::filesystem::last_write_time(path, ec);
+			uintmax_t size = ec ? 0 : std::filesystem::file_size(path, ec);
+
+			if (!ec && (!seen || writeTime != lastWrite || size != lastSize))
+			{
+				seen = true;
+				lastWrite = writeTime;
+				lastSize = size;
+
+				lock.unlock();
+				LoadFile(path);
+				lock.lock();
+				continue;
+			}
+
+			m_watchCond.wait_for(lock, interval, [this] { return m_stopWatching; });
+		}
+	}
+
+	ExtensionPolicy& SharedExtensionPolicy()
+	{
+		static ExtensionPolicy policy;
+		return policy;
+	}
+}
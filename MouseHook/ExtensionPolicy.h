@@ -0,0 +1,148 @@
+#pragma once
+
+#include "ExtensionMatcher.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Extension policy loaded from a config file.
+// The file is compiled into an immutable ExtensionTable (same folded keys and multiplicative
+// perfect hash as ExtensionMatcher, searched at load time instead of compile time).
+// ExtensionPolicy publishes tables RCU style: readers never lock, a reload swaps the
+// pointer and frees the old table once every reader that could still see it has left.
+namespace SystemDrag
+{
+	class ExtensionTable
+	{
+	public:
+		// Keys from ExtensionKeys::Fold; zero keys are ignored, duplicates collapse
+		static std::unique_ptr<ExtensionTable> Compile(std::vector<uint64_t> keys);
+		static std::unique_ptr<ExtensionTable> FromList(const wchar_t* const* extensions, size_t count);
+
+		template <typename CharT>
+		bool Match(std::basic_string_view<CharT> ext) const
+		{
+			uint64_t key = ExtensionKeys::Fold(ext);
+			return key != 0 && m_keys[(size_t)((key * m_multiplier) >> m_shift)] == key;
+		}
+
+		size_t size() const { return m_count; }
+
+	private:
+		ExtensionTable() : m_multiplier(1), m_shift(63), m_count(0) {}
+
+		uint64_t m_multiplier;
+		unsigned m_shift;
+		size_t m_count;
+		std::vector<uint64_t> m_keys;
+	};
+
+	// Config format: extensions separated by whitespace, ',' or ';', leading dot optional,
+	// '#' starts a comment. Writers should replace the file atomically (write + rename);
+	// a torn write is simply picked up again on the next change.
+	bool ParseExtensionPolicy(const std::string& text, std::vector<uint64_t>& keys, std::string& error);
+
+	class ExtensionPolicy
+	{
+	public:
+		// Starts with the built-in ExtensionLists::Document table
+		ExtensionPolicy();
+		~ExtensionPolicy();
+
+		ExtensionPolicy(const ExtensionPolicy&) = delete;
+		ExtensionPolicy& operator=(const ExtensionPolicy&) = delete;
+
+		// Parses and publishes the file, keeps the current table on any error
+		bool LoadFile(const std::filesystem::path& path);
+		void Publish(std::unique_ptr<ExtensionTable> table);
+
+		template <typename CharT>
+		bool Match(std::basic_string_view<CharT> ext) const
+		{
+			ReadGuard guard(*this);
+			return guard.table->Match(ext);
+		}
+
+		bool Match(const wchar_t* ext) const
+		{
+			return ext != nullptr && Match(std::wstring_view(ext));
+		}
+
+		template <typename CharT>
+		bool MatchPath(std::basic_string_view<CharT> path) const
+		{
+			return Match(ExtensionKeys::FindExtension(path));
+		}
+
+		// Runs visit(table) on one published table: every lookup inside sees the same generation
+		template <typename Visit>
+		auto Read(Visit visit) const
+		{
+			ReadGuard guard(*this);
+			return visit(*guard.table);
+		}
+
+		// Polls the file's write time and size, reloading on change
+		void StartWatching(const std::filesystem::path& path, std::chrono::milliseconds interval);
+		void StopWatching();
+
+		// Number of tables published so far (including the built-in one)
+		uint64_t Generation() const { return m_generation.load(std::memory_order_acquire); }
+
+	private:
+		// Two-bucket epoch counter: a reader registers in the bucket of the current epoch and
+		// re-checks the epoch, so a writer that flips the epoch only has to wait for the
+		// bucket it just retired.
+		struct ReadGuard
+		{
+			explicit ReadGuard(const ExtensionPolicy& policy) : owner(policy)
+			{
+				for (;;)
+				{
+					epoch = owner.m_epoch.load(std::memory_order_seq_cst);
+					owner.m_readers[epoch & 1].fetch_add(1, std::memory_order_seq_cst);
+					if (owner.m_epoch.load(std::memory_order_seq_cst) == epoch)
+					{
+						break;
+					}
+					owner.m_readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+				}
+				table = owner.m_current.load(std::memory_order_seq_cst);
+			}
+
+			~ReadGuard()
+			{
+				owner.m_readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+			}
+
+			const ExtensionPolicy& owner;
+			unsigned epoch;
+			const ExtensionTable* table;
+		};
+
+		void WatchLoop(std::filesystem::path path, std::chrono::milliseconds interval);
+
+		std::atomic<const ExtensionTable*> m_current;
+		std::atomic<unsigned> m_epoch;
+		mutable std::atomic<uint32_t> m_readers[2];
+		std::atomic<uint64_t> m_generation;
+		std::mutex m_publishMutex;
+
+		std::thread m_watcher;
+		std::mutex m_watchMutex;
+		std::condition_variable m_watchCond;
+		bool m_stopWatching;
+	};
+
+	// Process wide policy shared by all detectors
+	ExtensionPolicy& SharedExtensionPolicy();
+}
@@ -0,0 +1,174 @@
+#include "ExtensionPolicy.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hot reload of the extension policy under load. The watcher polls a temporary
+// extensions.conf while reader threads match against the policy in a loop; the file is then
+// rewritten a few times. Generation g lists its own extensions (".g<g>e<i>", one more per
+// generation so the size always changes). Checked: every rewrite shows up in Match within
+// the timeout, a reader never sees part of one generation's list and part of another's
+// inside one table, and never goes back to an older generation.
+namespace SystemDrag
+{
+	static std::string GenerationExtension(int generation, int index)
+	{
+		return ".g" + std::to_string(generation) + "e" + std::to_string(index);
+	}
+
+	static int GenerationSize(int generation)
+	{
+		return 8 + generation;
+	}
+
+	// Atomic replace, as the config format asks of writers
+	static bool WritePolicy(const std::filesystem::path& path, int generation)
+	{
+		std::filesystem::path temp = path;
+		temp += ".tmp";
+		{
+			std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+			out << "# generation " << generation << "\n";
+			for (int i = 0; i < GenerationSize(generation); i++)
+			{
+				out << GenerationExtension(generation, i) << (i % 4 == 3 ? "\n" : ", ");
+			}
+			if (!out)
+			{
+				return false;
+			}
+		}
+		std::error_code ec;
+		std::filesystem::rename(temp, path, ec);
+		return !ec;
+	}
+
+	struct ReaderResult
+	{
+		uint64_t reads = 0;
+		uint64_t mixed = 0;         // a table with a partial list, or lists of two generations
+		uint64_t regressions = 0;   // an older generation after a newer one
+		int newest = 0;
+	};
+
+	static void ReadLoop(const ExtensionPolicy& policy, int generations, std::atomic<bool>& stop, ReaderResult& result)
+	{
+		std::vector<std::vector<std::string>> lists(generations + 1);
+		for (int g = 1; g <= generations; g++)
+		{
+			for (int i = 0; i < GenerationSize(g); i++)
+			{
+				lists[g].push_back(GenerationExtension(g, i));
+			}
+		}
+
+		while (!stop.load(std::memory_order_relaxed))
+		{
+			// 0 is the built-in table, which lists none of them
+			int seen = policy.Read([&](const ExtensionTable& table)
+				{
+					int found = 0;
+					for (int g = 1; g <= generations; g++)
+					{
+						size_t hits = 0;
+						for (const std::string& ext : lists[g])
+						{
+							hits += table.Match(std::string_view(ext));
+						}
+						if (hits == 0)
+						{
+							continue;
+						}
+						if (hits != lists[g].size() || found != 0)
+						{
+							return -1;
+						}
+						found = g;
+					}
+					return found;
+				});
+
+			result.reads++;
+			if (seen < 0)
+			{
+				result.mixed++;
+				continue;
+			}
+			result.regressions += seen < result.newest;
+			result.newest = seen > result.newest ? seen : result.newest;
+		}
+	}
+
+	// Command line entry: ExtensionPolicyBenchMain [rewrites] [readers]
+	int ExtensionPolicyBenchMain(int argc, char* argv[])
+	{
+		int generations = argc > 1 ? std::atoi(argv[1]) : 20;
+		int readers = argc > 2 ? std::atoi(argv[2]) : 4;
+		generations = generations < 1 ? 1 : generations;
+		readers = readers < 1 ? 1 : readers;
+
+		std::filesystem::path path = std::filesystem::temp_directory_path() / "systemdrag-extensions.conf";
+		std::filesystem::remove(path);
+
+		ExtensionPolicy policy;
+		std::atomic<bool> stop(false);
+		std::vector<ReaderResult> results(readers);
+		std::vector<std::thread> threads;
+		for (int r = 0; r < readers; r++)
+		{
+			threads.emplace_back(ReadLoop, std::cref(policy), generations, std::ref(stop), std::ref(results[r]));
+		}
+
+		policy.StartWatching(path, std::chrono::milliseconds(5));
+		int flipped = 0;
+		double worstMs = 0;
+		for (int g = 1; g <= generations; g++)
+		{
+			if (!WritePolicy(path, g))
+			{
+				std::cout << "cannot write " << path.string() << std::endl;
+				break;
+			}
+
+			auto t0 = std::chrono::steady_clock::now();
+			std::string marker = GenerationExtension(g, 0);
+			bool seen = false;
+			while (!(seen = policy.Match(std::string_view(marker))) && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(2))
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+			worstMs = ms > worstMs ? ms : worstMs;
+			flipped += seen;
+		}
+		policy.StopWatching();
+		stop = true;
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		std::filesystem::remove(path);
+
+		ReaderResult total;
+		for (const ReaderResult& result : results)
+		{
+			total.reads += result.reads;
+			total.mixed += result.mixed;
+			total.regressions += result.regressions;
+		}
+
+		bool correct = flipped == generations && total.mixed == 0 && total.regressions == 0 && total.reads != 0;
+		std::cout << generations << " rewrites, " << flipped << " picked up, worst " << worstMs << " ms; " << readers
+			<< " readers, " << total.reads << " table reads, " << total.mixed << " mixed, " << total.regressions
+			<< " regressions" << std::endl;
+		std::cout << (correct ? "policy reload ok" : "policy reload WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
@@ -0,0 +1,201 @@
+#include "FileMetadata.h"
+#include "MetadataCache.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace SystemDrag
+{
+#ifdef _WIN32
+	void NativeMetadataBackend::Query(const std::filesystem::path& path, FileMetadata& metadata)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+		{
+			metadata.exists = false;
+			return;
+		}
+
+		metadata.exists = true;
+		metadata.attributes = data.dwFileAttributes;
+		metadata.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		metadata.writeTime = (int64_t)(((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+	}
+#else
+	static uint32_t PosixAttributes(const std::filesystem::path& path, unsigned mode)
+	{
+		uint32_t attributes = 0;
+		if (S_ISDIR(mode))
+		{
+			attributes |= FileAttrDirectory;
+		}
+		if ((mode & 0222) == 0)
+		{
+			attributes |= FileAttrReadOnly;
+		}
+		std::string name = path.filename().native();
+		if (name.size() > 1 && name[0] == '.' && name != "..")
+		{
+			attributes |= FileAttrHidden;
+		}
+		return attributes;
+	}
+
+	void NativeMetadataBackend::Query(const std::filesystem::path& path, FileMetadata& metadata)
+	{
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+		// Only ask for what we use, network file systems can skip the rest
+		struct statx info;
+		if (statx(AT_FDCWD, path.c_str(), 0, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME, &info) != 0)
+		{
+			metadata.exists = false;
+			return;
+		}
+
+		metadata.exists = true;
+		metadata.attributes = PosixAttributes(path, info.stx_mode);
+		metadata.size = info.stx_size;
+		metadata.writeTime = (int64_t)info.stx_mtime.tv_sec * 1000000000 + info.stx_mtime.tv_nsec;
+#else
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+		{
+			metadata.exists = false;
+			return;
+		}
+
+		metadata.exists = true;
+		metadata.attributes = PosixAttributes(path, info.st_mode);
+		metadata.size = (uint64_t)info.st_size;
+		metadata.writeTime = (int64_t)info.st_mtime * 1000000000;
+#endif
+	}
+#endif
+
+	MetadataResolver::MetadataResolver(IFileMetadataBackend& backend, size_t workers)
+		: m_backend(backend), m_batch(0), m_busy(0), m_shutdown(false),
+		m_paths(nullptr), m_results(nullptr), m_stopWhen(nullptr), m_next(0), m_resolved(0), m_stopIndex(0)
+	{
+		for (size_t i = 0; i < workers; i++)
+		{
+			m_threads.emplace_back(&MetadataResolver::WorkerLoop, this);
+		}
+	}
+
+	MetadataResolver::~MetadataResolver()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_shutdown = true;
+		}
+		m_wake.notify_all();
+		for (std::thread& thread : m_threads)
+		{
+			thread.join();
+		}
+	}
+
+	MetadataBatchResult MetadataResolver::Resolve(const std::vector<std::filesystem::path>& paths,
+		std::vector<FileMetadata>& results, const StopWhen& stopWhen)
+	{
+		results.assign(paths.size(), FileMetadata());
+		if (paths.empty())
+		{
+			return { 0, (size_t)-1 };
+		}
+
+		// The workers serve one batch; a second caller waits for it rather than replacing it
+		std::lock_guard<std::mutex> batchLock(m_resolveMutex);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_paths = &paths;
+			m_results = &results;
+			m_stopWhen = &stopWhen;
+			m_next.store(0);
+			m_resolved.store(0);
+			m_stopIndex.store((size_t)-1);
+			m_batch++;
+		}
+		if (paths.size() > 1)
+		{
+			m_wake.notify_all();
+		}
+
+		Drain();
+
+		// Workers that picked the batch up may still be inside a lookup. One that wakes up
+		// after this point finds no batch and goes back to sleep.
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_busy == 0; });
+		m_paths = nullptr;
+		m_results = nullptr;
+		m_stopWhen = nullptr;
+		return { m_resolved.load(), m_stopIndex.load() };
+	}
+
+	void MetadataResolver::Drain()
+	{
+		const std::vector<std::filesystem::path>& paths = *m_paths;
+		std::vector<FileMetadata>& results = *m_results;
+		const StopWhen& stopWhen = *m_stopWhen;
+
+		while (m_stopIndex.load(std::memory_order_relaxed) == (size_t)-1)
+		{
+			size_t index = m_next.fetch_add(1, std::memory_order_relaxed);
+			if (index >= paths.size())
+			{
+				break;
+			}
+
+			FileMetadata& metadata = results[index];
+			m_backend.Query(paths[index], metadata);
+			metadata.resolved = true;
+			m_resolved.fetch_add(1, std::memory_order_relaxed);
+
+			if (stopWhen && stopWhen(index, metadata))
+			{
+				size_t none = (size_t)-1;
+				m_stopIndex.compare_exchange_strong(none, index);
+			}
+		}
+	}
+
+	void MetadataResolver::WorkerLoop()
+	{
+		uint64_t seen = 0;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_wake.wait(lock, [&]() { return m_shutdown || m_batch != seen; });
+			if (m_shutdown)
+			{
+				return;
+			}
+			seen = m_batch;
+			if (m_paths == nullptr)
+			{
+				continue;
+			}
+
+			m_busy++;
+			lock.unlock();
+			Drain();
+			lock.lock();
+			if (--m_busy == 0)
+			{
+				m_idle.notify_all();
+			}
+		}
+	}
+
+	MetadataResolver& SharedMetadataResolver()
+	{
+		// Lookups wait on the disk or the network, not the CPU: 7 workers plus the caller
+		static MetadataResolver resolver(SharedMetadataCache(), 7);
+		return resolver;
+	}
+}
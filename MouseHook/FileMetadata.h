@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Batched file metadata lookups.
+// Every GetFileAttributes / CreateFile + GetFileSizeEx is a blocking round trip, which on a
+// network share means one server round trip per selected or dropped file. The resolver takes
+// the whole batch and fans the lookups out over a fixed set of worker threads, so the batch
+// costs about one round trip per worker instead of one per file, and it stops handing out
+// paths as soon as the caller has the answer it needs.
+namespace SystemDrag
+{
+	// Attribute bits follow FILE_ATTRIBUTE_*; the POSIX backend synthesizes the ones it can
+	enum FileAttributeBits : uint32_t
+	{
+		FileAttrReadOnly = 0x01,
+		FileAttrHidden = 0x02,
+		FileAttrSystem = 0x04,
+		FileAttrDirectory = 0x10,
+		FileAttrArchive = 0x20
+	};
+
+	struct FileMetadata
+	{
+		bool resolved;      // false when the batch stopped before this path was looked at
+		bool exists;
+		uint32_t attributes;
+		uint64_t size;
+		int64_t writeTime;  // backend clock: FILETIME ticks on Windows, nanoseconds since the epoch on POSIX
+
+		bool IsDirectory() const { return exists && (attributes & FileAttrDirectory) != 0; }
+	};
+
+	class IFileMetadataBackend
+	{
+	public:
+		virtual ~IFileMetadataBackend() {}
+
+		// Called concurrently from the worker threads
+		virtual void Query(const std::filesystem::path& path, FileMetadata& metadata) = 0;
+	};
+
+	// GetFileAttributesExW on Windows (attributes, size and write time in one call),
+	// statx on Linux, stat elsewhere
+	class NativeMetadataBackend : public IFileMetadataBackend
+	{
+	public:
+		void Query(const std::filesystem::path& path, FileMetadata& metadata) override;
+	};
+
+	struct MetadataBatchResult
+	{
+		size_t resolved;
+		size_t stopIndex;   // index that satisfied the stop condition, or npos
+	};
+
+	class MetadataResolver
+	{
+	public:
+		// Decides from one result that the rest of the batch is not needed.
+		// Runs on the worker threads.
+		typedef std::function<bool(size_t index, const FileMetadata& metadata)> StopWhen;
+
+		// The calling thread works on the batch too, so workers = 0 resolves serially
+		MetadataResolver(IFileMetadataBackend& backend, size_t workers);
+		~MetadataResolver();
+
+		MetadataResolver(const MetadataResolver&) = delete;
+		MetadataResolver& operator=(const MetadataResolver&) = delete;
+
+		// results[i] belongs to paths[i]. Batches from several threads run one after another.
+		MetadataBatchResult Resolve(const std::vector<std::filesystem::path>& paths,
+			std::vector<FileMetadata>& results, const StopWhen& stopWhen = StopWhen());
+
+		size_t Workers() const { return m_threads.size(); }
+
+	private:
+		void WorkerLoop();
+		void Drain();
+
+		IFileMetadataBackend& m_backend;
+		std::vector<std::thread> m_threads;
+
+		std::mutex m_resolveMutex;   // held for a whole batch
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_idle;
+		uint64_t m_batch;
+		size_t m_busy;
+		bool m_shutdown;
+
+		// Current batch, published under m_mutex
+		const std::vector<std::filesystem::path>* m_paths;
+		std::vector<FileMetadata>* m_results;
+		const StopWhen* m_stopWhen;
+		std::atomic<size_t> m_next;
+		std::atomic<size_t> m_resolved;
+		std::atomic<size_t> m_stopIndex;
+	};
+
+	// Resolver shared by the detectors, over the change-notified metadata cache; created on first use
+	MetadataResolver& SharedMetadataResolver();
+}
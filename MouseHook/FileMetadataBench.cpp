@@ -0,0 +1,128 @@
+#include "FileMetadata.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Batch metadata lookups over a generated directory of files: serial lookups against the
+// worker pool, with an optional per-lookup delay standing in for a network share round trip,
+// plus an early-exit batch that stops at the first directory and batches from two threads
+// on one resolver, as the detection workers share it.
+namespace SystemDrag
+{
+	// Adds a fixed delay to every lookup, like a remote file system would
+	class DelayedMetadataBackend : public IFileMetadataBackend
+	{
+	public:
+		DelayedMetadataBackend(IFileMetadataBackend& inner, std::chrono::microseconds delay) : m_inner(inner), m_delay(delay) {}
+
+		void Query(const std::filesystem::path& path, FileMetadata& metadata) override
+		{
+			if (m_delay.count() > 0)
+			{
+				std::this_thread::sleep_for(m_delay);
+			}
+			m_inner.Query(path, metadata);
+		}
+
+	private:
+		IFileMetadataBackend& m_inner;
+		std::chrono::microseconds m_delay;
+	};
+
+	static double TimeBatch(MetadataResolver& resolver, const std::vector<std::filesystem::path>& paths,
+		std::vector<FileMetadata>& results, const MetadataResolver::StopWhen& stopWhen, MetadataBatchResult& batch)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		batch = resolver.Resolve(paths, results, stopWhen);
+		auto t1 = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(t1 - t0).count();
+	}
+
+	// Command line entry: MetadataBenchMain [files] [workers] [delay-us] [directory]
+	int MetadataBenchMain(int argc, char* argv[])
+	{
+		size_t files = argc > 1 ? (size_t)std::atoi(argv[1]) : 5000;
+		size_t workers = argc > 2 ? (size_t)std::atoi(argv[2]) : 7;
+		std::chrono::microseconds delay(argc > 3 ? std::atoi(argv[3]) : 0);
+		std::filesystem::path root = argc > 4 ? std::filesystem::path(argv[4])
+			: std::filesystem::temp_directory_path() / "metadata-bench";
+
+		std::error_code ec;
+		std::filesystem::create_directories(root, ec);
+		std::vector<std::filesystem::path> paths;
+		for (size_t i = 0; i < files; i++)
+		{
+			std::filesystem::path path = root / ("file" + std::to_string(i) + ".txt");
+			if (!std::filesystem::exists(path, ec))
+			{
+				std::ofstream(path) << std::string(i % 4096, 'x');
+			}
+			paths.push_back(path);
+		}
+		// A directory in the middle of the batch for the early-exit run
+		std::filesystem::path folder = root / "folder.txt";
+		std::filesystem::create_directories(folder, ec);
+		paths.insert(paths.begin() + paths.size() / 2, folder);
+
+		NativeMetadataBackend native;
+		DelayedMetadataBackend backend(native, delay);
+		MetadataResolver serial(backend, 0);
+		MetadataResolver pooled(backend, workers);
+
+		std::vector<FileMetadata> serialResults;
+		std::vector<FileMetadata> pooledResults;
+		MetadataBatchResult batch;
+		double serialMs = TimeBatch(serial, paths, serialResults, MetadataResolver::StopWhen(), batch);
+		double pooledMs = TimeBatch(pooled, paths, pooledResults, MetadataResolver::StopWhen(), batch);
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			mismatches += serialResults[i].exists != pooledResults[i].exists || serialResults[i].size != pooledResults[i].size
+				|| serialResults[i].attributes != pooledResults[i].attributes;
+		}
+
+		std::vector<FileMetadata> earlyResults;
+		double earlyMs = TimeBatch(pooled, paths, earlyResults,
+			[](size_t, const FileMetadata& metadata) { return metadata.IsDirectory(); }, batch);
+
+		// Two callers on the pooled resolver: each batch must come back whole and match the serial run
+		size_t crossed = 0;
+		std::vector<std::thread> callers;
+		std::vector<size_t> callerMismatches(2, 0);
+		for (size_t c = 0; c < callerMismatches.size(); c++)
+		{
+			callers.emplace_back([&, c]()
+				{
+					std::vector<FileMetadata> results;
+					for (int round = 0; round < 5; round++)
+					{
+						MetadataBatchResult own = pooled.Resolve(paths, results);
+						callerMismatches[c] += own.resolved != paths.size();
+						for (size_t i = 0; i < paths.size(); i++)
+						{
+							callerMismatches[c] += !results[i].resolved || results[i].size != serialResults[i].size;
+						}
+					}
+				});
+		}
+		for (size_t c = 0; c < callers.size(); c++)
+		{
+			callers[c].join();
+			crossed += callerMismatches[c];
+		}
+
+		std::cout << paths.size() << " paths, delay " << delay.count() << " us" << std::endl;
+		std::cout << "serial: " << serialMs << " ms" << std::endl;
+		std::cout << "pool of " << pooled.Workers() << "+1: " << pooledMs << " ms (x" << serialMs / pooledMs << ")" << std::endl;
+		std::cout << "early exit at directory: " << earlyMs << " ms, resolved " << batch.resolved
+			<< ", stopped at " << batch.stopIndex << std::endl;
+		std::cout << "mismatches: " << mismatches << ", concurrent callers: " << crossed << std::endl;
+		return mismatches == 0 && crossed == 0 && batch.stopIndex == paths.size() / 2 ? 0 : 1;
+	}
+}
@@ -4,115 +4,89 @@
 #include <exdisp.h>  // For IShellWindows
 #include <shldisp.h> // For IShellFolderViewDual
 #include <comdef.h>   // For _bstr_t, _variant_t
-#include <set>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 
+#include "ComShellSession.h"
+#include "ExtensionPolicy.h"
+#include "FileMetadata.h"
+#include "WindowTree.h"
+
 class FileDetector3 {
 private:
-	static const std::set<std::wstring> targetExtensions;
-	static const int SWC_DESKTOP = 8;
-	static const int SWFO_NEEDDISPATCH = 1;
-
 	struct ShellWindowInfo {
 		HWND hwnd;
 		bool isDesktop;
 	};
 
-	static std::wstring GetWindowClassName(HWND hWnd) {
-		wchar_t className[256];
-		GetClassName(hWnd, className, sizeof(className) / sizeof(wchar_t));
-		return std::wstring(className);
-	}
-
 	static ShellWindowInfo FindShellParent(HWND hWnd) {
-		ShellWindowInfo result = { nullptr, false };
-		HWND current = hWnd;
-
-		while (current != nullptr) {
-			std::wstring className = GetWindowClassName(current);
-
-			// Check if it's a regular explorer window
-			if (className == L"CabinetWClass") {
-				result.hwnd = current;
-				result.isDesktop = false;
-				return result;
-			}
-
-			// Check if it's desktop
-			if (className == L"Progman" || className == L"WorkerW") {
-				result.hwnd = current;
-				result.isDesktop = true;
-				return result;
-			}
-
-			current = GetParent(current);
-		}
-
+		// Memoized per window, invalidated when windows are destroyed or reparented
+		SystemDrag::ShellRoot root = SystemDrag::ShellAncestry().Resolve((SystemDrag::WindowKey)hWnd);
+		ShellWindowInfo result = { (HWND)root.window, root.kind == SystemDrag::ShellKind::Desktop };
 		return result;
 	}
 
-	static bool CheckExplorerWindow(IShellWindows* shellWindows, HWND targetHwnd) {
-		long count;
-		if (FAILED(shellWindows->get_Count(&count))) {
-			return false;
-		}
-
-		for (long i = 0; i < count; i++) {
-			VARIANT index;
-			index.vt = VT_I4;
-			index.lVal = i;
-
-			IDispatch* dispatch = nullptr;
-			if (FAILED(shellWindows->Item(index, &dispatch)) || !dispatch) {
-				continue;
+	// Scans the session's IShellWindows proxy; a scan that finds Explorer gone runs once more
+	// on a new connection
+	static bool CheckExplorerWindow(SystemDrag::ComShellSession& session, HWND targetHwnd) {
+		bool result = false;
+		session.WithShellWindows([&](IShellWindows* shellWindows) {
+			long count;
+			HRESULT hr = shellWindows->get_Count(&count);
+			if (FAILED(hr)) {
+				return SystemDrag::ShellStatusFromResult(hr);
 			}
 
-			IWebBrowser2* browser = nullptr;
-			if (FAILED(dispatch->QueryInterface(IID_IWebBrowser2, (void**)&browser))) {
-				dispatch->Release();
-				continue;
-			}
+			for (long i = 0; i < count; i++) {
+				VARIANT index;
+				index.vt = VT_I4;
+				index.lVal = i;
 
-			HWND windowHwnd = nullptr;
-			if (SUCCEEDED(browser->get_HWND((LONG_PTR*)&windowHwnd))) {
-				if (windowHwnd == targetHwnd) {
-					bool result = HasValidSelection(browser);
-					browser->Release();
+				IDispatch* dispatch = nullptr;
+				if (FAILED(shellWindows->Item(index, &dispatch)) || !dispatch) {
+					continue;
+				}
+
+				IWebBrowser2* browser = nullptr;
+				if (FAILED(dispatch->QueryInterface(IID_IWebBrowser2, (void**)&browser))) {
 					dispatch->Release();
-					return result;
+					continue;
 				}
-			}
 
-			browser->Release();
-			dispatch->Release();
-		}
+				HWND windowHwnd = nullptr;
+				if (SUCCEEDED(browser->get_HWND((LONG_PTR*)&windowHwnd))) {
+					if (windowHwnd == targetHwnd) {
+						result = HasValidSelection(browser);
+						browser->Release();
+						dispatch->Release();
+						return SystemDrag::ShellStatus::Ok;
+					}
+				}
 
-		return false;
+				browser->Release();
+				dispatch->Release();
+			}
+			return SystemDrag::ShellStatus::Ok;
+		});
+		return result;
 	}
 
-	static bool CheckDesktopSelection(IShellWindows* shellWindows) {
-		VARIANT empty = { VT_EMPTY };
-		long hwnd = 0;
-
-		// Get desktop window
-		IDispatch* desktopDispatch = nullptr;
-		if (FAILED(shellWindows->FindWindowSW(&empty, &empty, SWC_DESKTOP, &hwnd,
-			SWFO_NEEDDISPATCH, &desktopDispatch)) ||
-			!desktopDispatch) {
+	// The desktop view comes from the session, FindWindowSW only runs after Explorer restarted
+	static bool CheckDesktopSelection(SystemDrag::ComShellSession& session) {
+		CComPtr<IDispatch> desktopDispatch;
+		if (session.DesktopView(desktopDispatch) != SystemDrag::ShellStatus::Ok) {
 			return false;
 		}
 
 		IWebBrowser2* desktopBrowser = nullptr;
 		if (FAILED(desktopDispatch->QueryInterface(IID_IWebBrowser2, (void**)&desktopBrowser))) {
-			desktopDispatch->Release();
 			return false;
 		}
 
 		bool result = HasValidSelection(desktopBrowser);
 		desktopBrowser->Release();
-		desktopDispatch->Release();
 		return result;
 	}
 
@@ -145,38 +119,43 @@ private:
 			return false;
 		}
 
+		// Item() and get_Path() are both calls into Explorer, so the selection is walked in
+		// chunks that start at one item and double up to 32: a selection whose first item is a
+		// file costs what it did before, a long one still gets parallel lookups. Extensions are
+		// checked first, they are free; each chunk's matching paths are looked up together to
+		// skip directories named like files, and the walk stops at the first confirmed file.
+		// A path that cannot be queried still counts, as before.
 		bool foundValidFile = false;
-		for (long i = 0; i < itemCount; i++) {
-			VARIANT itemIndex;
-			itemIndex.vt = VT_I4;
-			itemIndex.lVal = i;
-
-			FolderItem* item = nullptr;
-			if (FAILED(selectedItems->Item(itemIndex, &item)) || !item) {
-				continue;
-			}
-
-			BSTR pathBstr = nullptr;
-			if (SUCCEEDED(item->get_Path(&pathBstr)) && pathBstr) {
-				std::wstring path(pathBstr);
-				SysFreeString(pathBstr);
-
-				// Check if it's a directory
-				DWORD attrs = GetFileAttributes(path.c_str());
-				if (attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY)) {
-					item->Release();
+		std::vector<std::filesystem::path> candidates;
+		std::vector<SystemDrag::FileMetadata> metadata;
+		long chunk = 1;
+		for (long i = 0; i < itemCount && !foundValidFile; chunk = (std::min)(chunk * 2, 32L)) {
+			candidates.clear();
+			for (long end = (std::min)(itemCount, i + chunk); i < end; i++) {
+				VARIANT itemIndex;
+				itemIndex.vt = VT_I4;
+				itemIndex.lVal = i;
+
+				FolderItem* item = nullptr;
+				if (FAILED(selectedItems->Item(itemIndex, &item)) || !item) {
 					continue;
 				}
 
-				// Check extension
-				std::wstring ext = PathFindExtension(path.c_str());
-				if (targetExtensions.find(ext) != targetExtensions.end()) {
-					foundValidFile = true;
-					item->Release();
-					break;
+				BSTR pathBstr = nullptr;
+				if (SUCCEEDED(item->get_Path(&pathBstr)) && pathBstr) {
+					if (SystemDrag::SharedExtensionPolicy().Match(PathFindExtension(pathBstr))) {
+						candidates.emplace_back(std::wstring(pathBstr, SysStringLen(pathBstr)));
+					}
+					SysFreeString(pathBstr);
 				}
+				item->Release();
+			}
+
+			if (!candidates.empty()) {
+				SystemDrag::MetadataBatchResult batch = SystemDrag::SharedMetadataResolver().Resolve(candidates, metadata,
+					[](size_t, const SystemDrag::FileMetadata& entry) { return !entry.IsDirectory(); });
+				foundValidFile = batch.stopIndex != (size_t)-1;
 			}
-			item->Release();
 		}
 
 		selectedItems->Release();
@@ -186,72 +165,52 @@ private:
 	}
 
 public:
+	// Call on an STA thread; the proxies are kept in its shell session between polls
 	static bool IsDraggingSupportedFile() {
-		// Initialize COM
-		if (FAILED(CoInitialize(nullptr))) {
-			return false;
-		}
-
 		bool result = false;
 		try {
 			// Get cursor position
 			POINT mousePos;
 			if (!GetCursorPos(&mousePos)) {
-				CoUninitialize();
 				return false;
 			}
 
 			// Get window under cursor
 			HWND targetHwnd = WindowFromPoint(mousePos);
 			if (!targetHwnd) {
-				CoUninitialize();
 				return false;
 			}
 
 			// Find shell parent
 			ShellWindowInfo shellInfo = FindShellParent(targetHwnd);
 			if (!shellInfo.hwnd) {
-				CoUninitialize();
-				return false;
-			}
-
-			// Create Shell.Application
-			IShellWindows* shellWindows = nullptr;
-			if (FAILED(CoCreateInstance(CLSID_ShellWindows, nullptr, CLSCTX_ALL,
-				IID_IShellWindows, (void**)&shellWindows)) ||
-				!shellWindows) {
-				CoUninitialize();
 				return false;
 			}
 
+			SystemDrag::ComShellSession& session = SystemDrag::CurrentShellSession();
 			if (shellInfo.isDesktop) {
-				result = CheckDesktopSelection(shellWindows);
+				result = CheckDesktopSelection(session);
 			}
 			else {
-				result = CheckExplorerWindow(shellWindows, shellInfo.hwnd);
+				result = CheckExplorerWindow(session, shellInfo.hwnd);
 			}
 
-			shellWindows->Release();
-
 		}
 		catch (...) {
 			result = false;
 		}
 
-		CoUninitialize();
 		return result;
 	}
 };
 
-// Initialize static member
-const std::set<std::wstring> FileDetector3::targetExtensions = {
-	L".txt", L".csv", L".log", L".xml", L".json", L".cs", L".html",
-	L".md", L".xaml", L".py", L".java", L".c", L".cpp"
-};
-
 // Main ڲ
 int main3()
 {
+	// COM is entered once for the whole run, the shell session is released before leaving it
+	SystemDrag::ShellApartmentScope apartment;
+	// The extension list follows extensions.conf while the loop runs
+	SystemDrag::SharedExtensionPolicy().StartWatching(L"extensions.conf", std::chrono::milliseconds(1000));
 	std::cout << "Monitoring mouse... Drag a file (e.g., .txt) to see detection." << std::endl;
 	std::cout << "Press Ctrl+C to exit." << std::endl;
 
@@ -0,0 +1,54 @@
+#include "FormatNegotiation.h"
+
+namespace SystemDrag
+{
+	// HDROP lists every path in one block; the ID list has names but not always paths;
+	// text is at best a single path
+	const DropFormat FormatNegotiator::Priority[(size_t)DropFormat::Count] =
+	{
+		DropFormat::HDrop,
+		DropFormat::ShellIdList,
+		DropFormat::UnicodeText,
+		DropFormat::Text
+	};
+
+	FormatNegotiator::FormatNegotiator()
+	{
+		m_ids[(size_t)DropFormat::HDrop] = FormatIdHDrop;
+		m_ids[(size_t)DropFormat::ShellIdList] = 0;
+		m_ids[(size_t)DropFormat::UnicodeText] = FormatIdUnicodeText;
+		m_ids[(size_t)DropFormat::Text] = FormatIdText;
+	}
+
+	FormatOffer FormatNegotiator::Negotiate(IFormatSource& source, uint32_t wanted) const
+	{
+		FormatOffer offer = { 0, DropFormat::None, {} };
+		std::vector<bool> fetchable;
+		source.EnumerateFormats(offer.formats, fetchable);
+
+		for (size_t i = 0; i < offer.formats.size(); i++)
+		{
+			if (!fetchable[i])
+			{
+				continue;
+			}
+			for (size_t k = 0; k < (size_t)DropFormat::Count; k++)
+			{
+				if (m_ids[k] != 0 && m_ids[k] == offer.formats[i])
+				{
+					offer.available |= FormatBit((DropFormat)k);
+				}
+			}
+		}
+
+		for (DropFormat format : Priority)
+		{
+			if ((offer.available & wanted & FormatBit(format)) != 0)
+			{
+				offer.best = format;
+				break;
+			}
+		}
+		return offer;
+	}
+}
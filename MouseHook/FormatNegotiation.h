@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Clipboard / drag format negotiation in one pass.
+// Probing formats one by one with QueryGetData + GetData copies every payload that happens
+// to be present, even when an earlier one already answered the question. Here the source is
+// enumerated once into a bitmap of the formats we understand, a priority table picks the
+// cheapest one that is sufficient, and only that payload is fetched, and only when the
+// caller actually reads it.
+namespace SystemDrag
+{
+	enum class DropFormat : uint8_t
+	{
+		HDrop,          // CF_HDROP: every path, one block
+		ShellIdList,    // CFSTR_SHELLIDLIST: item IDs, names decodable for file system items
+		UnicodeText,    // CF_UNICODETEXT: maybe a path
+		Text,           // CF_TEXT: maybe a path, in the ANSI code page
+		Count,
+		None = Count
+	};
+
+	constexpr uint32_t FormatBit(DropFormat format) { return 1u << (unsigned)format; }
+
+	// Standard clipboard format ids, the same values as CF_*
+	enum StandardFormatIds : uint32_t
+	{
+		FormatIdText = 1,
+		FormatIdUnicodeText = 13,
+		FormatIdHDrop = 15
+	};
+
+	// A fetched payload; data stays valid until the source releases it
+	struct FormatPayload
+	{
+		const void* data;
+		size_t size;
+	};
+
+	class IFormatSource
+	{
+	public:
+		virtual ~IFormatSource() {}
+
+		// One enumeration of every format the source offers (TYMED_HGLOBAL or not)
+		virtual void EnumerateFormats(std::vector<uint32_t>& formats, std::vector<bool>& fetchable) = 0;
+		// Fetches one payload; a source holds at most one at a time
+		virtual bool Fetch(uint32_t format, FormatPayload& payload) = 0;
+		virtual void Release() = 0;
+	};
+
+	struct FormatOffer
+	{
+		uint32_t available;             // FormatBit of each understood format that can be fetched
+		DropFormat best;                // highest priority available format, or None
+		std::vector<uint32_t> formats;  // everything offered, for listing
+	};
+
+	class FormatNegotiator
+	{
+	public:
+		// Knows the standard ids; registered formats (ShellIdList) are added with Register
+		FormatNegotiator();
+
+		void Register(DropFormat format, uint32_t id) { m_ids[(size_t)format] = id; }
+		// 0 for None
+		uint32_t FormatId(DropFormat format) const { return format < DropFormat::Count ? m_ids[(size_t)format] : 0; }
+
+		// wanted limits the formats that may be picked
+		FormatOffer Negotiate(IFormatSource& source, uint32_t wanted = ~0u) const;
+
+		// Priority table, cheapest sufficient format first
+		static const DropFormat Priority[(size_t)DropFormat::Count];
+
+	private:
+		uint32_t m_ids[(size_t)DropFormat::Count];
+	};
+
+	// Fetches on first access and releases on destruction
+	class LazyPayload
+	{
+	public:
+		LazyPayload(IFormatSource& source, uint32_t format)
+			: m_source(source), m_format(format), m_state(State::Unfetched), m_payload{ nullptr, 0 } {}
+		~LazyPayload()
+		{
+			if (m_state == State::Held)
+			{
+				m_source.Release();
+			}
+		}
+
+		LazyPayload(const LazyPayload&) = delete;
+		LazyPayload& operator=(const LazyPayload&) = delete;
+
+		// nullptr if the fetch failed
+		const FormatPayload* Get()
+		{
+			if (m_state == State::Unfetched)
+			{
+				m_state = m_source.Fetch(m_format, m_payload) ? State::Held : State::Failed;
+			}
+			return m_state == State::Held ? &m_payload : nullptr;
+		}
+
+	private:
+		enum class State
+		{
+			Unfetched,
+			Held,
+			Failed
+		};
+
+		IFormatSource& m_source;
+		uint32_t m_format;
+		State m_state;
+		FormatPayload m_payload;
+	};
+}
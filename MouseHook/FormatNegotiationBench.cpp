@@ -0,0 +1,196 @@
+#include "FormatNegotiation.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Format negotiation against a fake data object that counts what it is asked for. The old
+// clipboard probe is replayed on the same fake: QueryGetData + GetData for CF_HDROP,
+// CF_UNICODETEXT and CF_TEXT in turn, then a second enumeration for the format listing.
+namespace SystemDrag
+{
+	class FakeDataObject : public IFormatSource
+	{
+	public:
+		struct Offered
+		{
+			uint32_t format;
+			bool hglobal;
+			size_t bytes;
+		};
+
+		explicit FakeDataObject(const std::vector<Offered>& offered) : m_offered(offered), m_held(false) {}
+
+		void EnumerateFormats(std::vector<uint32_t>& formats, std::vector<bool>& fetchable) override
+		{
+			enumerations++;
+			formats.clear();
+			fetchable.clear();
+			for (const Offered& offered : m_offered)
+			{
+				formats.push_back(offered.format);
+				fetchable.push_back(offered.hglobal);
+			}
+		}
+
+		bool QueryGetData(uint32_t format) const
+		{
+			queries++;
+			for (const Offered& offered : m_offered)
+			{
+				if (offered.format == format && offered.hglobal)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Like a real data object, GetData copies the payload into a fresh global block
+		bool Fetch(uint32_t format, FormatPayload& payload) override
+		{
+			getDataCalls++;
+			for (const Offered& offered : m_offered)
+			{
+				if (offered.format == format && offered.hglobal)
+				{
+					m_copy.assign(offered.bytes, 'x');
+					bytesCopied += offered.bytes;
+					payload.data = m_copy.data();
+					payload.size = m_copy.size();
+					m_held = true;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void Release() override
+		{
+			m_held = false;
+		}
+
+		mutable size_t queries = 0;
+		size_t enumerations = 0;
+		size_t getDataCalls = 0;
+		size_t bytesCopied = 0;
+
+	private:
+		std::vector<Offered> m_offered;
+		std::vector<char> m_copy;
+		bool m_held;
+	};
+
+	// ExtractFileInfoFromDropClipboard before negotiation
+	static void LegacyProbe(FakeDataObject& source)
+	{
+		const uint32_t probes[] = { FormatIdHDrop, FormatIdUnicodeText, FormatIdText };
+		bool textMissing = false;
+		for (uint32_t format : probes)
+		{
+			FormatPayload payload = { nullptr, 0 };
+			if (source.QueryGetData(format))
+			{
+				if (source.Fetch(format, payload))
+				{
+					source.Release();
+				}
+			}
+			else
+			{
+				textMissing = format == FormatIdText;
+			}
+		}
+		if (textMissing)
+		{
+			std::vector<uint32_t> formats;
+			std::vector<bool> fetchable;
+			source.EnumerateFormats(formats, fetchable);
+		}
+	}
+
+	static bool NegotiatedProbe(FakeDataObject& source, DropFormat expected, uint32_t shellIdList)
+	{
+		FormatNegotiator negotiator;
+		negotiator.Register(DropFormat::ShellIdList, shellIdList);
+		FormatOffer offer = negotiator.Negotiate(source);
+		LazyPayload payload(source, negotiator.FormatId(offer.best));
+		if (offer.best != DropFormat::None)
+		{
+			payload.Get();
+		}
+		return offer.best == expected;
+	}
+
+	// Command line entry: FormatNegotiationBenchMain [paths in the drop] [rounds]
+	int FormatNegotiationBenchMain(int argc, char* argv[])
+	{
+		size_t paths = argc > 1 ? (size_t)std::atoi(argv[1]) : 10000;
+		int rounds = argc > 2 ? std::atoi(argv[2]) : 1000;
+
+		// Explorer puts the paths in HDROP and again as text, next to a dozen shell formats
+		size_t hdropBytes = 20 + paths * 60 * 2;
+		const uint32_t shellIdList = 0xC0A1;
+		const uint32_t fileContents = 0xC0A2;
+		struct Scenario
+		{
+			const char* name;
+			std::vector<FakeDataObject::Offered> offered;
+			DropFormat expected;
+		};
+		std::vector<Scenario> scenarios =
+		{
+			{ "explorer files", { { shellIdList, true, paths * 40 }, { FormatIdHDrop, true, hdropBytes },
+				{ FormatIdUnicodeText, true, paths * 60 * 2 }, { FormatIdText, true, paths * 60 },
+				{ fileContents, false, 0 }, { 0xC0A3, true, 16 }, { 0xC0A4, true, 16 } }, DropFormat::HDrop },
+			{ "editor text", { { FormatIdUnicodeText, true, 4096 }, { FormatIdText, true, 2048 }, { 7, true, 2048 } },
+				DropFormat::UnicodeText },
+			{ "library items", { { shellIdList, true, paths * 40 }, { fileContents, false, 0 } }, DropFormat::ShellIdList },
+			{ "ansi text", { { FormatIdText, true, 256 } }, DropFormat::Text },
+			{ "bitmap", { { 8, true, 1 << 20 }, { 2, false, 0 }, { 17, true, 1 << 20 } }, DropFormat::None }
+		};
+
+		bool correct = true;
+		for (const Scenario& scenario : scenarios)
+		{
+			FakeDataObject legacy(scenario.offered);
+			FakeDataObject negotiated(scenario.offered);
+
+			auto t0 = std::chrono::steady_clock::now();
+			for (int r = 0; r < rounds; r++)
+			{
+				LegacyProbe(legacy);
+			}
+			auto t1 = std::chrono::steady_clock::now();
+			for (int r = 0; r < rounds; r++)
+			{
+				correct = NegotiatedProbe(negotiated, scenario.expected, shellIdList) && correct;
+			}
+			auto t2 = std::chrono::steady_clock::now();
+
+			std::cout << scenario.name << ":" << std::endl;
+			std::cout << "  probing:     " << (double)legacy.queries / rounds << " QueryGetData, "
+				<< (double)legacy.getDataCalls / rounds << " GetData, " << legacy.bytesCopied / rounds << " bytes, "
+				<< (double)legacy.enumerations / rounds << " enumerations, "
+				<< std::chrono::duration<double, std::micro>(t1 - t0).count() / rounds << " us" << std::endl;
+			std::cout << "  negotiation: " << (double)negotiated.queries / rounds << " QueryGetData, "
+				<< (double)negotiated.getDataCalls / rounds << " GetData, " << negotiated.bytesCopied / rounds << " bytes, "
+				<< (double)negotiated.enumerations / rounds << " enumerations, "
+				<< std::chrono::duration<double, std::micro>(t2 - t1).count() / rounds << " us" << std::endl;
+
+			// At most one enumeration and one fetch, never more bytes than the probe where the
+			// probe found anything (it never looked at the ID list)
+			if (negotiated.enumerations != (size_t)rounds || negotiated.getDataCalls > (size_t)rounds
+				|| (legacy.getDataCalls > 0 && negotiated.bytesCopied > legacy.bytesCopied))
+			{
+				correct = false;
+			}
+		}
+
+		std::cout << (correct ? "negotiation ok" : "negotiation WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
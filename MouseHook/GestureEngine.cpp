@@ -0,0 +1,86 @@
+#include "GestureEngine.h"
+
+#include <cstdlib>
+
+namespace SystemDrag
+{
+	GestureEngine::GestureEngine(int minDragX, int minDragY)
+		: m_minDragX(minDragX), m_minDragY(minDragY)
+		, m_buttonDown(false), m_dragging(false), m_checkRequested(false)
+		, m_sessionId(0), m_startX(0), m_startY(0), m_startTime(0)
+	{
+	}
+
+	void GestureEngine::SetThreshold(int minDragX, int minDragY)
+	{
+		m_minDragX = minDragX;
+		m_minDragY = minDragY;
+	}
+
+	void GestureEngine::Reset()
+	{
+		m_buttonDown = false;
+		m_dragging = false;
+		m_checkRequested = false;
+	}
+
+	unsigned GestureEngine::Feed(const PointerEvent& ev)
+	{
+		unsigned signals = GestureNone;
+
+		switch (ev.action)
+		{
+		case PointerAction::ButtonDown:
+		{
+			// A new press always starts a new session, even if the release was lost
+			m_buttonDown = true;
+			m_dragging = false;
+			m_checkRequested = false;
+			m_sessionId++;
+			m_startX = ev.x;
+			m_startY = ev.y;
+			m_startTime = ev.time;
+			break;
+		}
+
+		case PointerAction::Move:
+		{
+			if (!m_buttonDown)
+			{
+				break;
+			}
+
+			if (!m_dragging)
+			{
+				long dx = std::labs((long)ev.x - m_startX);
+				long dy = std::labs((long)ev.y - m_startY);
+
+				if (dx >= m_minDragX || dy >= m_minDragY)
+				{
+					m_dragging = true;
+					signals |= GestureDragStart;
+				}
+			}
+
+			if (m_dragging && !m_checkRequested)
+			{
+				m_checkRequested = true;
+				signals |= GestureCheckRequested;
+			}
+			break;
+		}
+
+		case PointerAction::ButtonUp:
+		{
+			if (m_dragging)
+			{
+				signals |= GestureDragEnd;
+			}
+			Reset();
+			break;
+		}
+		}
+
+		return signals;
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+// Platform independent drag gesture state machine.
+// The hook callbacks translate MSLLHOOKSTRUCT into PointerEvent and feed it here,
+// so the same logic can be replayed and measured without a live desktop.
+namespace SystemDrag
+{
+	enum class PointerAction : uint8_t
+	{
+		Move,
+		ButtonDown,
+		ButtonUp
+	};
+
+	struct PointerEvent
+	{
+		uint32_t time;       // milliseconds, same clock as MSLLHOOKSTRUCT::time
+		int32_t x;
+		int32_t y;
+		PointerAction action;
+	};
+
+	// Transitions emitted by GestureEngine::Feed (bit mask, one event can raise several)
+	enum GestureSignal : unsigned
+	{
+		GestureNone = 0,
+		GestureDragStart = 1u << 0,
+		GestureCheckRequested = 1u << 1,
+		GestureDragEnd = 1u << 2
+	};
+
+	enum class DragEventKind : uint8_t
+	{
+		CheckRequested,
+		DragEnd,
+		Prefetch        // speculative detection for a press that has not crossed the threshold yet
+	};
+
+	// Record handed from the hook callback to the detection consumer
+	struct DragEventRecord
+	{
+		uint32_t sessionId;
+		uint32_t time;       // MSLLHOOKSTRUCT::time of the triggering event
+		int32_t x;
+		int32_t y;
+		DragEventKind kind;
+		uint16_t pointer;    // PointerTable slot of the session, 0 from single pointer sources
+	};
+
+	class GestureEngine
+	{
+	public:
+		// The threshold is inclusive: a drag starts once |dx| >= minDragX or |dy| >= minDragY,
+		// matching the SM_CXDRAG / SM_CYDRAG semantics.
+		explicit GestureEngine(int minDragX = 4, int minDragY = 4);
+
+		void SetThreshold(int minDragX, int minDragY);
+		// Forget the current press; the hook also uses it to stop tracking a press
+		// that did not land on a shell window
+		void Reset();
+
+		// Advance the state machine by one event, returns a GestureSignal mask
+		unsigned Feed(const PointerEvent& ev);
+
+		// True when Feed() would return GestureNone for a move to (x, y), so the hook can
+		// skip the event. Only a pending press needs moves, and then only the one that puts
+		// the pointer at or past the threshold; the distance from the press point is every
+		// delta since the press added up, so the moves skipped before it lose nothing.
+		bool MoveIsIdle(int32_t x, int32_t y) const
+		{
+			if (!m_buttonDown || m_checkRequested)
+			{
+				return true;
+			}
+			return !m_dragging && std::labs((long)x - m_startX) < m_minDragX && std::labs((long)y - m_startY) < m_minDragY;
+		}
+
+		bool IsButtonDown() const { return m_buttonDown; }
+		bool IsDragging() const { return m_dragging; }
+		// Incremented on every button down, identifies the current press / drag
+		uint32_t SessionId() const { return m_sessionId; }
+		int32_t StartX() const { return m_startX; }
+		int32_t StartY() const { return m_startY; }
+		uint32_t StartTime() const { return m_startTime; }
+
+	private:
+		int m_minDragX;
+		int m_minDragY;
+
+		bool m_buttonDown;
+		bool m_dragging;
+		bool m_checkRequested;
+		uint32_t m_sessionId;
+		int32_t m_startX;
+		int32_t m_startY;
+		uint32_t m_startTime;
+	};
+}
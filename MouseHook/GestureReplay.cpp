@@ -0,0 +1,171 @@
+#include "GestureReplay.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace SystemDrag
+{
+	std::vector<PointerEvent> MakeSyntheticGestures(size_t gestureCount, int movesPerGesture,
+		int dragPercent, uint32_t seed)
+	{
+		std::vector<PointerEvent> events;
+		events.reserve(gestureCount * (movesPerGesture + 2));
+
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> pos(0, 3840);
+		std::uniform_int_distribution<int> step(-3, 3);
+		std::uniform_int_distribution<int> percent(0, 99);
+
+		uint32_t time = 0;
+		for (size_t g = 0; g < gestureCount; g++)
+		{
+			int32_t x = pos(rng);
+			int32_t y = pos(rng) / 2;
+			bool drag = percent(rng) < dragPercent;
+
+			events.push_back({ time, x, y, PointerAction::ButtonDown });
+			for (int i = 0; i < movesPerGesture; i++)
+			{
+				time++;
+				if (drag)
+				{
+					// Steady drift to the right, crosses any sane threshold after a few moves
+					x += 2;
+					y += step(rng);
+				}
+				else
+				{
+					// Hand jitter, stays inside the threshold box
+					x = events.back().x + (i % 2 ? 1 : -1);
+				}
+				events.push_back({ time, x, y, PointerAction::Move });
+			}
+			time++;
+			events.push_back({ time, x, y, PointerAction::ButtonUp });
+			time += 50;
+		}
+		return events;
+	}
+
+	bool LoadGestureTrace(const std::string& path, std::vector<PointerEvent>& events)
+	{
+		std::ifstream in(path);
+		if (!in)
+		{
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(in, line))
+		{
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+
+			std::istringstream fields(line);
+			PointerEvent ev = {};
+			char action = 0;
+			if (!(fields >> ev.time >> ev.x >> ev.y >> action))
+			{
+				std::cerr << "Bad trace line: " << line << std::endl;
+				return false;
+			}
+
+			switch (action)
+			{
+			case 'D': ev.action = PointerAction::ButtonDown; break;
+			case 'U': ev.action = PointerAction::ButtonUp; break;
+			case 'M': ev.action = PointerAction::Move; break;
+			default:
+				std::cerr << "Bad trace action: " << line << std::endl;
+				return false;
+			}
+			events.push_back(ev);
+		}
+		return true;
+	}
+
+	bool SaveGestureTrace(const std::string& path, const std::vector<PointerEvent>& events)
+	{
+		std::ofstream out(path);
+		if (!out)
+		{
+			return false;
+		}
+
+		for (const PointerEvent& ev : events)
+		{
+			char action = ev.action == PointerAction::ButtonDown ? 'D'
+				: ev.action == PointerAction::ButtonUp ? 'U' : 'M';
+			out << ev.time << ' ' << ev.x << ' ' << ev.y << ' ' << action << '\n';
+		}
+		return bool(out);
+	}
+
+	ReplayStats ReplayGestures(GestureEngine& engine, const std::vector<PointerEvent>& events, int iterations)
+	{
+		ReplayStats stats = {};
+
+		auto begin = std::chrono::steady_clock::now();
+		for (int it = 0; it < iterations; it++)
+		{
+			engine.Reset();
+			for (const PointerEvent& ev : events)
+			{
+				unsigned signals = engine.Feed(ev);
+				stats.dragStarts += (signals & GestureDragStart) != 0;
+				stats.dragEnds += (signals & GestureDragEnd) != 0;
+				stats.checks += (signals & GestureCheckRequested) != 0;
+			}
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		stats.events = (uint64_t)events.size() * iterations;
+		stats.elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+		return stats;
+	}
+
+	int ReplayMain(int argc, char* argv[])
+	{
+		std::vector<PointerEvent> events;
+		if (argc > 1 && std::string(argv[1]) != "-")
+		{
+			if (!LoadGestureTrace(argv[1], events))
+			{
+				std::cerr << "Failed to load trace: " << argv[1] << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			events = MakeSyntheticGestures(100000, 16, 30, 42);
+		}
+
+		int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+		if (iterations <= 0)
+		{
+			iterations = 1;
+		}
+
+		GestureEngine engine;
+		ReplayStats stats = ReplayGestures(engine, events, iterations);
+
+		std::cout << "events: " << stats.events
+			<< " dragStart: " << stats.dragStarts
+			<< " dragEnd: " << stats.dragEnds
+			<< " check: " << stats.checks << std::endl;
+		std::cout << "events/sec: " << stats.EventsPerSecond()
+			<< " ns/event: " << stats.NsPerEvent() << std::endl;
+
+		// Every drag ends again, except one the trace may stop in the middle of
+		bool correct = stats.events != 0 && stats.dragStarts >= stats.dragEnds
+			&& stats.dragStarts - stats.dragEnds <= (uint64_t)iterations;
+		std::cout << (correct ? "replay ok" : "replay WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
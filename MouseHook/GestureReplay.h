@@ -0,0 +1,38 @@
+#pragma once
+
+#include "GestureEngine.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Replay driver for GestureEngine: feeds recorded or synthetic pointer streams
+// and measures throughput, no Windows API involved.
+namespace SystemDrag
+{
+	struct ReplayStats
+	{
+		uint64_t events;
+		uint64_t dragStarts;
+		uint64_t dragEnds;
+		uint64_t checks;
+		double elapsedNs;
+
+		double EventsPerSecond() const { return elapsedNs > 0 ? events * 1e9 / elapsedNs : 0; }
+		double NsPerEvent() const { return events > 0 ? elapsedNs / events : 0; }
+	};
+
+	// Generates gestureCount presses; every dragPercent-th of them is a drag of movesPerGesture moves,
+	// the rest are clicks that jitter inside the threshold
+	std::vector<PointerEvent> MakeSyntheticGestures(size_t gestureCount, int movesPerGesture,
+		int dragPercent, uint32_t seed);
+
+	// Text trace, one event per line: "<time> <x> <y> <D|U|M>", '#' starts a comment
+	bool LoadGestureTrace(const std::string& path, std::vector<PointerEvent>& events);
+	bool SaveGestureTrace(const std::string& path, const std::vector<PointerEvent>& events);
+
+	ReplayStats ReplayGestures(GestureEngine& engine, const std::vector<PointerEvent>& events, int iterations);
+
+	// Command line entry: ReplayMain [trace-file, "-" for synthetic gestures] [iterations]
+	int ReplayMain(int argc, char* argv[]);
+}
@@ -7,8 +7,28 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <algorithm>
-#include <set>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include "AsyncLog.h"
+#include "ComShellSession.h"
+#include "ContentSniffer.h"
+#include "DetectionExecutor.h"
+#include "DragTrace.h"
+#include "DragVerdict.h"
+#include "ExtensionPolicy.h"
+#include "GestureEngine.h"
+#include "HookWatchdog.h"
+#include "LatencyHistogram.h"
+#include "PointerTable.h"
+#include "ShellSelectionSource.h"
+#include "ShellWindowsSource.h"
+#include "Speculation.h"
+#include "StaApartment.h"
+#include "WindowTree.h"
 
 #pragma comment(lib, "User32.lib")
 #pragma comment(lib, "Ole32.lib")
@@ -20,126 +40,56 @@ namespace SystemDrag
 	class FileDetector
 	{
 	private:
-		static bool IsTargetExtension(const std::wstring& path)
+		static HWND FindShellParent(HWND hWnd, bool& isDesktop)
 		{
-			// Ŀ׺
-			static const std::set<std::wstring> targetExtensions = {
-				L".txt", L".csv", L".log", L".xml", L".json", L".cs",
-				L".html", L".md", L".xaml", L".py", L".java", L".c", L".cpp", L".png", L".doc", L".docx", L".pdf", L".jpg", L".jpeg", L".bmp"
-			};
-
-			LPWSTR ext = PathFindExtensionW(path.c_str());
-			if (ext == NULL) return false;
-
-			std::wstring extStr(ext);
-			// תΪСдбȽ
-			std::transform(extStr.begin(), extStr.end(), extStr.begin(), ::towlower);
-
-			return targetExtensions.count(extStr) > 0;
+			// Ȳҽڻ棬ٻı丸ʱʧЧ
+			ShellRoot root = ShellAncestry().Resolve((WindowKey)hWnd);
+			isDesktop = root.kind == ShellKind::Desktop;
+			return (HWND)root.window;
 		}
 
-		//  Window/View ǷѡеĺϷļ
-		static bool HasValidSelection(IDispatch* pDispWindow)
+		// ȡڶӦͼȡѡд result Disconnected ʾͼԴʧЧ
+		static ShellStatus PullView(HWND shellHwnd, bool isDesktop, const CancelToken& token, Verdict& result)
 		{
-			if (!pDispWindow) return false;
-
-			CComPtr<IWebBrowser2> pBrowser;
-			HRESULT hr = pDispWindow->QueryInterface(IID_IWebBrowser2, (void**)&pBrowser);
-			if (FAILED(hr)) return false;
-
-			// ȡ Document
-			CComPtr<IDispatch> pDispDoc;
-			hr = pBrowser->get_Document(&pDispDoc);
-			if (FAILED(hr) || !pDispDoc) return false;
-
-			// ȡ Folder View
-			CComPtr<IShellFolderViewDual> pFolderView;
-			hr = pDispDoc->QueryInterface(IID_IShellFolderViewDual, (void**)&pFolderView);
-			if (FAILED(hr)) return false;
-
-			// ȡ SelectedItems
-			CComPtr<FolderItems> pSelectedItems;
-			hr = pFolderView->SelectedItems(&pSelectedItems);
-			if (FAILED(hr) || !pSelectedItems) return false;
-
-			long count = 0;
-			pSelectedItems->get_Count(&count);
-			if (count == 0) return false;
-
-			// ѡ
-			for (long i = 0; i < count; i++)
+			CComPtr<IDispatch> pDisp;
+			if (isDesktop)
 			{
-				CComVariant varIndex(i);
-				CComPtr<FolderItem> pItem;
-				hr = pSelectedItems->Item(varIndex, &pItem);
-
-				if (SUCCEEDED(hr) && pItem)
+				// ͼɱ̵߳ Shell Ự棺IShellWindows ֻһΣFindWindowSW ֻ״
+				// ԼԴ (洰ٻ÷ RPC_E_DISCONNECTED) ִ֮
+				ShellStatus status = CurrentShellSession().DesktopView(pDisp);
+				if (status != ShellStatus::Ok)
 				{
-					VARIANT_BOOL isFolder = VARIANT_FALSE;
-					pItem->get_IsFolder(&isFolder);
-
-					// ļУ (Ӧ C# Directory.Exists ߼)
-					if (isFolder == VARIANT_TRUE) continue;
-
-					BSTR bstrPath = NULL;
-					pItem->get_Path(&bstrPath);
-					if (bstrPath)
-					{
-						std::wstring path(bstrPath, SysStringLen(bstrPath));
-						SysFreeString(bstrPath);
-
-						if (IsTargetExtension(path))
-						{
-							return true;
-						}
-					}
+					SharedLog().Write("Failed to get the desktop view:{}", (int)status);
+					return status;
 				}
 			}
-			return false;
-		}
-
-		static HWND FindShellParent(HWND hWnd, bool& isDesktop)
-		{
-			isDesktop = false;
-			HWND current = hWnd;
-
-			while (current != NULL)
+			else if (!ShellViews().Lookup((WindowKey)shellHwnd, pDisp))
 			{
-				wchar_t className[256];
-				GetClassNameW(current, className, 256);
-
-				// ǷͨԴ
-				if (wcscmp(className, L"CabinetWClass") == 0)
-				{
-					return current;
-				}
-
-				// Ƿ
-				if (wcscmp(className, L"Progman") == 0 || wcscmp(className, L"WorkerW") == 0)
-				{
-					isDesktop = true;
-					return current;
-				}
-
-				current = GetParent(current);
+				// ӻȡڶӦͼֻдע± IShellWindows Shell ͼ
+				return ShellStatus::Ok;
 			}
 
-			// ׼飺ѭûҵ WorkerW ܸ Progman 
-			HWND progman = FindWindowW(L"Progman", NULL);
-			if (progman != NULL)
+			if (token.Cancelled())
 			{
-				// 򻯴ҲҲû NULL
+				result = Verdict::Cancelled;
+				return ShellStatus::Ok;
 			}
-
-			return NULL;
+			result = SelectionTracking().Pull((WindowKey)shellHwnd, pDisp, token);
+			return LastSelectionStatus();
 		}
 
 	public:
 		static bool IsDraggingSupportedFile()
+		{
+			return Detect(CancelToken()) == Verdict::Supported;
+		}
+
+		// ȡļ⣺token ӦקỰһ账 Cancelled
+		static Verdict Detect(const CancelToken& token)
 		{
 			// COM ʼ (ʵʹн߳ڴʼһΣҪںƵ)
 			//CoInitialize(NULL);
-			bool result = false;
+			Verdict result = Verdict::Unsupported;
 
 			try
 			{
@@ -147,82 +97,52 @@ namespace SystemDrag
 				POINT mousePos;
 				GetCursorPos(&mousePos);
 
-				// 2. ȡµĴھ
+				// 2. ȡµĴھ (ʱֽ׶ֱͼ)
+				StageTimer windowStage(DetectionStage::WindowFromPoint);
 				HWND targetHwnd = WindowFromPoint(mousePos);
+				windowStage.Stop();
 				if (targetHwnd == NULL) throw 0;
 
 				// 3. ϻ
 				bool isDesktop = false;
+				StageTimer parentStage(DetectionStage::FindShellParent);
 				HWND shellHwnd = FindShellParent(targetHwnd, isDesktop);
-				if (shellHwnd == NULL) throw 0;
-
-				// 4. ʼ ShellWindows
-				CComPtr<IShellWindows> pShellWindows;
-				HRESULT hr = pShellWindows.CoCreateInstance(CLSID_ShellWindows);
-				if (FAILED(hr))
+				parentStage.Stop();
+				if (shellHwnd == NULL)
 				{
-					std::cout << "Failed to create IShellWindows instance:" << hr << std::endl;
+					SharedDragTrace().ShellLookup(token.Session(), (uint64_t)(uintptr_t)targetHwnd, 0, (uint8_t)ShellKind::None, false);
 					throw 0;
 				}
-
-				// 5. Ͳ
-				if (isDesktop)
+				if (token.Cancelled()) return Verdict::Cancelled;
+
+				// Ѷѡ仯ĴֱӲκο̵
+				Verdict tracked = Verdict::Unsupported;
+				bool trackedHit = SelectionTracking().Lookup((WindowKey)shellHwnd, tracked);
+				SharedDragTrace().ShellLookup(token.Session(), (uint64_t)(uintptr_t)targetHwnd, (uint64_t)(uintptr_t)shellHwnd,
+					(uint8_t)(isDesktop ? ShellKind::Desktop : ShellKind::Explorer), trackedHit);
+				if (trackedHit)
 				{
-					// Ӧ C#: shellWindows.FindWindowSW(..., SWC_DESKTOP, ..., SWFO_NEEDDISPATCH)
-					// SWC_DESKTOP = 8, SWFO_NEEDDISPATCH = 1
-					CComVariant vMissing;
-					vMissing.vt = VT_ERROR;
-					vMissing.scode = DISP_E_PARAMNOTFOUND;
-					int hwndVal = 0;
-					CComPtr<IDispatch> pDispDesktop;
-
-					hr = pShellWindows->FindWindowSW(
-						&vMissing, &vMissing,
-						SWC_DESKTOP,
-						(long*)&hwndVal,
-						SWFO_NEEDDISPATCH,
-						&pDispDesktop
-					);
-
-					if (SUCCEEDED(hr) && pDispDesktop)
-					{
-						result = HasValidSelection(pDispDesktop);
-					}
+					return tracked;
 				}
-				else
-				{
-					// д򿪵 Explorer 
-					long winCount = 0;
-					pShellWindows->get_Count(&winCount);
 
-					for (long i = 0; i < winCount; i++)
+				// 4. ͲҡͼԴ˳ʱ (ͼ򻺴Ĵͼϵĵ÷
+				// RPC_E_DISCONNECTED)Ͽ̵߳ Shell Ựͼ桢ôڵĸһ
+				for (int attempt = 0; attempt < 2; attempt++)
+				{
+					result = Verdict::Unsupported;
+					if (PullView(shellHwnd, isDesktop, token, result) != ShellStatus::Disconnected)
 					{
-						CComVariant index(i);
-						CComPtr<IDispatch> pDisp;
-						hr = pShellWindows->Item(index, &pDisp);
-
-						if (SUCCEEDED(hr) && pDisp)
-						{
-							CComPtr<IWebBrowser2> pBrowser;
-							hr = pDisp->QueryInterface(IID_IWebBrowser2, (void**)&pBrowser);
-							if (SUCCEEDED(hr))
-							{
-								SHANDLE_PTR hWindow = 0;
-								pBrowser->get_HWND(&hWindow);
-
-								if ((HWND)hWindow == shellHwnd)
-								{
-									result = HasValidSelection(pDisp);
-									if (result) break;
-								}
-							}
-						}
+						break;
 					}
+					SharedLog().Write("Shell view disconnected, reconnecting:{}", attempt);
+					SelectionTracking().OnViewGone((WindowKey)shellHwnd);
+					ShellViews().Invalidate();
+					CurrentShellSession().Reconnect();
 				}
 			}
 			catch (...)
 			{
-				result = false;
+				result = Verdict::Unsupported;
 			}
 
 			//CoUninitialize();
@@ -232,123 +152,455 @@ namespace SystemDrag
 }
 
 
-// ԶϢ ID߳̽չӷ
-#define WM_PERFORM_DRAG_CHECK (WM_USER + 100)
-// ȫھڷϢ
-static DWORD g_mainThreadId = 0;
+// ק״̬ ( Windows ޹أ߻ط)//мʺÿһָ룬
+// ԼקỰÿλİ/קբŹжϻỰǷѹ
+static SystemDrag::PointerTable g_pointers(16);
+
+// Ʋ (--speculate )º󼴿ʼ⣬קʱֱӲý
+// ֻһΰµָ
+static bool g_speculate = false;
+// ºȴһƶٷƲ⣺ʱԴѴ갴£ѡѸ
+static bool g_prefetchPending = false;
+static uint32_t g_prefetchSlot = SystemDrag::PointerTable::NoSlot;
 
+static int64_t SteadyNs()
+{
+	return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-// ȫ״̬
-static bool g_isLButtonDown = false;
-static bool g_isDragging = false;
-static bool g_detectionCalled = false;
-static POINT g_dragStartPos = { 0, 0 };
+// ʱ̣ͳ  ->  Ķ˵˺ʱ (߳д̶߳)
+static std::atomic<uint32_t> g_pressTimedSession(0);
+static std::atomic<int64_t> g_pressTimeNs(0);
 
-// ϵͳקֵ
-static int g_minDragX = 0;
-static int g_minDragY = 0;
+//  -> ̣߳ÿ߳һ STA һ/ߵУ
+// ָλɣͬһָ¼˳ͬһִ߳
+static SystemDrag::DetectionExecutor* g_detection = nullptr;
+
+static void PushDragEvent(SystemDrag::DragEventKind kind, uint32_t slot, uint32_t session, const SystemDrag::PointerEvent& ev)
+{
+	SystemDrag::DragEventRecord record = { session, ev.time, ev.x, ev.y, kind, (uint16_t)slot };
+	if (g_detection != nullptr)
+	{
+		g_detection->Post(record);
+	}
+}
 
 // Ӿ
 static HHOOK g_mouseHook = NULL;
 
+// ӻصʱԤʱȹرջصڵ־ٰѰλõжϽ̣߳
+// صղ¼ʱע̽¼̽Ҳղ°װ
+static SystemDrag::SteadyWatchdogClock g_watchdogClock;
+static SystemDrag::HookWatchdog g_watchdog(g_watchdogClock, SystemDrag::DefaultHookBudget(SystemDrag::LowLevelHooksTimeoutNs()));
+
+// ϲƶ (--no-coalesce رգ--trace ʱҲرԱ¼ÿ¼)
+static bool g_coalesceMoves = true;
+
 // =========================================================
 // 2. ӻص (ļ߼)
 // =========================================================
 
 LRESULT CALLBACK MouseHookProc(int nCode, WPARAM wParam, LPARAM lParam)
 {
+	// ·δ¡Ѿקֵڵƶκźţ
+	// ֱӷУ4-8 kHz ÿǧλص
+	if (nCode >= 0 && wParam == WM_MOUSEMOVE && g_coalesceMoves && !g_prefetchPending)
+	{
+		const MSLLHOOKSTRUCT* pMove = (const MSLLHOOKSTRUCT*)lParam;
+		if (g_pointers.MoveIsIdle(SystemDrag::PointerDeviceFromExtraInfo(pMove->dwExtraInfo), pMove->pt.x, pMove->pt.y))
+		{
+			g_watchdog.FastPath();
+			return CallNextHookEx(g_mouseHook, nCode, wParam, lParam);
+		}
+	}
+
+	uint64_t hookEntered = g_watchdog.Enter();
+
 	// ȷЧ (nCode >= 0)
 	if (nCode >= 0)
 	{
 		MSLLHOOKSTRUCT* pMouseStruct = (MSLLHOOKSTRUCT*)lParam;
-		POINT currentPos = pMouseStruct->pt;
 
+		SystemDrag::PointerEvent ev;
+		ev.time = pMouseStruct->time;
+		ev.x = pMouseStruct->pt.x;
+		ev.y = pMouseStruct->pt.y;
+
+		// ʺʹϢ豸֣Ҽק (/ƶ˵) ֿ
+		uint32_t device = SystemDrag::PointerDeviceFromExtraInfo(pMouseStruct->dwExtraInfo);
+		SystemDrag::PointerButton button = SystemDrag::PointerButton::Left;
+		bool relevant = true;
 		switch (wParam)
 		{
 		case WM_LBUTTONDOWN:
-		{
-			// 
-			g_isLButtonDown = true;
-			g_isDragging = false;
-			g_detectionCalled = false;
-			g_dragStartPos = currentPos;
-			std::cout << "\n[EVENT] LButton Down.\n";
+		case WM_RBUTTONDOWN:
+		case WM_MBUTTONDOWN:
+			ev.action = SystemDrag::PointerAction::ButtonDown;
+			break;
+		case WM_MOUSEMOVE:
+			ev.action = SystemDrag::PointerAction::Move;
+			break;
+		case WM_LBUTTONUP:
+		case WM_RBUTTONUP:
+		case WM_MBUTTONUP:
+			ev.action = SystemDrag::PointerAction::ButtonUp;
+			break;
+		default:
+			relevant = false;
 			break;
 		}
+		if (wParam == WM_RBUTTONDOWN || wParam == WM_RBUTTONUP)
+		{
+			button = SystemDrag::PointerButton::Right;
+		}
+		else if (wParam == WM_MBUTTONDOWN || wParam == WM_MBUTTONUP)
+		{
+			button = SystemDrag::PointerButton::Middle;
+		}
 
-		case WM_MOUSEMOVE:
+		// Ź̽¼ֻȷϹȻЧ
+		if (SystemDrag::IsHookProbe(pMouseStruct->dwExtraInfo))
 		{
-			if (g_isLButtonDown)
+			relevant = false;
+		}
+
+		if (relevant)
+		{
+			// ¼ı״ָ̬룺һƶƽͬһ豸ϰסĶ
+			SystemDrag::PointerSignal raised[SystemDrag::PointerTable::ButtonCount];
+			size_t raisedCount = 0;
+			uint32_t traceSession = 0;
+			SystemDrag::ShellKind pressKind = SystemDrag::ShellKind::None;
+
+			if (ev.action == SystemDrag::PointerAction::ButtonDown)
 			{
-				if (!g_isDragging)
+				// ͬһָȡ֮ǰδɵļ⣬ָקӰ
+				// вλռʱΰ
+				uint32_t slot = g_pointers.Press(device, button, ev);
+				if (slot != SystemDrag::PointerTable::NoSlot)
 				{
-					// ڰ£Ƿ񳬹קֵ
-					long dx = std::abs(currentPos.x - g_dragStartPos.x);
-					long dy = std::abs(currentPos.y - g_dragStartPos.y);
+					traceSession = g_pointers.SessionId(slot);
+
+					// λòԴ/ڣΰ²ק
+					// صԤʱһÿΰ¶٣̵߳ FindShellParent ų Shell 
+					if (g_watchdog.ShedPressWork())
+					{
+						pressKind = SystemDrag::ShellKind::Explorer;
+					}
+					else
+					{
+						HWND target = WindowFromPoint(pMouseStruct->pt);
+						pressKind = SystemDrag::ShellAncestry().Resolve((SystemDrag::WindowKey)target).kind;
+					}
+					if (pressKind == SystemDrag::ShellKind::None)
+					{
+						g_pointers.Drop(slot);
+					}
+					else
+					{
+						if (g_watchdog.LoggingAllowed())
+						{
+							SystemDrag::SharedLog().Write("\n[EVENT] Button {} Down, device {}, session {}.", button, device, traceSession);
+						}
+						g_pressTimeNs.store(SteadyNs(), std::memory_order_relaxed);
+						g_pressTimedSession.store(traceSession, std::memory_order_release);
+						g_prefetchPending = g_speculate;
+						g_prefetchSlot = slot;
+					}
+				}
+			}
+			else if (ev.action == SystemDrag::PointerAction::Move)
+			{
+				if (g_prefetchPending && g_pointers.IsDown(g_prefetchSlot) && g_pointers.Device(g_prefetchSlot) == device)
+				{
+					g_prefetchPending = false;
+					PushDragEvent(SystemDrag::DragEventKind::Prefetch, g_prefetchSlot, g_pointers.SessionId(g_prefetchSlot), ev);
+				}
+				raisedCount = g_pointers.Move(device, ev, raised);
+			}
+			else
+			{
+				raised[0] = g_pointers.Release(device, button);
+				if (raised[0].slot != SystemDrag::PointerTable::NoSlot)
+				{
+					traceSession = raised[0].sessionId;
+					raisedCount = 1;
+					if (raised[0].slot == g_prefetchSlot)
+					{
+						g_prefetchPending = false;
+					}
+				}
+			}
 
-					if (dx >= g_minDragX || dy >= g_minDragY)
+			// ļ (--trace )¼״̬ÿ¼߻ط
+			SystemDrag::SharedDragTrace().Pointer(traceSession, ev, (uint8_t)pressKind, device, button);
+
+			for (size_t i = 0; i < raisedCount; i++)
+			{
+				const SystemDrag::PointerSignal& pointer = raised[i];
+				if (pointer.signals & SystemDrag::GestureDragStart)
+				{
+					// ﵽקֵ
+					if (g_watchdog.LoggingAllowed())
 					{
-						// ﵽקֵ
-						g_isDragging = true;
-						std::cout << "[EVENT] Dragging Started.\n";
+						SystemDrag::SharedLog().Write("[EVENT] Dragging Started, session {}.", pointer.sessionId);
 					}
 				}
 
-				if (g_isDragging && !g_detectionCalled)
+				if (pointer.signals & SystemDrag::GestureCheckRequested)
 				{
-					// קִļ
-					PostThreadMessage(g_mainThreadId, WM_PERFORM_DRAG_CHECK, 0, 0);
-					g_detectionCalled = true;
+					// קִ֪ͨ߳ļ (קբ״̬)
+					PushDragEvent(SystemDrag::DragEventKind::CheckRequested, pointer.slot, pointer.sessionId, ev);
+				}
+
+				if (pointer.signals & SystemDrag::GestureDragEnd)
+				{
+					if (g_watchdog.LoggingAllowed())
+					{
+						SystemDrag::SharedLog().Write("[EVENT] Dragging Released, session {}.", pointer.sessionId);
+					}
+					PushDragEvent(SystemDrag::DragEventKind::DragEnd, pointer.slot, pointer.sessionId, ev);
 				}
 			}
-			break;
 		}
+	}
 
-		case WM_LBUTTONUP:
+	g_watchdog.Leave(hookEntered);
+
+	// صһӣ¼ȥ
+	return CallNextHookEx(g_mouseHook, nCode, wParam, lParam);
+}
+
+// ʱϵͳյûʱע̽¼̽Ҳûյ˵ѱϵͳƳ
+static void ServiceHookWatchdog()
+{
+	switch (g_watchdog.Poll(SystemDrag::LastInputNs(g_watchdogClock)))
+	{
+	case SystemDrag::HeartbeatAction::Probe:
+		SystemDrag::SendHookProbe();
+		break;
+	case SystemDrag::HeartbeatAction::Reinstall:
+		SystemDrag::SharedLog().Write("[WARN] mouse hook lost, reinstalling");
+		UnhookWindowsHookEx(g_mouseHook);
+		g_mouseHook = SetWindowsHookEx(WH_MOUSE_LL, MouseHookProc, NULL, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+
+
+// ÿ߳Լ״̬ͬһָ¼ǽͬһ̣߳ƲҪ̹߳
+struct DetectionWorkerState
+{
+	SystemDrag::SpeculativeVerdict speculation;
+	SystemDrag::VerdictStats verdicts = {};
+};
+
+// ڼ߳ (Ե STA) ִйͶ¼
+class HookDetectionHandler : public SystemDrag::IDetectionHandler
+{
+public:
+	explicit HookDetectionHandler(size_t workers) : m_workers(workers) {}
+
+	void Run(size_t worker, const SystemDrag::DragEventRecord& record) override
+	{
+		DetectionWorkerState& state = m_workers[worker];
+		if (record.kind == SystemDrag::DragEventKind::Prefetch)
 		{
-			// ͷ
-			if (g_isDragging)
+			// Ʋ⣺ɿ
+			SystemDrag::CancelToken pressToken(g_pointers.PressGate(record.pointer), record.sessionId);
+			if (pressToken.Cancelled())
 			{
-				std::cout << "[EVENT] Dragging Released.\n";
+				return;
 			}
-			// ״̬
-			g_isLButtonDown = false;
-			g_isDragging = false;
-			g_detectionCalled = false;
-			break;
+			state.speculation.Begin(record.sessionId);
+			SystemDrag::Verdict speculative = SystemDrag::FileDetector::Detect(pressToken);
+			state.speculation.Complete(record.sessionId, speculative, GetTickCount());
+			return;
+		}
+
+		if (record.kind != SystemDrag::DragEventKind::CheckRequested)
+		{
+			return;
+		}
+
+		// Ựѽָɿѿʼµƣټ
+		SystemDrag::CancelToken token(g_pointers.DragGate(record.pointer), record.sessionId);
+		if (token.Cancelled())
+		{
+			state.verdicts.skipped++;
+			return;
+		}
+
+		// ͬһΰƲֱӲ
+		SystemDrag::Verdict verdict = SystemDrag::Verdict::Unsupported;
+		SystemDrag::VerdictSource source = SystemDrag::VerdictSource::Speculative;
+		if (!g_speculate || !state.speculation.Commit(record.sessionId, record.time, verdict))
+		{
+			source = SystemDrag::VerdictSource::Detected;
+			// ڱ̵߳ STA ִУ̲߳ȴɿἰʱرոָקբ
+			state.verdicts.started++;
+			verdict = SystemDrag::FileDetector::Detect(token);
+			if (verdict == SystemDrag::Verdict::Cancelled)
+			{
+				state.verdicts.cancelled++;
+				SystemDrag::SharedLog().Write("[CANCEL] session {} ended during detection", record.sessionId);
+				return;
+			}
+			if (token.Cancelled())
+			{
+				// ѹڣ
+				state.verdicts.staleDropped++;
+				return;
+			}
+			state.speculation.RecordOnDemand(record.time, GetTickCount());
 		}
+
+		state.verdicts.completed++;
+		if (record.sessionId == g_pressTimedSession.load(std::memory_order_acquire))
+		{
+			int64_t pressNs = g_pressTimeNs.load(std::memory_order_relaxed);
+			SystemDrag::SharedDetectionLatency().Record(SystemDrag::DetectionStage::PressToVerdict,
+				(uint64_t)(SteadyNs() - pressNs));
+		}
+		SystemDrag::SharedDragTrace().VerdictReached(record.sessionId, verdict, source, GetTickCount() - record.time);
+		if (verdict == SystemDrag::Verdict::Supported)
+		{
+			SystemDrag::SharedLog().Write("[ɹ] קֵ֧ļ! session {} at ({}, {}), worker {}",
+				record.sessionId, record.x, record.y, worker);
 		}
 	}
 
-	// صһӣ¼ȥ
-	return CallNextHookEx(g_mouseHook, nCode, wParam, lParam);
-}
+	// ȴڼַѡ仯ֻ֪ͨ˱ǣص֮⣩¶ȡ
+	void Idle(size_t) override
+	{
+		SystemDrag::SelectionTracking().RefreshPending();
+	}
+
+	// ͼġShell ỰȲڱ̣߳ CoUninitialize ֮ǰͷ
+	void Exit(size_t) override
+	{
+		SystemDrag::ReleaseSelectionTracking();
+		SystemDrag::ReleaseShellViews();
+		SystemDrag::ReleaseShellSession();
+		SystemDrag::ReleaseShellAncestry();
+	}
+
+	// ֻڼֹ߳ͣȡ
+	SystemDrag::VerdictStats Verdicts()
+	{
+		SystemDrag::VerdictStats total = {};
+		for (const DetectionWorkerState& state : m_workers)
+		{
+			total.started += state.verdicts.started;
+			total.completed += state.verdicts.completed;
+			total.cancelled += state.verdicts.cancelled;
+			total.skipped += state.verdicts.skipped;
+			total.staleDropped += state.verdicts.staleDropped;
+		}
+		return total;
+	}
+
+	SystemDrag::SpeculationStats Speculation()
+	{
+		SystemDrag::SpeculationStats total = {};
+		for (DetectionWorkerState& state : m_workers)
+		{
+			state.speculation.Flush();
+			const SystemDrag::SpeculationStats& stats = state.speculation.Stats();
+			total.prefetches += stats.prefetches;
+			total.hits += stats.hits;
+			total.misses += stats.misses;
+			total.discarded += stats.discarded;
+			total.cancelled += stats.cancelled;
+			total.verdicts += stats.verdicts;
+			total.timeToVerdictMs += stats.timeToVerdictMs;
+			total.maxTimeToVerdictMs = (std::max)(total.maxTimeToVerdictMs, stats.maxTimeToVerdictMs);
+		}
+		return total;
+	}
+
+private:
+	std::vector<DetectionWorkerState> m_workers;
+};
 
 
 
 // Main ڲ
-int main()
+//  --speculate Ʋ⣬--sniff ļͷݶչжϣ
+// --trace <ļ> קỰ¼̶СĻθļ (DragTraceBenchMain ɻط)
+// --latency <ļܵ> ׶εĺʱֱͼ (Prometheus ıʽ)
+// --no-coalesce ÿƶĻص
+// --workers <n> ߳ (Ĭ 1ÿ߳һ STA)
+int main(int argc, char* argv[])
 {
+	std::string tracePath;
+	std::string latencyPath;
+	size_t workers = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--speculate")
+		{
+			g_speculate = true;
+		}
+		else if (std::string(argv[i]) == "--sniff")
+		{
+			SystemDrag::SharedContentSniffer().SetEnabled(true);
+		}
+		else if (std::string(argv[i]) == "--trace" && i + 1 < argc)
+		{
+			tracePath = argv[++i];
+		}
+		else if (std::string(argv[i]) == "--latency" && i + 1 < argc)
+		{
+			latencyPath = argv[++i];
+		}
+		else if (std::string(argv[i]) == "--no-coalesce")
+		{
+			g_coalesceMoves = false;
+		}
+		else if (std::string(argv[i]) == "--workers" && i + 1 < argc)
+		{
+			workers = (size_t)(std::max)(1, std::atoi(argv[++i]));
+		}
+	}
+
 	std::cout << "Monitoring mouse... Drag a file (e.g., .txt) to see detection." << std::endl;
 	std::cout << "Press Ctrl+C to exit." << std::endl;
 
-	// --- 1. COM Initialization (STA Ǳ) ---
-	HRESULT hr = CoInitialize(NULL);
-	if (hr != S_OK && hr != S_FALSE)
+	// --- غ׺ԣļ޸ĺԶЧ ---
+	SystemDrag::SharedExtensionPolicy().StartWatching(L"extensions.conf", std::chrono::milliseconds(1000));
+
+	// --- 1. ̣߳ÿ̳߳ʼԼ STAֻ߳йӺϢѭκ COM  ---
+	HookDetectionHandler handler(workers);
+	SystemDrag::DetectionExecutor detection(workers,
+		[](size_t) { return std::unique_ptr<SystemDrag::IApartment>(new SystemDrag::StaApartment()); }, handler);
+	if (!detection.Start())
 	{
-		std::cerr << "COM Initialization failed (HRESULT: " << std::hex << hr << "). Shell operations require STA." << std::endl;
+		std::cerr << "COM Initialization failed on a detection thread. Shell operations require STA." << std::endl;
+		SystemDrag::SharedExtensionPolicy().StopWatching();
 		return 1;
 	}
+	g_detection = &detection;
 
-	// --- 2. 洢߳ ID (ʹ) ---
-	g_mainThreadId = GetCurrentThreadId();
+	// --- 2. ȡקֵ ---
+	int minDragX = GetSystemMetrics(SM_CXDRAG);
+	int minDragY = GetSystemMetrics(SM_CYDRAG);
+	g_pointers.SetThreshold(minDragX, minDragY);
+	std::cout << "Drag Detector Active (Hook installed). Threshold: " << minDragX << "px, detection threads: "
+		<< detection.Workers() << std::endl;
 
-	// --- 3. ȡקֵװ (֮ǰͬ) ---
-	g_minDragX = GetSystemMetrics(SM_CXDRAG);
-	g_minDragY = GetSystemMetrics(SM_CYDRAG);
-	std::cout << "Drag Detector Active (Hook installed). Threshold: " << g_minDragX << "px" << std::endl;
+	// --- ļڰװǰ򿪣һΰ¾м¼ ---
+	if (!tracePath.empty() && !SystemDrag::SharedDragTrace().Open(tracePath, 16 << 20, minDragX, minDragY))
+	{
+		std::cerr << "Failed to open trace file: " << tracePath << std::endl;
+	}
+	g_coalesceMoves = g_coalesceMoves && !SystemDrag::SharedDragTrace().Enabled();
 
-	// --- װͼ깳 ---
+	// --- 3. װͼ깳 ---
 	// WH_MOUSE_LL: ͼ¼
 	// MouseHookProc: ص
 	// NULL: HMODULEڵͼӣͨΪ NULL
@@ -358,22 +610,39 @@ int main()
 	if (g_mouseHook == NULL)
 	{
 		std::cerr << "Failed to install hook! Error: " << GetLastError() << std::endl;
-		CoUninitialize();
+		g_detection = nullptr;
+		detection.Stop();
+		SystemDrag::SharedExtensionPolicy().StopWatching();
 		return 1;
 	}
 
-	// --- 4. Ϣѭ (ֱӴԶϢ) ---
-	// Ϣᷢ͵̵߳ϢУȻ DispatchMessage  MouseHookProc 
+	// Źÿ 250ms һ
+	UINT_PTR heartbeatTimer = SetTimer(NULL, 0, 250, NULL);
+
+	// ʱֱͼÿ뵼һΣڵ߳дļܵ߳һ
+	// LowLevelHooksTimeoutϵͳֱƳ
+	SystemDrag::LatencyExporter latencyExporter;
+	if (!latencyPath.empty())
+	{
+		latencyExporter.Start(latencyPath, std::chrono::seconds(1));
+	}
+
+	// --- 4. Ϣѭ ---
+	// ӻص̵߳Ϣѭãصֻ״̬¼̣߳Ӳȴ⡣
 	MSG msg;
+	uint64_t reportedDrops = 0;
 	while (GetMessage(&msg, NULL, 0, 0))
 	{
-		// ǷԶϢ
-		if (msg.message == WM_PERFORM_DRAG_CHECK)
+		if (msg.message == WM_TIMER && msg.wParam == heartbeatTimer)
 		{
-			// ȷ COM ̣߳STẠִ߳
-			if (SystemDrag::FileDetector::IsDraggingSupportedFile())
+			ServiceHookWatchdog();
+
+			// Ҳ飬ֻд־첽־߳
+			uint64_t dropped = detection.Stats().dropped;
+			if (dropped != reportedDrops)
 			{
-				std::cout << "[ɹ] קֵ֧ļ!\n";
+				reportedDrops = dropped;
+				SystemDrag::SharedLog().Write("[WARN] drag events dropped: {}", reportedDrops);
 			}
 		}
 		else
@@ -384,8 +653,48 @@ int main()
 		}
 	}
 
-	// --- 5.  ---
+	// --- 5. жعӣֹͣ߳ (ͷŻ沢˳ STA) ---
+	KillTimer(NULL, heartbeatTimer);
 	UnhookWindowsHookEx(g_mouseHook);
-	CoUninitialize();
+	g_detection = nullptr;
+	detection.Stop();
+
+	// ˳ͳֱд std::coutȰ첽־ʣµд
+	SystemDrag::SharedLog().Flush();
+	SystemDrag::VerdictStats verdictStats = handler.Verdicts();
+	std::cout << "Verdicts: started " << verdictStats.started << ", completed " << verdictStats.completed
+		<< ", cancelled " << verdictStats.cancelled << ", skipped " << verdictStats.skipped
+		<< ", stale " << verdictStats.staleDropped << std::endl;
+
+	SystemDrag::SpeculationStats speculation = handler.Speculation();
+	std::cout << "Speculation: prefetches " << speculation.prefetches << ", hit rate " << speculation.HitRate() * 100
+		<< "%, discarded " << speculation.discarded << ", cancelled " << speculation.cancelled
+		<< ", time to verdict avg " << speculation.MeanTimeToVerdictMs() << " ms, max "
+		<< speculation.maxTimeToVerdictMs << " ms" << std::endl;
+
+	SystemDrag::ExecutorStats executor = detection.Stats();
+	SystemDrag::LatencySnapshot handoff;
+	SystemDrag::SharedDetectionLatency().Snapshot(SystemDrag::DetectionStage::WorkerHandoff, handoff);
+	std::cout << "Detection threads: " << detection.Workers() << ", events " << executor.posted << ", dropped "
+		<< executor.dropped << ", handoff p50 " << handoff.QuantileNs(0.5) / 1000 << " us, p99 "
+		<< handoff.QuantileNs(0.99) / 1000 << " us" << std::endl;
+
+	// жأһεɵֹ߳ͣʱ
+	if (!latencyPath.empty() && !latencyExporter.Stop())
+	{
+		std::cerr << "Failed to export latency histograms: " << latencyPath << std::endl;
+	}
+
+	const SystemDrag::HookWatchdogStats& watchdog = g_watchdog.Stats();
+	std::cout << "Hook: callbacks " << watchdog.callbacks << ", avg "
+		<< (watchdog.callbacks != 0 ? watchdog.callbackNs / watchdog.callbacks : 0) << " ns, fast path moves "
+		<< watchdog.fastPath << ", max " << watchdog.maxCallbackNs / 1000 << " us, risky "
+		<< watchdog.risky << ", over timeout " << watchdog.overTimeout << ", degradations " << watchdog.degradations
+		<< ", probes " << watchdog.probes << ", reinstalls " << watchdog.reinstalls << std::endl;
+
+	// --- 6.  ---
+	SystemDrag::SharedDragTrace().Close();
+	SystemDrag::ReleaseShellAncestry();
+	SystemDrag::SharedExtensionPolicy().StopWatching();
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,200 @@
+#include "HookWatchdog.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <cwchar>
+
+#pragma comment(lib, "Advapi32.lib")
+#pragma comment(lib, "User32.lib")
+#endif
+
+namespace SystemDrag
+{
+	HookBudgetConfig DefaultHookBudget(uint64_t timeoutNs)
+	{
+		HookBudgetConfig config;
+		config.timeoutNs = timeoutNs;
+		config.callbackRiskNs = timeoutNs / 4;
+		config.windowNs = 1000000000;
+		config.windowBudgetNs = 50000000;
+		config.calmNs = 5000000000;
+		config.heartbeatNs = 1000000000;
+		config.probeTimeoutNs = 500000000;
+		return config;
+	}
+
+	HookWatchdog::HookWatchdog(IWatchdogClock& clock, const HookBudgetConfig& config)
+		: m_clock(clock), m_config(config), m_load(HookLoad::Normal), m_stats(),
+		m_slotNs(config.windowNs / Slots != 0 ? config.windowNs / Slots : 1), m_slotBusy(), m_slotEpoch(),
+		m_lastRisk(0), m_lastCallback(clock.NowNs()), m_probeSent(0), m_probeCallbacks(0), m_polledFastPath(0), m_suspect(false)
+	{
+	}
+
+	// Hook time in the slots of the last window; a slot stamped with an older epoch is stale
+	uint64_t HookWatchdog::Busy(uint64_t now)
+	{
+		uint64_t slot = now / m_slotNs;
+		uint64_t busy = 0;
+		for (size_t i = 0; i < Slots; i++)
+		{
+			if (m_slotEpoch[i] != 0 && m_slotEpoch[i] - 1 + Slots > slot)
+			{
+				busy += m_slotBusy[i];
+			}
+		}
+		return busy;
+	}
+
+	void HookWatchdog::Leave(uint64_t enteredNs)
+	{
+		uint64_t now = m_clock.NowNs();
+		uint64_t spent = now > enteredNs ? now - enteredNs : 0;
+		m_stats.callbacks++;
+		m_stats.callbackNs += spent;
+		m_stats.maxCallbackNs = spent > m_stats.maxCallbackNs ? spent : m_stats.maxCallbackNs;
+		m_lastCallback = now;
+
+		uint64_t slot = now / m_slotNs;
+		size_t index = (size_t)(slot % Slots);
+		if (m_slotEpoch[index] != slot + 1)
+		{
+			m_slotEpoch[index] = slot + 1;
+			m_slotBusy[index] = 0;
+		}
+		m_slotBusy[index] += spent;
+
+		if (spent >= m_config.timeoutNs)
+		{
+			// Windows may have unhooked us already; the next Poll checks
+			m_stats.overTimeout++;
+			m_suspect = true;
+		}
+
+		if (spent >= m_config.callbackRiskNs || Busy(now) >= m_config.windowBudgetNs)
+		{
+			m_stats.risky++;
+			m_lastRisk = now;
+			if (m_load != HookLoad::Shedding)
+			{
+				m_load = (HookLoad)((uint8_t)m_load + 1);
+				m_stats.degradations++;
+			}
+		}
+		else
+		{
+			Recover(now);
+		}
+	}
+
+	// One level back per calm period, and only with the window well under budget
+	void HookWatchdog::Recover(uint64_t now)
+	{
+		if (m_load != HookLoad::Normal && now - m_lastRisk >= m_config.calmNs && Busy(now) < m_config.windowBudgetNs / 2)
+		{
+			m_load = (HookLoad)((uint8_t)m_load - 1);
+			m_lastRisk = now;
+			m_stats.recoveries++;
+		}
+	}
+
+	HeartbeatAction HookWatchdog::Poll(uint64_t lastInputNs)
+	{
+		uint64_t now = m_clock.NowNs();
+		Recover(now);
+
+		// Fast path moves carry no time; any since the last Poll mean the hook saw input
+		// within the last heartbeat
+		if (m_stats.fastPath != m_polledFastPath)
+		{
+			m_polledFastPath = m_stats.fastPath;
+			m_lastCallback = now;
+		}
+		uint64_t seen = m_stats.callbacks + m_stats.fastPath;
+
+		if (m_probeSent != 0)
+		{
+			if (seen != m_probeCallbacks)
+			{
+				m_probeSent = 0;
+				return HeartbeatAction::None;
+			}
+			if (now - m_probeSent < m_config.probeTimeoutNs)
+			{
+				return HeartbeatAction::None;
+			}
+			m_probeSent = 0;
+			m_suspect = false;
+			m_lastCallback = now;
+			m_stats.reinstalls++;
+			return HeartbeatAction::Reinstall;
+		}
+
+		// Input the hook should have seen by now but did not (keyboard input also counts
+		// here, the probe sorts that out)
+		bool missed = lastInputNs > m_lastCallback && now > lastInputNs && now - lastInputNs >= m_config.heartbeatNs;
+		if (m_suspect || missed)
+		{
+			m_suspect = false;
+			m_probeSent = now != 0 ? now : 1;
+			m_probeCallbacks = seen;
+			m_stats.probes++;
+			return HeartbeatAction::Probe;
+		}
+		return HeartbeatAction::None;
+	}
+
+#ifdef _WIN32
+	static const uintptr_t HookProbeTag = 0x53444B50;   // "SDKP"
+
+	uint64_t LowLevelHooksTimeoutNs()
+	{
+		// Usually a REG_DWORD, sometimes written as a string
+		DWORD value = 0;
+		DWORD size = sizeof(value);
+		if (RegGetValueW(HKEY_CURRENT_USER, L"Control Panel\\Desktop", L"LowLevelHooksTimeout",
+			RRF_RT_REG_DWORD, nullptr, &value, &size) == ERROR_SUCCESS && value != 0)
+		{
+			return (uint64_t)value * 1000000;
+		}
+
+		wchar_t text[16] = {};
+		size = sizeof(text);
+		if (RegGetValueW(HKEY_CURRENT_USER, L"Control Panel\\Desktop", L"LowLevelHooksTimeout",
+			RRF_RT_REG_SZ, nullptr, text, &size) == ERROR_SUCCESS)
+		{
+			unsigned long parsed = std::wcstoul(text, nullptr, 10);
+			if (parsed != 0)
+			{
+				return (uint64_t)parsed * 1000000;
+			}
+		}
+		return 300000000;
+	}
+
+	uint64_t LastInputNs(IWatchdogClock& clock)
+	{
+		LASTINPUTINFO info = { sizeof(LASTINPUTINFO), 0 };
+		uint64_t now = clock.NowNs();
+		if (!GetLastInputInfo(&info))
+		{
+			return 0;
+		}
+		uint64_t agoNs = (uint64_t)(DWORD)(GetTickCount() - info.dwTime) * 1000000;
+		return now > agoNs ? now - agoNs : 0;
+	}
+
+	void SendHookProbe()
+	{
+		INPUT input = {};
+		input.type = INPUT_MOUSE;
+		input.mi.dwFlags = MOUSEEVENTF_MOVE;
+		input.mi.dwExtraInfo = HookProbeTag;
+		SendInput(1, &input, sizeof(INPUT));
+	}
+
+	bool IsHookProbe(uintptr_t extraInfo)
+	{
+		return extraInfo == HookProbeTag;
+	}
+#endif
+}
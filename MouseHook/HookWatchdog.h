@@ -0,0 +1,135 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Budget watchdog for the low-level mouse hook callback.
+// Windows drops a WH_MOUSE_LL hook without notice once a callback runs past
+// LowLevelHooksTimeout, and the monitor goes blind. Every callback is timed against a
+// per-call risk threshold and a rolling budget of hook time per second. When either is
+// hit the watchdog degrades one level (first no console logging in the hook, then the
+// press classification is left to the detection thread) and steps back after a calm
+// period. The heartbeat compares the system's last input time with the last callback:
+// input the hook never saw (or a callback past the timeout) asks for a probe event, and
+// if even the probe does not come through, the hook is reinstalled. Nothing is injected
+// while the user is idle, so idle timers and the screen saver keep working.
+// Time comes from an injected clock so the policy runs without Windows. Not thread-safe:
+// owned by the thread that installed the hook, which runs both the callbacks and Poll().
+namespace SystemDrag
+{
+	class IWatchdogClock
+	{
+	public:
+		virtual ~IWatchdogClock() {}
+		virtual uint64_t NowNs() = 0;
+	};
+
+	class SteadyWatchdogClock : public IWatchdogClock
+	{
+	public:
+		uint64_t NowNs() override
+		{
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	};
+
+	enum class HookLoad : uint8_t
+	{
+		Normal,
+		Quiet,      // no logging from the callback
+		Shedding    // also skip the press classification, the detection thread resolves it
+	};
+
+	struct HookBudgetConfig
+	{
+		uint64_t timeoutNs;         // LowLevelHooksTimeout
+		uint64_t callbackRiskNs;    // one callback this long degrades
+		uint64_t windowNs;          // rolling window for the busy budget
+		uint64_t windowBudgetNs;    // hook time per window that degrades
+		uint64_t calmNs;            // no risk for this long steps back one level
+		uint64_t heartbeatNs;       // input unseen by the hook for this long triggers a probe
+		uint64_t probeTimeoutNs;    // unanswered probe means the hook is gone
+	};
+
+	// Risk at a quarter of the timeout, 5% of every second in the hook, probe after 1 s
+	HookBudgetConfig DefaultHookBudget(uint64_t timeoutNs);
+
+	enum class HeartbeatAction : uint8_t
+	{
+		None,
+		Probe,      // inject an event the callback will see
+		Reinstall   // unhook and hook again
+	};
+
+	struct HookWatchdogStats
+	{
+		uint64_t callbacks;
+		uint64_t fastPath;          // coalesced moves, counted but not timed
+		uint64_t callbackNs;        // total time of the timed callbacks
+		uint64_t risky;             // over callbackRiskNs or the window budget
+		uint64_t overTimeout;       // long enough that Windows may have dropped the hook
+		uint64_t maxCallbackNs;
+		uint64_t degradations;
+		uint64_t recoveries;
+		uint64_t probes;
+		uint64_t reinstalls;
+	};
+
+	class HookWatchdog
+	{
+	public:
+		HookWatchdog(IWatchdogClock& clock, const HookBudgetConfig& config);
+
+		// Bracket every callback
+		uint64_t Enter() { return m_clock.NowNs(); }
+		void Leave(uint64_t enteredNs);
+		// Instead of Enter/Leave for a move the hook passed straight on; still proof the
+		// hook is alive, picked up by the next Poll
+		void FastPath() { m_stats.fastPath++; }
+
+		HookLoad Load() const { return m_load; }
+		bool LoggingAllowed() const { return m_load == HookLoad::Normal; }
+		bool ShedPressWork() const { return m_load == HookLoad::Shedding; }
+
+		// Periodic, from the hook thread's message loop; lastInputNs is when the system last
+		// saw user input (mouse or keyboard), on the same clock
+		HeartbeatAction Poll(uint64_t lastInputNs);
+
+		const HookBudgetConfig& Config() const { return m_config; }
+		const HookWatchdogStats& Stats() const { return m_stats; }
+
+	private:
+		static const size_t Slots = 10;
+
+		uint64_t Busy(uint64_t now);
+		void Recover(uint64_t now);
+
+		IWatchdogClock& m_clock;
+		HookBudgetConfig m_config;
+		HookLoad m_load;
+		HookWatchdogStats m_stats;
+
+		uint64_t m_slotNs;
+		uint64_t m_slotBusy[Slots];
+		uint64_t m_slotEpoch[Slots];
+
+		uint64_t m_lastRisk;
+		uint64_t m_lastCallback;
+		uint64_t m_probeSent;       // 0 when no probe is outstanding
+		uint64_t m_probeCallbacks;  // callbacks and fast path moves when the probe went out
+		uint64_t m_polledFastPath;  // fast path moves at the last Poll
+		bool m_suspect;             // a callback ran past the timeout
+	};
+
+#ifdef _WIN32
+	// LowLevelHooksTimeout from the registry, 300 ms when it is not set
+	uint64_t LowLevelHooksTimeoutNs();
+	// GetLastInputInfo on the watchdog clock
+	uint64_t LastInputNs(IWatchdogClock& clock);
+	// Zero-distance injected move, tagged so the callback can tell it apart
+	void SendHookProbe();
+	bool IsHookProbe(uintptr_t extraInfo);
+#endif
+}
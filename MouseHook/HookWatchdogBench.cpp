@@ -0,0 +1,120 @@
+#include "HookWatchdog.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+// Hook watchdog on a scripted clock: steady light traffic, one slow callback, a sustained
+// burst over the window budget, the calm periods back to normal, keyboard input the
+// hook rightly never saw, and a hook that really stopped receiving callbacks. Then the
+// per-callback cost of Enter/Leave on the real clock.
+namespace SystemDrag
+{
+	class FakeWatchdogClock : public IWatchdogClock
+	{
+	public:
+		FakeWatchdogClock() : now(1000000000) {}
+		uint64_t NowNs() override { return now; }
+		uint64_t now;
+	};
+
+	static const uint64_t Ms = 1000000;
+
+	// One callback that takes spentNs, then idle until the next one is due
+	static void Callback(HookWatchdog& watchdog, FakeWatchdogClock& clock, uint64_t spentNs, uint64_t gapNs)
+	{
+		uint64_t entered = watchdog.Enter();
+		clock.now += spentNs;
+		watchdog.Leave(entered);
+		clock.now += gapNs;
+	}
+
+	static bool Expect(bool condition, const char* what)
+	{
+		std::cout << (condition ? "  ok     " : "  FAILED ") << what << std::endl;
+		return condition;
+	}
+
+	// Command line entry: HookWatchdogBenchMain [callbacks for the overhead loop]
+	int HookWatchdogBenchMain(int argc, char* argv[])
+	{
+		size_t callbacks = argc > 1 ? (size_t)std::atoll(argv[1]) : 10000000;
+		bool correct = true;
+
+		FakeWatchdogClock clock;
+		HookWatchdog watchdog(clock, DefaultHookBudget(300 * Ms));
+		std::cout << "scripted clock, timeout 300 ms:" << std::endl;
+
+		// 1 kHz mouse at 20 us per callback: 2% of the window, well inside the budget
+		for (int i = 0; i < 5000; i++)
+		{
+			Callback(watchdog, clock, 20000, Ms - 20000);
+		}
+		correct &= Expect(watchdog.Load() == HookLoad::Normal, "light traffic stays normal");
+		correct &= Expect(watchdog.Poll(clock.now) == HeartbeatAction::None, "no probe while callbacks keep up");
+
+		// A single 100 ms callback, a third of the timeout
+		Callback(watchdog, clock, 100 * Ms, Ms);
+		correct &= Expect(watchdog.Load() == HookLoad::Quiet && !watchdog.LoggingAllowed(), "slow callback silences logging");
+
+		// 8 kHz mouse at 10 us per callback: 8% of every second
+		for (int i = 0; i < 8000; i++)
+		{
+			Callback(watchdog, clock, 10000, 115000);
+		}
+		correct &= Expect(watchdog.Load() == HookLoad::Shedding && watchdog.ShedPressWork(), "sustained load sheds press work");
+
+		// Calm: one level back per calm period
+		for (int i = 0; i < 5500; i++)
+		{
+			Callback(watchdog, clock, 20000, Ms - 20000);
+		}
+		correct &= Expect(watchdog.Load() == HookLoad::Quiet, "first calm period steps back to quiet");
+		for (int i = 0; i < 5500; i++)
+		{
+			Callback(watchdog, clock, 20000, Ms - 20000);
+		}
+		correct &= Expect(watchdog.Load() == HookLoad::Normal, "second calm period back to normal");
+
+		// Typing only: the system saw input, the hook did not; the probe comes through
+		uint64_t typed = clock.now;
+		clock.now += 1500 * Ms;
+		correct &= Expect(watchdog.Poll(typed) == HeartbeatAction::Probe, "unseen input asks for a probe");
+		Callback(watchdog, clock, 20000, 10 * Ms);
+		correct &= Expect(watchdog.Poll(typed) == HeartbeatAction::None, "answered probe keeps the hook");
+
+		// Idle user: nothing to see, nothing injected
+		clock.now += 60000 * Ms;
+		correct &= Expect(watchdog.Poll(typed) == HeartbeatAction::None, "idle desktop is left alone");
+
+		// A callback past the timeout, after which Windows drops the hook
+		Callback(watchdog, clock, 400 * Ms, Ms);
+		correct &= Expect(watchdog.Poll(typed) == HeartbeatAction::Probe, "callback past the timeout asks for a probe");
+		clock.now += 200 * Ms;
+		correct &= Expect(watchdog.Poll(clock.now) == HeartbeatAction::None, "probe still in flight");
+		clock.now += 400 * Ms;
+		correct &= Expect(watchdog.Poll(clock.now) == HeartbeatAction::Reinstall, "unanswered probe reinstalls");
+		Callback(watchdog, clock, 20000, Ms);
+		correct &= Expect(watchdog.Poll(clock.now) == HeartbeatAction::None, "reinstalled hook is quiet again");
+
+		const HookWatchdogStats& stats = watchdog.Stats();
+		std::cout << "  callbacks " << stats.callbacks << ", risky " << stats.risky << ", over timeout " << stats.overTimeout
+			<< ", degradations " << stats.degradations << ", recoveries " << stats.recoveries << ", probes "
+			<< stats.probes << ", reinstalls " << stats.reinstalls << std::endl;
+		correct &= stats.probes == 2 && stats.reinstalls == 1 && stats.overTimeout == 1;
+
+		// What the real callback pays: two clock reads and the bookkeeping
+		SteadyWatchdogClock steady;
+		HookWatchdog live(steady, DefaultHookBudget(300 * Ms));
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < callbacks; i++)
+		{
+			live.Leave(live.Enter());
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / callbacks;
+		std::cout << "Enter/Leave on the steady clock: " << ns << " ns per callback" << std::endl;
+
+		std::cout << (correct ? "watchdog ok" : "watchdog WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
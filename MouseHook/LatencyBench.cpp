@@ -0,0 +1,171 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Cost of recording into the stage histograms and accuracy of what comes back out. Values
+// are spread log-uniformly over 128 ns .. 17 s, like stage timings that range from a cached
+// window lookup to a hung Explorer. The loop that only generates the values is timed too,
+// so the difference is the recording cost alone.
+namespace SystemDrag
+{
+	static inline uint64_t NextValue(uint64_t& state)
+	{
+		// xorshift64, then a log-uniform value: a random exponent and mantissa
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		unsigned exponent = 7 + (unsigned)(state % 27);   // 2^7 ns .. 2^33 ns
+		return ((uint64_t)1 << exponent) | (state >> 40) % ((uint64_t)1 << exponent);
+	}
+
+	static bool CheckExport(const DetectionLatency& latency)
+	{
+		std::ostringstream text;
+		latency.WritePrometheus(text);
+
+		// Cumulative buckets never decrease within a stage and end at the count
+		std::istringstream lines(text.str());
+		std::string line;
+		std::string stage;
+		uint64_t previous = 0;
+		bool ok = true;
+		while (std::getline(lines, line))
+		{
+			if (line.compare(0, 39, "systemdrag_stage_latency_seconds_bucket") != 0)
+			{
+				continue;
+			}
+			std::string current = line.substr(0, line.find(",le="));
+			uint64_t value = std::strtoull(line.substr(line.rfind(' ') + 1).c_str(), nullptr, 10);
+			if (current != stage)
+			{
+				stage = current;
+				previous = 0;
+			}
+			ok = ok && value >= previous;
+			previous = value;
+		}
+
+		std::filesystem::path path = std::filesystem::temp_directory_path() / "systemdrag-latency.prom";
+		ok = ok && latency.ExportPrometheus(path) && std::filesystem::file_size(path) == text.str().size();
+		std::filesystem::remove(path);
+		if (!ok)
+		{
+			return false;
+		}
+
+		// Periodic export on the exporter's own thread, then the final one from Stop()
+		LatencyExporter exporter(latency);
+		exporter.Start(path, std::chrono::milliseconds(2));
+		auto t0 = std::chrono::steady_clock::now();
+		while (exporter.Exports() < 3 && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(2))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		uint64_t periodic = exporter.Exports();
+		ok = exporter.Stop() && periodic >= 3 && exporter.Failures() == 0
+			&& std::filesystem::file_size(path) == text.str().size();
+		std::filesystem::remove(path);
+		return ok;
+	}
+
+	// Command line entry: LatencyBenchMain [records] [threads]
+	int LatencyBenchMain(int argc, char* argv[])
+	{
+		size_t records = argc > 1 ? (size_t)std::atoll(argv[1]) : 20000000;
+		int threads = argc > 2 ? std::atoi(argv[2]) : 4;
+
+		DetectionLatency latency;
+		uint64_t state = 88172645463325252ull;
+		uint64_t sink = 0;
+
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < records; i++)
+		{
+			sink += NextValue(state);
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		volatile uint64_t keep = sink;
+		(void)keep;
+		for (size_t i = 0; i < records; i++)
+		{
+			latency.Record(DetectionStage::SelectedItems, NextValue(state));
+		}
+		auto t2 = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < records / 10; i++)
+		{
+			StageTimer timer(DetectionStage::FindShellParent, latency);
+		}
+		auto t3 = std::chrono::steady_clock::now();
+
+		double baseNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / records;
+		double recordNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / records;
+		double timerNs = std::chrono::duration<double, std::nano>(t3 - t2).count() / (records / 10);
+		std::cout << "record: " << recordNs - baseNs << " ns (" << recordNs << " with value generation), "
+			<< "StageTimer with two clock reads: " << timerNs << " ns" << std::endl;
+
+		// Every thread on the same stage: the worst case for the shared cache lines
+		std::vector<std::thread> workers;
+		auto t4 = std::chrono::steady_clock::now();
+		for (int t = 0; t < threads; t++)
+		{
+			workers.emplace_back([&latency, records, threads, t]()
+			{
+				uint64_t local = 0x9E3779B97F4A7C15ull * (t + 1);
+				for (size_t i = 0; i < records / threads; i++)
+				{
+					latency.Record(DetectionStage::PressToVerdict, NextValue(local));
+				}
+			});
+		}
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+		double sharedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t4).count()
+			/ (records / threads * threads);
+		std::cout << threads << " threads on one stage: " << sharedNs << " ns/record wall" << std::endl;
+
+		LatencySnapshot shared;
+		latency.Snapshot(DetectionStage::PressToVerdict, shared);
+		bool correct = shared.count == records / threads * threads;
+
+		// Quantiles against the exact sorted values
+		const size_t sampleCount = 1000000;
+		LatencyHistogram histogram;
+		std::vector<uint64_t> values(sampleCount);
+		for (uint64_t& value : values)
+		{
+			value = NextValue(state);
+			histogram.Record(value);
+		}
+		std::sort(values.begin(), values.end());
+		LatencySnapshot snapshot;
+		histogram.Snapshot(snapshot);
+		double worst = 0;
+		for (double q : { 0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999, 0.9999, 1.0 })
+		{
+			uint64_t exact = values[(size_t)std::max(1.0, std::ceil(q * sampleCount)) - 1];
+			double error = std::abs((double)snapshot.QuantileNs(q) - (double)exact) / (double)exact;
+			worst = std::max(worst, error);
+		}
+		std::cout << "quantiles over " << sampleCount << " values: worst relative error " << worst * 100 << "%" << std::endl;
+		correct = correct && worst <= 1.0 / LatencySnapshot::SubCount && snapshot.maxNs == values.back();
+
+		bool exported = CheckExport(latency);
+		std::cout << "prometheus export " << (exported ? "ok" : "WRONG") << std::endl;
+		correct = correct && exported;
+
+		std::cout << (correct ? "latency ok" : "latency WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
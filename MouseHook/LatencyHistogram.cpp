@@ -0,0 +1,239 @@
+#include "LatencyHistogram.h"
+
+#include <cmath>
+#include <fstream>
+#include <system_error>
+
+namespace SystemDrag
+{
+	static const char* const StageNames[(size_t)DetectionStage::Count] =
+	{
+		"window_from_point",
+		"find_shell_parent",
+		"create_shell_windows",
+		"shell_windows_scan",
+		"selected_items",
+		"file_checks",
+		"press_to_verdict",
+		"worker_handoff"
+	};
+
+	const char* StageName(DetectionStage stage)
+	{
+		return stage < DetectionStage::Count ? StageNames[(size_t)stage] : "unknown";
+	}
+
+	uint64_t LatencySnapshot::BucketLow(size_t index)
+	{
+		if (index < 2 * SubCount)
+		{
+			return index;
+		}
+		unsigned shift = (unsigned)(index / SubCount) - 1;
+		return (uint64_t)(SubCount + index % SubCount) << shift;
+	}
+
+	uint64_t LatencySnapshot::BucketHigh(size_t index)
+	{
+		if (index < 2 * SubCount)
+		{
+			return index + 1;
+		}
+		unsigned shift = (unsigned)(index / SubCount) - 1;
+		uint64_t low = BucketLow(index);
+		uint64_t width = (uint64_t)1 << shift;
+		return low > UINT64_MAX - width ? UINT64_MAX : low + width;
+	}
+
+	uint64_t LatencySnapshot::QuantileNs(double q) const
+	{
+		if (count == 0)
+		{
+			return 0;
+		}
+		double wanted = std::ceil(q * (double)count);
+		uint64_t rank = wanted < 1.0 ? 1 : wanted > (double)count ? count : (uint64_t)wanted;
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BucketCount; i++)
+		{
+			seen += buckets[i];
+			if (seen >= rank)
+			{
+				uint64_t high = BucketHigh(i) - 1;
+				return high < maxNs ? high : maxNs;
+			}
+		}
+		return maxNs;
+	}
+
+	uint64_t LatencySnapshot::CountAtOrBelow(uint64_t boundNs) const
+	{
+		// Only buckets that lie entirely at or below the bound, so a count is never inflated
+		uint64_t total = 0;
+		for (size_t i = 0; i < BucketCount && BucketHigh(i) - 1 <= boundNs; i++)
+		{
+			total += buckets[i];
+		}
+		return total;
+	}
+
+	void LatencyHistogram::Snapshot(LatencySnapshot& snapshot) const
+	{
+		snapshot.count = 0;
+		for (size_t i = 0; i < LatencySnapshot::BucketCount; i++)
+		{
+			snapshot.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+			snapshot.count += snapshot.buckets[i];
+		}
+		snapshot.sumNs = m_sum.load(std::memory_order_relaxed);
+		snapshot.maxNs = m_max.load(std::memory_order_relaxed);
+	}
+
+	void LatencyHistogram::Clear()
+	{
+		for (std::atomic<uint64_t>& bucket : m_buckets)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		m_sum.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	void DetectionLatency::Clear()
+	{
+		for (LatencyHistogram& stage : m_stages)
+		{
+			stage.Clear();
+		}
+	}
+
+	void DetectionLatency::WritePrometheus(std::ostream& out) const
+	{
+		// Prometheus style boundaries; the fine buckets underneath answer the quantiles
+		static const uint64_t boundsNs[] =
+		{
+			1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+			1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 500000000,
+			1000000000, 2500000000, 5000000000, 10000000000
+		};
+		static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+		LatencySnapshot snapshot;
+		out << "# HELP systemdrag_stage_latency_seconds Time spent in one stage of drag detection.\n";
+		out << "# TYPE systemdrag_stage_latency_seconds histogram\n";
+		for (size_t s = 0; s < (size_t)DetectionStage::Count; s++)
+		{
+			m_stages[s].Snapshot(snapshot);
+			const char* stage = StageNames[s];
+			for (uint64_t bound : boundsNs)
+			{
+				out << "systemdrag_stage_latency_seconds_bucket{stage=\"" << stage << "\",le=\"" << bound / 1e9 << "\"} "
+					<< snapshot.CountAtOrBelow(bound) << '\n';
+			}
+			out << "systemdrag_stage_latency_seconds_bucket{stage=\"" << stage << "\",le=\"+Inf\"} " << snapshot.count << '\n';
+			out << "systemdrag_stage_latency_seconds_sum{stage=\"" << stage << "\"} " << snapshot.sumNs / 1e9 << '\n';
+			out << "systemdrag_stage_latency_seconds_count{stage=\"" << stage << "\"} " << snapshot.count << '\n';
+		}
+
+		out << "# HELP systemdrag_stage_latency_quantile_seconds Latency quantiles, within 1/16 of the true value.\n";
+		out << "# TYPE systemdrag_stage_latency_quantile_seconds gauge\n";
+		for (size_t s = 0; s < (size_t)DetectionStage::Count; s++)
+		{
+			m_stages[s].Snapshot(snapshot);
+			for (double q : quantiles)
+			{
+				out << "systemdrag_stage_latency_quantile_seconds{stage=\"" << StageNames[s] << "\",quantile=\"" << q << "\"} "
+					<< snapshot.QuantileNs(q) / 1e9 << '\n';
+			}
+			out << "systemdrag_stage_latency_quantile_seconds{stage=\"" << StageNames[s] << "\",quantile=\"1\"} "
+				<< snapshot.maxNs / 1e9 << '\n';
+		}
+	}
+
+	bool DetectionLatency::ExportPrometheus(const std::filesystem::path& path) const
+	{
+		std::error_code error;
+		std::filesystem::file_status status = std::filesystem::status(path, error);
+		// A pipe on Windows may not stat at all (type none), which counts as not a file
+		bool inPlace = status.type() != std::filesystem::file_type::not_found && !std::filesystem::is_regular_file(status);
+		std::filesystem::path target = inPlace ? path : std::filesystem::path(path.native() + std::filesystem::path(".tmp").native());
+
+		{
+			std::ofstream out(target, std::ios::binary | std::ios::trunc);
+			if (!out)
+			{
+				return false;
+			}
+			WritePrometheus(out);
+			if (!out.flush())
+			{
+				return false;
+			}
+		}
+
+		if (!inPlace)
+		{
+			std::filesystem::rename(target, path, error);
+			return !error;
+		}
+		return true;
+	}
+
+	DetectionLatency& SharedDetectionLatency()
+	{
+		static DetectionLatency latency;
+		return latency;
+	}
+
+	LatencyExporter::LatencyExporter(const DetectionLatency& latency)
+		: m_latency(latency), m_stop(false), m_exports(0), m_failures(0)
+	{
+	}
+
+	LatencyExporter::~LatencyExporter()
+	{
+		Stop();
+	}
+
+	void LatencyExporter::Start(const std::filesystem::path& path, std::chrono::milliseconds interval)
+	{
+		Stop();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = false;
+		}
+		m_path = path;
+		m_thread = std::thread(&LatencyExporter::ExportLoop, this, path, interval);
+	}
+
+	bool LatencyExporter::Stop()
+	{
+		if (!m_thread.joinable())
+		{
+			return true;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		m_thread.join();
+
+		bool exported = m_latency.ExportPrometheus(m_path);
+		(exported ? m_exports : m_failures).fetch_add(1, std::memory_order_relaxed);
+		return exported;
+	}
+
+	void LatencyExporter::ExportLoop(std::filesystem::path path, std::chrono::milliseconds interval)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_wake.wait_for(lock, interval, [this] { return m_stop; }))
+		{
+			lock.unlock();
+			bool exported = m_latency.ExportPrometheus(path);
+			(exported ? m_exports : m_failures).fetch_add(1, std::memory_order_relaxed);
+			lock.lock();
+		}
+	}
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Per-stage latency histograms for the detection pipeline.
+// Log-linear buckets in the HDR histogram style: 16 linear sub-buckets per power of two of
+// nanoseconds, so any value is kept within 1/16 of itself from 1 ns to centuries, in a
+// fixed table with no allocation. Recording is one relaxed atomic add on the bucket and one
+// on the sum, safe from any thread. Readers take a snapshot and derive quantiles or the
+// Prometheus text exposition from it.
+namespace SystemDrag
+{
+	enum class DetectionStage : uint8_t
+	{
+		WindowFromPoint,
+		FindShellParent,
+		CreateShellWindows,     // CoCreateInstance(CLSID_ShellWindows)
+		ShellWindowsScan,       // walking IShellWindows for a window or the desktop
+		SelectedItems,          // SelectedItems and the per-item path reads
+		FileChecks,             // file content and metadata checks
+		PressToVerdict,         // button down to the verdict, end to end
+		WorkerHandoff,          // hook posting an event to a detection worker starting on it
+		Count
+	};
+
+	const char* StageName(DetectionStage stage);
+
+	struct LatencySnapshot
+	{
+		static constexpr unsigned SubBits = 4;
+		static constexpr size_t SubCount = (size_t)1 << SubBits;
+		static constexpr size_t BucketCount = (64 - SubBits + 1) * SubCount;
+
+		std::array<uint64_t, BucketCount> buckets;
+		uint64_t count;
+		uint64_t sumNs;
+		uint64_t maxNs;
+
+		// Lower bound of a bucket and the first value of the next one
+		static uint64_t BucketLow(size_t index);
+		static uint64_t BucketHigh(size_t index);
+
+		// Upper bound of the bucket holding the q-th value, 0 when empty
+		uint64_t QuantileNs(double q) const;
+		// Values <= bound, exact at bucket boundaries
+		uint64_t CountAtOrBelow(uint64_t boundNs) const;
+		double MeanNs() const { return count != 0 ? (double)sumNs / count : 0.0; }
+	};
+
+	class LatencyHistogram
+	{
+	public:
+		LatencyHistogram() { Clear(); }
+
+		LatencyHistogram(const LatencyHistogram&) = delete;
+		LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+		static size_t BucketIndex(uint64_t ns)
+		{
+			if (ns < 2 * LatencySnapshot::SubCount)
+			{
+				return (size_t)ns;
+			}
+			unsigned shift = HighestBit(ns) - LatencySnapshot::SubBits;
+			return (size_t)(shift + 1) * LatencySnapshot::SubCount + (size_t)((ns >> shift) - LatencySnapshot::SubCount);
+		}
+
+		void Record(uint64_t ns)
+		{
+			m_buckets[BucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+			m_sum.fetch_add(ns, std::memory_order_relaxed);
+			uint64_t max = m_max.load(std::memory_order_relaxed);
+			while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		// Concurrent records may land in the snapshot or the next one, never get lost
+		void Snapshot(LatencySnapshot& snapshot) const;
+		void Clear();
+
+	private:
+		static unsigned HighestBit(uint64_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanReverse64(&index, value);
+			return (unsigned)index;
+#else
+			return 63u - (unsigned)__builtin_clzll(value);
+#endif
+		}
+
+		std::array<std::atomic<uint64_t>, LatencySnapshot::BucketCount> m_buckets;
+		std::atomic<uint64_t> m_sum;
+		std::atomic<uint64_t> m_max;
+	};
+
+	class DetectionLatency
+	{
+	public:
+		void Record(DetectionStage stage, uint64_t ns) { m_stages[(size_t)stage].Record(ns); }
+		void Record(DetectionStage stage, std::chrono::steady_clock::duration elapsed)
+		{
+			Record(stage, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+		}
+		void Snapshot(DetectionStage stage, LatencySnapshot& snapshot) const { m_stages[(size_t)stage].Snapshot(snapshot); }
+		void Clear();
+
+		// Prometheus text exposition: one histogram family with a stage label, plus quantile
+		// gauges read off the fine buckets
+		void WritePrometheus(std::ostream& out) const;
+		// A regular file is replaced through a temporary so scrapers never see half of it;
+		// a pipe or device is written in place
+		bool ExportPrometheus(const std::filesystem::path& path) const;
+
+	private:
+		LatencyHistogram m_stages[(size_t)DetectionStage::Count];
+	};
+
+	DetectionLatency& SharedDetectionLatency();
+
+	// Exports a DetectionLatency on a thread of its own every interval. The hook thread must
+	// not do it: a slow disk, or a pipe nobody is reading, would stall its message pump past
+	// LowLevelHooksTimeout and Windows would drop the hook. Here it only stalls the exporter.
+	class LatencyExporter
+	{
+	public:
+		explicit LatencyExporter(const DetectionLatency& latency = SharedDetectionLatency());
+		~LatencyExporter();
+
+		LatencyExporter(const LatencyExporter&) = delete;
+		LatencyExporter& operator=(const LatencyExporter&) = delete;
+
+		void Start(const std::filesystem::path& path, std::chrono::milliseconds interval);
+		// Joins the thread, then exports once more so the file ends with the final counts;
+		// false when that last export failed
+		bool Stop();
+
+		uint64_t Exports() const { return m_exports.load(std::memory_order_relaxed); }
+		uint64_t Failures() const { return m_failures.load(std::memory_order_relaxed); }
+
+	private:
+		void ExportLoop(std::filesystem::path path, std::chrono::milliseconds interval);
+
+		const DetectionLatency& m_latency;
+		std::filesystem::path m_path;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		bool m_stop;
+		std::atomic<uint64_t> m_exports;
+		std::atomic<uint64_t> m_failures;
+	};
+
+	// Records the time from construction to Stop() or destruction, once
+	class StageTimer
+	{
+	public:
+		explicit StageTimer(DetectionStage stage, DetectionLatency& latency = SharedDetectionLatency())
+			: m_latency(&latency), m_stage(stage), m_start(std::chrono::steady_clock::now())
+		{
+		}
+
+		~StageTimer() { Stop(); }
+
+		StageTimer(const StageTimer&) = delete;
+		StageTimer& operator=(const StageTimer&) = delete;
+
+		void Stop()
+		{
+			if (m_latency != nullptr)
+			{
+				m_latency->Record(m_stage, std::chrono::steady_clock::now() - m_start);
+				m_latency = nullptr;
+			}
+		}
+
+	private:
+		DetectionLatency* m_latency;
+		DetectionStage m_stage;
+		std::chrono::steady_clock::time_point m_start;
+	};
+}
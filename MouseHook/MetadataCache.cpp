@@ -0,0 +1,280 @@
+#include "MetadataCache.h"
+
+#ifdef _WIN32
+#include <cwctype>
+#endif
+
+namespace SystemDrag
+{
+	MetadataCache::MetadataCache(IFileMetadataBackend& inner, std::unique_ptr<IDirectoryWatcher> watcher, size_t memoryCap,
+		size_t directoryCap)
+		: m_inner(inner), m_watcher(std::move(watcher)), m_memoryCap(memoryCap), m_directoryCap(directoryCap), m_bytes(0),
+		m_clock(0), m_stats()
+	{
+		if (m_watcher && !m_watcher->Start(*this))
+		{
+			m_watcher.reset();
+		}
+	}
+
+	MetadataCache::~MetadataCache()
+	{
+		// Stop the notification thread before the state it writes to goes away
+		m_watcher.reset();
+	}
+
+	MetadataCache::Key MetadataCache::MakeKey(const std::filesystem::path& path)
+	{
+		Key key = path.native();
+#ifdef _WIN32
+		// NTFS names are case-insensitive, notifications may not use the caller's spelling
+		for (wchar_t& c : key)
+		{
+			c = (wchar_t)std::towlower(c);
+		}
+#endif
+		return key;
+	}
+
+	void MetadataCache::Query(const std::filesystem::path& path, FileMetadata& metadata)
+	{
+		Key key = MakeKey(path);
+		std::filesystem::path parent = path.parent_path();
+		Key directoryKey = MakeKey(parent);
+		uint64_t generation = 0;
+		bool cacheable = false;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto entry = m_entries.find(key);
+			if (entry != m_entries.end())
+			{
+				m_stats.hits++;
+				m_lru.splice(m_lru.begin(), m_lru, entry->second);
+				m_directories.find(entry->second->directory)->second.lastUsed = ++m_clock;
+				metadata = entry->second->metadata;
+				return;
+			}
+			m_stats.misses++;
+
+			auto directory = m_directories.find(directoryKey);
+			if (directory == m_directories.end() && m_watcher)
+			{
+				if (m_directories.size() >= m_directoryCap)
+				{
+					EvictDirectory();
+				}
+				if (m_directories.size() < m_directoryCap && m_watcher->Watch(parent))
+				{
+					DirectoryState state = { parent, true, 0, 0, 0, 0 };
+					directory = m_directories.emplace(directoryKey, state).first;
+				}
+			}
+
+			if (directory != m_directories.end() && directory->second.watched)
+			{
+				// Pinned: the directory stays watched until this lookup is done
+				directory->second.pending++;
+				directory->second.lastUsed = ++m_clock;
+				generation = directory->second.generation;
+				cacheable = true;
+			}
+			else
+			{
+				m_stats.uncached++;
+			}
+		}
+
+		m_inner.Query(path, metadata);
+		if (!cacheable)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto directory = m_directories.find(directoryKey);
+		DirectoryState& state = directory->second;
+
+		// A notification in between means the result may predate the change
+		if (state.generation == generation && state.watched && m_entries.count(key) == 0)
+		{
+			Entry entry = { key, directoryKey, metadata, 0 };
+			entry.bytes = sizeof(Entry) + 64 + (2 * key.size() + directoryKey.size()) * sizeof(Key::value_type);
+			m_lru.push_front(entry);
+			m_entries[key] = m_lru.begin();
+			m_bytes += entry.bytes;
+			state.entries++;
+
+			while (m_bytes > m_memoryCap && !m_lru.empty())
+			{
+				m_stats.evictions++;
+				Erase(std::prev(m_lru.end()));
+			}
+		}
+
+		state.pending--;
+		ReleaseDirectory(directory);
+	}
+
+	void MetadataCache::Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		while (!m_lru.empty())
+		{
+			Erase(m_lru.begin());
+		}
+	}
+
+	MetadataCacheStats MetadataCache::Stats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		MetadataCacheStats stats = m_stats;
+		stats.entries = m_entries.size();
+		stats.bytes = m_bytes;
+		stats.memoryCap = m_memoryCap;
+		stats.watchedDirectories = m_directories.size();
+		stats.directoryCap = m_directoryCap;
+		return stats;
+	}
+
+	void MetadataCache::OnPathChanged(const std::filesystem::path& path)
+	{
+		Key key = MakeKey(path);
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto directory = m_directories.find(MakeKey(path.parent_path()));
+		if (directory != m_directories.end())
+		{
+			directory->second.generation++;
+		}
+
+		auto entry = m_entries.find(key);
+		if (entry != m_entries.end())
+		{
+			m_stats.invalidations++;
+			Erase(entry->second);
+		}
+
+		// A watched subdirectory was renamed or deleted
+		if (m_directories.count(key) != 0)
+		{
+			DropDirectory(key);
+		}
+	}
+
+	void MetadataCache::OnDirectoryChanged(const std::filesystem::path& directory)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		DropDirectory(MakeKey(directory));
+	}
+
+	void MetadataCache::OnOverflow()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.overflows++;
+		for (auto& directory : m_directories)
+		{
+			directory.second.generation++;
+		}
+		while (!m_lru.empty())
+		{
+			m_stats.invalidations++;
+			Erase(m_lru.begin());
+		}
+	}
+
+	void MetadataCache::DropDirectory(const Key& directoryKey)
+	{
+		auto directory = m_directories.find(directoryKey);
+		if (directory == m_directories.end())
+		{
+			return;
+		}
+
+		// Lookups still in flight will not insert; the state goes away with the last of them
+		directory->second.generation++;
+		directory->second.watched = false;
+		directory->second.pending++;
+		for (auto entry = m_lru.begin(); entry != m_lru.end(); )
+		{
+			auto next = std::next(entry);
+			if (entry->directory == directoryKey)
+			{
+				m_stats.invalidations++;
+				Erase(entry);
+			}
+			entry = next;
+		}
+		directory->second.pending--;
+		ReleaseDirectory(directory);
+	}
+
+	// Directories pinned by a lookup in flight are skipped; when all are, the caller leaves
+	// the new directory unwatched
+	void MetadataCache::EvictDirectory()
+	{
+		auto victim = m_directories.end();
+		for (auto directory = m_directories.begin(); directory != m_directories.end(); ++directory)
+		{
+			if (directory->second.pending == 0 && (victim == m_directories.end() || directory->second.lastUsed < victim->second.lastUsed))
+			{
+				victim = directory;
+			}
+		}
+		if (victim == m_directories.end())
+		{
+			return;
+		}
+
+		Key directoryKey = victim->first;
+		victim->second.pending++;
+		for (auto entry = m_lru.begin(); entry != m_lru.end(); )
+		{
+			auto next = std::next(entry);
+			if (entry->directory == directoryKey)
+			{
+				m_stats.evictions++;
+				Erase(entry);
+			}
+			entry = next;
+		}
+		m_stats.directoryEvictions++;
+		victim->second.pending--;
+		ReleaseDirectory(victim);
+	}
+
+	void MetadataCache::Erase(std::list<Entry>::iterator entry)
+	{
+		auto directory = m_directories.find(entry->directory);
+		m_bytes -= entry->bytes;
+		m_entries.erase(entry->key);
+		m_lru.erase(entry);
+
+		if (directory != m_directories.end())
+		{
+			directory->second.entries--;
+			ReleaseDirectory(directory);
+		}
+	}
+
+	void MetadataCache::ReleaseDirectory(std::unordered_map<Key, DirectoryState>::iterator directory)
+	{
+		if (directory->second.entries != 0 || directory->second.pending != 0)
+		{
+			return;
+		}
+		if (m_watcher)
+		{
+			m_watcher->Unwatch(directory->second.path);
+		}
+		m_directories.erase(directory);
+	}
+
+	MetadataCache& SharedMetadataCache()
+	{
+		// A few thousand entries, enough for repeated drags out of the same folders
+		static NativeMetadataBackend backend;
+		static MetadataCache cache(backend, CreateNativeDirectoryWatcher(), 1024 * 1024);
+		return cache;
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "DirectoryWatcher.h"
+#include "FileMetadata.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Bounded LRU cache of path -> metadata in front of another metadata backend.
+// An entry stays valid until a change notification for it or its directory arrives, there is
+// no TTL: a path is only cached once its parent directory is watched, and a directory stops
+// being watched when its last entry leaves the cache. At most directoryCap directories are
+// watched at once; watching one more first drops the least recently used one with all its
+// entries, so a watch lasts from the first lookup in a directory until its entries are
+// evicted or invalidated, or it becomes the least recently used. Paths in directories that
+// cannot be watched go straight to the inner backend. A rename of a directory further up the tree is
+// not seen, only changes inside the immediate parent.
+// Memory is capped by an estimate of the bytes held per entry. Thread-safe, so it can sit
+// under a MetadataResolver as its backend.
+namespace SystemDrag
+{
+	struct MetadataCacheStats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t uncached;           // misses in directories that could not be watched
+		uint64_t evictions;          // dropped to stay under the memory cap
+		uint64_t directoryEvictions; // directories unwatched to stay under the directory cap
+		uint64_t invalidations;      // dropped by a change notification
+		uint64_t overflows;
+		size_t entries;
+		size_t bytes;
+		size_t memoryCap;
+		size_t watchedDirectories;
+		size_t directoryCap;
+	};
+
+	class MetadataCache : public IFileMetadataBackend, private IChangeListener
+	{
+	public:
+		// Each watched directory holds a handle open on Windows and an inotify watch on Linux
+		static constexpr size_t DefaultDirectoryCap = 64;
+
+		// watcher may be null, then nothing is cached
+		MetadataCache(IFileMetadataBackend& inner, std::unique_ptr<IDirectoryWatcher> watcher, size_t memoryCap,
+			size_t directoryCap = DefaultDirectoryCap);
+		~MetadataCache();
+
+		void Query(const std::filesystem::path& path, FileMetadata& metadata) override;
+
+		void Clear();
+		MetadataCacheStats Stats();
+
+	private:
+		typedef std::filesystem::path::string_type Key;
+
+		struct Entry
+		{
+			Key key;
+			Key directory;
+			FileMetadata metadata;
+			size_t bytes;
+		};
+
+		struct DirectoryState
+		{
+			std::filesystem::path path;
+			bool watched;
+			uint64_t generation;   // bumped by every notification for the directory
+			size_t entries;
+			size_t pending;        // lookups in flight that may still insert
+			uint64_t lastUsed;     // m_clock at the last lookup in the directory
+		};
+
+		static Key MakeKey(const std::filesystem::path& path);
+
+		void OnPathChanged(const std::filesystem::path& path) override;
+		void OnDirectoryChanged(const std::filesystem::path& directory) override;
+		void OnOverflow() override;
+
+		void DropDirectory(const Key& directory);
+		void EvictDirectory();
+		void Erase(std::list<Entry>::iterator entry);
+		void ReleaseDirectory(std::unordered_map<Key, DirectoryState>::iterator directory);
+
+		IFileMetadataBackend& m_inner;
+		std::unique_ptr<IDirectoryWatcher> m_watcher;
+		size_t m_memoryCap;
+		size_t m_directoryCap;
+
+		std::mutex m_mutex;
+		std::list<Entry> m_lru;   // most recently used first
+		std::unordered_map<Key, std::list<Entry>::iterator> m_entries;
+		std::unordered_map<Key, DirectoryState> m_directories;
+		size_t m_bytes;
+		uint64_t m_clock;
+		MetadataCacheStats m_stats;
+	};
+
+	// Cache over NativeMetadataBackend and the native directory watcher, used by
+	// SharedMetadataResolver(); created on first use
+	MetadataCache& SharedMetadataCache();
+}
@@ -0,0 +1,172 @@
+#include "MetadataCache.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Metadata cache over the native backend and directory watcher: hit rate for a skewed access
+// pattern, eviction under a small memory cap and under a directory cap smaller than the
+// number of directories, and invalidation correctness, where files are
+// modified behind the cache's back and the cache must report the new size once the change
+// notification has arrived.
+namespace SystemDrag
+{
+	static void PrintCacheStats(const char* label, const MetadataCacheStats& stats)
+	{
+		std::cout << label << ": hits " << stats.hits << ", misses " << stats.misses << ", hit rate "
+			<< (stats.hits + stats.misses > 0 ? 100.0 * stats.hits / (stats.hits + stats.misses) : 0) << "%, uncached "
+			<< stats.uncached << ", evictions " << stats.evictions << ", invalidations " << stats.invalidations
+			<< ", entries " << stats.entries << ", bytes " << stats.bytes << " / " << stats.memoryCap
+			<< ", watched directories " << stats.watchedDirectories << " / " << stats.directoryCap
+			<< ", directory evictions " << stats.directoryEvictions << std::endl;
+	}
+
+	// Command line entry: MetadataCacheBenchMain [files] [lookups] [modifications] [directory]
+	int MetadataCacheBenchMain(int argc, char* argv[])
+	{
+		size_t files = argc > 1 ? (size_t)std::atoi(argv[1]) : 2000;
+		size_t lookups = argc > 2 ? (size_t)std::atoi(argv[2]) : 200000;
+		size_t modifications = argc > 3 ? (size_t)std::atoi(argv[3]) : 200;
+		std::filesystem::path root = argc > 4 ? std::filesystem::path(argv[4])
+			: std::filesystem::temp_directory_path() / "metadata-cache-bench";
+
+		// Files spread over a few directories, like several open folders
+		std::vector<std::filesystem::path> paths;
+		std::error_code ec;
+		for (size_t i = 0; i < files; i++)
+		{
+			std::filesystem::path directory = root / ("dir" + std::to_string(i % 8));
+			std::filesystem::create_directories(directory, ec);
+			std::filesystem::path path = directory / ("file" + std::to_string(i) + ".txt");
+			std::ofstream(path, std::ios::trunc) << std::string(i % 512, 'x');
+			paths.push_back(path);
+		}
+
+		std::mt19937 rng(21);
+		std::geometric_distribution<size_t> skew(0.01);
+		NativeMetadataBackend native;
+		FileMetadata metadata = {};
+
+		// Hit rate and lookup cost, cache large enough for everything
+		{
+			MetadataCache cache(native, CreateNativeDirectoryWatcher(), 64 * 1024 * 1024);
+			auto t0 = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < lookups; i++)
+			{
+				cache.Query(paths[skew(rng) % paths.size()], metadata);
+			}
+			auto t1 = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < lookups; i++)
+			{
+				native.Query(paths[skew(rng) % paths.size()], metadata);
+			}
+			auto t2 = std::chrono::steady_clock::now();
+			PrintCacheStats("large cap", cache.Stats());
+			std::cout << "cached " << std::chrono::duration<double, std::nano>(t1 - t0).count() / lookups
+				<< " ns/lookup, uncached " << std::chrono::duration<double, std::nano>(t2 - t1).count() / lookups
+				<< " ns/lookup" << std::endl;
+		}
+
+		// Eviction, room for about a tenth of the files
+		{
+			MetadataCache cache(native, CreateNativeDirectoryWatcher(), files * 30);
+			for (size_t i = 0; i < lookups; i++)
+			{
+				cache.Query(paths[skew(rng) % paths.size()], metadata);
+			}
+			PrintCacheStats("small cap", cache.Stats());
+		}
+
+		// Directory cap: half the directories, so they keep displacing each other. Sizes must
+		// stay right and no more directories than the cap may be watched at any time.
+		size_t wrongSizes = 0;
+		size_t overCap = 0;
+		bool wrongLru = false;
+		MetadataCacheStats directoryStats = {};
+		{
+			const size_t directoryCap = 4;
+			MetadataCache cache(native, CreateNativeDirectoryWatcher(), 64 * 1024 * 1024, directoryCap);
+
+			// paths[i] is in dir(i % 8): touch dir0 again before a fifth directory comes in, so
+			// dir1 is the one to go and dir0 keeps its entry
+			for (size_t i : { 0, 1, 2, 3, 0, 4 })
+			{
+				cache.Query(paths[i], metadata);
+			}
+			uint64_t hits = cache.Stats().hits;
+			cache.Query(paths[0], metadata);
+			wrongLru = cache.Stats().hits != hits + 1;
+			cache.Query(paths[1], metadata);
+			wrongLru = wrongLru || cache.Stats().hits != hits + 1;
+
+			for (size_t i = 0; i < lookups / 4; i++)
+			{
+				size_t index = skew(rng) % paths.size();
+				cache.Query(paths[index], metadata);
+				if (metadata.size != index % 512)
+				{
+					wrongSizes++;
+				}
+				if (i % 64 == 0 && cache.Stats().watchedDirectories > directoryCap)
+				{
+					overCap++;
+				}
+			}
+			directoryStats = cache.Stats();
+			PrintCacheStats("directory cap", directoryStats);
+		}
+		// Without a native watcher nothing is cached, so there is nothing to evict either
+		bool watching = directoryStats.uncached != directoryStats.misses;
+		bool capped = wrongSizes == 0 && overCap == 0 && directoryStats.watchedDirectories <= directoryStats.directoryCap
+			&& (!watching || (!wrongLru && directoryStats.directoryEvictions > 0));
+		std::cout << "directory cap: " << wrongSizes << " wrong sizes, " << overCap << " samples over the cap, "
+			<< (wrongLru ? "wrong" : "least recently used") << " directory evicted: " << (capped ? "ok" : "WRONG") << std::endl;
+
+		// Invalidation: every modified file must show its new size once notified
+		size_t stale = 0;
+		double worstMs = 0;
+		{
+			MetadataCache cache(native, CreateNativeDirectoryWatcher(), 64 * 1024 * 1024);
+			for (const std::filesystem::path& path : paths)
+			{
+				cache.Query(path, metadata);
+			}
+
+			std::uniform_int_distribution<size_t> pick(0, paths.size() - 1);
+			for (size_t i = 0; i < modifications; i++)
+			{
+				const std::filesystem::path& path = paths[pick(rng)];
+				cache.Query(path, metadata);
+				uint64_t before = metadata.size;
+				std::ofstream(path, std::ios::app) << "appended";
+
+				auto t0 = std::chrono::steady_clock::now();
+				auto deadline = t0 + std::chrono::seconds(2);
+				for (;;)
+				{
+					cache.Query(path, metadata);
+					if (metadata.size == before + 8)
+					{
+						break;
+					}
+					if (std::chrono::steady_clock::now() > deadline)
+					{
+						stale++;
+						break;
+					}
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+				}
+				worstMs = std::max(worstMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+			}
+			PrintCacheStats("invalidation", cache.Stats());
+		}
+		std::cout << "modifications " << modifications << ", stale after 2 s: " << stale
+			<< ", worst notification delay " << worstMs << " ms" << std::endl;
+		return stale == 0 && capped ? 0 : 1;
+	}
+}
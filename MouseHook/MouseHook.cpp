@@ -6,136 +6,95 @@
 #include <comdef.h>   // For _bstr_t, _variant_t
 #include <atlbase.h> // 使用 CComPtr 简化 COM 内存管理
 #include <oleauto.h>
-#include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 #include <algorithm>
 
+#include "AsyncLog.h"
+#include "ComShellSession.h"
+#include "DataObjectSource.h"
+#include "DragVerdict.h"
+#include "DropFiles.h"
+#include "ExtensionPolicy.h"
+#include "FileMetadata.h"
+#include "FormatNegotiation.h"
+#include "GestureEngine.h"
+#include "HookWatchdog.h"
+#include "ShellIdList.h"
+#include "ShellWindowsSource.h"
+#include "WindowTree.h"
+
 #pragma comment(lib, "User32.lib")
 #pragma comment(lib, "Ole32.lib")
 #pragma comment(lib, "OleAut32.lib")
 #pragma comment(lib, "Shlwapi.lib")
 
 HHOOK g_mouseHook;
-bool g_isDragging = false;
-POINT g_dragStartPos = { 0, 0 };
 const int DRAG_THRESHOLD = 3; // 拖动阈值（像素）
+// 超过阈值才算拖动，状态机的阈值是包含的，所以加 1
+static SystemDrag::GestureEngine g_gesture(DRAG_THRESHOLD + 1, DRAG_THRESHOLD + 1);
+// 钩子只投递检测请求，检测在 main1 的消息循环里执行，会话结束后未完成的检测作废
+#define WM_DRAG_VERDICT_REQUEST (WM_USER + 101)
+static DWORD g_hookThreadId = 0;
+static SystemDrag::DragSessionGate g_dragSession;
+// 回调计时，超出预算时关闭回调内的日志并跳过按下位置判断，钩子被系统移除后重新安装
+static SystemDrag::SteadyWatchdogClock g_watchdogClock;
+static SystemDrag::HookWatchdog g_watchdog(g_watchdogClock, SystemDrag::DefaultHookBudget(SystemDrag::LowLevelHooksTimeoutNs()));
 
 void ExtractFileInfoFromDropClipboard();
-void CheckOtherDataFormats(IDataObject* pDataObject);
+void CheckOtherDataFormats(const std::vector<uint32_t>& formats);
 void ExtractFileTypeInfo(const std::wstring& filePath);
+void ExtractFileTypeInfo(const std::wstring& filePath, const SystemDrag::FileMetadata& metadata);
 
 
 //----------------------------------------------------------------------------------------
 
 class FileDetector {
 private:
-	static const std::set<std::wstring> targetExtensions;
-	static const int SWC_DESKTOP = 8;
-	static const int SWFO_NEEDDISPATCH = 1;
-
 	struct ShellWindowInfo {
 		HWND hwnd;
 		bool isDesktop;
 	};
 
 	static ShellWindowInfo FindShellParent(HWND hWnd) {
-		ShellWindowInfo result = { nullptr, false };
-		HWND current = hWnd;
-
-		while (current != nullptr) {
-			wchar_t className[256];
-			GetClassName(current, className, sizeof(className) / sizeof(wchar_t));
-
-			// Check if it's a regular explorer window
-			if (wcscmp(className, L"CabinetWClass") == 0) {
-				result.hwnd = current;
-				result.isDesktop = false;
-				return result;
-			}
-
-			// Check if it's desktop
-			if (wcscmp(className, L"Progman") == 0 || wcscmp(className, L"WorkerW") == 0) {
-				result.hwnd = current;
-				result.isDesktop = true;
-				return result;
-			}
-
-			current = GetParent(current);
-		}
-
-		// Fallback: check for desktop handle
-		HWND progman = FindWindow(L"Progman", nullptr);
-		if (progman != nullptr) {
-			// Simplified desktop detection
-		}
-
+		// Memoized per window, invalidated when windows are destroyed or reparented
+		SystemDrag::ShellRoot root = SystemDrag::ShellAncestry().Resolve((SystemDrag::WindowKey)hWnd);
+		ShellWindowInfo result = { (HWND)root.window, root.kind == SystemDrag::ShellKind::Desktop };
 		return result;
 	}
 
-	static bool CheckExplorerWindow(IShellWindows* shellWindows, HWND targetHwnd) {
-		long count;
-		if (FAILED(shellWindows->get_Count(&count))) {
+	// The view comes from the shared HWND -> view cache, IShellWindows is only rescanned
+	// after a window registers. Relies on the caller's apartment outliving the cache.
+	static bool CheckExplorerWindow(HWND targetHwnd) {
+		CComPtr<IDispatch> dispatch;
+		if (!SystemDrag::ShellViews().Lookup((SystemDrag::WindowKey)targetHwnd, dispatch)) {
 			return false;
 		}
 
-		for (long i = 0; i < count; i++) {
-			VARIANT index;
-			index.vt = VT_I4;
-			index.lVal = i;
-
-			IDispatch* dispatch = nullptr;
-			if (FAILED(shellWindows->Item(index, &dispatch)) || !dispatch) {
-				continue;
-			}
-
-			IWebBrowser2* browser = nullptr;
-			if (FAILED(dispatch->QueryInterface(IID_IWebBrowser2, (void**)&browser))) {
-				dispatch->Release();
-				continue;
-			}
-
-			HWND windowHwnd = nullptr;
-			if (SUCCEEDED(browser->get_HWND((LONG_PTR*)&windowHwnd))) {
-				if (windowHwnd == targetHwnd) {
-					bool result = HasValidSelection(browser);
-					browser->Release();
-					dispatch->Release();
-					return result;
-				}
-			}
-
-			browser->Release();
-			dispatch->Release();
+		CComPtr<IWebBrowser2> browser;
+		if (FAILED(dispatch->QueryInterface(IID_IWebBrowser2, (void**)&browser))) {
+			return false;
 		}
 
-		return false;
+		return HasValidSelection(browser);
 	}
 
-	static bool CheckDesktopSelection(IShellWindows* shellWindows) {
-		IShellBrowser* shellBrowser = nullptr;
-		VARIANT empty = { VT_EMPTY };
-		long hwnd = 0;
-
-		// Get desktop window
-		IDispatch* desktopDispatch = nullptr;
-		if (FAILED(shellWindows->FindWindowSW(&empty, &empty, SWC_DESKTOP, &hwnd,
-			SWFO_NEEDDISPATCH, &desktopDispatch)) ||
-			!desktopDispatch) {
+	// The desktop view is kept by the thread's shell session and only looked up again after
+	// Explorer restarted
+	static bool CheckDesktopSelection() {
+		CComPtr<IDispatch> desktopDispatch;
+		if (SystemDrag::CurrentShellSession().DesktopView(desktopDispatch) != SystemDrag::ShellStatus::Ok) {
 			return false;
 		}
 
-		IWebBrowser2* desktopBrowser = nullptr;
+		CComPtr<IWebBrowser2> desktopBrowser;
 		if (FAILED(desktopDispatch->QueryInterface(IID_IWebBrowser2, (void**)&desktopBrowser))) {
-			desktopDispatch->Release();
 			return false;
 		}
 
-		bool result = HasValidSelection(desktopBrowser);
-		desktopBrowser->Release();
-		desktopDispatch->Release();
-		return result;
+		return HasValidSelection(desktopBrowser);
 	}
 
 	static bool HasValidSelection(IWebBrowser2* browser) {
@@ -174,38 +133,43 @@ private:
 			return false;
 		}
 
+		// Item() and get_Path() are both calls into Explorer, so the selection is walked in
+		// chunks that start at one item and double up to 32: a selection whose first item is a
+		// file costs what it did before, a long one still gets parallel lookups. Extensions are
+		// checked first, they are free; each chunk's matching paths are looked up together to
+		// skip directories named like files, and the walk stops at the first confirmed file.
+		// A path that cannot be queried still counts, as before.
 		bool foundValidFile = false;
-		for (long i = 0; i < itemCount; i++) {
-			VARIANT itemIndex;
-			itemIndex.vt = VT_I4;
-			itemIndex.lVal = i;
-
-			FolderItem* item = nullptr;
-			if (FAILED(selectedItems->Item(itemIndex, &item)) || !item) {
-				continue;
-			}
-
-			BSTR pathBstr = nullptr;
-			if (SUCCEEDED(item->get_Path(&pathBstr)) && pathBstr) {
-				std::wstring path(pathBstr);
-				SysFreeString(pathBstr);
-
-				// Check if it's a directory
-				DWORD attrs = GetFileAttributes(path.c_str());
-				if (attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY)) {
-					item->Release();
+		std::vector<std::filesystem::path> candidates;
+		std::vector<SystemDrag::FileMetadata> metadata;
+		long chunk = 1;
+		for (long i = 0; i < itemCount && !foundValidFile; chunk = (std::min)(chunk * 2, 32L)) {
+			candidates.clear();
+			for (long end = (std::min)(itemCount, i + chunk); i < end; i++) {
+				VARIANT itemIndex;
+				itemIndex.vt = VT_I4;
+				itemIndex.lVal = i;
+
+				FolderItem* item = nullptr;
+				if (FAILED(selectedItems->Item(itemIndex, &item)) || !item) {
 					continue;
 				}
 
-				// Check extension
-				std::wstring ext = PathFindExtension(path.c_str());
-				if (targetExtensions.find(ext) != targetExtensions.end()) {
-					foundValidFile = true;
-					item->Release();
-					break;
+				BSTR pathBstr = nullptr;
+				if (SUCCEEDED(item->get_Path(&pathBstr)) && pathBstr) {
+					if (SystemDrag::SharedExtensionPolicy().Match(PathFindExtension(pathBstr))) {
+						candidates.emplace_back(std::wstring(pathBstr, SysStringLen(pathBstr)));
+					}
+					SysFreeString(pathBstr);
 				}
+				item->Release();
+			}
+
+			if (!candidates.empty()) {
+				SystemDrag::MetadataBatchResult batch = SystemDrag::SharedMetadataResolver().Resolve(candidates, metadata,
+					[](size_t, const SystemDrag::FileMetadata& entry) { return !entry.IsDirectory(); });
+				foundValidFile = batch.stopIndex != (size_t)-1;
 			}
-			item->Release();
 		}
 
 		selectedItems->Release();
@@ -216,121 +180,85 @@ private:
 	}
 
 public:
+	// Runs on the caller's STA, which keeps the shell session between calls
 	static bool IsDraggingSupportedFile() {
 		try {
-			// Initialize COM
-			if (FAILED(CoInitialize(nullptr))) {
-				return false;
-			}
-
 			// Get cursor position
 			POINT mousePos;
 			if (!GetCursorPos(&mousePos)) {
-				CoUninitialize();
 				return false;
 			}
 
 			// Get window under cursor
 			HWND targetHwnd = WindowFromPoint(mousePos);
 			if (!targetHwnd) {
-				CoUninitialize();
 				return false;
 			}
 
 			// Find shell parent
 			ShellWindowInfo shellInfo = FindShellParent(targetHwnd);
 			if (!shellInfo.hwnd) {
-				CoUninitialize();
-				return false;
-			}
-
-			// Create Shell.Application
-			IShellWindows* shellWindows = nullptr;
-			if (FAILED(CoCreateInstance(CLSID_ShellWindows, nullptr, CLSCTX_ALL,
-				IID_IShellWindows, (void**)&shellWindows)) ||
-				!shellWindows) {
-				CoUninitialize();
 				return false;
 			}
 
-			bool result = false;
 			if (shellInfo.isDesktop) {
-				result = CheckDesktopSelection(shellWindows);
+				return CheckDesktopSelection();
 			}
-			else {
-				result = CheckExplorerWindow(shellWindows, shellInfo.hwnd);
-			}
-
-			shellWindows->Release();
-			CoUninitialize();
-			return result;
+			return CheckExplorerWindow(shellInfo.hwnd);
 
 		}
 		catch (...) {
-			CoUninitialize();
 			return false;
 		}
 	}
 };
 
-// Initialize static member
-const std::set<std::wstring> FileDetector::targetExtensions = {
-	L".txt", L".csv", L".log", L".xml", L".json", L".cs", L".html",
-	L".md", L".xaml", L".py", L".java", L".c", L".cpp"
-};
-
 class FileDetector1
 {
 private:
-	static bool IsTargetExtension(const std::wstring& path)
+	static bool IsTargetExtension(std::wstring_view path)
 	{
-		// 定义目标后缀名
-		static const std::set<std::wstring> targetExtensions = {
-			L".txt", L".csv", L".log", L".xml", L".json", L".cs",
-			L".html", L".md", L".xaml", L".py", L".java", L".c", L".cpp"
-		};
-
-		LPWSTR ext = PathFindExtensionW(path.c_str());
-		if (ext == NULL) return false;
-
-		std::wstring extStr(ext);
-		// 转换为小写进行比较
-		std::transform(extStr.begin(), extStr.end(), extStr.begin(), ::towlower);
-
-		return targetExtensions.count(extStr) > 0;
+		// 配置文件编译出的匹配表，热更新时无锁读取
+		return SystemDrag::SharedExtensionPolicy().MatchPath(path);
 	}
 
 	// 检查具体的 Window/View 是否包含选中的合法文件
-	static bool HasValidSelection(IDispatch* pDispWindow)
+	// 每次跨进程调用之后检查会话是否已结束，结束则立即放弃
+	static SystemDrag::Verdict HasValidSelection(IDispatch* pDispWindow, const SystemDrag::CancelToken& token)
 	{
-		if (!pDispWindow) return false;
+		if (!pDispWindow) return SystemDrag::Verdict::Unsupported;
 
 		CComPtr<IWebBrowser2> pBrowser;
 		HRESULT hr = pDispWindow->QueryInterface(IID_IWebBrowser2, (void**)&pBrowser);
-		if (FAILED(hr)) return false;
+		if (FAILED(hr)) return SystemDrag::Verdict::Unsupported;
 
 		// 获取 Document
 		CComPtr<IDispatch> pDispDoc;
 		hr = pBrowser->get_Document(&pDispDoc);
-		if (FAILED(hr) || !pDispDoc) return false;
+		if (token.Cancelled()) return SystemDrag::Verdict::Cancelled;
+		if (FAILED(hr) || !pDispDoc) return SystemDrag::Verdict::Unsupported;
 
 		// 获取 Folder View
 		CComPtr<IShellFolderViewDual> pFolderView;
 		hr = pDispDoc->QueryInterface(IID_IShellFolderViewDual, (void**)&pFolderView);
-		if (FAILED(hr)) return false;
+		if (token.Cancelled()) return SystemDrag::Verdict::Cancelled;
+		if (FAILED(hr)) return SystemDrag::Verdict::Unsupported;
 
 		// 获取 SelectedItems
 		CComPtr<FolderItems> pSelectedItems;
 		hr = pFolderView->SelectedItems(&pSelectedItems);
-		if (FAILED(hr) || !pSelectedItems) return false;
+		if (token.Cancelled()) return SystemDrag::Verdict::Cancelled;
+		if (FAILED(hr) || !pSelectedItems) return SystemDrag::Verdict::Unsupported;
 
 		long count = 0;
 		pSelectedItems->get_Count(&count);
-		if (count == 0) return false;
+		if (count == 0) return SystemDrag::Verdict::Unsupported;
 
 		// 遍历选中项
 		for (long i = 0; i < count; i++)
 		{
+			if (token.Cancelled()) return SystemDrag::Verdict::Cancelled;
+
 			CComVariant varIndex(i);
 			CComPtr<FolderItem> pItem;
 			hr = pSelectedItems->Item(varIndex, &pItem);
@@ -347,73 +275,52 @@ private:
 				pItem->get_Path(&bstrPath);
 				if (bstrPath)
 				{
-					std::wstring path(bstrPath, SysStringLen(bstrPath));
+					// 直接在 BSTR 上匹配后缀，避免拷贝
+					bool matched = IsTargetExtension(std::wstring_view(bstrPath, SysStringLen(bstrPath)));
 					SysFreeString(bstrPath);
 
-					if (IsTargetExtension(path))
+					if (matched)
 					{
-						return true;
+						return SystemDrag::Verdict::Supported;
 					}
 				}
 			}
 		}
-		return false;
+		return SystemDrag::Verdict::Unsupported;
 	}
 
 	static HWND FindShellParent(HWND hWnd, bool& isDesktop)
 	{
-		isDesktop = false;
-		HWND current = hWnd;
-
-		while (current != NULL)
-		{
-			wchar_t className[256];
-			GetClassNameW(current, className, 256);
-
-			// 检查是否是普通资源管理器
-			if (wcscmp(className, L"CabinetWClass") == 0)
-			{
-				return current;
-			}
-
-			// 检查是否是桌面
-			if (wcscmp(className, L"Progman") == 0 || wcscmp(className, L"WorkerW") == 0)
-			{
-				isDesktop = true;
-				return current;
-			}
-
-			current = GetParent(current);
-		}
-
-		// 兜底检查：如果上面的循环没找到，但 WorkerW 可能覆盖在 Progman 上
-		HWND progman = FindWindowW(L"Progman", NULL);
-		if (progman != NULL)
-		{
-			// 这里简化处理，如果找不到父级但也没报错，返回 NULL
-		}
-
-		return NULL;
+		// 祖先查找结果按窗口缓存，窗口销毁或改变父窗口时失效
+		SystemDrag::ShellRoot root = SystemDrag::ShellAncestry().Resolve((SystemDrag::WindowKey)hWnd);
+		isDesktop = root.kind == SystemDrag::ShellKind::Desktop;
+		return (HWND)root.window;
 	}
 
 public:
 	static bool IsDraggingSupportedFile()
+	{
+		return Detect(SystemDrag::CancelToken()) == SystemDrag::Verdict::Supported;
+	}
+
+	// 可取消的检测：token 对应的拖拽会话结束后，在下一个步骤处返回 Cancelled
+	static SystemDrag::Verdict Detect(const SystemDrag::CancelToken& token)
 	{
 		// COM 初始化 (实际使用中建议在线程入口处初始化一次，不要在函数内频繁调用)
 		//CoInitialize(NULL);
-		bool result = false;
+		SystemDrag::Verdict result = SystemDrag::Verdict::Unsupported;
 
 		try
 		{
 			// 1. 获取鼠标位置
 			POINT mousePos;
 			GetCursorPos(&mousePos);
-			std::cout << "Mouse pos at (" << mousePos.x << ", " << mousePos.y << ")\n";
+			SystemDrag::SharedLog().Write("Mouse pos at ({}, {})", mousePos.x, mousePos.y);
 			// 2. 获取鼠标下的窗口句柄
 			HWND targetHwnd = WindowFromPoint(mousePos);
 			if (targetHwnd == NULL)
 			{
-				std::cout << "No window at mouse position\n" << std::endl;
+				SystemDrag::SharedLog().Write("No window at mouse position");
 				throw 0;
 			}
 
@@ -422,76 +329,40 @@ public:
 			HWND shellHwnd = FindShellParent(targetHwnd, isDesktop);
 			if (shellHwnd == NULL)
 			{
-				std::cout << "No shell parent found\n" << std::endl;
+				SystemDrag::SharedLog().Write("No shell parent found");
 				throw 0;
 			}
+			if (token.Cancelled()) return SystemDrag::Verdict::Cancelled;
 
-			// 4. 初始化 ShellWindows
-			CComPtr<IShellWindows> pShellWindows;
-			HRESULT hr = pShellWindows.CoCreateInstance(CLSID_ShellWindows);
-			if (FAILED(hr))
-			{
-                std::cout << "Failed to create IShellWindows instance:" << hr << std::endl;
-				throw 0;
-			}
-			// 5. 根据类型查找
+			// 4. 根据类型查找
 			if (isDesktop)
 			{
-				// 对应 C#: shellWindows.FindWindowSW(..., SWC_DESKTOP, ..., SWFO_NEEDDISPATCH)
-				// SWC_DESKTOP = 8, SWFO_NEEDDISPATCH = 1
-				CComVariant vMissing;
-				vMissing.vt = VT_ERROR;
-				vMissing.scode = DISP_E_PARAMNOTFOUND;
-				int hwndVal = 0;
+				// 桌面视图由本线程的 Shell 会话缓存，资源管理器重启后才重新查找
 				CComPtr<IDispatch> pDispDesktop;
-
-				hr = pShellWindows->FindWindowSW(
-					&vMissing, &vMissing,
-					SWC_DESKTOP,
-					(long*)&hwndVal,
-					SWFO_NEEDDISPATCH,
-					&pDispDesktop
-				);
-
-				if (SUCCEEDED(hr) && pDispDesktop)
+				SystemDrag::ShellStatus status = SystemDrag::CurrentShellSession().DesktopView(pDispDesktop);
+				if (status != SystemDrag::ShellStatus::Ok)
 				{
-					result = HasValidSelection(pDispDesktop);
+					SystemDrag::SharedLog().Write("Failed to get the desktop view:{}", (int)status);
+					throw 0;
 				}
+
+				if (token.Cancelled()) return SystemDrag::Verdict::Cancelled;
+				result = HasValidSelection(pDispDesktop, token);
 			}
 			else
 			{
-				// 遍历所有打开的 Explorer 窗口
-				long winCount = 0;
-				pShellWindows->get_Count(&winCount);
-
-				for (long i = 0; i < winCount; i++)
+				// 从缓存中取窗口对应的视图，只有窗口注册后才重新遍历 IShellWindows
+				CComPtr<IDispatch> pDisp;
+				if (SystemDrag::ShellViews().Lookup((SystemDrag::WindowKey)shellHwnd, pDisp))
 				{
-					CComVariant index(i);
-					CComPtr<IDispatch> pDisp;
-					hr = pShellWindows->Item(index, &pDisp);
-
-					if (SUCCEEDED(hr) && pDisp)
-					{
-						CComPtr<IWebBrowser2> pBrowser;
-						hr = pDisp->QueryInterface(IID_IWebBrowser2, (void**)&pBrowser);
-						if (SUCCEEDED(hr))
-						{
-							SHANDLE_PTR hWindow = 0;
-							pBrowser->get_HWND(&hWindow);
-
-							if ((HWND)hWindow == shellHwnd)
-							{
-								result = HasValidSelection(pDisp);
-								if (result) break;
-							}
-						}
-					}
+					if (token.Cancelled()) return SystemDrag::Verdict::Cancelled;
+					result = HasValidSelection(pDisp, token);
 				}
 			}
 		}
 		catch (...)
 		{
-			result = false;
+			result = SystemDrag::Verdict::Unsupported;
 		}
 
 		//CoUninitialize();
@@ -504,50 +375,85 @@ public:
 
 
 LRESULT CALLBACK MouseProc(int nCode, WPARAM wParam, LPARAM lParam) {
+	// 快速路径：不会产生手势信号的移动只计数，直接放行
+	if (nCode == HC_ACTION && wParam == WM_MOUSEMOVE) {
+		const MSLLHOOKSTRUCT* pMove = (const MSLLHOOKSTRUCT*)lParam;
+		if (g_gesture.MoveIsIdle(pMove->pt.x, pMove->pt.y)) {
+			g_watchdog.FastPath();
+			return CallNextHookEx(g_mouseHook, nCode, wParam, lParam);
+		}
+	}
+
+	uint64_t hookEntered = g_watchdog.Enter();
 	if (nCode == HC_ACTION) {
 		MSLLHOOKSTRUCT* pMouse = (MSLLHOOKSTRUCT*)lParam;
 
-		if (wParam == WM_LBUTTONDOWN) {
+		SystemDrag::PointerEvent ev = { pMouse->time, pMouse->pt.x, pMouse->pt.y, SystemDrag::PointerAction::Move };
+		bool relevant = true;
+		switch (wParam) {
+		case WM_LBUTTONDOWN:
 			/*std::cout << "Mouse Button Down at (" << pMouse->pt.x << ", " << pMouse->pt.y << ")\n";*/
-			// 你可以在这里检测是否是拖拽开始的条件
 			// 记录拖动起始位置
-			g_dragStartPos = pMouse->pt;
-			g_isDragging = false;
+			ev.action = SystemDrag::PointerAction::ButtonDown;
+			break;
+		case WM_MOUSEMOVE:
+			ev.action = SystemDrag::PointerAction::Move;
+			break;
+		case WM_LBUTTONUP:
+			ev.action = SystemDrag::PointerAction::ButtonUp;
+			break;
+		default:
+			relevant = false;
+			break;
+		}
+		// 看门狗的探测事件只用来确认钩子仍然有效
+		if (SystemDrag::IsHookProbe(pMouse->dwExtraInfo)) {
+			relevant = false;
 		}
 
-		if (wParam == WM_MOUSEMOVE) {
-			// 检测鼠标是否有拖拽操作
-			if (GetAsyncKeyState(VK_LBUTTON) & 0x8000) {
-				// 检查是否超过拖动阈值
-				int deltaX = abs(pMouse->pt.x - g_dragStartPos.x);
-				int deltaY = abs(pMouse->pt.y - g_dragStartPos.y);
-
-				if (!g_isDragging && (deltaX > DRAG_THRESHOLD || deltaY > DRAG_THRESHOLD)) {
-					g_isDragging = true;
-					std::cout << "move begin..." << std::endl;
-
-					// 尝试从拖放剪贴板获取文件信息
-					//ExtractFileInfoFromDropClipboard();
-					std::cout << "Mouse Button move at (" << pMouse->pt.x << ", " << pMouse->pt.y << ")\n";
-					bool isDraggingSupportedFile = FileDetector1::IsDraggingSupportedFile();
-					std::cout << "isDraggingSupportedFile: " << isDraggingSupportedFile << std::endl;
-					
+		unsigned signals = relevant ? g_gesture.Feed(ev) : SystemDrag::GestureNone;
+
+		if (relevant && ev.action == SystemDrag::PointerAction::ButtonDown) {
+			// 新的手势取代之前所有未完成的检测
+			g_dragSession.End();
+
+			// 按下位置不在资源管理器/桌面内，本次按下不跟踪拖拽
+			// 超出预算时跳过，由 main1 里的检测判断窗口
+			if (!g_watchdog.ShedPressWork()) {
+				HWND target = WindowFromPoint(pMouse->pt);
+				if (SystemDrag::ShellAncestry().Resolve((SystemDrag::WindowKey)target).kind == SystemDrag::ShellKind::None) {
+					g_gesture.Reset();
 				}
 			}
 		}
 
-		if (wParam == WM_LBUTTONUP)
-		{
-			if (g_isDragging) {
-				std::cout << "move end" << std::endl;
-				g_isDragging = false;
+		if ((signals & SystemDrag::GestureDragStart) && g_watchdog.LoggingAllowed()) {
+			SystemDrag::SharedLog().Write("move begin...");
+		}
+
+		if (signals & SystemDrag::GestureCheckRequested) {
+			// 尝试从拖放剪贴板获取文件信息
+			//ExtractFileInfoFromDropClipboard();
+			if (g_watchdog.LoggingAllowed()) {
+				SystemDrag::SharedLog().Write("Mouse Button move at ({}, {})", pMouse->pt.x, pMouse->pt.y);
 			}
+			g_dragSession.Begin(g_gesture.SessionId());
+			PostThreadMessage(g_hookThreadId, WM_DRAG_VERDICT_REQUEST, g_gesture.SessionId(), MAKELPARAM(pMouse->pt.x, pMouse->pt.y));
+		}
+
+		if (signals & SystemDrag::GestureDragEnd) {
+			if (g_watchdog.LoggingAllowed()) {
+				SystemDrag::SharedLog().Write("move end");
+			}
+			g_dragSession.End();
 		}
 	}
+	g_watchdog.Leave(hookEntered);
 	return CallNextHookEx(g_mouseHook, nCode, wParam, lParam);
 }
 
 // 从拖放剪贴板提取文件信息
+// 只枚举一次格式，按优先级选出够用的那一个格式，只取这一份数据
 void ExtractFileInfoFromDropClipboard() {
 	//HRESULT hr = OleInitialize(nullptr);
 	HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
@@ -559,114 +465,115 @@ void ExtractFileInfoFromDropClipboard() {
 	// 获取拖放剪贴板数据
 	hr = OleGetClipboard(&pDataObject);
 	if (SUCCEEDED(hr) && pDataObject) {
-		FORMATETC fmtetc = {
-			CF_HDROP,
-			NULL,
-			DVASPECT_CONTENT,
-			-1,
-			TYMED_HGLOBAL
-		};
-		FORMATETC fmtetcUnicodeText = { CF_UNICODETEXT, NULL, DVASPECT_CONTENT, -1, TYMED_HGLOBAL };
-		FORMATETC fmtetcText = { CF_TEXT, NULL, DVASPECT_CONTENT, -1, TYMED_HGLOBAL };
-
-
-		if (SUCCEEDED(pDataObject->QueryGetData(&fmtetc))) {
-			STGMEDIUM stgmed;
-			// 查询HDROP数据
-			hr = pDataObject->GetData(&fmtetc, &stgmed);
-			if (SUCCEEDED(hr)) {
-				HDROP hDrop = static_cast<HDROP>(GlobalLock(stgmed.hGlobal));
-				if (hDrop) {
-					// 获取文件数量
-					UINT fileCount = DragQueryFile(hDrop, 0xFFFFFFFF, nullptr, 0);
-					std::cout << "drag file count: " << fileCount << std::endl;
-
-					// 遍历所有文件
-					for (UINT i = 0; i < fileCount; i++) {
-						// 获取文件路径长度
-						UINT pathLength = DragQueryFile(hDrop, i, nullptr, 0);
-						if (pathLength > 0) {
-							std::vector<TCHAR> buffer(pathLength + 1);
-							DragQueryFile(hDrop, i, buffer.data(), pathLength + 1);
-
-							std::wstring filePath(buffer.data());
-							std::wcout << L"file " << (i + 1) << L": " << filePath << std::endl;
-
-							// 获取文件属性信息
-							ExtractFileTypeInfo(filePath);
-						}
-					}
+		SystemDrag::DataObjectSource source(pDataObject);
+		SystemDrag::FormatNegotiator negotiator;
+		negotiator.Register(SystemDrag::DropFormat::ShellIdList, RegisterClipboardFormat(CFSTR_SHELLIDLIST));
+		SystemDrag::FormatOffer offer = negotiator.Negotiate(source);
+		SystemDrag::LazyPayload payload(source, negotiator.FormatId(offer.best));
+
+		switch (offer.best) {
+		case SystemDrag::DropFormat::HDrop:
+			if (const SystemDrag::FormatPayload* drop = payload.Get()) {
+				// 解析失败时列表为空
+				SystemDrag::DropFilesView dropFiles;
+				if (SystemDrag::DropFilesView::Parse(drop->data, drop->size, dropFiles)
+					!= SystemDrag::DropFilesView::Status::Ok) {
+					std::wcout << L"malformed DROPFILES block" << std::endl;
+				}
+
+				// 获取文件数量
+				std::cout << "drag file count: " << dropFiles.size() << std::endl;
+
+				// 直接遍历锁定的 DROPFILES 内存，不再每个文件调用两次 DragQueryFile
+				std::vector<std::filesystem::path> filePaths;
+				for (std::u16string_view path : dropFiles.WidePaths()) {
+					filePaths.emplace_back(SystemDrag::AsWide(path));
+				}
+				// 旧程序给出的 ANSI 列表按系统代码页转换
+				for (std::string_view path : dropFiles.AnsiPaths()) {
+					filePaths.emplace_back(std::string(path));
+				}
 
-					GlobalUnlock(stgmed.hGlobal);
+				// 所有文件的属性一次批量并行查询
+				std::vector<SystemDrag::FileMetadata> metadata;
+				SystemDrag::SharedMetadataResolver().Resolve(filePaths, metadata);
+				for (size_t i = 0; i < filePaths.size(); i++) {
+					std::wcout << L"file " << (i + 1) << L": " << filePaths[i].native() << std::endl;
+
+					// 获取文件属性信息
+					ExtractFileTypeInfo(filePaths[i].native(), metadata[i]);
 				}
-				ReleaseStgMedium(&stgmed);
 			}
-		}
-		else
-		{
-			std::wcout << L"CF_HDROP format not supported" << std::endl;
-		}
+			break;
+
+		case SystemDrag::DropFormat::ShellIdList:
+			// 库、搜索结果、压缩文件夹、手机等没有 CF_HDROP，直接从 item ID 里读名字，不逐个绑定
+			if (const SystemDrag::FormatPayload* idList = payload.Get()) {
+				SystemDrag::ShellIdListView items;
+				if (SystemDrag::ShellIdListView::Parse(idList->data, idList->size, items)
+					!= SystemDrag::ShellIdListView::Status::Ok) {
+					std::wcout << L"malformed shell ID list" << std::endl;
+				}
 
-		if (SUCCEEDED(pDataObject->QueryGetData(&fmtetcUnicodeText)))
-		{
-			STGMEDIUM stgmedText;
-
-			hr = pDataObject->GetData(&fmtetcUnicodeText, &stgmedText);
-			if (SUCCEEDED(hr)) {
-				wchar_t* pText = static_cast<wchar_t*>(GlobalLock(stgmedText.hGlobal));
-				if (pText) {
-					std::wstring text = pText;
-					std::wcout << L"CF_UNICODETEXT: " << text << std::endl;
-					// 检查文本是否为文件路径（简单的检查：是否包含扩展名，并且路径存在）
-					// 这里我们假设文本就是文件路径
-					if (GetFileAttributes(text.c_str()) != INVALID_FILE_ATTRIBUTES) {
-						std::wcout << L"Text is a valid file path: " << text << std::endl;
-						ExtractFileTypeInfo(text);
+				std::cout << "shell item count: " << items.size() << std::endl;
+				std::wcout << L"parent: " << SystemDrag::AsWide(items.ParentPath()) << std::endl;
+				for (size_t i = 0; i < items.size(); i++) {
+					SystemDrag::ShellItem item = items.Item(i);
+					if (item.kind == SystemDrag::ShellItemKind::Other) {
+						std::wcout << L"item " << (i + 1) << L": (not a file system item)" << std::endl;
+						continue;
 					}
-					else {
-						// 如果文本不是文件路径，我们将其视为普通文本
-						std::wcout << L"Text is not a file path: " << text << std::endl;
+					std::wcout << L"item " << (i + 1) << L": " << SystemDrag::AsWide(item.name) << std::endl;
+					if (item.kind == SystemDrag::ShellItemKind::File) {
+						std::wcout << L"  extension: " << SystemDrag::AsWide(item.Extension())
+							<< (SystemDrag::SharedExtensionPolicy().Match(item.Extension()) ? L" (supported)" : L"") << std::endl;
+						std::wcout << L"  size: " << item.size << L" bytes" << std::endl;
 					}
-					GlobalUnlock(stgmedText.hGlobal);
 				}
-				ReleaseStgMedium(&stgmedText);
 			}
-		}
-		else
-		{
-			std::wcout << L"CF_UNICODETEXT format not supported" << std::endl;
-		}
+			break;
+
+		case SystemDrag::DropFormat::UnicodeText:
+			if (const SystemDrag::FormatPayload* unicodeText = payload.Get()) {
+				const wchar_t* pText = static_cast<const wchar_t*>(unicodeText->data);
+				std::wstring text(pText, wcsnlen(pText, unicodeText->size / sizeof(wchar_t)));
+				std::wcout << L"CF_UNICODETEXT: " << text << std::endl;
+				// 检查文本是否为文件路径（简单的检查：是否包含扩展名，并且路径存在）
+				// 这里我们假设文本就是文件路径
+				if (GetFileAttributes(text.c_str()) != INVALID_FILE_ATTRIBUTES) {
+					std::wcout << L"Text is a valid file path: " << text << std::endl;
+					ExtractFileTypeInfo(text);
+				}
+				else {
+					// 如果文本不是文件路径，我们将其视为普通文本
+					std::wcout << L"Text is not a file path: " << text << std::endl;
+				}
+			}
+			break;
 
-		if (SUCCEEDED(pDataObject->QueryGetData(&fmtetcText)))
-		{
+		case SystemDrag::DropFormat::Text:
 			// 尝试CF_TEXT
-			STGMEDIUM stgmedTextA;
-
-			hr = pDataObject->GetData(&fmtetcText, &stgmedTextA);
-			if (SUCCEEDED(hr)) {
-				char* pText = static_cast<char*>(GlobalLock(stgmedTextA.hGlobal));
-				if (pText) {
-					std::string text = pText;
-					std::cout << "CF_TEXT: " << text << std::endl;
-					// 转换为宽字符串
-					std::wstring wtext(text.begin(), text.end());
-					if (GetFileAttributes(wtext.c_str()) != INVALID_FILE_ATTRIBUTES) {
-						std::wcout << L"Text is a valid file path: " << wtext << std::endl;
-						ExtractFileTypeInfo(wtext);
-					}
-					else {
-						std::wcout << L"Text is not a file path: " << wtext << std::endl;
-					}
-					GlobalUnlock(stgmedTextA.hGlobal);
+			if (const SystemDrag::FormatPayload* ansiText = payload.Get()) {
+				const char* pText = static_cast<const char*>(ansiText->data);
+				std::string text(pText, strnlen(pText, ansiText->size));
+				std::cout << "CF_TEXT: " << text << std::endl;
+				// 转换为宽字符串
+				std::wstring wtext(text.begin(), text.end());
+				if (GetFileAttributes(wtext.c_str()) != INVALID_FILE_ATTRIBUTES) {
+					std::wcout << L"Text is a valid file path: " << wtext << std::endl;
+					ExtractFileTypeInfo(wtext);
+				}
+				else {
+					std::wcout << L"Text is not a file path: " << wtext << std::endl;
 				}
-				ReleaseStgMedium(&stgmedTextA);
 			}
-		}
-		else
-		{
-			std::wcout << L"TEXT format not supported" << std::endl;
-			// 尝试其他数据格式
-			CheckOtherDataFormats(pDataObject);
+			break;
+
+		default:
+			std::wcout << L"no CF_HDROP / shell ID list / CF_UNICODETEXT / CF_TEXT format" << std::endl;
+			// 列出其他数据格式，用的是同一次枚举的结果
+			CheckOtherDataFormats(offer.formats);
+			break;
 		}
 
 		pDataObject->Release();
@@ -679,48 +586,44 @@ void ExtractFileInfoFromDropClipboard() {
 }
 
 // 检查其他数据格式
-void CheckOtherDataFormats(IDataObject* pDataObject) {
-	// 查询支持的数据格式
-	IEnumFORMATETC* pEnumFormat = nullptr;
-	HRESULT hr = pDataObject->EnumFormatEtc(DATADIR_GET, &pEnumFormat);
-
-	if (SUCCEEDED(hr) && pEnumFormat) {
-		FORMATETC fmtetc;
-		ULONG fetched = 0;
+void CheckOtherDataFormats(const std::vector<uint32_t>& formats) {
+	std::cout << "data format in clipboard:" << std::endl;
 
-		std::cout << "data format in clipboard:" << std::endl;
-
-		while (pEnumFormat->Next(1, &fmtetc, &fetched) == S_OK && fetched == 1) {
-			TCHAR formatName[256];
-			if (GetClipboardFormatName(fmtetc.cfFormat, formatName, 256) > 0) {
-				std::wcout << L"format1: " << formatName << L" (ID: " << fmtetc.cfFormat << L")" << std::endl;
-			}
-			else {
-				// 标准格式
-				std::string stdFormatName;
-				switch (fmtetc.cfFormat) {
-				case CF_TEXT: stdFormatName = "CF_TEXT"; break;
-				case CF_UNICODETEXT: stdFormatName = "CF_UNICODETEXT"; break;
-				case CF_BITMAP: stdFormatName = "CF_BITMAP"; break;
-				case CF_DIB: stdFormatName = "CF_DIB"; break;
-				case CF_HDROP: stdFormatName = "CF_HDROP"; break;
-				case CF_LOCALE: stdFormatName = "CF_LOCALE"; break;
-				case CF_OEMTEXT: stdFormatName = "CF_OEMTEXT"; break;
-				default: stdFormatName = "unknown"; break;
-				}
-				std::cout << "format2: " << stdFormatName << " (ID: " << fmtetc.cfFormat << ")" << std::endl;
+	for (uint32_t format : formats) {
+		TCHAR formatName[256];
+		if (GetClipboardFormatName(format, formatName, 256) > 0) {
+			std::wcout << L"format1: " << formatName << L" (ID: " << format << L")" << std::endl;
+		}
+		else {
+			// 标准格式
+			std::string stdFormatName;
+			switch (format) {
+			case CF_TEXT: stdFormatName = "CF_TEXT"; break;
+			case CF_UNICODETEXT: stdFormatName = "CF_UNICODETEXT"; break;
+			case CF_BITMAP: stdFormatName = "CF_BITMAP"; break;
+			case CF_DIB: stdFormatName = "CF_DIB"; break;
+			case CF_HDROP: stdFormatName = "CF_HDROP"; break;
+			case CF_LOCALE: stdFormatName = "CF_LOCALE"; break;
+			case CF_OEMTEXT: stdFormatName = "CF_OEMTEXT"; break;
+			default: stdFormatName = "unknown"; break;
 			}
+			std::cout << "format2: " << stdFormatName << " (ID: " << format << ")" << std::endl;
 		}
-
-		pEnumFormat->Release();
 	}
 }
 
 // 提取文件类型信息
 void ExtractFileTypeInfo(const std::wstring& filePath) {
-	// 获取文件属性
-	DWORD attr = GetFileAttributes(filePath.c_str());
-	if (attr != INVALID_FILE_ATTRIBUTES) {
+	std::vector<std::filesystem::path> paths(1, filePath);
+	std::vector<SystemDrag::FileMetadata> metadata;
+	SystemDrag::SharedMetadataResolver().Resolve(paths, metadata);
+	ExtractFileTypeInfo(filePath, metadata[0]);
+}
+
+// 属性、大小已由一次 GetFileAttributesEx 查询得到，不再打开文件
+void ExtractFileTypeInfo(const std::wstring& filePath, const SystemDrag::FileMetadata& metadata) {
+	DWORD attr = metadata.attributes;
+	if (metadata.exists) {
 		if (attr & FILE_ATTRIBUTE_DIRECTORY) {
 			std::wcout << L"  type: directory" << std::endl;
 		}
@@ -735,15 +638,7 @@ void ExtractFileTypeInfo(const std::wstring& filePath) {
 			}
 
 			// 获取文件大小
-			HANDLE hFile = CreateFile(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ,
-				nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-			if (hFile != INVALID_HANDLE_VALUE) {
-				LARGE_INTEGER fileSize;
-				if (GetFileSizeEx(hFile, &fileSize)) {
-					std::wcout << L"  size: " << fileSize.QuadPart << L" bytes" << std::endl;
-				}
-				CloseHandle(hFile);
-			}
+			std::wcout << L"  size: " << metadata.size << L" bytes" << std::endl;
 		}
 
 		// 显示文件属性
@@ -772,17 +667,56 @@ int main1() {
 		std::cerr << "错误：线程已经是 MTA 模式，Shell 接口需要 STA 模式。" << std::endl;
 		// 如果必须在 MTA 线程运行，请参考方案三
 	}
+	// 加载后缀名策略，文件修改后自动生效
+	SystemDrag::SharedExtensionPolicy().StartWatching(L"extensions.conf", std::chrono::milliseconds(1000));
+
+	g_hookThreadId = GetCurrentThreadId();
 	InstallMouseHook();
+	// 看门狗心跳：钩子错过了输入就注入探测事件，探测也收不到就重新安装
+	UINT_PTR heartbeatTimer = SetTimer(NULL, 0, 250, NULL);
 
 	// 进入消息循环
 	MSG msg;
 	while (GetMessage(&msg, NULL, 0, 0)) {
+		if (msg.message == WM_TIMER && msg.wParam == heartbeatTimer) {
+			SystemDrag::HeartbeatAction action = g_watchdog.Poll(SystemDrag::LastInputNs(g_watchdogClock));
+			if (action == SystemDrag::HeartbeatAction::Probe) {
+				SystemDrag::SendHookProbe();
+			}
+			else if (action == SystemDrag::HeartbeatAction::Reinstall) {
+				SystemDrag::SharedLog().Write("mouse hook lost, reinstalling");
+				UnhookWindowsHookEx(g_mouseHook);
+				InstallMouseHook();
+			}
+			continue;
+		}
+		if (msg.message == WM_DRAG_VERDICT_REQUEST) {
+			uint32_t session = (uint32_t)msg.wParam;
+			SystemDrag::CancelToken token(g_dragSession, session);
+			if (token.Cancelled()) {
+				// 请求排队期间已松开或已开始新的按下
+				continue;
+			}
+
+			SystemDrag::Verdict verdict = FileDetector1::Detect(token);
+			if (verdict == SystemDrag::Verdict::Cancelled || token.Cancelled()) {
+				SystemDrag::SharedLog().Write("verdict for session {} dropped", session);
+				continue;
+			}
+			SystemDrag::SharedLog().Write("isDraggingSupportedFile: {}", (int)(verdict == SystemDrag::Verdict::Supported));
+			continue;
+		}
 		TranslateMessage(&msg);
 		DispatchMessage(&msg);
 	}
 
 	// 卸载钩子
+	KillTimer(NULL, heartbeatTimer);
 	UnhookWindowsHookEx(g_mouseHook);
+	SystemDrag::ReleaseShellViews();
+	SystemDrag::ReleaseShellSession();
+	SystemDrag::ReleaseShellAncestry();
+	SystemDrag::SharedExtensionPolicy().StopWatching();
 
 	// 2. 结束清理
 	CoUninitialize();
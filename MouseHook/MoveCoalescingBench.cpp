@@ -0,0 +1,172 @@
+#include "DragTrace.h"
+#include "GestureEngine.h"
+#include "HookWatchdog.h"
+#include "SpscRing.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Replay of synthetic 8 kHz mouse input through the hook callback with and without move
+// coalescing. The callback is the one in Hook.cpp minus the Windows calls: watchdog
+// timing, the gesture state machine, the trace check and the queue to the detection
+// thread. Input alternates between hovering, clicks that jitter inside the threshold and
+// drags; both runs must raise the same signals for the same events, and the watchdog must
+// account for every event.
+namespace SystemDrag
+{
+	struct SimulatedHook
+	{
+		SimulatedHook(IWatchdogClock& clock, bool coalesce)
+			: watchdog(clock, DefaultHookBudget(300000000)), coalesce(coalesce)
+		{
+		}
+
+		// Returns the signals so the two runs can be compared event by event
+		unsigned Callback(const PointerEvent& ev)
+		{
+			if (coalesce && ev.action == PointerAction::Move && gesture.MoveIsIdle(ev.x, ev.y))
+			{
+				watchdog.FastPath();
+				return GestureNone;
+			}
+
+			uint64_t entered = watchdog.Enter();
+			unsigned signals = gesture.Feed(ev);
+			SharedDragTrace().Pointer(gesture.SessionId(), ev, 0);
+			if (signals & GestureCheckRequested)
+			{
+				DragEventRecord record = { gesture.SessionId(), ev.time, ev.x, ev.y, DragEventKind::CheckRequested, 0 };
+				queue.TryPush(record);
+			}
+			if (signals & GestureDragEnd)
+			{
+				DragEventRecord record = { gesture.SessionId(), ev.time, ev.x, ev.y, DragEventKind::DragEnd, 0 };
+				queue.TryPush(record);
+			}
+			watchdog.Leave(entered);
+			return signals;
+		}
+
+		HookWatchdog watchdog;
+		GestureEngine gesture;
+		SpscRing<DragEventRecord, 256> queue;
+		bool coalesce;
+	};
+
+	// events per second of input; time is in ms like MSLLHOOKSTRUCT::time
+	static std::vector<PointerEvent> MakeHighRateInput(size_t seconds, size_t rate)
+	{
+		std::vector<PointerEvent> events;
+		uint64_t state = 0x2545F4914F6CDD1Dull;
+		size_t total = seconds * rate;
+		int32_t x = 500;
+		int32_t y = 500;
+		size_t phase = 0;
+		while (events.size() < total)
+		{
+			// 1 s of hovering, then 300 ms of pressed button: every other time a click that
+			// jitters inside the threshold, otherwise a slow drag
+			for (size_t i = 0; i < rate && events.size() < total; i++)
+			{
+				state = state * 6364136223846793005ull + 1442695040888963407ull;
+				x += (int32_t)(state >> 62) - 1;
+				y += (int32_t)((state >> 60) & 3) - 1;
+				events.push_back(PointerEvent{ (uint32_t)(events.size() * 1000 / rate), x, y, PointerAction::Move });
+			}
+
+			bool drag = phase++ % 2 == 1;
+			int32_t pressX = x;
+			int32_t pressY = y;
+			events.push_back(PointerEvent{ (uint32_t)(events.size() * 1000 / rate), x, y, PointerAction::ButtonDown });
+			for (size_t i = 0; i < rate * 3 / 10 && events.size() < total; i++)
+			{
+				state = state * 6364136223846793005ull + 1442695040888963407ull;
+				if (drag)
+				{
+					x += (int32_t)(i % 8 == 0);
+				}
+				else
+				{
+					// Sub-pixel sensor noise around the press point
+					x = pressX + (int32_t)(state >> 62) - 1;
+					y = pressY + (int32_t)((state >> 60) & 3) - 1;
+				}
+				events.push_back(PointerEvent{ (uint32_t)(events.size() * 1000 / rate), x, y, PointerAction::Move });
+			}
+			events.push_back(PointerEvent{ (uint32_t)(events.size() * 1000 / rate), x, y, PointerAction::ButtonUp });
+		}
+		return events;
+	}
+
+	// Fresh hook per run; returns ns per event
+	static double Replay(bool coalesce, const std::vector<PointerEvent>& events, std::vector<unsigned>& signals,
+		HookWatchdogStats& stats)
+	{
+		SteadyWatchdogClock clock;
+		SimulatedHook hook(clock, coalesce);
+		signals.assign(events.size(), GestureNone);
+		DragEventRecord drained;
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			signals[i] = hook.Callback(events[i]);
+			while (hook.queue.TryPop(drained))
+			{
+			}
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / events.size();
+		stats = hook.watchdog.Stats();
+		return ns;
+	}
+
+	// Command line entry: MoveCoalescingBenchMain [seconds of input] [rate-hz]
+	int MoveCoalescingBenchMain(int argc, char* argv[])
+	{
+		size_t seconds = argc > 1 ? (size_t)std::atoi(argv[1]) : 60;
+		size_t rate = argc > 2 ? (size_t)std::atoi(argv[2]) : 8000;
+		if (rate < 10)
+		{
+			rate = 10;
+		}
+
+		std::vector<PointerEvent> events = MakeHighRateInput(seconds, rate);
+		std::vector<unsigned> fullSignals;
+		std::vector<unsigned> coalescedSignals;
+		HookWatchdogStats fullStats;
+		HookWatchdogStats stats;
+
+		// Alternate so frequency scaling and caches treat both alike; keep the fastest
+		double fullNs = 0;
+		double coalescedNs = 0;
+		for (int round = 0; round < 3; round++)
+		{
+			double f = Replay(false, events, fullSignals, fullStats);
+			double c = Replay(true, events, coalescedSignals, stats);
+			fullNs = round == 0 || f < fullNs ? f : fullNs;
+			coalescedNs = round == 0 || c < coalescedNs ? c : coalescedNs;
+		}
+
+		size_t mismatches = 0;
+		size_t drags = 0;
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			mismatches += fullSignals[i] != coalescedSignals[i];
+			drags += (fullSignals[i] & GestureDragStart) != 0;
+		}
+
+		std::cout << events.size() << " events at " << rate << " Hz, " << drags << " drags" << std::endl;
+		std::cout << "full callback: " << fullNs << " ns/event, coalesced: " << coalescedNs << " ns/event ("
+			<< fullNs / coalescedNs << "x), fast path " << 100.0 * stats.fastPath / events.size() << "% of events"
+			<< std::endl;
+		std::cout << "timed callbacks: full " << fullStats.callbacks << ", coalesced " << stats.callbacks
+			<< " at " << (stats.callbacks != 0 ? stats.callbackNs / stats.callbacks : 0) << " ns avg" << std::endl;
+
+		bool correct = mismatches == 0 && drags != 0 && stats.callbacks + stats.fastPath == events.size()
+			&& fullStats.callbacks == events.size();
+		std::cout << (correct ? "coalescing ok" : "coalescing WRONG") << " (" << mismatches << " signal mismatches)"
+			<< std::endl;
+		return correct ? 0 : 1;
+	}
+}
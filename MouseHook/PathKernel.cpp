@@ -0,0 +1,312 @@
+#include "PathKernel.h"
+
+#include <cwctype>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PATHKERNEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 inside functions that ask for it; MSVC always can
+#if defined(PATHKERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PATHKERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PATHKERNEL_TARGET_AVX2
+#endif
+
+namespace SystemDrag
+{
+	void PathBatch::Clear()
+	{
+		m_length = 0;
+		m_chars.assign(Padding, 0);
+		m_paths.clear();
+	}
+
+	void PathBatch::Reserve(size_t paths, size_t units)
+	{
+		m_paths.reserve(paths);
+		m_chars.reserve(units + Padding);
+	}
+
+	void PathBatch::Append(std::u16string_view path)
+	{
+		Span span = { (uint32_t)m_length, (uint32_t)path.size() };
+		m_chars.resize(m_length + path.size() + Padding, 0);
+		path.copy(m_chars.data() + m_length, path.size());
+		m_length += path.size();
+		m_paths.push_back(span);
+	}
+
+	void PathBatch::Append(std::wstring_view path)
+	{
+		if (sizeof(wchar_t) == sizeof(char16_t))
+		{
+			Append(std::u16string_view(reinterpret_cast<const char16_t*>(path.data()), path.size()));
+			return;
+		}
+
+		Span span = { (uint32_t)m_length, 0 };
+		m_chars.resize(m_length + path.size() * 2 + Padding, 0);
+		char16_t* out = m_chars.data() + m_length;
+		for (wchar_t c : path)
+		{
+			uint32_t unit = (uint32_t)c;
+			if (unit > 0xFFFF)
+			{
+				unit -= 0x10000;
+				*out++ = (char16_t)(0xD800 + (unit >> 10));
+				*out++ = (char16_t)(0xDC00 + (unit & 0x3FF));
+			}
+			else
+			{
+				*out++ = (char16_t)unit;
+			}
+		}
+		span.length = (uint32_t)(out - (m_chars.data() + m_length));
+		m_length += span.length;
+		m_chars.resize(m_length + Padding);
+		m_paths.push_back(span);
+	}
+
+	static inline bool IsSeparator(char16_t c)
+	{
+		return c == u'\\' || c == u'/' || c == u':';
+	}
+
+	static inline unsigned HighestBit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, mask);
+		return (unsigned)index;
+#else
+		return 31u - (unsigned)__builtin_clz(mask);
+#endif
+	}
+
+	// Shared tail of every kernel: extension position and in-place folding
+	static inline void Finish(char16_t* path, uint32_t length, int lastSeparator, int lastDot, bool nonAscii, PathInfo& info)
+	{
+		info.length = length;
+		info.nameOffset = (uint32_t)(lastSeparator + 1);
+		info.extensionOffset = lastDot > lastSeparator ? (uint32_t)lastDot : length;
+		info.nonAscii = nonAscii;
+
+		for (uint32_t i = info.extensionOffset + 1; i < length; i++)
+		{
+			char16_t c = path[i];
+			if (c >= u'A' && c <= u'Z')
+			{
+				path[i] = (char16_t)(c + (u'a' - u'A'));
+			}
+		}
+	}
+
+	// Slow path for flagged paths: fold what the kernels left alone with the C library's
+	// case mapping. Surrogates are skipped, towlower knows nothing about halves of a pair.
+	static void FoldNonAscii(char16_t* extension, uint32_t length)
+	{
+		for (uint32_t i = 0; i < length; i++)
+		{
+			char16_t c = extension[i];
+			if (c >= 0x80 && (c < 0xD800 || c > 0xDFFF))
+			{
+				extension[i] = (char16_t)std::towlower((wint_t)c);
+			}
+		}
+	}
+
+	static void AnalyzeScalar(char16_t* path, uint32_t length, PathInfo& info)
+	{
+		int lastSeparator = -1;
+		int lastDot = -1;
+		char16_t high = 0;
+		for (uint32_t i = 0; i < length; i++)
+		{
+			char16_t c = path[i];
+			high |= c;
+			if (IsSeparator(c))
+			{
+				lastSeparator = (int)i;
+			}
+			else if (c == u'.')
+			{
+				lastDot = (int)i;
+			}
+		}
+		Finish(path, length, lastSeparator, lastDot, (high & 0xFF80) != 0, info);
+	}
+
+#ifdef PATHKERNEL_X86
+	// movemask_epi8 yields two bits per UTF-16 unit, so the unit index is bit / 2
+	static void AnalyzeSse2(char16_t* path, uint32_t length, PathInfo& info)
+	{
+		const __m128i backslash = _mm_set1_epi16((short)u'\\');
+		const __m128i slash = _mm_set1_epi16((short)u'/');
+		const __m128i colon = _mm_set1_epi16((short)u':');
+		const __m128i dot = _mm_set1_epi16((short)u'.');
+		const __m128i highMask = _mm_set1_epi16((short)0xFF80);
+		const __m128i zero = _mm_setzero_si128();
+
+		int lastSeparator = -1;
+		int lastDot = -1;
+		uint32_t highBits = 0;
+		for (uint32_t i = 0; i < length; i += 8)
+		{
+			uint32_t remaining = length - i;
+			uint32_t valid = remaining >= 8 ? 0xFFFFu : (1u << (2 * remaining)) - 1;
+			__m128i v = _mm_loadu_si128((const __m128i*)(path + i));
+
+			__m128i separators = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, backslash), _mm_cmpeq_epi16(v, slash)),
+				_mm_cmpeq_epi16(v, colon));
+			uint32_t separatorBits = (uint32_t)_mm_movemask_epi8(separators) & valid;
+			uint32_t dotBits = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(v, dot)) & valid;
+			if (separatorBits)
+			{
+				lastSeparator = (int)(i + HighestBit(separatorBits) / 2);
+			}
+			if (dotBits)
+			{
+				lastDot = (int)(i + HighestBit(dotBits) / 2);
+			}
+
+			// The tail block reads into the next path (or the padding), hence the valid mask everywhere
+			__m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(v, highMask), zero);
+			highBits |= ~(uint32_t)_mm_movemask_epi8(ascii) & valid;
+		}
+		Finish(path, length, lastSeparator, lastDot, highBits != 0, info);
+	}
+
+	PATHKERNEL_TARGET_AVX2
+	static void AnalyzeAvx2(char16_t* path, uint32_t length, PathInfo& info)
+	{
+		const __m256i backslash = _mm256_set1_epi16((short)u'\\');
+		const __m256i slash = _mm256_set1_epi16((short)u'/');
+		const __m256i colon = _mm256_set1_epi16((short)u':');
+		const __m256i dot = _mm256_set1_epi16((short)u'.');
+		const __m256i highMask = _mm256_set1_epi16((short)0xFF80);
+		const __m256i zero = _mm256_setzero_si256();
+
+		int lastSeparator = -1;
+		int lastDot = -1;
+		uint32_t highBits = 0;
+		for (uint32_t i = 0; i < length; i += 16)
+		{
+			uint32_t remaining = length - i;
+			uint32_t valid = remaining >= 16 ? 0xFFFFFFFFu : (1u << (2 * remaining)) - 1;
+			__m256i v = _mm256_loadu_si256((const __m256i*)(path + i));
+
+			__m256i separators = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, backslash),
+				_mm256_cmpeq_epi16(v, slash)), _mm256_cmpeq_epi16(v, colon));
+			uint32_t separatorBits = (uint32_t)_mm256_movemask_epi8(separators) & valid;
+			uint32_t dotBits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, dot)) & valid;
+			if (separatorBits)
+			{
+				lastSeparator = (int)(i + HighestBit(separatorBits) / 2);
+			}
+			if (dotBits)
+			{
+				lastDot = (int)(i + HighestBit(dotBits) / 2);
+			}
+
+			__m256i ascii = _mm256_cmpeq_epi16(_mm256_and_si256(v, highMask), zero);
+			highBits |= ~(uint32_t)_mm256_movemask_epi8(ascii) & valid;
+		}
+		Finish(path, length, lastSeparator, lastDot, highBits != 0, info);
+	}
+
+	static bool CpuHasAvx2()
+	{
+#ifdef _MSC_VER
+		int regs[4];
+		__cpuid(regs, 0);
+		if (regs[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(regs, 1);
+		bool osxsave = (regs[2] & (1 << 27)) != 0;
+		bool avx = (regs[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+		__cpuidex(regs, 7, 0);
+		return (regs[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+
+	PathKernel BestPathKernel()
+	{
+#ifdef PATHKERNEL_X86
+		static const PathKernel best = CpuHasAvx2() ? PathKernel::Avx2 : PathKernel::Sse2;
+		return best;
+#else
+		return PathKernel::Scalar;
+#endif
+	}
+
+	const char* PathKernelName(PathKernel kernel)
+	{
+		switch (kernel)
+		{
+		case PathKernel::Sse2:
+			return "sse2";
+		case PathKernel::Avx2:
+			return "avx2";
+		default:
+			return "scalar";
+		}
+	}
+
+	static void FoldFlagged(PathBatch& batch, const std::vector<PathInfo>& infos)
+	{
+		char16_t* units = batch.Units();
+		for (size_t i = 0; i < infos.size(); i++)
+		{
+			if (infos[i].nonAscii && infos[i].HasExtension())
+			{
+				FoldNonAscii(units + batch.Begin(i) + infos[i].extensionOffset, infos[i].length - infos[i].extensionOffset);
+			}
+		}
+	}
+
+	void AnalyzePaths(PathBatch& batch, std::vector<PathInfo>& infos, PathKernel kernel)
+	{
+		infos.resize(batch.size());
+		char16_t* units = batch.Units();
+
+#ifdef PATHKERNEL_X86
+		if (kernel == PathKernel::Avx2)
+		{
+			for (size_t i = 0; i < batch.size(); i++)
+			{
+				AnalyzeAvx2(units + batch.Begin(i), (uint32_t)batch.Path(i).size(), infos[i]);
+			}
+			FoldFlagged(batch, infos);
+			return;
+		}
+		if (kernel == PathKernel::Sse2)
+		{
+			for (size_t i = 0; i < batch.size(); i++)
+			{
+				AnalyzeSse2(units + batch.Begin(i), (uint32_t)batch.Path(i).size(), infos[i]);
+			}
+			FoldFlagged(batch, infos);
+			return;
+		}
+#endif
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			AnalyzeScalar(units + batch.Begin(i), (uint32_t)batch.Path(i).size(), infos[i]);
+		}
+		FoldFlagged(batch, infos);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Path normalization for large drags in one pass over a packed buffer.
+// All paths of a batch live back to back in one UTF-16 buffer. The kernel finds the final
+// separator ('\\', '/' or ':') and the extension's dot of every path and ASCII-folds the
+// extension in place. Paths with any non-ASCII unit are flagged and their extension goes
+// through a towlower slow path afterwards, so the result matches a per-path towlower.
+// SSE2 or AVX2 on x86 (picked at run time), scalar elsewhere.
+namespace SystemDrag
+{
+	struct PathInfo
+	{
+		uint32_t length;
+		uint32_t nameOffset;        // first unit of the final component
+		uint32_t extensionOffset;   // the extension's '.', or length when there is none
+		bool nonAscii;              // took the slow path for its extension
+
+		bool HasExtension() const { return extensionOffset < length; }
+	};
+
+	class PathBatch
+	{
+	public:
+		// Zero units kept past the last path so a block load never needs a tail loop
+		static constexpr size_t Padding = 16;
+
+		PathBatch() : m_length(0), m_chars(Padding, 0) {}
+
+		void Clear();
+		void Reserve(size_t paths, size_t units);
+
+		void Append(std::u16string_view path);
+		// wchar_t is UTF-16 on Windows; wider wchar_t is encoded as UTF-16 here
+		void Append(std::wstring_view path);
+
+		size_t size() const { return m_paths.size(); }
+		std::u16string_view Path(size_t index) const
+		{
+			return std::u16string_view(m_chars.data() + m_paths[index].begin, m_paths[index].length);
+		}
+		std::u16string_view Extension(size_t index, const PathInfo& info) const
+		{
+			return Path(index).substr(info.extensionOffset);
+		}
+
+		// Raw access for the kernels
+		char16_t* Units() { return m_chars.data(); }
+		uint32_t Begin(size_t index) const { return m_paths[index].begin; }
+
+	private:
+		struct Span
+		{
+			uint32_t begin;
+			uint32_t length;
+		};
+
+		size_t m_length;
+		std::vector<char16_t> m_chars;
+		std::vector<Span> m_paths;
+	};
+
+	enum class PathKernel
+	{
+		Scalar,
+		Sse2,
+		Avx2
+	};
+
+	// Best kernel this CPU supports
+	PathKernel BestPathKernel();
+	const char* PathKernelName(PathKernel kernel);
+
+	// infos[i] describes batch.Path(i); extensions are folded in the batch's own buffer
+	void AnalyzePaths(PathBatch& batch, std::vector<PathInfo>& infos, PathKernel kernel = BestPathKernel());
+}
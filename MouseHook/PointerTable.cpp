@@ -0,0 +1,167 @@
+#include "PointerTable.h"
+
+#include <cstdlib>
+
+namespace SystemDrag
+{
+	PointerTable::PointerTable(size_t capacity, int minDragX, int minDragY)
+		: m_capacity(capacity == 0 ? 1 : capacity > 0xFFFF ? 0xFFFF : capacity)
+		, m_minDragX(minDragX), m_minDragY(minDragY)
+		, m_device(m_capacity, 0), m_button(m_capacity, 0), m_state(m_capacity, StateFree), m_session(m_capacity, 0)
+		, m_startX(m_capacity, 0), m_startY(m_capacity, 0), m_startTime(m_capacity, 0)
+		, m_pressGates(new DragSessionGate[m_capacity]), m_dragGates(new DragSessionGate[m_capacity])
+		, m_highWater(0), m_active(0), m_pending(0), m_nextSession(0), m_overflows(0)
+	{
+	}
+
+	void PointerTable::SetThreshold(int minDragX, int minDragY)
+	{
+		m_minDragX = minDragX;
+		m_minDragY = minDragY;
+	}
+
+	uint32_t PointerTable::Find(uint32_t device, PointerButton button) const
+	{
+		for (uint32_t slot = 0; slot < m_highWater; slot++)
+		{
+			if (m_state[slot] != StateFree && m_device[slot] == device && m_button[slot] == (uint8_t)button)
+			{
+				return slot;
+			}
+		}
+		return NoSlot;
+	}
+
+	void PointerTable::Free(uint32_t slot)
+	{
+		if ((m_state[slot] & (StateDown | StateChecked)) == StateDown)
+		{
+			m_pending--;
+		}
+		m_state[slot] = StateFree;
+		m_pressGates[slot].End();
+		m_dragGates[slot].End();
+		m_active--;
+		while (m_highWater > 0 && m_state[m_highWater - 1] == StateFree)
+		{
+			m_highWater--;
+		}
+	}
+
+	uint32_t PointerTable::Press(uint32_t device, PointerButton button, const PointerEvent& ev)
+	{
+		uint32_t slot = Find(device, button);
+		if (slot != NoSlot)
+		{
+			Free(slot);
+		}
+
+		// Lowest free slot, so the occupied range stays short
+		slot = 0;
+		while (slot < m_capacity && m_state[slot] != StateFree)
+		{
+			slot++;
+		}
+		if (slot == m_capacity)
+		{
+			m_overflows++;
+			return NoSlot;
+		}
+
+		if (++m_nextSession == 0)
+		{
+			m_nextSession = 1;
+		}
+		m_device[slot] = device;
+		m_button[slot] = (uint8_t)button;
+		m_state[slot] = StateDown;
+		m_session[slot] = m_nextSession;
+		m_startX[slot] = ev.x;
+		m_startY[slot] = ev.y;
+		m_startTime[slot] = ev.time;
+		m_pressGates[slot].Begin(m_nextSession);
+		m_active++;
+		m_pending++;
+		if (slot >= m_highWater)
+		{
+			m_highWater = slot + 1;
+		}
+		return slot;
+	}
+
+	size_t PointerTable::Move(uint32_t device, const PointerEvent& ev, PointerSignal* out)
+	{
+		size_t raised = 0;
+		if (m_pending == 0)
+		{
+			return 0;
+		}
+
+		for (uint32_t slot = 0; slot < m_highWater && raised < ButtonCount; slot++)
+		{
+			// Only a press that has not requested its check yet can still change
+			if (m_device[slot] != device || (m_state[slot] & (StateDown | StateChecked)) != StateDown)
+			{
+				continue;
+			}
+
+			unsigned signals = GestureNone;
+			if ((m_state[slot] & StateDragging) == 0)
+			{
+				long dx = std::labs((long)ev.x - m_startX[slot]);
+				long dy = std::labs((long)ev.y - m_startY[slot]);
+				if (dx < m_minDragX && dy < m_minDragY)
+				{
+					continue;
+				}
+				m_state[slot] |= StateDragging;
+				signals |= GestureDragStart;
+			}
+
+			m_state[slot] |= StateChecked;
+			m_pending--;
+			m_dragGates[slot].Begin(m_session[slot]);
+			signals |= GestureCheckRequested;
+			out[raised++] = PointerSignal{ slot, m_session[slot], signals };
+		}
+		return raised;
+	}
+
+	PointerSignal PointerTable::Release(uint32_t device, PointerButton button)
+	{
+		uint32_t slot = Find(device, button);
+		if (slot == NoSlot)
+		{
+			return PointerSignal{ NoSlot, 0, GestureNone };
+		}
+
+		PointerSignal released = { slot, m_session[slot], (m_state[slot] & StateDragging) ? GestureDragEnd : GestureNone };
+		Free(slot);
+		return released;
+	}
+
+	void PointerTable::Drop(uint32_t slot)
+	{
+		if (slot < m_highWater && m_state[slot] != StateFree)
+		{
+			Free(slot);
+		}
+	}
+
+	bool PointerTable::MoveIsIdleSlow(uint32_t device, int32_t x, int32_t y) const
+	{
+		for (uint32_t slot = 0; slot < m_highWater; slot++)
+		{
+			if (m_device[slot] != device || (m_state[slot] & (StateDown | StateChecked)) != StateDown)
+			{
+				continue;
+			}
+			if ((m_state[slot] & StateDragging) != 0
+				|| std::labs((long)x - m_startX[slot]) >= m_minDragX || std::labs((long)y - m_startY[slot]) >= m_minDragY)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "DragVerdict.h"
+#include "GestureEngine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Drag state for many pointers at once.
+// A pointer is one button held on one device: the left and right mouse buttons, a pen and
+// every touch contact are tracked apart, each with its own drag sessions and verdict gates.
+// Moves arrive per device and advance every button held on it. The table keeps one array
+// per field, so a move only walks the device and state arrays of the occupied slots.
+// Transitions are the ones of GestureEngine, which stays the single pointer reference.
+namespace SystemDrag
+{
+	enum class PointerButton : uint8_t
+	{
+		Left,
+		Right,
+		Middle
+	};
+
+	// Device ids: 0 is the mouse, pen and touch contacts get their cursor id in the low byte
+	const uint32_t MouseDevice = 0;
+	inline uint32_t PenDevice(uint32_t cursorId) { return 0x100 | (cursorId & 0xFF); }
+	inline uint32_t TouchDevice(uint32_t contactId) { return 0x200 | (contactId & 0xFF); }
+
+	// Mouse messages promoted from pen and touch input carry MI_WP_SIGNATURE in
+	// MSLLHOOKSTRUCT::dwExtraInfo, bit 7 set for touch and the cursor id in the low 7 bits
+	inline uint32_t PointerDeviceFromExtraInfo(uintptr_t extraInfo)
+	{
+		if ((extraInfo & 0xFFFFFF00) != 0xFF515700)
+		{
+			return MouseDevice;
+		}
+		return (extraInfo & 0x80) ? TouchDevice((uint32_t)(extraInfo & 0x7F)) : PenDevice((uint32_t)(extraInfo & 0x7F));
+	}
+
+	// A pointer that changed state; slot is NoSlot when the event did not belong to a tracked pointer
+	struct PointerSignal
+	{
+		uint32_t slot;
+		uint32_t sessionId;
+		unsigned signals;   // GestureSignal mask
+	};
+
+	class PointerTable
+	{
+	public:
+		static const uint32_t NoSlot = 0xFFFFFFFF;
+		// Most pointers one move can advance: every button of its device
+		static const size_t ButtonCount = 3;
+
+		// capacity is the number of pointers that can be down at the same time, at most 65535
+		// so a slot fits DragEventRecord::pointer
+		explicit PointerTable(size_t capacity = 16, int minDragX = 4, int minDragY = 4);
+
+		void SetThreshold(int minDragX, int minDragY);
+
+		// Starts a new session for button on device and returns its slot. A pointer that is still
+		// down starts over (its release was lost); with every slot taken the press is not tracked.
+		uint32_t Press(uint32_t device, PointerButton button, const PointerEvent& ev);
+		// Advances every pointer held on device; writes up to ButtonCount signals to out and
+		// returns how many pointers raised one
+		size_t Move(uint32_t device, const PointerEvent& ev, PointerSignal* out);
+		// Frees the pointer; GestureDragEnd when it was dragging
+		PointerSignal Release(uint32_t device, PointerButton button);
+		// Stops tracking the press in slot, the hook drops presses that are not on a shell window
+		void Drop(uint32_t slot);
+
+		// True when Move() would raise nothing for a move of device to (x, y), see GestureEngine::MoveIsIdle
+		bool MoveIsIdle(uint32_t device, int32_t x, int32_t y) const
+		{
+			return m_pending == 0 || MoveIsIdleSlow(device, x, y);
+		}
+
+		bool IsDown(uint32_t slot) const { return slot < m_highWater && (m_state[slot] & StateDown) != 0; }
+		bool IsDragging(uint32_t slot) const { return slot < m_highWater && (m_state[slot] & StateDragging) != 0; }
+		uint32_t SessionId(uint32_t slot) const { return m_session[slot]; }
+		uint32_t Device(uint32_t slot) const { return m_device[slot]; }
+		PointerButton Button(uint32_t slot) const { return (PointerButton)m_button[slot]; }
+		int32_t StartX(uint32_t slot) const { return m_startX[slot]; }
+		int32_t StartY(uint32_t slot) const { return m_startY[slot]; }
+		uint32_t StartTime(uint32_t slot) const { return m_startTime[slot]; }
+
+		// Per slot: the press is live from Press() to Release()/Drop(), the drag from the check
+		// request to Release(); detection jobs poll these through a CancelToken. A reused slot
+		// carries a new session id, so tokens of the previous pointer read as cancelled.
+		const DragSessionGate& PressGate(uint32_t slot) const { return m_pressGates[slot]; }
+		const DragSessionGate& DragGate(uint32_t slot) const { return m_dragGates[slot]; }
+
+		size_t Capacity() const { return m_capacity; }
+		size_t Active() const { return m_active; }
+		// Presses ignored because every slot was taken
+		uint64_t Overflows() const { return m_overflows; }
+
+	private:
+		enum : uint8_t
+		{
+			StateFree = 0,
+			StateDown = 1 << 0,
+			StateDragging = 1 << 1,
+			StateChecked = 1 << 2
+		};
+
+		uint32_t Find(uint32_t device, PointerButton button) const;
+		void Free(uint32_t slot);
+		bool MoveIsIdleSlow(uint32_t device, int32_t x, int32_t y) const;
+
+		size_t m_capacity;
+		int m_minDragX;
+		int m_minDragY;
+
+		std::vector<uint32_t> m_device;
+		std::vector<uint8_t> m_button;
+		std::vector<uint8_t> m_state;
+		std::vector<uint32_t> m_session;
+		std::vector<int32_t> m_startX;
+		std::vector<int32_t> m_startY;
+		std::vector<uint32_t> m_startTime;
+		std::unique_ptr<DragSessionGate[]> m_pressGates;
+		std::unique_ptr<DragSessionGate[]> m_dragGates;
+
+		uint32_t m_highWater;   // slots at or above are free
+		size_t m_active;        // pointers down
+		size_t m_pending;       // pointers down that have not requested their check yet
+		uint32_t m_nextSession;
+		uint64_t m_overflows;
+	};
+}
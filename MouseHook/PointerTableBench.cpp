@@ -0,0 +1,197 @@
+#include "GestureEngine.h"
+#include "GestureReplay.h"
+#include "PointerTable.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <vector>
+
+// Multi-pointer drag tracking without a desktop. Every synthetic device gets its own gesture
+// stream from MakeSyntheticGestures; the streams are interleaved into one and fed to a
+// PointerTable, while one GestureEngine per device replays its stream alone. The table must
+// raise the same signals as the engines, event by event, keep session ids unique across
+// pointers and open and close the per-slot gates with the sessions. Two buttons held on
+// the same mouse must both follow its moves. Then throughput at growing pointer counts.
+namespace SystemDrag
+{
+	struct DeviceEvent
+	{
+		uint32_t device;
+		PointerEvent ev;
+	};
+
+	// Round robin over the devices, so every pointer is down at the same time most of the run
+	static std::vector<DeviceEvent> MakeInterleaved(size_t pointers, size_t gestures, std::vector<std::vector<PointerEvent>>& streams)
+	{
+		streams.clear();
+		size_t longest = 0;
+		for (size_t p = 0; p < pointers; p++)
+		{
+			streams.push_back(MakeSyntheticGestures(gestures, 12, 40, (uint32_t)(p * 7919 + 1)));
+			longest = std::max(longest, streams.back().size());
+		}
+
+		std::vector<DeviceEvent> events;
+		for (size_t i = 0; i < longest; i++)
+		{
+			for (size_t p = 0; p < pointers; p++)
+			{
+				if (i < streams[p].size())
+				{
+					events.push_back(DeviceEvent{ (uint32_t)(0x1000 + p), streams[p][i] });
+				}
+			}
+		}
+		return events;
+	}
+
+	// Table signals for one event, OR-ed like a single engine would report them
+	static unsigned FeedTable(PointerTable& table, const DeviceEvent& de, PointerSignal* raised, size_t& count)
+	{
+		count = 0;
+		switch (de.ev.action)
+		{
+		case PointerAction::ButtonDown:
+			table.Press(de.device, PointerButton::Left, de.ev);
+			return GestureNone;
+		case PointerAction::Move:
+		{
+			count = table.Move(de.device, de.ev, raised);
+			unsigned signals = GestureNone;
+			for (size_t i = 0; i < count; i++)
+			{
+				signals |= raised[i].signals;
+			}
+			return signals;
+		}
+		case PointerAction::ButtonUp:
+		default:
+		{
+			raised[0] = table.Release(de.device, PointerButton::Left);
+			count = raised[0].slot != PointerTable::NoSlot ? 1 : 0;
+			return raised[0].signals;
+		}
+		}
+	}
+
+	static bool CheckAgainstEngines(size_t pointers, size_t gestures)
+	{
+		std::vector<std::vector<PointerEvent>> streams;
+		std::vector<DeviceEvent> events = MakeInterleaved(pointers, gestures, streams);
+		PointerTable table(pointers);
+		std::vector<GestureEngine> engines(pointers);
+
+		size_t mismatches = 0;
+		size_t gateErrors = 0;
+		size_t checks = 0;
+		std::set<uint32_t> sessions;
+		PointerSignal raised[PointerTable::ButtonCount];
+		for (const DeviceEvent& de : events)
+		{
+			unsigned expected = engines[de.device - 0x1000].Feed(de.ev);
+			size_t count = 0;
+			unsigned signals = FeedTable(table, de, raised, count);
+			mismatches += signals != expected;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const PointerSignal& s = raised[i];
+				if (s.signals & GestureCheckRequested)
+				{
+					checks++;
+					// A session is checked once and never shared with another pointer
+					gateErrors += !sessions.insert(s.sessionId).second;
+					gateErrors += !table.DragGate(s.slot).IsLive(s.sessionId) || !table.PressGate(s.slot).IsLive(s.sessionId);
+				}
+				if (de.ev.action == PointerAction::ButtonUp)
+				{
+					gateErrors += table.DragGate(s.slot).IsLive(s.sessionId) || table.PressGate(s.slot).IsLive(s.sessionId);
+				}
+			}
+		}
+
+		bool correct = mismatches == 0 && gateErrors == 0 && checks != 0 && table.Active() == 0 && table.Overflows() == 0;
+		std::cout << pointers << " pointers, " << events.size() << " events, " << checks << " checks: "
+			<< mismatches << " signal mismatches, " << gateErrors << " gate errors" << std::endl;
+		return correct;
+	}
+
+	// Left and right button held together on the mouse, plus a pen that never moves
+	static bool CheckSharedDevice()
+	{
+		PointerTable table(4, 4, 4);
+		PointerSignal raised[PointerTable::ButtonCount];
+		uint32_t left = table.Press(MouseDevice, PointerButton::Left, PointerEvent{ 0, 100, 100, PointerAction::ButtonDown });
+		uint32_t right = table.Press(MouseDevice, PointerButton::Right, PointerEvent{ 1, 102, 100, PointerAction::ButtonDown });
+		uint32_t pen = table.Press(PenDevice(1), PointerButton::Left, PointerEvent{ 2, 100, 100, PointerAction::ButtonDown });
+
+		bool correct = left != right && table.SessionId(left) != table.SessionId(right);
+		// 4 px from the left press, 2 px from the right one: only the left pointer drags
+		correct = correct && table.Move(MouseDevice, PointerEvent{ 3, 104, 100, PointerAction::Move }, raised) == 1
+			&& raised[0].slot == left;
+		correct = correct && table.Move(MouseDevice, PointerEvent{ 4, 106, 100, PointerAction::Move }, raised) == 1
+			&& raised[0].slot == right && table.IsDragging(left) && !table.IsDragging(pen);
+		correct = correct && table.MoveIsIdle(MouseDevice, 300, 300) && !table.MoveIsIdle(PenDevice(1), 300, 300);
+
+		// Releasing the right button leaves the left drag alone
+		correct = correct && table.Release(MouseDevice, PointerButton::Right).signals == GestureDragEnd
+			&& table.DragGate(left).IsLive(table.SessionId(left));
+		correct = correct && PointerDeviceFromExtraInfo(0xFF515781) == TouchDevice(1)
+			&& PointerDeviceFromExtraInfo(0xFF515702) == PenDevice(2) && PointerDeviceFromExtraInfo(0) == MouseDevice;
+		std::cout << "shared mouse device: " << (correct ? "ok" : "WRONG") << std::endl;
+		return correct;
+	}
+
+	// ns per event, best of three runs
+	static double Measure(size_t pointers, size_t gestures, size_t& eventCount)
+	{
+		std::vector<std::vector<PointerEvent>> streams;
+		std::vector<DeviceEvent> events = MakeInterleaved(pointers, gestures, streams);
+		eventCount = events.size();
+
+		double best = 0;
+		uint64_t checks = 0;
+		PointerSignal raised[PointerTable::ButtonCount];
+		for (int run = 0; run < 3; run++)
+		{
+			PointerTable table(pointers);
+			auto t0 = std::chrono::steady_clock::now();
+			for (const DeviceEvent& de : events)
+			{
+				size_t count = 0;
+				checks += (FeedTable(table, de, raised, count) & GestureCheckRequested) != 0;
+			}
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / events.size();
+			best = run == 0 || ns < best ? ns : best;
+		}
+		return checks != 0 ? best : 0;
+	}
+
+	// Command line entry: PointerTableBenchMain [gestures per pointer] [max pointers]
+	int PointerTableBenchMain(int argc, char* argv[])
+	{
+		size_t gestures = argc > 1 ? (size_t)std::atoi(argv[1]) : 100;
+		size_t maxPointers = argc > 2 ? (size_t)std::atoi(argv[2]) : 1024;
+		if (gestures == 0)
+		{
+			gestures = 1;
+		}
+
+		bool correct = CheckSharedDevice();
+		correct = CheckAgainstEngines(1, gestures) && correct;
+		correct = CheckAgainstEngines(std::min<size_t>(64, std::max<size_t>(maxPointers, 1)), gestures) && correct;
+
+		for (size_t pointers = 1; pointers <= maxPointers; pointers *= 4)
+		{
+			size_t events = 0;
+			double ns = Measure(pointers, gestures, events);
+			std::cout << pointers << " concurrent pointers: " << ns << " ns/event over " << events << " events" << std::endl;
+		}
+
+		std::cout << (correct ? "pointer table ok" : "pointer table WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
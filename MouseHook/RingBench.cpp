@@ -0,0 +1,85 @@
+#include "GestureEngine.h"
+#include "SpscRing.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+// Two-thread stress run and throughput benchmark for SpscRing.
+// The producer retries on full so every record must arrive exactly once and in order;
+// any gap or reordering is reported as an error.
+namespace SystemDrag
+{
+	template <typename Ring>
+	static int RunRing(Ring& ring, uint64_t count, bool blocking, const char* name)
+	{
+		uint64_t errors = 0;
+		uint64_t fullSpins = 0;
+
+		auto begin = std::chrono::steady_clock::now();
+
+		std::thread consumer([&ring, count, blocking, &errors]
+			{
+				uint64_t expected = 0;
+				DragEventRecord record;
+				while (expected < count)
+				{
+					if (!ring.TryPop(record))
+					{
+						if (blocking)
+						{
+							ring.WaitForData();
+						}
+						else
+						{
+							std::this_thread::yield();
+						}
+						continue;
+					}
+
+					uint64_t seq = ((uint64_t)record.sessionId << 32) | record.time;
+					if (seq != expected)
+					{
+						errors++;
+						expected = seq;
+					}
+					expected++;
+				}
+			});
+
+		for (uint64_t i = 0; i < count; i++)
+		{
+			DragEventRecord record = { (uint32_t)(i >> 32), (uint32_t)i, (int32_t)i, -(int32_t)i,
+				DragEventKind::CheckRequested, 0 };
+			while (!ring.TryPush(record))
+			{
+				fullSpins++;
+				std::this_thread::yield();
+			}
+		}
+		consumer.join();
+
+		auto end = std::chrono::steady_clock::now();
+		double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+		std::cout << name << ": " << count << " records, "
+			<< count * 1e9 / ns << " records/sec, "
+			<< ns / count << " ns/record, full retries: " << fullSpins
+			<< ", errors: " << errors << std::endl;
+		return errors == 0 ? 0 : 1;
+	}
+
+	// Command line entry: RingBenchMain [records]
+	int RingBenchMain(int argc, char* argv[])
+	{
+		uint64_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000000;
+
+		static SpscRing<DragEventRecord, 1024, NullWakeup> spinRing;
+		static SpscRing<DragEventRecord, 1024, CondVarWakeup> blockingRing;
+
+		int result = RunRing(spinRing, count, false, "spin");
+		result |= RunRing(blockingRing, count, true, "condvar");
+		return result;
+	}
+}
@@ -0,0 +1,199 @@
+#include "ExtensionPolicy.h"
+#include "SelectionTracker.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Selection tracking against mock views that emit selection-changed events: drags,
+// selection changes and now and then an extension policy reload are interleaved at random,
+// every tracked verdict is checked against a fresh pull, and the number of simulated
+// cross-process calls is compared with the pull-every-drag path.
+namespace SystemDrag
+{
+	typedef size_t MockViewId;
+
+	class MockSelectionSource : public ISelectionSource<MockViewId>
+	{
+	public:
+		MockSelectionSource(size_t views, bool deliversEvents)
+			: m_selection(views), m_subscribed(views, false), m_deliversEvents(deliversEvents), m_tracker(nullptr), m_calls(0)
+		{
+		}
+
+		void Attach(SelectionTracker<MockViewId>* tracker) { m_tracker = tracker; }
+
+		// One call for document, folder view and SelectedItems each, then one per item
+		Verdict ReadSelection(const MockViewId& view, const CancelToken& token) override
+		{
+			m_calls += 3;
+			for (const std::wstring& path : m_selection[view])
+			{
+				if (token.Cancelled())
+				{
+					return Verdict::Cancelled;
+				}
+				m_calls++;
+				if (SharedExtensionPolicy().MatchPath(std::wstring_view(path)))
+				{
+					return Verdict::Supported;
+				}
+			}
+			return Verdict::Unsupported;
+		}
+
+		SelectionRules Rules() const override
+		{
+			return SelectionRules{ SharedExtensionPolicy().Generation(), false };
+		}
+
+		bool Subscribe(WindowKey window, const MockViewId& view) override
+		{
+			if (!m_deliversEvents)
+			{
+				return false;
+			}
+			m_subscribed[view] = true;
+			(void)window;
+			return true;
+		}
+
+		void Unsubscribe(WindowKey window) override
+		{
+			m_subscribed[ViewOf(window)] = false;
+		}
+
+		// The user clicks around in the view
+		void Select(MockViewId view, std::vector<std::wstring> paths)
+		{
+			m_selection[view] = std::move(paths);
+			if (m_subscribed[view] && m_tracker)
+			{
+				m_tracker->OnSelectionChanged(WindowOf(view));
+			}
+		}
+
+		// The window navigates to another folder
+		void Navigate(MockViewId view)
+		{
+			m_selection[view].clear();
+			if (m_subscribed[view] && m_tracker)
+			{
+				m_tracker->OnViewGone(WindowOf(view));
+			}
+		}
+
+		static WindowKey WindowOf(MockViewId view) { return 0x10000 + view * 16; }
+		static MockViewId ViewOf(WindowKey window) { return (window - 0x10000) / 16; }
+
+		uint64_t Calls() const { return m_calls; }
+
+	private:
+		std::vector<std::vector<std::wstring>> m_selection;
+		std::vector<bool> m_subscribed;
+		bool m_deliversEvents;
+		SelectionTracker<MockViewId>* m_tracker;
+		uint64_t m_calls;
+	};
+
+	static int RunSelectionScenario(bool deliversEvents, size_t views, size_t operations, uint32_t seed)
+	{
+		static const wchar_t* const names[] = {
+			L"C:\\data\\report.docx", L"C:\\data\\notes.txt", L"C:\\data\\setup.exe",
+			L"C:\\data\\photo.png", L"C:\\data\\archive.7z", L"C:\\data\\sheet.xlsx"
+		};
+
+		MockSelectionSource source(views, deliversEvents);
+		SelectionTracker<MockViewId> tracker(source);
+		source.Attach(&tracker);
+
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> percent(0, 99);
+		std::uniform_int_distribution<size_t> pickView(0, views - 1);
+		std::uniform_int_distribution<int> pickName(0, 5);
+		std::uniform_int_distribution<int> selectionSize(0, 12);
+
+		size_t drags = 0;
+		size_t reloads = 0;
+		size_t mismatches = 0;
+		uint64_t checkCalls = 0;
+		for (size_t op = 0; op < operations; op++)
+		{
+			MockViewId view = pickView(rng);
+			int roll = percent(rng);
+			if (roll < 25)
+			{
+				std::vector<std::wstring> selection;
+				for (int i = selectionSize(rng); i > 0; i--)
+				{
+					selection.push_back(names[pickName(rng)]);
+				}
+				source.Select(view, std::move(selection));
+			}
+			else if (roll < 27)
+			{
+				source.Navigate(view);
+			}
+			else if (roll < 28)
+			{
+				// extensions.conf changes: .exe is supported in every other generation
+				reloads++;
+				std::vector<const wchar_t*> list(std::begin(ExtensionLists::Document), std::end(ExtensionLists::Document));
+				if (reloads % 2 == 1)
+				{
+					list.push_back(L".exe");
+				}
+				SharedExtensionPolicy().Publish(ExtensionTable::FromList(list.data(), list.size()));
+			}
+			else if (roll < 40)
+			{
+				// Idle time in the message loop
+				tracker.RefreshPending();
+			}
+			else
+			{
+				drags++;
+				Verdict verdict = Verdict::Unsupported;
+				WindowKey window = MockSelectionSource::WindowOf(view);
+				if (!tracker.Lookup(window, verdict))
+				{
+					verdict = tracker.Pull(window, view, CancelToken());
+				}
+
+				// Reference answer, not counted as work of the tracker
+				uint64_t before = source.Calls();
+				mismatches += verdict != source.ReadSelection(view, CancelToken());
+				checkCalls += source.Calls() - before;
+			}
+		}
+
+		// Leave the built-in policy for whatever runs next
+		SharedExtensionPolicy().Publish(ExtensionTable::FromList(ExtensionLists::Document, std::size(ExtensionLists::Document)));
+
+		const SelectionTrackerStats& stats = tracker.Stats();
+		std::cout << (deliversEvents ? "events: " : "pull:   ") << drags << " drags, "
+			<< (double)(source.Calls() - checkCalls) / drags << " calls/drag, table hits " << stats.hits
+			<< ", pulls " << stats.pulls << ", events " << stats.events << ", refreshes " << stats.refreshes
+			<< ", policy reloads " << reloads << " (" << stats.ruleChanges << " verdicts retired), mismatches "
+			<< mismatches << std::endl;
+		return mismatches == 0 ? 0 : 1;
+	}
+
+	// Command line entry: SelectionBenchMain [views] [operations]
+	int SelectionBenchMain(int argc, char* argv[])
+	{
+		size_t views = argc > 1 ? (size_t)std::atoi(argv[1]) : 8;
+		size_t operations = argc > 2 ? (size_t)std::atoi(argv[2]) : 200000;
+		if (views == 0)
+		{
+			views = 1;
+		}
+
+		int failed = RunSelectionScenario(false, views, operations, 9);
+		failed |= RunSelectionScenario(true, views, operations, 9);
+		return failed;
+	}
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "DragVerdict.h"
+#include "ShellViewCache.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Per-view "selection contains a supported file" flag, kept current by selection-changed
+// notifications instead of walking FolderItems on every drag.
+// A view is tracked from the first time its selection is pulled; from then on the drag path
+// is a table read. Events only mark the flag stale, the re-read happens in RefreshPending()
+// outside of the event callback so the shell is not blocked on us. Views that cannot deliver
+// events are never tracked and are pulled on every drag, as before.
+// Not thread-safe: use it on the apartment that owns the views.
+namespace SystemDrag
+{
+	// What a verdict was judged by. A verdict stored under other rules (the extension policy
+	// was reloaded, content sniffing was switched) is stale.
+	struct SelectionRules
+	{
+		uint64_t policyGeneration;
+		bool sniffing;
+
+		bool operator==(const SelectionRules& other) const
+		{
+			return policyGeneration == other.policyGeneration && sniffing == other.sniffing;
+		}
+		bool operator!=(const SelectionRules& other) const { return !(*this == other); }
+	};
+
+	template <typename View>
+	class ISelectionSource
+	{
+	public:
+		virtual ~ISelectionSource() {}
+
+		// Pull path: walk the current selection of the view
+		virtual Verdict ReadSelection(const View& view, const CancelToken& token) = 0;
+		// The rules ReadSelection judges by right now
+		virtual SelectionRules Rules() const = 0;
+
+		// Start reporting selection changes of the view to the tracker (OnSelectionChanged),
+		// and navigation away from it or its window closing (OnViewGone).
+		// False when the view has no notifications.
+		virtual bool Subscribe(WindowKey window, const View& view) = 0;
+		virtual void Unsubscribe(WindowKey window) = 0;
+	};
+
+	struct SelectionTrackerStats
+	{
+		uint64_t hits;            // drag answered from the table
+		uint64_t pulls;           // drag had to walk the selection
+		uint64_t events;          // selection-changed notifications
+		uint64_t refreshes;       // re-reads triggered by notifications
+		uint64_t subscriptions;
+		uint64_t unsubscribable;  // pulls of views without notifications
+		uint64_t ruleChanges;     // verdicts retired by a policy reload or a sniffing switch
+	};
+
+	template <typename View>
+	class SelectionTracker
+	{
+	public:
+		explicit SelectionTracker(ISelectionSource<View>& source) : m_source(source), m_stats() {}
+		~SelectionTracker() { Clear(); }
+
+		// Drag path, no call into the view. False when the view is not tracked or its flag is stale.
+		bool Lookup(WindowKey window, Verdict& verdict)
+		{
+			auto it = m_entries.find(window);
+			if (it == m_entries.end() || it->second.stale)
+			{
+				return false;
+			}
+			if (it->second.rules != m_source.Rules())
+			{
+				// Judged by an older policy or sniffing setting, the caller pulls again
+				m_stats.ruleChanges++;
+				it->second.stale = true;
+				return false;
+			}
+			m_stats.hits++;
+			verdict = it->second.verdict;
+			return true;
+		}
+
+		// Walk the selection and start tracking the view if it delivers events
+		Verdict Pull(WindowKey window, const View& view, const CancelToken& token)
+		{
+			m_stats.pulls++;
+			auto it = m_entries.find(window);
+			if (it == m_entries.end())
+			{
+				// Subscribe before reading so a change during the read is not lost
+				if (!m_source.Subscribe(window, view))
+				{
+					m_stats.unsubscribable++;
+					return m_source.ReadSelection(view, token);
+				}
+				m_stats.subscriptions++;
+				it = m_entries.emplace(window, Entry(view)).first;
+			}
+
+			uint64_t changes = it->second.changes;
+			SelectionRules rules = m_source.Rules();
+			Verdict verdict = m_source.ReadSelection(view, token);
+			if (verdict != Verdict::Cancelled)
+			{
+				// The read may have let notifications in, look the entry up again
+				Store(window, changes, rules, verdict);
+			}
+			return verdict;
+		}
+
+		// Event side
+		void OnSelectionChanged(WindowKey window)
+		{
+			auto it = m_entries.find(window);
+			if (it == m_entries.end())
+			{
+				return;
+			}
+			m_stats.events++;
+			it->second.changes++;
+			if (!it->second.stale)
+			{
+				it->second.stale = true;
+				m_pending.push_back(window);
+			}
+		}
+
+		// The window navigated to another folder (the view object is replaced) or closed
+		void OnViewGone(WindowKey window)
+		{
+			if (m_entries.erase(window) != 0)
+			{
+				m_source.Unsubscribe(window);
+			}
+		}
+
+		// Re-read the views whose selection changed. Call it from the message loop,
+		// not from inside a notification.
+		void RefreshPending()
+		{
+			while (!m_pending.empty())
+			{
+				WindowKey window = m_pending.back();
+				m_pending.pop_back();
+
+				auto it = m_entries.find(window);
+				if (it == m_entries.end() || !it->second.stale)
+				{
+					continue;
+				}
+
+				m_stats.refreshes++;
+				View view = it->second.view;
+				uint64_t changes = it->second.changes;
+				SelectionRules rules = m_source.Rules();
+				Store(window, changes, rules, m_source.ReadSelection(view, CancelToken()));
+			}
+		}
+
+		void Clear()
+		{
+			for (auto& entry : m_entries)
+			{
+				m_source.Unsubscribe(entry.first);
+			}
+			m_entries.clear();
+			m_pending.clear();
+		}
+
+		size_t size() const { return m_entries.size(); }
+		const SelectionTrackerStats& Stats() const { return m_stats; }
+
+	private:
+		struct Entry
+		{
+			explicit Entry(const View& v) : view(v), verdict(Verdict::Unsupported), changes(0), rules(), stale(true) {}
+
+			View view;
+			Verdict verdict;
+			uint64_t changes;
+			SelectionRules rules;   // taken before the read, so a reload during it retires the verdict
+			bool stale;
+		};
+
+		void Store(WindowKey window, uint64_t changesBefore, const SelectionRules& rules, Verdict verdict)
+		{
+			auto it = m_entries.find(window);
+			if (it == m_entries.end())
+			{
+				return;
+			}
+			if (it->second.changes != changesBefore)
+			{
+				// Changed again while we were reading, the result may already be old
+				m_pending.push_back(window);
+				return;
+			}
+			it->second.verdict = verdict;
+			it->second.rules = rules;
+			it->second.stale = false;
+		}
+
+		ISelectionSource<View>& m_source;
+		std::unordered_map<WindowKey, Entry> m_entries;
+		std::vector<WindowKey> m_pending;
+		SelectionTrackerStats m_stats;
+	};
+}
@@ -0,0 +1,117 @@
+#include "ShellAncestry.h"
+
+namespace SystemDrag
+{
+	// Guards against owner/parent cycles in broken window trees
+	static const int MaxDepth = 256;
+
+	ShellRoot WalkShellAncestry(IWindowTree& tree, WindowKey window, uint64_t* levelsWalked)
+	{
+		WindowKey current = window;
+		for (int depth = 0; current != 0 && depth < MaxDepth; depth++)
+		{
+			if (levelsWalked)
+			{
+				(*levelsWalked)++;
+			}
+
+			ShellKind kind = tree.Classify(current);
+			if (kind != ShellKind::None)
+			{
+				return { current, kind };
+			}
+			current = tree.Parent(current);
+		}
+		return { 0, ShellKind::None };
+	}
+
+	ShellAncestryCache::ShellAncestryCache(IWindowTree& tree, size_t capacity)
+		: m_tree(tree), m_mask(0), m_generation(1), m_stats()
+	{
+		size_t size = 16;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		// generation 0 never matches, so a zeroed table is empty
+		m_entries.assign(size, Entry());
+		m_mask = size - 1;
+	}
+
+	ShellAncestryCache::Entry* ShellAncestryCache::Find(WindowKey window)
+	{
+		// HWND values are multiples of 2 or 4 with little entropy in the low bits
+		Entry& entry = m_entries[(size_t)((window * 0x9E3779B97F4A7C15ull) >> 40) & m_mask];
+		return (entry.window == window && entry.generation == m_generation) ? &entry : nullptr;
+	}
+
+	void ShellAncestryCache::Store(WindowKey window, const ShellRoot& root)
+	{
+		Entry& entry = m_entries[(size_t)((window * 0x9E3779B97F4A7C15ull) >> 40) & m_mask];
+		entry.window = window;
+		entry.root = root.window;
+		entry.generation = m_generation;
+		entry.kind = root.kind;
+	}
+
+	bool ShellAncestryCache::OnWindowChanged(WindowKey window)
+	{
+		if (!Contains(window) && !Contains(m_tree.Parent(window)))
+		{
+			return false;
+		}
+		Invalidate();
+		return true;
+	}
+
+	ShellRoot ShellAncestryCache::Resolve(WindowKey window)
+	{
+		if (window == 0)
+		{
+			return { 0, ShellKind::None };
+		}
+
+		if (Entry* entry = Find(window))
+		{
+			m_stats.hits++;
+			return { entry->root, entry->kind };
+		}
+		m_stats.misses++;
+
+		// Walk up until a shell window, the top or an already cached ancestor;
+		// every window on the way shares the answer
+		WindowKey visited[MaxDepth];
+		int count = 0;
+		ShellRoot result = { 0, ShellKind::None };
+
+		WindowKey current = window;
+		while (current != 0 && count < MaxDepth)
+		{
+			if (count > 0)
+			{
+				if (Entry* entry = Find(current))
+				{
+					result = { entry->root, entry->kind };
+					break;
+				}
+			}
+
+			m_stats.levelsWalked++;
+			visited[count++] = current;
+
+			ShellKind kind = m_tree.Classify(current);
+			if (kind != ShellKind::None)
+			{
+				result = { current, kind };
+				break;
+			}
+			current = m_tree.Parent(current);
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			Store(visited[i], result);
+		}
+		return result;
+	}
+}
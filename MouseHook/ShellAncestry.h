@@ -0,0 +1,94 @@
+#pragma once
+
+#include "ShellViewCache.h"
+
+#include <cstdint>
+#include <vector>
+
+// Memoized FindShellParent.
+// Walking GetParent and comparing class names on every level is repeated for the same
+// windows on every press, so results are kept in a direct-mapped table keyed by window
+// and stamped with a generation. Invalidate() bumps the generation (window destroyed or
+// reparented), which retires every entry at once without touching the table.
+// Not thread-safe: owned by the thread that feeds it.
+namespace SystemDrag
+{
+	enum class ShellKind : uint8_t
+	{
+		None,       // not inside a shell window
+		Explorer,   // CabinetWClass
+		Desktop     // Progman / WorkerW
+	};
+
+	struct ShellRoot
+	{
+		WindowKey window;   // the shell window itself, 0 when kind is None
+		ShellKind kind;
+	};
+
+	class IWindowTree
+	{
+	public:
+		virtual ~IWindowTree() {}
+
+		// 0 for a top-level window
+		virtual WindowKey Parent(WindowKey window) = 0;
+		// Shell kind of this very window, judged by its class name
+		virtual ShellKind Classify(WindowKey window) = 0;
+	};
+
+	struct ShellAncestryStats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t levelsWalked;
+		uint64_t invalidations;
+	};
+
+	// Uncached walk, what FindShellParent used to do
+	ShellRoot WalkShellAncestry(IWindowTree& tree, WindowKey window, uint64_t* levelsWalked = nullptr);
+
+	class ShellAncestryCache
+	{
+	public:
+		// capacity is rounded up to a power of two
+		explicit ShellAncestryCache(IWindowTree& tree, size_t capacity = 1024);
+
+		ShellRoot Resolve(WindowKey window);
+
+		void Invalidate()
+		{
+			m_generation++;
+			m_stats.invalidations++;
+		}
+
+		// A window was destroyed or reparented. Invalidates only when the window, or its
+		// parent, has a current entry, so tooltips and menus coming and going leave the cache
+		// alone. True when it invalidated.
+		bool OnWindowChanged(WindowKey window);
+
+		// True while a current entry exists for the window, either looked up or walked through
+		bool Contains(WindowKey window) { return window != 0 && Find(window) != nullptr; }
+
+		uint32_t Generation() const { return m_generation; }
+		const ShellAncestryStats& Stats() const { return m_stats; }
+
+	private:
+		struct Entry
+		{
+			WindowKey window;
+			WindowKey root;
+			uint32_t generation;
+			ShellKind kind;
+		};
+
+		Entry* Find(WindowKey window);
+		void Store(WindowKey window, const ShellRoot& root);
+
+		IWindowTree& m_tree;
+		std::vector<Entry> m_entries;
+		size_t m_mask;
+		uint32_t m_generation;
+		ShellAncestryStats m_stats;
+	};
+}
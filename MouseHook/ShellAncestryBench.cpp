@@ -0,0 +1,150 @@
+#include "ShellAncestry.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Synthetic window forest for FindShellParent: measures ancestry depth, cache hit rate
+// and lookup time of the memoized walk against the plain GetParent / class name walk.
+// Window destructions go through OnWindowChanged, the entry point the WinEvent hook uses.
+namespace SystemDrag
+{
+	class SyntheticWindowTree : public IWindowTree
+	{
+	public:
+		// topLevel windows, each the root of a chain of depth child windows;
+		// every shellEvery-th top-level window is an Explorer window, window 1 is the desktop
+		SyntheticWindowTree(size_t topLevel, int depth, int shellEvery, std::chrono::nanoseconds callCost)
+			: m_callCost(callCost), m_calls(0)
+		{
+			m_parent.push_back(0);
+			m_kind.push_back(ShellKind::None);
+
+			for (size_t t = 0; t < topLevel; t++)
+			{
+				WindowKey root = m_parent.size();
+				m_parent.push_back(0);
+				m_kind.push_back(t == 0 ? ShellKind::Desktop
+					: (t % shellEvery == 0 ? ShellKind::Explorer : ShellKind::None));
+
+				WindowKey parent = root;
+				for (int d = 0; d < depth; d++)
+				{
+					WindowKey child = m_parent.size();
+					m_parent.push_back(parent);
+					m_kind.push_back(ShellKind::None);
+					parent = child;
+				}
+				m_leaves.push_back(parent);
+			}
+		}
+
+		// Windows outside the forest behave like destroyed ones: no parent, no class
+		WindowKey Parent(WindowKey window) override
+		{
+			Spin();
+			return window < m_parent.size() ? m_parent[window] : 0;
+		}
+
+		ShellKind Classify(WindowKey window) override
+		{
+			Spin();
+			return window < m_kind.size() ? m_kind[window] : ShellKind::None;
+		}
+
+		const std::vector<WindowKey>& Leaves() const { return m_leaves; }
+		uint64_t Calls() const { return m_calls; }
+
+	private:
+		void Spin()
+		{
+			m_calls++;
+			if (m_callCost.count() == 0)
+			{
+				return;
+			}
+			auto until = std::chrono::steady_clock::now() + m_callCost;
+			while (std::chrono::steady_clock::now() < until)
+			{
+			}
+		}
+
+		std::vector<WindowKey> m_parent;
+		std::vector<ShellKind> m_kind;
+		std::vector<WindowKey> m_leaves;
+		std::chrono::nanoseconds m_callCost;
+		uint64_t m_calls;
+	};
+
+	// Command line entry: ShellAncestryBenchMain [windows] [depth] [presses] [call-ns]
+	int ShellAncestryBenchMain(int argc, char* argv[])
+	{
+		size_t windows = argc > 1 ? (size_t)std::atoi(argv[1]) : 200;
+		int depth = argc > 2 ? std::atoi(argv[2]) : 8;
+		size_t presses = argc > 3 ? (size_t)std::atoi(argv[3]) : 200000;
+		std::chrono::nanoseconds callCost(argc > 4 ? std::atoi(argv[4]) : 0);
+
+		// The pointer tends to stay over a handful of windows. Every 100th press follows a
+		// tooltip or menu being destroyed, every 10000th one of the windows pressed on
+		std::vector<WindowKey> targets;
+		{
+			SyntheticWindowTree layout(windows, depth, 4, callCost);
+			std::mt19937 rng(5);
+			std::geometric_distribution<size_t> locality(0.2);
+			for (size_t i = 0; i < presses; i++)
+			{
+				targets.push_back(layout.Leaves()[locality(rng) % layout.Leaves().size()]);
+			}
+		}
+
+		SyntheticWindowTree plainTree(windows, depth, 4, callCost);
+		uint64_t levels = 0;
+		size_t plainShell = 0;
+		auto t0 = std::chrono::steady_clock::now();
+		for (WindowKey window : targets)
+		{
+			plainShell += WalkShellAncestry(plainTree, window, &levels).kind != ShellKind::None;
+		}
+		auto t1 = std::chrono::steady_clock::now();
+
+		SyntheticWindowTree cachedTree(windows, depth, 4, callCost);
+		ShellAncestryCache cache(cachedTree);
+		size_t cachedShell = 0;
+		auto t2 = std::chrono::steady_clock::now();
+		size_t relevantDestroys = 0;
+		for (size_t i = 0; i < targets.size(); i++)
+		{
+			WindowKey destroyed = 0;
+			if (i % 10000 == 9999)
+			{
+				destroyed = targets[i - 1];
+				relevantDestroys++;
+			}
+			else if (i % 100 == 99)
+			{
+				destroyed = (WindowKey)(0x100000 + i);
+			}
+			if (destroyed != 0)
+			{
+				cache.OnWindowChanged(destroyed);
+			}
+			cachedShell += cache.Resolve(targets[i]).kind != ShellKind::None;
+		}
+		auto t3 = std::chrono::steady_clock::now();
+
+		double plainNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+		double cachedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count();
+		const ShellAncestryStats& stats = cache.Stats();
+
+		std::cout << "walk: " << plainNs / presses << " ns/press, avg depth " << (double)levels / presses
+			<< ", window calls " << plainTree.Calls() << std::endl;
+		std::cout << "cache: " << cachedNs / presses << " ns/press, hit rate "
+			<< 100.0 * stats.hits / (stats.hits + stats.misses) << "%, levels walked " << stats.levelsWalked
+			<< ", window calls " << cachedTree.Calls() << std::endl;
+		std::cout << "presses over shell windows: " << plainShell << " / " << presses << ", invalidations "
+			<< stats.invalidations << std::endl;
+		return plainShell == cachedShell && stats.invalidations == relevantDestroys ? 0 : 1;
+	}
+}
@@ -0,0 +1,244 @@
+#include "ShellIdList.h"
+
+#include "ExtensionMatcher.h"
+
+#include <cstring>
+
+namespace SystemDrag
+{
+	static uint16_t ReadLe16(const uint8_t* p)
+	{
+		return (uint16_t)(p[0] | (p[1] << 8));
+	}
+
+	static uint32_t ReadLe32(const uint8_t* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	// Shell item type byte: 0x2X drives, 0x3X file system entries (bit 0 folder, bit 1 file,
+	// bit 2 short name stored as UTF-16)
+	enum ShellItemTypes : uint8_t
+	{
+		ItemTypeMask = 0x70,
+		ItemTypeDrive = 0x20,
+		ItemTypeFileSystem = 0x30,
+		ItemFlagFolder = 0x01,
+		ItemFlagUnicode = 0x04
+	};
+
+	// Offsets inside a file system item ID
+	enum FileSystemItemLayout : size_t
+	{
+		FsItemSize = 4,
+		FsItemAttributes = 12,
+		FsItemShortName = 14
+	};
+
+	// Extension block 0xBEEF0004 carries the long name; where it starts moved with the version
+	static const uint32_t FileEntryExtension = 0xBEEF0004;
+
+	static size_t LongNameOffset(uint16_t version)
+	{
+		if (version >= 9) return 46;
+		if (version == 8) return 42;
+		if (version == 7) return 38;
+		if (version >= 3) return 20;
+		return 0;
+	}
+
+	std::u16string_view ShellItem::Extension() const
+	{
+		return ExtensionKeys::FindExtension(name);
+	}
+
+	ShellIdListView::Status ShellIdListView::Parse(const void* data, size_t size, ShellIdListView& view)
+	{
+		view = ShellIdListView();
+		const uint8_t* bytes = (const uint8_t*)data;
+		if (bytes == nullptr || size < 8)
+		{
+			return Status::TooSmall;
+		}
+
+		// UINT cidl, then cidl + 1 offsets: the parent folder and one per item
+		uint32_t count = ReadLe32(bytes);
+		if (count >= size / 4 - 1)
+		{
+			return Status::TooSmall;
+		}
+		size_t tableEnd = 4 + 4 * ((size_t)count + 1);
+
+		for (size_t i = 0; i <= count; i++)
+		{
+			size_t position = ReadLe32(bytes + 4 + 4 * i);
+			if (position < tableEnd || position >= size)
+			{
+				return Status::BadOffset;
+			}
+
+			// SHITEMIDs of cb bytes each, ending with cb == 0
+			for (;;)
+			{
+				if (position + 2 > size)
+				{
+					return Status::BadItemId;
+				}
+				uint16_t cb = ReadLe16(bytes + position);
+				if (cb == 0)
+				{
+					break;
+				}
+				if (cb < 2 || position + cb > size)
+				{
+					return Status::BadItemId;
+				}
+				position += cb;
+			}
+		}
+
+		view.m_data = bytes;
+		view.m_size = size;
+		view.m_count = count;
+		return Status::Ok;
+	}
+
+	const uint8_t* ShellIdListView::IdList(size_t index) const
+	{
+		return m_data + ReadLe32(m_data + 4 + 4 * index);
+	}
+
+	ShellItem ShellIdListView::Item(size_t index) const
+	{
+		// Relative lists are usually one ID long; search results can nest deeper
+		const uint8_t* id = IdList(index + 1);
+		const uint8_t* last = nullptr;
+		for (uint16_t cb = ReadLe16(id); cb != 0; cb = ReadLe16(id))
+		{
+			last = id;
+			id += cb;
+		}
+		if (last == nullptr)
+		{
+			return ShellItem{ ShellItemKind::Other, {}, {}, 0, 0 };
+		}
+		return Decode(last, ReadLe16(last));
+	}
+
+	ShellItem ShellIdListView::Decode(const uint8_t* id, size_t cb) const
+	{
+		ShellItem item = { ShellItemKind::Other, {}, {}, 0, 0 };
+		if (cb < 3)
+		{
+			return item;
+		}
+
+		uint8_t type = id[2];
+		if ((type & ItemTypeMask) == ItemTypeDrive)
+		{
+			// "C:\" in ANSI right after the type byte
+			const char* name = (const char*)id + 3;
+			item.kind = ShellItemKind::Drive;
+			item.shortName = std::string_view(name, strnlen(name, cb - 3));
+			item.name = WidenAnsi(item.shortName);
+			return item;
+		}
+		if ((type & ItemTypeMask) != ItemTypeFileSystem || cb < FsItemShortName + 2)
+		{
+			return item;
+		}
+
+		item.kind = (type & ItemFlagFolder) ? ShellItemKind::Folder : ShellItemKind::File;
+		item.size = ReadLe32(id + FsItemSize);
+		item.attributes = ReadLe16(id + FsItemAttributes);
+
+		if ((type & ItemFlagUnicode) == 0)
+		{
+			const char* shortName = (const char*)id + FsItemShortName;
+			item.shortName = std::string_view(shortName, strnlen(shortName, cb - FsItemShortName));
+		}
+
+		// The last WORD of the ID points back at the first extension block
+		size_t block = ReadLe16(id + cb - 2);
+		if (block >= FsItemShortName && block + 8 <= cb - 2 && ReadLe32(id + block + 4) == FileEntryExtension)
+		{
+			size_t blockEnd = block + ReadLe16(id + block);
+			size_t nameStart = block + LongNameOffset(ReadLe16(id + block + 2));
+			if (nameStart > block && blockEnd <= cb)
+			{
+				for (size_t end = nameStart; end + 2 <= blockEnd; end += 2)
+				{
+					if (ReadLe16(id + end) == 0)
+					{
+						item.name = Widen(id + nameStart, (end - nameStart) / 2);
+						break;
+					}
+				}
+			}
+		}
+		if (item.name.empty())
+		{
+			item.name = WidenAnsi(item.shortName);
+		}
+		return item;
+	}
+
+	std::u16string_view ShellIdListView::Widen(const uint8_t* utf16, size_t units) const
+	{
+		if (((uintptr_t)utf16 & 1) == 0)
+		{
+			return std::u16string_view((const char16_t*)utf16, units);
+		}
+		m_scratch.emplace_back(units, u'\0');
+		std::memcpy(&m_scratch.back()[0], utf16, units * sizeof(char16_t));
+		return m_scratch.back();
+	}
+
+	// Short names are in the ANSI code page; ASCII is exact, the rest is a best effort
+	std::u16string_view ShellIdListView::WidenAnsi(std::string_view ansi) const
+	{
+		if (ansi.empty())
+		{
+			return {};
+		}
+		m_scratch.emplace_back(ansi.begin(), ansi.end());
+		for (char16_t& c : m_scratch.back())
+		{
+			c = (char16_t)(uint8_t)c;
+		}
+		return m_scratch.back();
+	}
+
+	std::u16string ShellIdListView::ParentPath() const
+	{
+		std::u16string path;
+		const uint8_t* id = IdList(0);
+		for (uint16_t cb = ReadLe16(id); cb != 0; id += cb, cb = ReadLe16(id))
+		{
+			// Root items (desktop, this PC) carry a CLSID and add nothing to the path
+			if (cb >= 3 && id[2] == 0x1F)
+			{
+				continue;
+			}
+
+			ShellItem item = Decode(id, cb);
+			if (item.kind == ShellItemKind::Drive)
+			{
+				path.assign(item.name);
+			}
+			else if (item.kind == ShellItemKind::Folder && !path.empty())
+			{
+				if (path.back() != u'\\')
+				{
+					path += u'\\';
+				}
+				path += item.name;
+			}
+			else
+			{
+				return std::u16string();
+			}
+		}
+		return path;
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+// Zero-copy reader for CFSTR_SHELLIDLIST (a CIDA block).
+// Drags out of libraries, search results, zip folders and devices often carry only shell
+// item IDs. Binding every item through IShellFolder to get its name costs a shell round trip
+// per item; but file system item IDs already contain the name, size and attributes, so this
+// decodes them straight from the blob. The layout of those IDs is not documented and
+// differs between Windows versions: the known file system and drive items are decoded, and
+// every other item is reported as Other so a caller can still bind just those.
+namespace SystemDrag
+{
+	enum class ShellItemKind : uint8_t
+	{
+		File,
+		Folder,
+		Drive,
+		Other       // namespace extension, zip folder, device...: needs the shell
+	};
+
+	struct ShellItem
+	{
+		ShellItemKind kind;
+		std::u16string_view name;   // long name, or the short name widened; empty for Other
+		std::string_view shortName; // 8.3 name as stored, ANSI
+		uint64_t size;              // 32 bits in the item ID, 0 for folders
+		uint16_t attributes;        // FILE_ATTRIBUTE_* low word
+
+		// ".ext" of name, empty when there is none
+		std::u16string_view Extension() const;
+	};
+
+	class ShellIdListView
+	{
+	public:
+		enum class Status
+		{
+			Ok,
+			TooSmall,       // shorter than its own offset table
+			BadOffset,      // an offset points outside the block
+			BadItemId       // an item ID list runs past the block or has a bad cb
+		};
+
+		ShellIdListView() : m_data(nullptr), m_size(0), m_count(0) {}
+
+		// Walks every ID list once; nothing outside [data, data + size) is read
+		static Status Parse(const void* data, size_t size, ShellIdListView& view);
+
+		// Number of items, the parent folder not included
+		size_t size() const { return m_count; }
+
+		// Decodes the last ID of item index's relative list
+		ShellItem Item(size_t index) const;
+
+		// "C:\dir\sub" when the parent is a plain file system folder, empty otherwise
+		std::u16string ParentPath() const;
+
+	private:
+		const uint8_t* IdList(size_t index) const;
+		ShellItem Decode(const uint8_t* id, size_t cb) const;
+		std::u16string_view Widen(const uint8_t* utf16, size_t units) const;
+		std::u16string_view WidenAnsi(std::string_view ansi) const;
+
+		const uint8_t* m_data;
+		size_t m_size;
+		size_t m_count;
+		// Names that are not 2-byte aligned in the blob, or only short names, get copied here
+		mutable std::deque<std::u16string> m_scratch;
+	};
+}
@@ -0,0 +1,239 @@
+#include "ShellIdList.h"
+#include "ExtensionMatcher.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// CIDA parser on synthetic blobs laid out like Windows 10 writes them: a this-PC root, a
+// drive and folder IDs for the parent, then one file system ID per item with a version 9
+// extension block holding the long name. Some items are placed at odd offsets and some are
+// non file system IDs, to cover the copy fallback and the Other kind. Timing at several
+// sizes shows the cost stays proportional to the blob.
+namespace SystemDrag
+{
+	static void PutLe16(std::vector<uint8_t>& out, uint16_t value)
+	{
+		out.push_back((uint8_t)value);
+		out.push_back((uint8_t)(value >> 8));
+	}
+
+	static void PutLe32(std::vector<uint8_t>& out, uint32_t value)
+	{
+		PutLe16(out, (uint16_t)value);
+		PutLe16(out, (uint16_t)(value >> 16));
+	}
+
+	static std::vector<uint8_t> RootId()
+	{
+		std::vector<uint8_t> id = { 20, 0, 0x1F, 0x50 };
+		id.resize(20, 0xAB);   // CLSID of this PC, the value does not matter here
+		return id;
+	}
+
+	static std::vector<uint8_t> DriveId(const char* drive)
+	{
+		std::vector<uint8_t> id = { 25, 0, 0x2F };
+		id.insert(id.end(), drive, drive + std::strlen(drive));
+		id.resize(25, 0);
+		return id;
+	}
+
+	static std::vector<uint8_t> FileSystemId(const std::u16string& name, const std::string& shortName, uint32_t size, bool folder)
+	{
+		std::vector<uint8_t> id = { 0, 0, (uint8_t)(folder ? 0x31 : 0x32), 0 };
+		PutLe32(id, size);
+		PutLe32(id, 0x5A215A21);                // DOS date and time
+		PutLe16(id, folder ? 0x10 : 0x20);
+		id.insert(id.end(), shortName.begin(), shortName.end());
+		id.push_back(0);
+		if (id.size() % 2)
+		{
+			id.push_back(0);
+		}
+
+		size_t block = id.size();
+		std::vector<uint8_t> extension;
+		PutLe16(extension, 0);                  // size, patched below
+		PutLe16(extension, 9);                  // version
+		PutLe32(extension, 0xBEEF0004);
+		PutLe32(extension, 0x5A215A21);         // created
+		PutLe32(extension, 0x5A215A21);         // accessed
+		PutLe16(extension, 0x2E);
+		extension.resize(46, 0);                // file reference and unknowns
+		for (char16_t c : name)
+		{
+			PutLe16(extension, c);
+		}
+		PutLe16(extension, 0);
+		PutLe16(extension, (uint16_t)block);    // first extension block offset
+		extension[0] = (uint8_t)extension.size();
+		extension[1] = (uint8_t)(extension.size() >> 8);
+
+		id.insert(id.end(), extension.begin(), extension.end());
+		id[0] = (uint8_t)id.size();
+		id[1] = (uint8_t)(id.size() >> 8);
+		return id;
+	}
+
+	struct ExpectedItem
+	{
+		ShellItemKind kind;
+		std::u16string name;
+	};
+
+	// Returns the blob; odd places some ID lists at odd addresses
+	static std::vector<uint8_t> BuildCida(size_t count, std::mt19937& rng, std::vector<ExpectedItem>& expected)
+	{
+		std::vector<std::vector<uint8_t>> lists;
+		std::vector<uint8_t> parent = RootId();
+		std::vector<uint8_t> drive = DriveId("C:\\");
+		parent.insert(parent.end(), drive.begin(), drive.end());
+		for (const char* folder : { "Users", "someone", "Documents" })
+		{
+			std::string ascii(folder);
+			std::vector<uint8_t> id = FileSystemId(std::u16string(ascii.begin(), ascii.end()), ascii, 0, true);
+			parent.insert(parent.end(), id.begin(), id.end());
+		}
+		lists.push_back(parent);
+
+		static const char* const extensions[] = { ".docx", ".PDF", ".txt", ".png", "", ".tar.gz" };
+		expected.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			std::vector<uint8_t> id;
+			if (rng() % 20 == 0)
+			{
+				// Delegate item of a zip folder or device: opaque to us
+				id = { 12, 0, 0x74, 0x1A, 1, 2, 3, 4, 5, 6, 7, 8 };
+				expected.push_back({ ShellItemKind::Other, u"" });
+			}
+			else
+			{
+				std::string ascii = "Quarterly report " + std::to_string(i) + extensions[rng() % 6];
+				std::u16string name(ascii.begin(), ascii.end());
+				if (rng() % 10 == 0)
+				{
+					name.insert(0, u"\u6587\u6863 ");   // non-ASCII long name
+				}
+				bool folder = rng() % 8 == 0;
+				id = FileSystemId(name, "QUARTE~" + std::to_string(i % 10), (uint32_t)(i * 37), folder);
+				expected.push_back({ folder ? ShellItemKind::Folder : ShellItemKind::File, name });
+			}
+			lists.push_back(id);
+		}
+
+		std::vector<uint8_t> blob;
+		PutLe32(blob, (uint32_t)count);
+		blob.resize(4 + 4 * (count + 1), 0);
+		for (size_t i = 0; i < lists.size(); i++)
+		{
+			if (rng() % 4 == 0)
+			{
+				blob.push_back(0xEE);   // odd padding before the list
+			}
+			uint32_t offset = (uint32_t)blob.size();
+			std::memcpy(blob.data() + 4 + 4 * i, &offset, sizeof(offset));
+			blob.insert(blob.end(), lists[i].begin(), lists[i].end());
+			PutLe16(blob, 0);
+		}
+		return blob;
+	}
+
+	// Command line entry: ShellIdListBenchMain [items] [fuzz iterations]
+	int ShellIdListBenchMain(int argc, char* argv[])
+	{
+		size_t count = argc > 1 ? (size_t)std::atoi(argv[1]) : 100000;
+		size_t fuzzIterations = argc > 2 ? (size_t)std::atoi(argv[2]) : 100000;
+		std::mt19937 rng(16);
+
+		// Round trip
+		std::vector<ExpectedItem> expected;
+		std::vector<uint8_t> blob = BuildCida(count, rng, expected);
+		size_t mismatches = 0;
+		ShellIdListView view;
+		if (ShellIdListView::Parse(blob.data(), blob.size(), view) != ShellIdListView::Status::Ok || view.size() != count)
+		{
+			mismatches++;
+		}
+		for (size_t i = 0; i < view.size(); i++)
+		{
+			ShellItem item = view.Item(i);
+			if (item.kind != expected[i].kind || item.name != expected[i].name)
+			{
+				mismatches++;
+			}
+		}
+		if (view.ParentPath() != u"C:\\Users\\someone\\Documents")
+		{
+			mismatches++;
+		}
+		std::cout << count << " items, " << blob.size() << " bytes, round trip mismatches " << mismatches << std::endl;
+
+		// Parse, decode and match every item at growing sizes
+		for (size_t items = 1000; items <= count; items *= 10)
+		{
+			std::vector<ExpectedItem> unused;
+			std::vector<uint8_t> sized = BuildCida(items, rng, unused);
+			const int rounds = (int)(2000000 / items) + 1;
+			size_t matched = 0;
+			auto t0 = std::chrono::steady_clock::now();
+			for (int r = 0; r < rounds; r++)
+			{
+				ShellIdListView timed;
+				ShellIdListView::Parse(sized.data(), sized.size(), timed);
+				for (size_t i = 0; i < timed.size(); i++)
+				{
+					ShellItem item = timed.Item(i);
+					matched += item.kind == ShellItemKind::File && ExtensionKeys::Fold(item.Extension()) != 0;
+				}
+			}
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+			std::cout << items << " items: " << ns / items << " ns/item, " << ns / sized.size() << " ns/byte, "
+				<< matched / rounds << " with an extension" << std::endl;
+		}
+
+		// Fuzz: the parser must reject the blob or decode every item without leaving it
+		std::vector<ExpectedItem> small;
+		std::vector<uint8_t> seed = BuildCida(6, rng, small);
+		size_t accepted = 0;
+		for (size_t i = 0; i < fuzzIterations; i++)
+		{
+			std::vector<uint8_t> mutated = seed;
+			if (rng() % 3 == 0)
+			{
+				mutated.resize(rng() % (mutated.size() + 1));
+			}
+			else
+			{
+				for (int k = 0; k < 6; k++)
+				{
+					mutated[rng() % mutated.size()] = (uint8_t)rng();
+				}
+			}
+
+			// Exact-size heap copy, so a sanitizer sees any overrun
+			uint8_t* copy = new uint8_t[mutated.size()];
+			std::memcpy(copy, mutated.data(), mutated.size());
+			ShellIdListView fuzzed;
+			if (ShellIdListView::Parse(mutated.empty() ? nullptr : copy, mutated.size(), fuzzed) == ShellIdListView::Status::Ok)
+			{
+				accepted++;
+				for (size_t k = 0; k < fuzzed.size(); k++)
+				{
+					fuzzed.Item(k);
+				}
+				fuzzed.ParentPath();
+			}
+			fuzzed = ShellIdListView();
+			delete[] copy;
+		}
+		std::cout << "fuzz: " << fuzzIterations << " blobs, " << accepted << " accepted" << std::endl;
+
+		return mismatches == 0 ? 0 : 1;
+	}
+}
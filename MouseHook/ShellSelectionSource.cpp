@@ -0,0 +1,363 @@
+#include "ShellSelectionSource.h"
+
+#include <shldisp.h>
+#include <shdispid.h>
+#include <exdispid.h>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "ComShellSession.h"
+#include "ContentSniffer.h"
+#include "DragTrace.h"
+#include "ExtensionPolicy.h"
+#include "LatencyHistogram.h"
+
+#pragma comment(lib, "Ole32.lib")
+#pragma comment(lib, "OleAut32.lib")
+
+namespace SystemDrag
+{
+	// Sink for one window, either on its folder view (DShellFolderViewEvents)
+	// or on its browser (DWebBrowserEvents2)
+	class ShellSelectionSource::EventSink : public IDispatch
+	{
+	public:
+		EventSink(ComSelectionTracker* tracker, WindowKey window, bool browser)
+			: m_refCount(1), m_tracker(tracker), m_window(window), m_browser(browser)
+		{
+		}
+
+		void Detach() { m_tracker = nullptr; }
+
+		// IUnknown methods
+		STDMETHODIMP QueryInterface(REFIID riid, void** ppvObject) override
+		{
+			if (riid == IID_IUnknown || riid == IID_IDispatch ||
+				riid == (m_browser ? DIID_DWebBrowserEvents2 : DIID_DShellFolderViewEvents))
+			{
+				*ppvObject = static_cast<IDispatch*>(this);
+				AddRef();
+				return S_OK;
+			}
+			*ppvObject = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		STDMETHODIMP_(ULONG) AddRef() override
+		{
+			return InterlockedIncrement(&m_refCount);
+		}
+
+		STDMETHODIMP_(ULONG) Release() override
+		{
+			ULONG refCount = InterlockedDecrement(&m_refCount);
+			if (refCount == 0)
+			{
+				delete this;
+			}
+			return refCount;
+		}
+
+		// IDispatch methods
+		STDMETHODIMP GetTypeInfoCount(UINT* pctinfo) override
+		{
+			*pctinfo = 0;
+			return S_OK;
+		}
+
+		STDMETHODIMP GetTypeInfo(UINT, LCID, ITypeInfo**) override
+		{
+			return E_NOTIMPL;
+		}
+
+		STDMETHODIMP GetIDsOfNames(REFIID, LPOLESTR*, UINT, LCID, DISPID*) override
+		{
+			return E_NOTIMPL;
+		}
+
+		STDMETHODIMP Invoke(DISPID dispIdMember, REFIID, LCID, WORD, DISPPARAMS*, VARIANT*, EXCEPINFO*, UINT*) override
+		{
+			// OnViewGone unsubscribes, which may release the last outside reference to us
+			CComPtr<IDispatch> self(this);
+			if (m_tracker == nullptr)
+			{
+				return S_OK;
+			}
+
+			if (m_browser)
+			{
+				if (dispIdMember == DISPID_NAVIGATECOMPLETE2 || dispIdMember == DISPID_ONQUIT)
+				{
+					m_tracker->OnViewGone(m_window);
+				}
+			}
+			else if (dispIdMember == DISPID_SELECTIONCHANGED || dispIdMember == DISPID_CONTENTSCHANGED)
+			{
+				// A rename of a selected file changes the answer as well
+				m_tracker->OnSelectionChanged(m_window);
+			}
+			return S_OK;
+		}
+
+	private:
+		ULONG m_refCount;
+		ComSelectionTracker* m_tracker;
+		WindowKey m_window;
+		bool m_browser;
+	};
+
+	ShellSelectionSource::ShellSelectionSource() : m_tracker(nullptr), m_status(ShellStatus::Ok)
+	{
+	}
+
+	ShellSelectionSource::~ShellSelectionSource()
+	{
+		for (auto& subscription : m_subscriptions)
+		{
+			Disconnect(subscription.second);
+		}
+	}
+
+	SelectionRules ShellSelectionSource::Rules() const
+	{
+		return SelectionRules{ SharedExtensionPolicy().Generation(), SharedContentSniffer().Enabled() };
+	}
+
+	bool ShellSelectionSource::Failed(HRESULT hr)
+	{
+		if (SUCCEEDED(hr))
+		{
+			return false;
+		}
+		if (ShellStatusFromResult(hr) == ShellStatus::Disconnected)
+		{
+			m_status = ShellStatus::Disconnected;
+		}
+		return true;
+	}
+
+	Verdict ShellSelectionSource::ReadSelection(const CComPtr<IDispatch>& view, const CancelToken& token)
+	{
+		m_status = ShellStatus::Ok;
+		if (!view) return Verdict::Unsupported;
+
+		CComPtr<IWebBrowser2> pBrowser;
+		HRESULT hr = view->QueryInterface(IID_IWebBrowser2, (void**)&pBrowser);
+		if (Failed(hr)) return Verdict::Unsupported;
+
+		CComPtr<IDispatch> pDispDoc;
+		hr = pBrowser->get_Document(&pDispDoc);
+		if (token.Cancelled()) return Verdict::Cancelled;
+		if (Failed(hr) || !pDispDoc) return Verdict::Unsupported;
+
+		CComPtr<IShellFolderViewDual> pFolderView;
+		hr = pDispDoc->QueryInterface(IID_IShellFolderViewDual, (void**)&pFolderView);
+		if (token.Cancelled()) return Verdict::Cancelled;
+		if (Failed(hr)) return Verdict::Unsupported;
+
+		// Until the last path is read; an early match stops the timer on return
+		StageTimer itemsStage(DetectionStage::SelectedItems);
+		CComPtr<FolderItems> pSelectedItems;
+		hr = pFolderView->SelectedItems(&pSelectedItems);
+		if (token.Cancelled()) return Verdict::Cancelled;
+		if (Failed(hr) || !pSelectedItems) return Verdict::Unsupported;
+
+		long count = 0;
+		if (Failed(pSelectedItems->get_Count(&count))) return Verdict::Unsupported;
+
+		// With content sniffing the paths are collected first and the file heads decide
+		ContentSniffer& sniffer = SharedContentSniffer();
+		bool sniff = sniffer.Enabled();
+		std::vector<std::filesystem::path> paths;
+		// With --trace the paths read here go to the trace, for replaying the verdict offline
+		TracedSelection traced(SharedDragTrace(), token.Session(), sniff);
+
+		for (long i = 0; i < count; i++)
+		{
+			if (token.Cancelled()) return Verdict::Cancelled;
+
+			CComVariant varIndex(i);
+			CComPtr<FolderItem> pItem;
+			hr = pSelectedItems->Item(varIndex, &pItem);
+			if (Failed(hr) || !pItem)
+			{
+				if (m_status == ShellStatus::Disconnected) return Verdict::Unsupported;
+				continue;
+			}
+
+			// Folders never count
+			VARIANT_BOOL isFolder = VARIANT_FALSE;
+			pItem->get_IsFolder(&isFolder);
+			if (isFolder == VARIANT_TRUE) continue;
+
+			BSTR bstrPath = NULL;
+			pItem->get_Path(&bstrPath);
+			if (bstrPath)
+			{
+				std::wstring_view path(bstrPath, SysStringLen(bstrPath));
+				traced.Add(std::u16string_view((const char16_t*)path.data(), path.size()));
+				bool matched = !sniff && SharedExtensionPolicy().MatchPath(path);
+				if (sniff)
+				{
+					paths.emplace_back(path);
+				}
+				SysFreeString(bstrPath);
+				if (matched)
+				{
+					return Verdict::Supported;
+				}
+			}
+		}
+		itemsStage.Stop();
+		if (!sniff)
+		{
+			return Verdict::Unsupported;
+		}
+
+		StageTimer checkStage(DetectionStage::FileChecks);
+		// A file that cannot be sniffed (empty, unreadable, a cloud placeholder) is judged by its extension
+		SniffResult sniffed = sniffer.FindAccepted(paths, [&token]() { return token.Cancelled(); },
+			[](const std::filesystem::path& path) { return SharedExtensionPolicy().MatchPath(std::wstring_view(path.native())); });
+		if (sniffed.cancelled)
+		{
+			return Verdict::Cancelled;
+		}
+		if (sniffed.found != (size_t)-1)
+		{
+			return Verdict::Supported;
+		}
+
+		// Out of budget: the paths that were never read fall back to their extension
+		for (size_t i = sniffed.examined; sniffed.exhausted && i < paths.size(); i++)
+		{
+			if (SharedExtensionPolicy().MatchPath(std::wstring_view(paths[i].native())))
+			{
+				return Verdict::Supported;
+			}
+		}
+		return Verdict::Unsupported;
+	}
+
+	bool ShellSelectionSource::Subscribe(WindowKey window, const CComPtr<IDispatch>& view)
+	{
+		if (m_tracker == nullptr || !view)
+		{
+			return false;
+		}
+
+		CComPtr<IWebBrowser2> pBrowser;
+		CComPtr<IDispatch> pDispDoc;
+		if (FAILED(view->QueryInterface(IID_IWebBrowser2, (void**)&pBrowser)) ||
+			FAILED(pBrowser->get_Document(&pDispDoc)) || !pDispDoc)
+		{
+			return false;
+		}
+
+		// Both are needed: without navigation events the flag would outlive the folder it describes
+		CComPtr<IConnectionPointContainer> viewContainer;
+		CComPtr<IConnectionPointContainer> browserContainer;
+		Subscription subscription = {};
+		if (FAILED(pDispDoc->QueryInterface(IID_IConnectionPointContainer, (void**)&viewContainer)) ||
+			FAILED(viewContainer->FindConnectionPoint(DIID_DShellFolderViewEvents, &subscription.viewPoint)) ||
+			FAILED(pBrowser->QueryInterface(IID_IConnectionPointContainer, (void**)&browserContainer)) ||
+			FAILED(browserContainer->FindConnectionPoint(DIID_DWebBrowserEvents2, &subscription.browserPoint)))
+		{
+			return false;
+		}
+
+		subscription.viewSink = new EventSink(m_tracker, window, false);
+		subscription.browserSink = new EventSink(m_tracker, window, true);
+		if (FAILED(subscription.viewPoint->Advise(subscription.viewSink, &subscription.viewCookie)))
+		{
+			subscription.viewCookie = 0;
+		}
+		if (FAILED(subscription.browserPoint->Advise(subscription.browserSink, &subscription.browserCookie)))
+		{
+			subscription.browserCookie = 0;
+		}
+
+		if (subscription.viewCookie == 0 || subscription.browserCookie == 0)
+		{
+			Disconnect(subscription);
+			return false;
+		}
+
+		Unsubscribe(window);
+		m_subscriptions[window] = subscription;
+		return true;
+	}
+
+	void ShellSelectionSource::Unsubscribe(WindowKey window)
+	{
+		auto it = m_subscriptions.find(window);
+		if (it == m_subscriptions.end())
+		{
+			return;
+		}
+		Disconnect(it->second);
+		m_subscriptions.erase(it);
+	}
+
+	void ShellSelectionSource::Disconnect(Subscription& subscription)
+	{
+		if (subscription.viewCookie != 0)
+		{
+			subscription.viewPoint->Unadvise(subscription.viewCookie);
+			subscription.viewCookie = 0;
+		}
+		if (subscription.browserCookie != 0)
+		{
+			subscription.browserPoint->Unadvise(subscription.browserCookie);
+			subscription.browserCookie = 0;
+		}
+
+		EventSink* sinks[] = { subscription.viewSink, subscription.browserSink };
+		for (EventSink* sink : sinks)
+		{
+			if (sink)
+			{
+				sink->Detach();
+				sink->Release();
+			}
+		}
+		subscription.viewSink = nullptr;
+		subscription.browserSink = nullptr;
+		subscription.viewPoint.Release();
+		subscription.browserPoint.Release();
+	}
+
+	struct SelectionTrackingState
+	{
+		SelectionTrackingState() : tracker(source)
+		{
+			source.Attach(&tracker);
+		}
+
+		ShellSelectionSource source;
+		ComSelectionTracker tracker;
+	};
+
+	// One per STA thread, like the views it subscribes to
+	static thread_local SelectionTrackingState* t_selection = nullptr;
+
+	ComSelectionTracker& SelectionTracking()
+	{
+		if (t_selection == nullptr)
+		{
+			t_selection = new SelectionTrackingState();
+		}
+		return t_selection->tracker;
+	}
+
+	void ReleaseSelectionTracking()
+	{
+		delete t_selection;
+		t_selection = nullptr;
+	}
+
+	ShellStatus LastSelectionStatus()
+	{
+		return t_selection != nullptr ? t_selection->source.LastStatus() : ShellStatus::Ok;
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <windows.h>
+#include <exdisp.h>
+#include <atlbase.h>
+
+#include <unordered_map>
+
+#include "SelectionTracker.h"
+#include "ShellSession.h"
+
+namespace SystemDrag
+{
+	typedef SelectionTracker<CComPtr<IDispatch>> ComSelectionTracker;
+
+	// ISelectionSource over the shell view of an Explorer window or the desktop.
+	// The view is the IWebBrowser2 dispatch from IShellWindows. Selection changes come from
+	// DShellFolderViewEvents on its document, navigation and closing from DWebBrowserEvents2
+	// on the browser; both are delivered by the message loop of the owning STA thread.
+	class ShellSelectionSource : public ISelectionSource<CComPtr<IDispatch>>
+	{
+	public:
+		ShellSelectionSource();
+		~ShellSelectionSource();
+
+		void Attach(ComSelectionTracker* tracker) { m_tracker = tracker; }
+
+		// How the last ReadSelection's calls into the view went: Disconnected when the
+		// Explorer that owns the view has exited and the read could not tell anything
+		ShellStatus LastStatus() const { return m_status; }
+
+		Verdict ReadSelection(const CComPtr<IDispatch>& view, const CancelToken& token) override;
+		SelectionRules Rules() const override;
+		bool Subscribe(WindowKey window, const CComPtr<IDispatch>& view) override;
+		void Unsubscribe(WindowKey window) override;
+
+	private:
+		class EventSink;
+
+		struct Subscription
+		{
+			CComPtr<IConnectionPoint> viewPoint;
+			CComPtr<IConnectionPoint> browserPoint;
+			DWORD viewCookie;
+			DWORD browserCookie;
+			EventSink* viewSink;
+			EventSink* browserSink;
+		};
+
+		static void Disconnect(Subscription& subscription);
+		// FAILED(hr), noting a disconnected view in m_status
+		bool Failed(HRESULT hr);
+
+		ComSelectionTracker* m_tracker;
+		ShellStatus m_status;
+		std::unordered_map<WindowKey, Subscription> m_subscriptions;
+	};
+
+	// Tracker owned by the calling STA thread, created on first use.
+	// Call ReleaseSelectionTracking() before CoUninitialize.
+	ComSelectionTracker& SelectionTracking();
+	void ReleaseSelectionTracking();
+	// LastStatus() of the source behind SelectionTracking(), for the Pull just made
+	ShellStatus LastSelectionStatus();
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ShellViewCache.h"
+
+// Long-lived connection to the shell for one apartment.
+// Creating CLSID_ShellWindows activates a proxy into Explorer, and FindWindowSW(SWC_DESKTOP)
+// is one more cross-process round trip; both used to run on every check. The session makes
+// them once and keeps the proxy and the desktop view until Explorer goes away: a call that
+// finds the server disconnected, or a desktop window that no longer exists, drops both and
+// the next use connects to the new Explorer. Not thread-safe: one session per apartment.
+namespace SystemDrag
+{
+	enum class ShellStatus : uint8_t
+	{
+		Ok,
+		Failed,         // this call failed, the connection may still be good
+		Disconnected    // the shell's process is gone (RPC_E_DISCONNECTED and friends)
+	};
+
+	template <typename Windows, typename Desktop>
+	class IShellSessionFactory
+	{
+	public:
+		virtual ~IShellSessionFactory() {}
+
+		// CoCreateInstance(CLSID_ShellWindows)
+		virtual ShellStatus CreateShellWindows(Windows& windows) = 0;
+		// FindWindowSW(SWC_DESKTOP, SWFO_NEEDDISPATCH) through the proxy, with the desktop's window
+		virtual ShellStatus FindDesktop(const Windows& windows, Desktop& desktop, WindowKey& window) = 0;
+		// Local check, no COM call: a restarted Explorer has a new desktop window
+		virtual bool WindowExists(WindowKey window) = 0;
+	};
+
+	struct ShellSessionStats
+	{
+		uint64_t connects;          // CreateShellWindows calls
+		uint64_t desktopLookups;    // FindDesktop calls
+		uint64_t reconnects;        // connections dropped because the shell went away
+		uint64_t failures;
+	};
+
+	template <typename Windows, typename Desktop>
+	class ShellSession
+	{
+	public:
+		explicit ShellSession(IShellSessionFactory<Windows, Desktop>& factory)
+			: m_factory(factory), m_windows(), m_desktop(), m_connected(false), m_hasDesktop(false)
+			, m_desktopWindow(0), m_generation(0), m_stats()
+		{
+		}
+
+		// The IShellWindows proxy, created on first use
+		ShellStatus ShellWindows(Windows& windows)
+		{
+			ShellStatus status = Connect();
+			if (status == ShellStatus::Ok)
+			{
+				windows = m_windows;
+			}
+			return status;
+		}
+
+		// The desktop's view, looked up on first use and again after Explorer restarted
+		ShellStatus DesktopView(Desktop& desktop)
+		{
+			if (m_hasDesktop && !m_factory.WindowExists(m_desktopWindow))
+			{
+				Reconnect();
+			}
+
+			if (!m_hasDesktop)
+			{
+				ShellStatus status = FindDesktop();
+				if (status == ShellStatus::Disconnected)
+				{
+					// The proxy was made by an Explorer that has since exited
+					Reconnect();
+					status = FindDesktop();
+				}
+				if (status != ShellStatus::Ok)
+				{
+					return status;
+				}
+			}
+			desktop = m_desktop;
+			return ShellStatus::Ok;
+		}
+
+		// Runs call(windows) on the proxy. A call that reports Disconnected is run once more
+		// on a new connection; its status is returned either way.
+		template <typename Call>
+		ShellStatus WithShellWindows(Call call)
+		{
+			for (int attempt = 0; ; attempt++)
+			{
+				ShellStatus status = Connect();
+				if (status == ShellStatus::Ok)
+				{
+					status = call(m_windows);
+				}
+				if (status != ShellStatus::Disconnected || attempt == 1)
+				{
+					return status;
+				}
+				Reconnect();
+			}
+		}
+
+		// For a caller whose own call through the desktop view found the shell gone
+		void Reconnect()
+		{
+			m_stats.reconnects++;
+			Reset();
+		}
+
+		// Release the proxies, e.g. before the apartment is left
+		void Reset()
+		{
+			m_windows = Windows();
+			m_desktop = Desktop();
+			m_connected = false;
+			m_hasDesktop = false;
+			m_desktopWindow = 0;
+		}
+
+		// Bumped by every new connection; objects tied to the old proxy compare it to notice
+		uint64_t Generation() const { return m_generation; }
+		const ShellSessionStats& Stats() const { return m_stats; }
+
+	private:
+		ShellStatus Connect()
+		{
+			if (m_connected)
+			{
+				return ShellStatus::Ok;
+			}
+
+			m_stats.connects++;
+			Windows windows = Windows();
+			ShellStatus status = m_factory.CreateShellWindows(windows);
+			if (status != ShellStatus::Ok)
+			{
+				m_stats.failures++;
+				return status;
+			}
+			m_windows = windows;
+			m_connected = true;
+			m_generation++;
+			return ShellStatus::Ok;
+		}
+
+		ShellStatus FindDesktop()
+		{
+			ShellStatus status = Connect();
+			if (status != ShellStatus::Ok)
+			{
+				return status;
+			}
+
+			m_stats.desktopLookups++;
+			Desktop desktop = Desktop();
+			WindowKey window = 0;
+			status = m_factory.FindDesktop(m_windows, desktop, window);
+			if (status != ShellStatus::Ok)
+			{
+				m_stats.failures++;
+				return status;
+			}
+			m_desktop = desktop;
+			m_desktopWindow = window;
+			m_hasDesktop = true;
+			return ShellStatus::Ok;
+		}
+
+		IShellSessionFactory<Windows, Desktop>& m_factory;
+		Windows m_windows;
+		Desktop m_desktop;
+		bool m_connected;
+		bool m_hasDesktop;
+		WindowKey m_desktopWindow;
+		uint64_t m_generation;
+		ShellSessionStats m_stats;
+	};
+}
@@ -0,0 +1,236 @@
+#include "ShellSession.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+// ShellSession against a fake shell. A proxy or view is the number of the Explorer instance
+// that made it; restarting the fake Explorer bumps that number, gives the desktop a new
+// window and makes calls through older proxies report Disconnected. Checked: one connection
+// and one desktop lookup however many checks run, a transparent reconnect after a restart
+// whether a call or the desktop window notices it, a bounded retry while Explorer is down,
+// and the session picking up again once it is back. Then the cost of a check with per-call
+// setup, as before, against the session, each cross-process call costing a set delay.
+namespace SystemDrag
+{
+	static void SpinFor(std::chrono::nanoseconds delay)
+	{
+		auto until = std::chrono::steady_clock::now() + delay;
+		while (std::chrono::steady_clock::now() < until)
+		{
+		}
+	}
+
+	class FakeShell : public IShellSessionFactory<int, int>
+	{
+	public:
+		explicit FakeShell(std::chrono::nanoseconds callCost)
+			: m_creations(0), m_lookups(0), m_calls(0), m_callCost(callCost), m_instance(1), m_running(true)
+		{
+		}
+
+		ShellStatus CreateShellWindows(int& windows) override
+		{
+			m_creations++;
+			// Activation: the class factory plus the proxy's own QueryInterface
+			SpinFor(m_callCost * 2);
+			if (!m_running)
+			{
+				return ShellStatus::Failed;
+			}
+			windows = m_instance;
+			return ShellStatus::Ok;
+		}
+
+		ShellStatus FindDesktop(const int& windows, int& desktop, WindowKey& window) override
+		{
+			m_lookups++;
+			ShellStatus status = Call(windows);
+			if (status == ShellStatus::Ok)
+			{
+				desktop = m_instance;
+				window = DesktopWindow();
+			}
+			return status;
+		}
+
+		bool WindowExists(WindowKey window) override
+		{
+			return m_running && window == DesktopWindow();
+		}
+
+		// One cross-process call through a proxy of the given instance
+		ShellStatus Call(int proxy)
+		{
+			m_calls++;
+			SpinFor(m_callCost);
+			return proxy == m_instance && m_running ? ShellStatus::Ok : ShellStatus::Disconnected;
+		}
+
+		void Restart() { m_instance++; m_running = true; }
+		void Exit() { m_instance++; m_running = false; }
+		void Start() { m_running = true; }
+
+		int Instance() const { return m_instance; }
+		WindowKey DesktopWindow() const { return 0x10010 + (WindowKey)m_instance * 16; }
+
+		uint64_t m_creations;
+		uint64_t m_lookups;
+		uint64_t m_calls;
+
+	private:
+		std::chrono::nanoseconds m_callCost;
+		int m_instance;
+		bool m_running;
+	};
+
+	typedef ShellSession<int, int> FakeShellSession;
+
+	static bool CheckReuse(size_t checks)
+	{
+		FakeShell shell(std::chrono::nanoseconds(0));
+		FakeShellSession session(shell);
+		size_t ok = 0;
+		for (size_t i = 0; i < checks; i++)
+		{
+			int desktop = 0;
+			ok += session.DesktopView(desktop) == ShellStatus::Ok && desktop == 1;
+			ok += session.WithShellWindows([&](int windows) { return shell.Call(windows); }) == ShellStatus::Ok;
+		}
+
+		const ShellSessionStats& stats = session.Stats();
+		bool correct = ok == checks * 2 && shell.m_creations == 1 && shell.m_lookups == 1 && stats.reconnects == 0
+			&& session.Generation() == 1;
+		std::cout << "reuse: " << (correct ? "ok" : "WRONG") << " (" << checks << " checks, " << shell.m_creations
+			<< " ShellWindows, " << shell.m_lookups << " desktop lookups)" << std::endl;
+		return correct;
+	}
+
+	static bool CheckRestart()
+	{
+		FakeShell shell(std::chrono::nanoseconds(0));
+		FakeShellSession session(shell);
+		int desktop = 0;
+		bool correct = session.DesktopView(desktop) == ShellStatus::Ok;
+
+		// The desktop window of the old Explorer is gone: noticed without a COM call
+		shell.Restart();
+		uint64_t callsBefore = shell.m_calls;
+		correct = correct && session.DesktopView(desktop) == ShellStatus::Ok && desktop == shell.Instance()
+			&& shell.m_calls == callsBefore + 1 && session.Stats().reconnects == 1;
+
+		// A scan through the old proxy fails and runs again on a new connection
+		shell.Restart();
+		int scans = 0;
+		ShellStatus status = session.WithShellWindows([&](int windows) { scans++; return shell.Call(windows); });
+		correct = correct && status == ShellStatus::Ok && scans == 2 && session.Stats().reconnects == 2
+			&& session.Generation() == 3;
+
+		// FindWindowSW through a proxy that went stale while the desktop was not cached
+		shell.Restart();
+		session.Reset();
+		correct = correct && session.WithShellWindows([&](int) { return ShellStatus::Ok; }) == ShellStatus::Ok;
+		shell.Restart();
+		correct = correct && session.DesktopView(desktop) == ShellStatus::Ok && desktop == shell.Instance();
+
+		std::cout << "explorer restart: " << (correct ? "ok" : "WRONG") << " (" << shell.m_creations << " ShellWindows, "
+			<< session.Stats().reconnects << " reconnects)" << std::endl;
+		return correct;
+	}
+
+	static bool CheckExplorerDown()
+	{
+		FakeShell shell(std::chrono::nanoseconds(0));
+		FakeShellSession session(shell);
+		int desktop = 0;
+		bool correct = session.DesktopView(desktop) == ShellStatus::Ok;
+
+		// While Explorer is down every check fails after at most two connection attempts
+		shell.Exit();
+		uint64_t creations = shell.m_creations;
+		int scans = 0;
+		correct = correct && session.DesktopView(desktop) != ShellStatus::Ok
+			&& session.WithShellWindows([&](int windows) { scans++; return shell.Call(windows); }) != ShellStatus::Ok
+			&& shell.m_creations - creations <= 4 && scans == 0;
+
+		// A call that keeps reporting Disconnected is not retried forever
+		shell.Start();
+		scans = 0;
+		correct = correct && session.WithShellWindows([&](int) { scans++; return ShellStatus::Disconnected; })
+			== ShellStatus::Disconnected && scans == 2;
+
+		correct = correct && session.DesktopView(desktop) == ShellStatus::Ok && desktop == shell.Instance();
+		std::cout << "explorer down: " << (correct ? "ok" : "WRONG") << " (" << session.Stats().failures
+			<< " failures)" << std::endl;
+		return correct;
+	}
+
+	// ns per desktop check, best of three runs
+	static double MeasurePerCall(size_t checks, std::chrono::nanoseconds callCost)
+	{
+		double best = 0;
+		for (int run = 0; run < 3; run++)
+		{
+			FakeShell shell(callCost);
+			auto t0 = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < checks; i++)
+			{
+				// CoCreateInstance(CLSID_ShellWindows) and FindWindowSW on every check
+				int windows = 0;
+				int desktop = 0;
+				WindowKey window = 0;
+				shell.CreateShellWindows(windows);
+				shell.FindDesktop(windows, desktop, window);
+				shell.Call(desktop);
+			}
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / checks;
+			best = run == 0 || ns < best ? ns : best;
+		}
+		return best;
+	}
+
+	static double MeasureSession(size_t checks, std::chrono::nanoseconds callCost)
+	{
+		double best = 0;
+		for (int run = 0; run < 3; run++)
+		{
+			FakeShell shell(callCost);
+			FakeShellSession session(shell);
+			auto t0 = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < checks; i++)
+			{
+				int desktop = 0;
+				session.DesktopView(desktop);
+				shell.Call(desktop);
+			}
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / checks;
+			best = run == 0 || ns < best ? ns : best;
+		}
+		return best;
+	}
+
+	// Command line entry: ShellSessionBenchMain [checks] [cross-process call us]
+	int ShellSessionBenchMain(int argc, char* argv[])
+	{
+		size_t checks = argc > 1 ? (size_t)std::atoi(argv[1]) : 5000;
+		int callUs = argc > 2 ? std::atoi(argv[2]) : 20;
+		if (checks == 0)
+		{
+			checks = 1;
+		}
+
+		bool correct = CheckReuse(checks);
+		correct = CheckRestart() && correct;
+		correct = CheckExplorerDown() && correct;
+
+		// The check's own read of the selection is one call in both cases
+		std::chrono::nanoseconds callCost = std::chrono::microseconds(callUs);
+		double perCall = MeasurePerCall(checks, callCost);
+		double session = MeasureSession(checks, callCost);
+		std::cout << "desktop check with " << callUs << " us calls: per-call setup " << perCall / 1000 << " us, session "
+			<< session / 1000 << " us" << std::endl;
+
+		std::cout << (correct ? "shell session ok" : "shell session WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
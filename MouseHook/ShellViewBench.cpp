@@ -0,0 +1,134 @@
+#include "ShellViewCache.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Compares the per-drag IShellWindows scan with ShellViewCache against a fake source
+// whose every entry costs a configurable "cross-process" delay.
+namespace SystemDrag
+{
+	static void SpinFor(std::chrono::nanoseconds delay)
+	{
+		auto until = std::chrono::steady_clock::now() + delay;
+		while (std::chrono::steady_clock::now() < until)
+		{
+		}
+	}
+
+	class FakeShellViewSource : public IShellViewSource<int>
+	{
+	public:
+		FakeShellViewSource(size_t windows, std::chrono::nanoseconds perItemCost, bool events)
+			: m_perItemCost(perItemCost), m_events(events), m_itemCalls(0)
+		{
+			for (size_t i = 0; i < windows; i++)
+			{
+				m_windows.push_back(0x10000 + i * 16);
+			}
+		}
+
+		bool Enumerate(const Visitor& visit) override
+		{
+			for (size_t i = 0; i < m_windows.size(); i++)
+			{
+				// Item(i) + QueryInterface(IWebBrowser2) + get_HWND
+				m_itemCalls++;
+				SpinFor(m_perItemCost);
+				visit(m_windows[i], (int)i);
+			}
+			return true;
+		}
+
+		bool DeliversEvents() const override { return m_events; }
+
+		// The uncached path: scan until the window turns up
+		bool Scan(WindowKey window, int& view)
+		{
+			for (size_t i = 0; i < m_windows.size(); i++)
+			{
+				m_itemCalls++;
+				SpinFor(m_perItemCost);
+				if (m_windows[i] == window)
+				{
+					view = (int)i;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void AddWindow() { m_windows.push_back(m_windows.back() + 16); }
+
+		const std::vector<WindowKey>& Windows() const { return m_windows; }
+		uint64_t ItemCalls() const { return m_itemCalls; }
+
+	private:
+		std::vector<WindowKey> m_windows;
+		std::chrono::nanoseconds m_perItemCost;
+		bool m_events;
+		uint64_t m_itemCalls;
+	};
+
+	// Command line entry: ShellViewBenchMain [windows] [lookups] [per-item-ns]
+	int ShellViewBenchMain(int argc, char* argv[])
+	{
+		size_t windows = argc > 1 ? (size_t)std::atoi(argv[1]) : 32;
+		size_t lookups = argc > 2 ? (size_t)std::atoi(argv[2]) : 2000;
+		std::chrono::nanoseconds perItem(argc > 3 ? std::atoi(argv[3]) : 20000);
+
+		std::mt19937 rng(11);
+		// 80% of drags start over a shell window, the rest over other applications
+		std::vector<WindowKey> targets;
+		{
+			FakeShellViewSource layout(windows, perItem, true);
+			std::uniform_int_distribution<size_t> pick(0, windows - 1);
+			std::uniform_int_distribution<int> percent(0, 99);
+			for (size_t i = 0; i < lookups; i++)
+			{
+				targets.push_back(percent(rng) < 80 ? layout.Windows()[pick(rng)] : 0x7000000 + i);
+			}
+		}
+
+		auto run = [&](const char* name, bool cached, bool events)
+			{
+				FakeShellViewSource source(windows, perItem, events);
+				ShellViewCache<int> cache(source);
+				size_t found = 0;
+
+				auto begin = std::chrono::steady_clock::now();
+				for (size_t i = 0; i < targets.size(); i++)
+				{
+					// A window opens every 500 drags
+					if (i % 500 == 499)
+					{
+						source.AddWindow();
+						cache.OnWindowRegistered();
+					}
+
+					int view = 0;
+					found += cached ? cache.Lookup(targets[i], view) : source.Scan(targets[i], view);
+				}
+				auto end = std::chrono::steady_clock::now();
+				double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+				std::cout << name << ": " << ns / targets.size() / 1000 << " us/lookup, found " << found
+					<< ", item calls " << source.ItemCalls();
+				if (cached)
+				{
+					const ShellViewCacheStats& stats = cache.Stats();
+					std::cout << ", hits " << stats.hits << ", misses " << stats.misses
+						<< ", refreshes " << stats.refreshes;
+				}
+				std::cout << std::endl;
+				return found;
+			};
+
+		size_t scanFound = run("scan", false, false);
+		size_t cacheFound = run("cache+events", true, true);
+		run("cache, no events", true, false);
+		return scanFound == cacheFound ? 0 : 1;
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// Top-level window -> shell view cache.
+// Scanning IShellWindows costs a QueryInterface and a cross-process get_HWND per entry,
+// so the mapping is built once and only rebuilt after the source reports that a window
+// was registered. A miss on a clean cache is authoritative ("not a shell view") and
+// costs no COM call at all. Not thread-safe: use it on the apartment that owns the views.
+namespace SystemDrag
+{
+	typedef uintptr_t WindowKey;
+
+	template <typename View>
+	class IShellViewSource
+	{
+	public:
+		typedef std::function<void(WindowKey, const View&)> Visitor;
+
+		virtual ~IShellViewSource() {}
+
+		// Visit every registered shell view; false if the enumeration itself failed
+		virtual bool Enumerate(const Visitor& visit) = 0;
+
+		// True when the source will call OnWindowRegistered / OnWindowRevoked on the cache.
+		// Without notifications every miss has to rescan.
+		virtual bool DeliversEvents() const = 0;
+	};
+
+	struct ShellViewCacheStats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t refreshes;
+		uint64_t registrations;
+		uint64_t revocations;
+	};
+
+	template <typename View>
+	class ShellViewCache
+	{
+	public:
+		explicit ShellViewCache(IShellViewSource<View>& source)
+			: m_source(source), m_dirty(true), m_stats()
+		{
+		}
+
+		bool Lookup(WindowKey window, View& view)
+		{
+			auto it = m_views.find(window);
+			if (it != m_views.end())
+			{
+				m_stats.hits++;
+				view = it->second;
+				return true;
+			}
+
+			if (m_dirty || !m_source.DeliversEvents())
+			{
+				Refresh();
+				it = m_views.find(window);
+				if (it != m_views.end())
+				{
+					m_stats.hits++;
+					view = it->second;
+					return true;
+				}
+			}
+
+			m_stats.misses++;
+			return false;
+		}
+
+		// Drop one window, e.g. after a call through its view failed
+		void Forget(WindowKey window)
+		{
+			m_views.erase(window);
+		}
+
+		void Invalidate()
+		{
+			m_views.clear();
+			m_dirty = true;
+		}
+
+		// Event sink side. A new window is not in the map yet: rescan on the next miss.
+		void OnWindowRegistered()
+		{
+			m_stats.registrations++;
+			m_dirty = true;
+		}
+
+		// Revocation only carries a cookie, not the HWND. Stale entries belong to
+		// destroyed windows that WindowFromPoint cannot return, so they are dropped on
+		// the next rescan instead of forcing one now.
+		void OnWindowRevoked()
+		{
+			m_stats.revocations++;
+			m_dirty = true;
+		}
+
+		size_t size() const { return m_views.size(); }
+		const ShellViewCacheStats& Stats() const { return m_stats; }
+
+	private:
+		void Refresh()
+		{
+			m_stats.refreshes++;
+			m_views.clear();
+			bool ok = m_source.Enumerate([this](WindowKey window, const View& view)
+				{
+					m_views[window] = view;
+				});
+			// A failed scan stays dirty so the next lookup retries
+			m_dirty = !ok;
+		}
+
+		IShellViewSource<View>& m_source;
+		std::unordered_map<WindowKey, View> m_views;
+		bool m_dirty;
+		ShellViewCacheStats m_stats;
+	};
+}
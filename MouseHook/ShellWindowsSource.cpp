@@ -0,0 +1,240 @@
+#include "ShellWindowsSource.h"
+
+#include <exdispid.h>
+
+#include "LatencyHistogram.h"
+
+#pragma comment(lib, "Ole32.lib")
+#pragma comment(lib, "OleAut32.lib")
+
+namespace SystemDrag
+{
+	// DShellWindowsEvents sink, forwards registrations to the cache
+	class ShellWindowsSource::EventSink : public IDispatch
+	{
+	public:
+		explicit EventSink(ComShellViewCache* cache) : m_refCount(1), m_cache(cache) {}
+
+		void Detach() { m_cache = nullptr; }
+
+		// IUnknown methods
+		STDMETHODIMP QueryInterface(REFIID riid, void** ppvObject) override
+		{
+			if (riid == IID_IUnknown || riid == IID_IDispatch || riid == DIID_DShellWindowsEvents)
+			{
+				*ppvObject = static_cast<IDispatch*>(this);
+				AddRef();
+				return S_OK;
+			}
+			*ppvObject = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		STDMETHODIMP_(ULONG) AddRef() override
+		{
+			return InterlockedIncrement(&m_refCount);
+		}
+
+		STDMETHODIMP_(ULONG) Release() override
+		{
+			ULONG refCount = InterlockedDecrement(&m_refCount);
+			if (refCount == 0)
+			{
+				delete this;
+			}
+			return refCount;
+		}
+
+		// IDispatch methods
+		STDMETHODIMP GetTypeInfoCount(UINT* pctinfo) override
+		{
+			*pctinfo = 0;
+			return S_OK;
+		}
+
+		STDMETHODIMP GetTypeInfo(UINT, LCID, ITypeInfo**) override
+		{
+			return E_NOTIMPL;
+		}
+
+		STDMETHODIMP GetIDsOfNames(REFIID, LPOLESTR*, UINT, LCID, DISPID*) override
+		{
+			return E_NOTIMPL;
+		}
+
+		STDMETHODIMP Invoke(DISPID dispIdMember, REFIID, LCID, WORD, DISPPARAMS*, VARIANT*, EXCEPINFO*, UINT*) override
+		{
+			if (m_cache == nullptr)
+			{
+				return S_OK;
+			}
+
+			switch (dispIdMember)
+			{
+			case DISPID_WINDOWREGISTERED:
+				m_cache->OnWindowRegistered();
+				break;
+			case DISPID_WINDOWREVOKED:
+				m_cache->OnWindowRevoked();
+				break;
+			}
+			return S_OK;
+		}
+
+	private:
+		ULONG m_refCount;
+		ComShellViewCache* m_cache;
+	};
+
+	ShellWindowsSource::ShellWindowsSource() : m_cache(nullptr), m_sink(nullptr), m_cookie(0), m_generation(0)
+	{
+	}
+
+	ShellWindowsSource::~ShellWindowsSource()
+	{
+		Disconnect();
+	}
+
+	bool ShellWindowsSource::Reconnected() const
+	{
+		return m_generation != CurrentShellSession().Generation();
+	}
+
+	bool ShellWindowsSource::Connect(ComShellViewCache* cache)
+	{
+		Disconnect();
+		m_cache = cache;
+		if (CurrentShellSession().ShellWindows(m_shellWindows) != ShellStatus::Ok)
+		{
+			return false;
+		}
+		m_generation = CurrentShellSession().Generation();
+
+		CComPtr<IConnectionPointContainer> container;
+		CComPtr<IConnectionPoint> point;
+		if (FAILED(m_shellWindows->QueryInterface(IID_IConnectionPointContainer, (void**)&container)) ||
+			FAILED(container->FindConnectionPoint(DIID_DShellWindowsEvents, &point)))
+		{
+			// The cache still works, it just rescans on every miss
+			return false;
+		}
+
+		m_sink = new EventSink(cache);
+		if (FAILED(point->Advise(m_sink, &m_cookie)))
+		{
+			m_cookie = 0;
+			m_sink->Release();
+			m_sink = nullptr;
+			return false;
+		}
+		return true;
+	}
+
+	void ShellWindowsSource::Disconnect()
+	{
+		if (m_cookie != 0 && m_shellWindows)
+		{
+			CComPtr<IConnectionPointContainer> container;
+			CComPtr<IConnectionPoint> point;
+			if (SUCCEEDED(m_shellWindows->QueryInterface(IID_IConnectionPointContainer, (void**)&container)) &&
+				SUCCEEDED(container->FindConnectionPoint(DIID_DShellWindowsEvents, &point)))
+			{
+				point->Unadvise(m_cookie);
+			}
+		}
+		m_cookie = 0;
+
+		if (m_sink)
+		{
+			m_sink->Detach();
+			m_sink->Release();
+			m_sink = nullptr;
+		}
+		m_shellWindows.Release();
+	}
+
+	bool ShellWindowsSource::Enumerate(const Visitor& visit)
+	{
+		// A proxy into an Explorer that has exited reports Disconnected and the session
+		// retries the scan once on a new connection
+		ShellStatus status = CurrentShellSession().WithShellWindows([&](const CComPtr<IShellWindows>& shellWindows)
+			{
+				StageTimer stage(DetectionStage::ShellWindowsScan);
+				long count = 0;
+				HRESULT hr = shellWindows->get_Count(&count);
+				if (FAILED(hr))
+				{
+					return ShellStatusFromResult(hr);
+				}
+
+				for (long i = 0; i < count; i++)
+				{
+					CComVariant index(i);
+					CComPtr<IDispatch> pDisp;
+					if (FAILED(shellWindows->Item(index, &pDisp)) || !pDisp)
+					{
+						continue;
+					}
+
+					CComPtr<IWebBrowser2> pBrowser;
+					if (FAILED(pDisp->QueryInterface(IID_IWebBrowser2, (void**)&pBrowser)))
+					{
+						continue;
+					}
+
+					SHANDLE_PTR hWindow = 0;
+					if (SUCCEEDED(pBrowser->get_HWND(&hWindow)) && hWindow)
+					{
+						visit((WindowKey)hWindow, pDisp);
+					}
+				}
+				return ShellStatus::Ok;
+			});
+
+		// Registrations of the new Explorer's windows go to the new proxy
+		if (m_cache != nullptr && Reconnected())
+		{
+			Connect(m_cache);
+		}
+		return status == ShellStatus::Ok;
+	}
+
+	struct ShellViewState
+	{
+		ShellViewState() : cache(source)
+		{
+			source.Connect(&cache);
+		}
+
+		~ShellViewState()
+		{
+			source.Disconnect();
+		}
+
+		ShellWindowsSource source;
+		ComShellViewCache cache;
+	};
+
+	// One per STA thread: the cached views are apartment-bound proxies
+	static thread_local ShellViewState* t_shellViews = nullptr;
+
+	ComShellViewCache& ShellViews()
+	{
+		if (t_shellViews == nullptr)
+		{
+			t_shellViews = new ShellViewState();
+		}
+		else if (t_shellViews->source.Reconnected())
+		{
+			// Explorer restarted: every cached view is a proxy into the old process
+			t_shellViews->cache.Invalidate();
+		}
+		return t_shellViews->cache;
+	}
+
+	void ReleaseShellViews()
+	{
+		delete t_shellViews;
+		t_shellViews = nullptr;
+	}
+}
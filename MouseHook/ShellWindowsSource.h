@@ -0,0 +1,48 @@
+#pragma once
+
+#include <windows.h>
+#include <exdisp.h>
+#include <atlbase.h>
+
+#include "ComShellSession.h"
+#include "ShellViewCache.h"
+
+namespace SystemDrag
+{
+	typedef ShellViewCache<CComPtr<IDispatch>> ComShellViewCache;
+
+	// IShellViewSource backed by CLSID_ShellWindows, through the thread's shell session.
+	// Connect() subscribes to DShellWindowsEvents so the cache only rescans after a window
+	// registers; events arrive through the message loop of the owning STA thread. After the
+	// session reconnected to a restarted Explorer the next scan subscribes again.
+	class ShellWindowsSource : public IShellViewSource<CComPtr<IDispatch>>
+	{
+	public:
+		ShellWindowsSource();
+		~ShellWindowsSource();
+
+		bool Connect(ComShellViewCache* cache);
+		void Disconnect();
+
+		bool Enumerate(const Visitor& visit) override;
+		bool DeliversEvents() const override { return m_cookie != 0; }
+
+		// The session moved to a new proxy since Connect(): cached views and the
+		// subscription belong to the old Explorer
+		bool Reconnected() const;
+
+	private:
+		class EventSink;
+
+		CComPtr<IShellWindows> m_shellWindows;  // the proxy the sink is advised on
+		ComShellViewCache* m_cache;
+		EventSink* m_sink;
+		DWORD m_cookie;
+		uint64_t m_generation;                  // session generation of m_shellWindows
+	};
+
+	// Cache owned by the calling STA thread, created on first use.
+	// Call ReleaseShellViews() before ReleaseShellSession() and CoUninitialize.
+	ComShellViewCache& ShellViews();
+	void ReleaseShellViews();
+}
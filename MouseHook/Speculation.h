@@ -0,0 +1,115 @@
+#pragma once
+
+#include "DragVerdict.h"
+
+#include <cstdint>
+
+// Speculative drag verdicts.
+// With speculation on, detection for a press starts right after the button goes down instead
+// of when the pointer crosses the drag threshold. The result is parked for that press: a drag
+// of the same press commits it, a plain click leaves it unclaimed and it is discarded.
+// Times are in the pointer event clock (milliseconds, MSLLHOOKSTRUCT::time on Windows).
+namespace SystemDrag
+{
+	struct SpeculationStats
+	{
+		uint64_t prefetches;        // speculative detections started
+		uint64_t hits;              // drag committed the verdict of its own press
+		uint64_t misses;            // drag found nothing usable and detected on demand
+		uint64_t discarded;         // press ended without a drag, verdict thrown away
+		uint64_t cancelled;         // press ended while the speculative detection ran
+		uint64_t verdicts;          // drags that got a verdict, hit or miss
+		uint64_t timeToVerdictMs;   // sum over drags: threshold crossing -> verdict available
+		uint32_t maxTimeToVerdictMs;
+
+		double HitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0; }
+		double MeanTimeToVerdictMs() const { return verdicts > 0 ? (double)timeToVerdictMs / verdicts : 0; }
+	};
+
+	class SpeculativeVerdict
+	{
+	public:
+		SpeculativeVerdict() : m_session(0), m_ready(false), m_verdict(Verdict::Unsupported), m_readyAt(0), m_stats() {}
+
+		// A speculative detection starts for the press `session`; a result nobody claimed is discarded
+		void Begin(uint32_t session)
+		{
+			Flush();
+			m_session = session;
+			m_ready = false;
+			m_stats.prefetches++;
+		}
+
+		void Complete(uint32_t session, Verdict verdict, uint32_t readyAt)
+		{
+			if (session != m_session)
+			{
+				return;
+			}
+			if (verdict == Verdict::Cancelled)
+			{
+				m_stats.cancelled++;
+				m_session = 0;
+				return;
+			}
+			m_ready = true;
+			m_verdict = verdict;
+			m_readyAt = readyAt;
+		}
+
+		// The drag of `session` asked for a verdict at `requestedAt`. Returns false on a miss,
+		// the caller then detects on demand and reports it through RecordOnDemand.
+		bool Commit(uint32_t session, uint32_t requestedAt, Verdict& verdict)
+		{
+			if (!m_ready || session != m_session)
+			{
+				m_stats.misses++;
+				return false;
+			}
+
+			verdict = m_verdict;
+			m_stats.hits++;
+			Record(requestedAt, m_readyAt);
+			m_session = 0;
+			m_ready = false;
+			return true;
+		}
+
+		void RecordOnDemand(uint32_t requestedAt, uint32_t readyAt)
+		{
+			Record(requestedAt, readyAt);
+		}
+
+		// Counts a parked, unclaimed verdict as discarded
+		void Flush()
+		{
+			if (m_ready)
+			{
+				m_stats.discarded++;
+			}
+			m_session = 0;
+			m_ready = false;
+		}
+
+		const SpeculationStats& Stats() const { return m_stats; }
+
+	private:
+		void Record(uint32_t requestedAt, uint32_t readyAt)
+		{
+			// A prefetch finished before the threshold was crossed costs the drag nothing
+			uint32_t waited = readyAt > requestedAt ? readyAt - requestedAt : 0;
+			m_stats.verdicts++;
+			m_stats.timeToVerdictMs += waited;
+			if (waited > m_stats.maxTimeToVerdictMs)
+			{
+				m_stats.maxTimeToVerdictMs = waited;
+			}
+		}
+
+		uint32_t m_session;
+		bool m_ready;
+		Verdict m_verdict;
+		uint32_t m_readyAt;
+		SpeculationStats m_stats;
+	};
+}
@@ -0,0 +1,179 @@
+#include "GestureReplay.h"
+#include "Speculation.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// Speculative verdicts against a simulated shell backend, in virtual time: the same gesture
+// stream is replayed with and without speculation and the counters show the hit rate, the
+// wasted work on clicks and the time from threshold crossing to verdict.
+namespace SystemDrag
+{
+	// A detection is `steps` cross-process calls of stepMs each, serialized on one apartment
+	// thread like the real STA consumer, and it stops at the first step boundary after the
+	// session it runs for has ended
+	class SimulatedShell
+	{
+	public:
+		SimulatedShell(uint32_t stepMs, int steps, int supportedPercent)
+			: m_stepMs(stepMs), m_steps(steps), m_supportedPercent(supportedPercent), m_busyUntil(0), m_calls(0)
+		{
+		}
+
+		Verdict Detect(uint32_t session, uint32_t requestedAt, uint32_t sessionEndsAt, uint32_t& readyAt)
+		{
+			uint32_t t = std::max(requestedAt, m_busyUntil);
+			for (int i = 0; i < m_steps; i++)
+			{
+				t += m_stepMs;
+				m_calls++;
+				if (t >= sessionEndsAt)
+				{
+					m_busyUntil = readyAt = t;
+					return Verdict::Cancelled;
+				}
+			}
+			m_busyUntil = readyAt = t;
+			return (int)(session % 100) < m_supportedPercent ? Verdict::Supported : Verdict::Unsupported;
+		}
+
+		uint64_t Calls() const { return m_calls; }
+
+	private:
+		uint32_t m_stepMs;
+		int m_steps;
+		int m_supportedPercent;
+		uint32_t m_busyUntil;
+		uint64_t m_calls;
+	};
+
+	static SpeculationStats SimulateSpeculation(const std::vector<PointerEvent>& events, bool speculate,
+		uint32_t stepMs, int steps, uint64_t& shellCalls)
+	{
+		// Press end times are known up front, the simulated shell needs them to cancel
+		std::unordered_map<uint32_t, uint32_t> releasedAt;
+		{
+			GestureEngine scan;
+			for (const PointerEvent& ev : events)
+			{
+				scan.Feed(ev);
+				if (ev.action == PointerAction::ButtonUp)
+				{
+					releasedAt[scan.SessionId()] = ev.time;
+				}
+			}
+		}
+		auto endOf = [&](uint32_t session)
+		{
+			auto it = releasedAt.find(session);
+			return it != releasedAt.end() ? it->second : std::numeric_limits<uint32_t>::max();
+		};
+
+		GestureEngine engine;
+		SimulatedShell shell(stepMs, steps, 70);
+		SpeculativeVerdict speculation;
+		bool prefetchPending = false;
+
+		for (const PointerEvent& ev : events)
+		{
+			unsigned signals = engine.Feed(ev);
+			uint32_t session = engine.SessionId();
+
+			if (ev.action == PointerAction::ButtonDown)
+			{
+				prefetchPending = speculate;
+			}
+			else if (ev.action == PointerAction::Move && prefetchPending && engine.IsButtonDown())
+			{
+				// Same trigger as the hook: the first move after the press
+				prefetchPending = false;
+				uint32_t readyAt = 0;
+				speculation.Begin(session);
+				Verdict verdict = shell.Detect(session, ev.time, endOf(session), readyAt);
+				speculation.Complete(session, verdict, readyAt);
+			}
+
+			if (signals & GestureCheckRequested)
+			{
+				Verdict verdict = Verdict::Unsupported;
+				if (!speculate || !speculation.Commit(session, ev.time, verdict))
+				{
+					uint32_t readyAt = 0;
+					if (shell.Detect(session, ev.time, endOf(session), readyAt) != Verdict::Cancelled)
+					{
+						speculation.RecordOnDemand(ev.time, readyAt);
+					}
+				}
+			}
+		}
+
+		speculation.Flush();
+		shellCalls = shell.Calls();
+		return speculation.Stats();
+	}
+
+	// Command line entry: SpeculationBenchMain [gestures] [drag-percent] [step-ms] [steps] [ms-per-event]
+	int SpeculationBenchMain(int argc, char* argv[])
+	{
+		size_t gestures = argc > 1 ? (size_t)std::atoi(argv[1]) : 10000;
+		int dragPercent = argc > 2 ? std::atoi(argv[2]) : 40;
+		uint32_t stepMs = argc > 3 ? (uint32_t)std::atoi(argv[3]) : 4;
+		int steps = argc > 4 ? std::atoi(argv[4]) : 8;
+		uint32_t msPerEvent = argc > 5 ? (uint32_t)std::atoi(argv[5]) : 8;
+
+		// Synthetic gestures tick once per millisecond, stretch them to a realistic report rate
+		std::vector<PointerEvent> events = MakeSyntheticGestures(gestures, 16, dragPercent, 3);
+		for (PointerEvent& ev : events)
+		{
+			ev.time *= msPerEvent;
+		}
+
+		// Presses that never asked for a verdict are the plain clicks
+		uint64_t presses = 0;
+		uint64_t drags = 0;
+		{
+			GestureEngine scan;
+			for (const PointerEvent& ev : events)
+			{
+				drags += (scan.Feed(ev) & GestureCheckRequested) != 0;
+				presses += ev.action == PointerAction::ButtonDown;
+			}
+		}
+		uint64_t clicks = presses - drags;
+
+		SpeculationStats stats[2];
+		uint64_t calls[2] = {};
+		const bool modes[] = { false, true };
+		for (bool speculate : modes)
+		{
+			stats[speculate] = SimulateSpeculation(events, speculate, stepMs, steps, calls[speculate]);
+			std::cout << (speculate ? "speculative: " : "on demand:   ")
+				<< "time to verdict avg " << stats[speculate].MeanTimeToVerdictMs() << " ms, max "
+				<< stats[speculate].maxTimeToVerdictMs << " ms over " << stats[speculate].verdicts << " drags; prefetches "
+				<< stats[speculate].prefetches << ", hit rate " << stats[speculate].HitRate() * 100 << "%, discarded "
+				<< stats[speculate].discarded << ", cancelled " << stats[speculate].cancelled << ", shell calls "
+				<< calls[speculate] << std::endl;
+		}
+
+		// The price of speculating: every click runs a detection nobody asked for. That is the
+		// whole of it, at most one detection (steps calls) per click on top of on demand.
+		const SpeculationStats& speculative = stats[1];
+		uint64_t extraCalls = calls[1] > calls[0] ? calls[1] - calls[0] : 0;
+		uint64_t callBound = clicks * (uint64_t)steps;
+		std::cout << presses << " presses, " << clicks << " clicks; speculation costs " << extraCalls
+			<< " extra shell calls (" << (clicks != 0 ? (double)extraCalls / clicks : 0) << " per click, bound "
+			<< callBound << ")" << std::endl;
+
+		// A click's prefetch is either discarded after it finished or cancelled while running
+		bool correct = speculative.HitRate() > 0
+			&& speculative.MeanTimeToVerdictMs() < stats[0].MeanTimeToVerdictMs()
+			&& speculative.discarded + speculative.cancelled == clicks
+			&& extraCalls <= callBound;
+		std::cout << (correct ? "speculation ok" : "speculation WRONG") << std::endl;
+		return correct ? 0 : 1;
+	}
+}
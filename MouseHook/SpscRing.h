@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+
+// Bounded single-producer / single-consumer ring.
+// Push and Pop are wait-free; the producer notifies the Wakeup policy only when it
+// finds the ring empty, so a consumer that drains everything before sleeping never
+// misses a record and the wakeup cost is paid once per burst instead of per event.
+namespace SystemDrag
+{
+	// Consumer polls, nothing to signal
+	struct NullWakeup
+	{
+		void Notify() {}
+		void Wait() {}
+	};
+
+	// Portable blocking wakeup. Notify takes a mutex, so it is meant for tools and
+	// non-hook producers; the hook thread plugs in a Win32 primitive instead.
+	class CondVarWakeup
+	{
+	public:
+		void Notify()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_signaled = true;
+			}
+			m_cond.notify_one();
+		}
+
+		void Wait()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cond.wait(lock, [this] { return m_signaled; });
+			m_signaled = false;
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		bool m_signaled = false;
+	};
+
+	template <typename T, size_t Capacity, typename Wakeup = NullWakeup>
+	class SpscRing
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	public:
+		SpscRing() : m_head(0), m_cachedTail(0), m_dropped(0), m_tail(0), m_cachedHead(0) {}
+
+		SpscRing(const SpscRing&) = delete;
+		SpscRing& operator=(const SpscRing&) = delete;
+
+		// Producer side. Returns false (and counts a drop) when the ring is full.
+		bool TryPush(const T& item)
+		{
+			size_t head = m_head.load(std::memory_order_relaxed);
+			if (head - m_cachedTail >= Capacity)
+			{
+				m_cachedTail = m_tail.load(std::memory_order_acquire);
+				if (head - m_cachedTail >= Capacity)
+				{
+					m_dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+			}
+
+			m_slots[head & (Capacity - 1)] = item;
+			m_head.store(head + 1, std::memory_order_release);
+
+			// Only the first record after the consumer drained the ring needs a wakeup; a
+			// polling consumer needs neither the wakeup nor the fence
+			if constexpr (!std::is_same<Wakeup, NullWakeup>::value)
+			{
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				m_cachedTail = m_tail.load(std::memory_order_relaxed);
+				if (m_cachedTail == head)
+				{
+					m_wakeup.Notify();
+				}
+			}
+			return true;
+		}
+
+		// Consumer side
+		bool TryPop(T& item)
+		{
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail == m_cachedHead)
+			{
+				// Pairs with the producer fence: either we see the new record or it sees us drained
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				m_cachedHead = m_head.load(std::memory_order_acquire);
+				if (tail == m_cachedHead)
+				{
+					return false;
+				}
+			}
+
+			item = m_slots[tail & (Capacity - 1)];
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer side: block on the wakeup until at least one record is available
+		void WaitForData()
+		{
+			for (;;)
+			{
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (!Empty())
+				{
+					return;
+				}
+				m_wakeup.Wait();
+			}
+		}
+
+		bool Empty() const
+		{
+			return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+		}
+
+		size_t Size() const
+		{
+			return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+		}
+
+		uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+		static constexpr size_t capacity() { return Capacity; }
+
+		Wakeup& GetWakeup() { return m_wakeup; }
+
+	private:
+		// Producer and consumer state live on separate cache lines
+		alignas(64) std::atomic<size_t> m_head;
+		size_t m_cachedTail;
+		std::atomic<uint64_t> m_dropped;
+
+		alignas(64) std::atomic<size_t> m_tail;
+		size_t m_cachedHead;
+
+		alignas(64) Wakeup m_wakeup;
+		T m_slots[Capacity];
+	};
+}
@@ -0,0 +1,57 @@
+#include "StaApartment.h"
+
+#pragma comment(lib, "Ole32.lib")
+#pragma comment(lib, "User32.lib")
+
+namespace SystemDrag
+{
+	StaApartment::StaApartment() : m_wake(CreateEventW(NULL, FALSE, FALSE, NULL)), m_initialized(false)
+	{
+	}
+
+	StaApartment::~StaApartment()
+	{
+		if (m_wake != NULL)
+		{
+			CloseHandle(m_wake);
+		}
+	}
+
+	bool StaApartment::Enter()
+	{
+		HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+		m_initialized = SUCCEEDED(hr);
+		if (m_initialized && m_wake == NULL)
+		{
+			// The worker does not call Leave() after a failed Enter(), so undo the init here
+			Leave();
+		}
+		return m_initialized;
+	}
+
+	void StaApartment::Wait(uint32_t timeoutMs)
+	{
+		MsgWaitForMultipleObjectsEx(1, &m_wake, timeoutMs, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+
+		MSG msg;
+		while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&msg);
+			DispatchMessageW(&msg);
+		}
+	}
+
+	void StaApartment::Notify()
+	{
+		SetEvent(m_wake);
+	}
+
+	void StaApartment::Leave()
+	{
+		if (m_initialized)
+		{
+			CoUninitialize();
+			m_initialized = false;
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <windows.h>
+
+#include "DetectionExecutor.h"
+
+namespace SystemDrag
+{
+	// COM single-threaded apartment for a detection worker. Waiting pumps the thread's
+	// message queue, which is how cross-apartment calls return and how the shell window,
+	// selection and WinEvent callbacks owned by the worker get delivered.
+	class StaApartment : public IApartment
+	{
+	public:
+		StaApartment();
+		~StaApartment();
+
+		bool Enter() override;
+		void Wait(uint32_t timeoutMs) override;
+		void Notify() override;
+		void Leave() override;
+
+	private:
+		HANDLE m_wake;      // auto-reset, so a Notify() before the wait is not lost
+		bool m_initialized;
+	};
+}
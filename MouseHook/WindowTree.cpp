@@ -0,0 +1,87 @@
+#include "WindowTree.h"
+
+#pragma comment(lib, "User32.lib")
+
+namespace SystemDrag
+{
+	WindowKey Win32WindowTree::Parent(WindowKey window)
+	{
+		return (WindowKey)GetParent((HWND)window);
+	}
+
+	ShellKind Win32WindowTree::Classify(WindowKey window)
+	{
+		wchar_t className[256];
+		if (GetClassNameW((HWND)window, className, 256) == 0)
+		{
+			return ShellKind::None;
+		}
+
+		// Regular explorer window
+		if (wcscmp(className, L"CabinetWClass") == 0)
+		{
+			return ShellKind::Explorer;
+		}
+
+		// Desktop
+		if (wcscmp(className, L"Progman") == 0 || wcscmp(className, L"WorkerW") == 0)
+		{
+			return ShellKind::Desktop;
+		}
+		return ShellKind::None;
+	}
+
+	struct ShellAncestryState
+	{
+		ShellAncestryState() : cache(tree), destroyHook(NULL), parentHook(NULL) {}
+
+		Win32WindowTree tree;
+		ShellAncestryCache cache;
+		HWINEVENTHOOK destroyHook;
+		HWINEVENTHOOK parentHook;
+	};
+
+	// One per thread: its WinEvent hooks are delivered to the thread that set them
+	static thread_local ShellAncestryState* t_ancestry = nullptr;
+
+	static void CALLBACK WindowChangedProc(HWINEVENTHOOK, DWORD, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+	{
+		// Only whole windows matter, not accessible objects inside them
+		if (t_ancestry && hwnd && idObject == OBJID_WINDOW && idChild == CHILDID_SELF)
+		{
+			t_ancestry->cache.OnWindowChanged((WindowKey)hwnd);
+		}
+	}
+
+	ShellAncestryCache& ShellAncestry()
+	{
+		if (t_ancestry == nullptr)
+		{
+			t_ancestry = new ShellAncestryState();
+			t_ancestry->destroyHook = SetWinEventHook(EVENT_OBJECT_DESTROY, EVENT_OBJECT_DESTROY,
+				NULL, WindowChangedProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+			t_ancestry->parentHook = SetWinEventHook(EVENT_OBJECT_PARENTCHANGE, EVENT_OBJECT_PARENTCHANGE,
+				NULL, WindowChangedProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+		}
+		return t_ancestry->cache;
+	}
+
+	void ReleaseShellAncestry()
+	{
+		if (t_ancestry == nullptr)
+		{
+			return;
+		}
+
+		if (t_ancestry->destroyHook)
+		{
+			UnhookWinEvent(t_ancestry->destroyHook);
+		}
+		if (t_ancestry->parentHook)
+		{
+			UnhookWinEvent(t_ancestry->parentHook);
+		}
+		delete t_ancestry;
+		t_ancestry = nullptr;
+	}
+}
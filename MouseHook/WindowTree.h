@@ -0,0 +1,22 @@
+#pragma once
+
+#include <windows.h>
+
+#include "ShellAncestry.h"
+
+namespace SystemDrag
+{
+	// IWindowTree over the live desktop (GetParent / GetClassNameW)
+	class Win32WindowTree : public IWindowTree
+	{
+	public:
+		WindowKey Parent(WindowKey window) override;
+		ShellKind Classify(WindowKey window) override;
+	};
+
+	// Ancestry cache for the calling thread, created on first use. Window destruction and
+	// reparenting are observed through out-of-context WinEvents, which are delivered by
+	// that thread's message loop and bump the cache generation.
+	ShellAncestryCache& ShellAncestry();
+	void ReleaseShellAncestry();
+}